@@ -0,0 +1,120 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef MAPNIK_CANCELLATION_TOKEN_HPP
+#define MAPNIK_CANCELLATION_TOKEN_HPP
+
+// boost
+#include <boost/optional.hpp>
+
+// stl
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+
+namespace mapnik {
+
+// Lets the caller of a render give up on it. Datasources which support it
+// stop waiting on their backend once the token is cancelled or its deadline
+// has passed. Copies share their state, so a token handed to a renderer can
+// be cancelled from another thread. A default constructed token never fires.
+class cancellation_token
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    cancellation_token() = default;
+
+    static cancellation_token create()
+    {
+        cancellation_token token;
+        token.state_ = std::make_shared<state>();
+        return token;
+    }
+
+    static cancellation_token create(clock_type::duration timeout)
+    {
+        cancellation_token token = create();
+        token.set_deadline(clock_type::now() + timeout);
+        return token;
+    }
+
+    explicit operator bool() const
+    {
+        return state_ != nullptr;
+    }
+
+    void cancel()
+    {
+        if (state_) state_->cancelled = true;
+    }
+
+    void set_deadline(clock_type::time_point deadline)
+    {
+        if (state_) state_->deadline = deadline.time_since_epoch().count();
+    }
+
+    boost::optional<clock_type::time_point> deadline() const
+    {
+        if (!state_) return boost::none;
+        clock_type::rep deadline = state_->deadline;
+        if (deadline == no_deadline()) return boost::none;
+        return clock_type::time_point(clock_type::duration(deadline));
+    }
+
+    // time left until the deadline, none if there is no deadline
+    boost::optional<std::chrono::milliseconds> remaining() const
+    {
+        boost::optional<clock_type::time_point> d = deadline();
+        if (!d) return boost::none;
+        return std::chrono::duration_cast<std::chrono::milliseconds>(*d - clock_type::now());
+    }
+
+    bool cancelled() const
+    {
+        if (!state_) return false;
+        if (state_->cancelled) return true;
+        clock_type::rep deadline = state_->deadline;
+        return deadline != no_deadline() &&
+            clock_type::now().time_since_epoch().count() >= deadline;
+    }
+
+private:
+    static constexpr clock_type::rep no_deadline()
+    {
+        return std::numeric_limits<clock_type::rep>::max();
+    }
+
+    struct state
+    {
+        std::atomic<bool> cancelled{false};
+        std::atomic<clock_type::rep> deadline{no_deadline()};
+    };
+
+    std::shared_ptr<state> state_;
+};
+
+}
+
+#endif // MAPNIK_CANCELLATION_TOKEN_HPP
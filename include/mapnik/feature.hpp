@@ -35,6 +35,7 @@
 #include <mapnik/util/noncopyable.hpp>
 
 // stl
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <map>
@@ -42,6 +43,9 @@
 #include <sstream>                      // for basic_stringstream
 #include <stdexcept>                    // for out_of_range
 #include <iostream>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
 
 namespace mapnik {
 
@@ -92,6 +96,26 @@ using context_ptr = std::shared_ptr<context_type>;
 
 static const value default_feature_value{};
 
+// Supplies attribute values on first access, so datasources can attach a raw
+// record to a feature and only pay for the columns that are actually read.
+// decode() may be called from any thread reading the feature.
+class feature_attribute_decoder
+{
+public:
+    virtual ~feature_attribute_decoder() {}
+    // decode the attribute at context `index` into `val`,
+    // returns false if this decoder does not provide it
+    virtual bool decode(std::size_t index, value & val) const = 0;
+};
+
+using feature_attribute_decoder_ptr = std::shared_ptr<feature_attribute_decoder const>;
+
+// Attributes supplied by a decoder are written into the feature the first
+// time a const accessor reads them. In MAPNIK_THREADSAFE builds each value
+// is decoded exactly once under a std::once_flag, so a feature may be read
+// from several threads at a time. Without MAPNIK_THREADSAFE, and for any
+// non-const member, a feature with a decoder must not be shared between
+// threads.
 class MAPNIK_DECL feature_impl : private util::noncopyable
 {
     friend class feature_kv_iterator;
@@ -106,7 +130,9 @@ public:
         ctx_(ctx),
         data_(ctx_->mapping_.size()),
         geom_(geometry::geometry_empty()),
-        raster_() {}
+        raster_(),
+        lazy_()
+        {}
 
     inline mapnik::value_integer id() const { return id_;}
     inline void set_id(mapnik::value_integer _id) { id_ = _id;}
@@ -129,6 +155,7 @@ public:
             && itr->second < data_.size())
         {
             data_[itr->second] = std::move(val);
+            if (lazy_) lazy_->settle(itr->second);
         }
         else
         {
@@ -143,6 +170,7 @@ public:
             && itr->second < data_.size())
         {
             data_[itr->second] = std::move(val);
+            if (lazy_) lazy_->settle(itr->second);
         }
         else
         {
@@ -169,10 +197,28 @@ public:
     inline value_type const& get(std::size_t index) const
     {
         if (index < data_.size())
+        {
+            if (lazy_) decode(index);
             return data_[index];
+        }
         return default_feature_value;
     }
 
+    // attributes not set explicitly are decoded by `decoder` on first access
+    inline void set_decoder(feature_attribute_decoder_ptr const& decoder)
+    {
+        lazy_.reset(decoder ? new lazy_attributes(decoder, data_.size()) : nullptr);
+    }
+
+    inline void decode_all() const
+    {
+        if (!lazy_) return;
+        for (std::size_t index = 0; index < lazy_->size; ++index)
+        {
+            decode(index);
+        }
+    }
+
     inline std::size_t size() const
     {
         return data_.size();
@@ -180,12 +226,14 @@ public:
 
     inline cont_type const& get_data() const
     {
+        decode_all();
         return data_;
     }
 
     inline void set_data(cont_type const& data)
     {
         data_ = data;
+        lazy_.reset();
     }
 
     inline context_ptr context() const
@@ -240,6 +288,7 @@ public:
 
     std::string to_string() const
     {
+        decode_all();
         std::stringstream ss;
         ss << "Feature ( id=" << id_ << std::endl;
         for (auto const& kv : ctx_->mapping_)
@@ -262,11 +311,65 @@ public:
     }
 
 private:
+    // per value decoding state, only allocated for features with a decoder
+    struct lazy_attributes
+    {
+        lazy_attributes(feature_attribute_decoder_ptr const& _decoder, std::size_t _size)
+            : decoder(_decoder),
+              size(_size),
+#ifdef MAPNIK_THREADSAFE
+              decoded(new std::once_flag[_size])
+#else
+              pending(new bool[_size])
+#endif
+        {
+#ifndef MAPNIK_THREADSAFE
+            std::fill(pending.get(), pending.get() + size, true);
+#endif
+        }
+
+        // the value at `index` was set explicitly and must not be decoded
+        inline void settle(std::size_t index)
+        {
+            if (index >= size) return;
+#ifdef MAPNIK_THREADSAFE
+            std::call_once(decoded[index], [] {});
+#else
+            pending[index] = false;
+#endif
+        }
+
+        feature_attribute_decoder_ptr decoder;
+        std::size_t size;
+#ifdef MAPNIK_THREADSAFE
+        std::unique_ptr<std::once_flag[]> decoded;
+#else
+        std::unique_ptr<bool[]> pending;
+#endif
+    };
+
+    inline void decode(std::size_t index) const
+    {
+        if (index >= lazy_->size) return;
+        // features are never created const, and each pending value is
+        // written exactly once before any reader sees it
+        value & val = const_cast<cont_type &>(data_)[index];
+        feature_attribute_decoder const& decoder = *lazy_->decoder;
+#ifdef MAPNIK_THREADSAFE
+        std::call_once(lazy_->decoded[index], [&decoder, &val, index] { decoder.decode(index, val); });
+#else
+        if (!lazy_->pending[index]) return;
+        lazy_->pending[index] = false;
+        decoder.decode(index, val);
+#endif
+    }
+
     mapnik::value_integer id_;
     context_ptr ctx_;
     cont_type data_;
     geometry::geometry<double> geom_;
     raster_ptr raster_;
+    std::unique_ptr<lazy_attributes> lazy_;
 };
 
 
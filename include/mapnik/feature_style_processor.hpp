@@ -27,6 +27,7 @@
 #include <mapnik/geometry/box2d.hpp>
 #include <mapnik/featureset.hpp>
 #include <mapnik/config.hpp>
+#include <mapnik/cancellation_token.hpp>
 #include <mapnik/feature_style_processor_context.hpp>
 
 // stl
@@ -84,6 +85,13 @@ public:
                         int buffer_size,
                         std::set<std::string>& names);
 
+    /*!
+     * \brief set the token handed to every datasource query, lets the caller abandon the render.
+     */
+    void set_cancellation(cancellation_token const& token);
+
+    cancellation_token const& cancellation() const;
+
 private:
     /*!
      * \brief renders a featureset with the given styles.
@@ -121,6 +129,7 @@ private:
     void render_submaterials(layer_rendering_material const & mat, Processor & p);
 
     Map const& m_;
+    cancellation_token cancel_;
 };
 }
 
@@ -76,7 +76,8 @@ struct layer_rendering_material
 
 template <typename Processor>
 feature_style_processor<Processor>::feature_style_processor(Map const& m, double scale_factor)
-    : m_(m)
+    : m_(m),
+      cancel_()
 {
     // https://github.com/mapnik/mapnik/issues/1100
     if (scale_factor <= 0)
@@ -85,6 +86,18 @@ feature_style_processor<Processor>::feature_style_processor(Map const& m, double
     }
 }
 
+template <typename Processor>
+void feature_style_processor<Processor>::set_cancellation(cancellation_token const& token)
+{
+    cancel_ = token;
+}
+
+template <typename Processor>
+cancellation_token const& feature_style_processor<Processor>::cancellation() const
+{
+    return cancel_;
+}
+
 template <typename Processor>
 void feature_style_processor<Processor>::prepare_layers(layer_rendering_material & parent_mat,
                                                         std::vector<layer> const & layers,
@@ -415,6 +428,7 @@ void feature_style_processor<Processor>::prepare_layer(layer_rendering_material
 
     query q(layer_ext,res,scale_denom,extent);
     q.set_variables(p.variables());
+    q.set_cancellation(cancel_);
 
     if (p.attribute_collection_policy() == COLLECT_ALL)
     {
@@ -36,6 +36,7 @@
 #pragma GCC diagnostic pop
 
 // stl
+#include <cstddef>
 #include <stdexcept>
 #include <string>
 
@@ -66,6 +67,21 @@ struct MAPNIK_DECL image_reader : private util::noncopyable
     virtual boost::optional<box2d<double> > bounding_box() const = 0;
     virtual void read(unsigned x,unsigned y,image_rgba8& image) = 0;
     virtual image_any read(unsigned x, unsigned y, unsigned width, unsigned height) = 0;
+    // Reduced resolution copies of the image stored in the same file, e.g. the
+    // internal overviews of a cloud optimized GeoTIFF, ordered from largest to
+    // smallest. Level 0 is the image itself, levels 1..overviews() the overviews.
+    virtual unsigned overviews() const { return 0; }
+    virtual unsigned overview_width(unsigned level) const { return level == 0 ? width() : 0; }
+    virtual unsigned overview_height(unsigned level) const { return level == 0 ? height() : 0; }
+    virtual image_any read_overview(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height)
+    {
+        if (level != 0) throw image_reader_exception("image_reader: overview " + std::to_string(level) + " does not exist");
+        return read(x, y, width, height);
+    }
+    // Readers able to decode parts of an image concurrently use up to
+    // `threads` threads per read, one by default. Callers that already read
+    // on several threads should leave it at one.
+    virtual void set_decode_threads(std::size_t /*threads*/) {}
     virtual ~image_reader() {}
 };
 
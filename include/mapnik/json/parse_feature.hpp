@@ -27,6 +27,8 @@
 #include <mapnik/feature.hpp>
 #include <mapnik/unicode.hpp>
 
+#include <utility>
+
 namespace mapnik { namespace json {
 
 template <typename Iterator>
@@ -35,6 +37,18 @@ void parse_feature(Iterator start, Iterator end, feature_impl& feature, mapnik::
 template <typename Iterator>
 void parse_geometry(Iterator start, Iterator end, feature_impl& feature);
 
+// Parses the members of a "properties" object, setting only the attributes
+// already present in the feature's context.
+template <typename Iterator>
+void parse_properties(Iterator start, Iterator end, feature_impl& feature, mapnik::transcoder const& tr = mapnik::transcoder("utf8"));
+
+// Locates the "geometry" and "properties" values of a GeoJSON Feature without parsing them.
+// Ranges are (offset, size) pairs relative to `start`, (0, 0) when the member is missing.
+template <typename Iterator>
+bool locate_feature_members(Iterator start, Iterator end,
+                            std::pair<std::size_t, std::size_t>& geometry,
+                            std::pair<std::size_t, std::size_t>& properties);
+
 }}
 
 
@@ -27,10 +27,11 @@
 #include <mapnik/config.hpp>
 #include <mapnik/util/singleton.hpp>
 #include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
 
+#include <cstddef>
 #include <memory>
 #include <string>
-#include <unordered_map>
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -45,16 +46,46 @@ namespace mapnik
 
 using mapped_region_ptr = std::shared_ptr<boost::interprocess::mapped_region>;
 
+// how a newly mapped file is going to be read
+enum class mapped_access
+{
+    normal,
+    sequential, // full scans (e.g. parsing a CSV or GeoJSON file)
+    random,     // index lookups
+    populate    // pre-fault the whole file, for small hot files
+};
+
+// Least recently used cache of read-only file mappings, bounded by number of
+// entries and mapped bytes. Only mappings no longer referenced outside the
+// cache (e.g. by an active featureset) are evicted and unmapped, so the cache
+// may exceed its limits while every entry is in use.
 class MAPNIK_DECL mapped_memory_cache :
         public singleton<mapped_memory_cache, CreateStatic>,
         private util::noncopyable
 {
     friend class CreateStatic<mapped_memory_cache>;
-    std::unordered_map<std::string,mapped_region_ptr> cache_;
+    // mappings still referenced elsewhere are never unmapped
+    struct region_policy : util::lru_cache_policy
+    {
+        bool evictable(std::string const&, mapped_region_ptr const& region) const
+        {
+            return region.use_count() <= 1;
+        }
+    };
+    util::lru_cache<std::string, mapped_region_ptr, std::hash<std::string>, region_policy> cache_;
+    mapped_memory_cache();
+    bool insert_impl(std::string const& key, mapped_region_ptr const& mem);
 public:
     bool insert(std::string const& key, mapped_region_ptr);
-    boost::optional<mapped_region_ptr> find(std::string const& key, bool update_cache = false);
+    boost::optional<mapped_region_ptr> find(std::string const& key, bool update_cache = false,
+                                            mapped_access access = mapped_access::normal);
+    bool remove(std::string const& key);
     void clear();
+    void set_max_entries(std::size_t max_entries);
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_entries() const;
+    std::size_t max_bytes() const;
+    util::lru_cache_stats stats() const;
 };
 
 extern template class MAPNIK_DECL singleton<mapped_memory_cache, CreateStatic>;
@@ -29,6 +29,8 @@
 
 // stl
 #include <deque>
+#include <memory>
+#include <vector>
 
 namespace mapnik {
 
@@ -51,7 +53,13 @@ public:
     size_t size() const;
     void clear();
 private:
+    struct spatial_index;
+    // indices of the features whose boxes intersect `box`, in insertion order
+    std::vector<std::size_t> query_index(box2d<double> const& box) const;
     std::deque<feature_ptr> features_;
+    // feature envelopes (raster extents for raster features), computed on push()
+    std::deque<box2d<double>> boxes_;
+    std::unique_ptr<spatial_index> index_;
     mapnik::layer_descriptor desc_;
     datasource::datasource_t type_;
     bool bbox_check_;
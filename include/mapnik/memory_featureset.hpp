@@ -34,6 +34,7 @@
 #include <mapnik/raster.hpp>
 
 #include <deque>
+#include <vector>
 
 namespace mapnik {
 
@@ -56,10 +57,27 @@ public:
           bbox_check_(bbox_check)
     {}
 
+    // features selected with the datasource's spatial index
+    memory_featureset(std::deque<feature_ptr> const& features, std::vector<std::size_t> && indices)
+        : bbox_(),
+          pos_(features.end()),
+          end_(features.end()),
+          type_(datasource::Vector),
+          bbox_check_(false),
+          features_(&features),
+          indices_(std::move(indices)),
+          index_pos_(indices_.begin())
+    {}
+
     virtual ~memory_featureset() {}
 
     feature_ptr next()
     {
+        if (features_ != nullptr)
+        {
+            if (index_pos_ != indices_.end()) return (*features_)[*index_pos_++];
+            return feature_ptr();
+        }
         while (pos_ != end_)
         {
             if (!bbox_check_)
@@ -96,6 +114,9 @@ private:
     std::deque<feature_ptr>::const_iterator end_;
     datasource::datasource_t type_;
     bool bbox_check_;
+    std::deque<feature_ptr> const* features_ = nullptr;
+    std::vector<std::size_t> indices_;
+    std::vector<std::size_t>::const_iterator index_pos_;
 };
 }
 
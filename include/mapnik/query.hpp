@@ -26,6 +26,7 @@
 //mapnik
 #include <mapnik/geometry/box2d.hpp>
 #include <mapnik/attribute.hpp>
+#include <mapnik/cancellation_token.hpp>
 
 // stl
 #include <set>
@@ -49,7 +50,8 @@ public:
           filter_factor_(1.0),
           unbuffered_bbox_(unbuffered_bbox),
           names_(),
-          vars_()
+          vars_(),
+          cancel_()
     {}
 
     query(box2d<double> const& bbox,
@@ -61,7 +63,8 @@ public:
           filter_factor_(1.0),
           unbuffered_bbox_(bbox),
           names_(),
-          vars_()
+          vars_(),
+          cancel_()
     {}
 
     query(box2d<double> const& bbox)
@@ -71,7 +74,8 @@ public:
           filter_factor_(1.0),
           unbuffered_bbox_(bbox),
           names_(),
-          vars_()
+          vars_(),
+          cancel_()
     {}
 
     query(query const& other)
@@ -81,7 +85,8 @@ public:
           filter_factor_(other.filter_factor_),
           unbuffered_bbox_(other.unbuffered_bbox_),
           names_(other.names_),
-          vars_(other.vars_)
+          vars_(other.vars_),
+          cancel_(other.cancel_)
     {}
 
     query& operator=(query const& other)
@@ -94,6 +99,7 @@ public:
         unbuffered_bbox_=other.unbuffered_bbox_;
         names_=other.names_;
         vars_=other.vars_;
+        cancel_=other.cancel_;
         return *this;
     }
 
@@ -157,6 +163,16 @@ public:
         return vars_;
     }
 
+    void set_cancellation(cancellation_token const& token)
+    {
+        cancel_ = token;
+    }
+
+    cancellation_token const& cancellation() const
+    {
+        return cancel_;
+    }
+
 private:
     box2d<double> bbox_;
     resolution_type resolution_;
@@ -165,6 +181,7 @@ private:
     box2d<double> unbuffered_bbox_;
     std::set<std::string> names_;
     attributes vars_;
+    cancellation_token cancel_;
 };
 
 }
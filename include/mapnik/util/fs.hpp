@@ -27,6 +27,7 @@
 #include <mapnik/config.hpp>
 
 // stl
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -42,6 +43,15 @@ MAPNIK_DECL std::string make_absolute(std::string const& filepath, std::string c
 MAPNIK_DECL std::string dirname(std::string const& value);
 MAPNIK_DECL std::string basename(std::string const& value);
 MAPNIK_DECL std::vector<std::string> list_directory(std::string const& value);
+// size in bytes, 0 if the file can't be read
+MAPNIK_DECL std::uint64_t file_size(std::string const& value);
+// modification time in nanoseconds since the epoch (whole seconds on Windows),
+// 0 if the file can't be read
+MAPNIK_DECL std::int64_t last_write_time(std::string const& value);
+// `value` followed by a random suffix, to name a temporary file next to it
+MAPNIK_DECL std::string unique_path(std::string const& value);
+// moves `from` to `to`, replacing `to` in one step; false on failure
+MAPNIK_DECL bool rename(std::string const& from, std::string const& to);
 
 }}
 
@@ -0,0 +1,226 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_UTIL_LRU_CACHE_HPP
+#define MAPNIK_UTIL_LRU_CACHE_HPP
+
+// mapnik
+#include <mapnik/util/fs.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace mapnik { namespace util {
+
+struct lru_cache_stats
+{
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+};
+
+inline void hash_combine(std::size_t & seed, std::size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// One version of a file. Cache keys holding a stamp stop matching once
+// the file is rewritten; size and time are 0 for names that aren't files.
+struct file_stamp
+{
+    std::string name;
+    std::uint64_t size = 0;
+    std::int64_t time = 0;
+
+    static file_stamp of(std::string const& filename)
+    {
+        return file_stamp{filename, file_size(filename), last_write_time(filename)};
+    }
+
+    bool operator==(file_stamp const& rhs) const
+    {
+        return size == rhs.size && time == rhs.time && name == rhs.name;
+    }
+
+    bool operator!=(file_stamp const& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    std::size_t hash() const
+    {
+        std::size_t seed = std::hash<std::string>()(name);
+        hash_combine(seed, std::hash<std::uint64_t>()(size));
+        hash_combine(seed, std::hash<std::int64_t>()(time));
+        return seed;
+    }
+};
+
+// Hooks of an lru_cache: whether an entry may be evicted now, and a
+// notification for every entry leaving the cache.
+struct lru_cache_policy
+{
+    template <typename Key, typename Value>
+    bool evictable(Key const&, Value const&) const { return true; }
+    template <typename Key, typename Value>
+    void erased(Key const&, Value const&) {}
+};
+
+// Map bounded by the total size of its values, as given to insert(), and
+// by their number. Least recently used evictable entries are dropped first;
+// the cache may exceed its limits while no entry is evictable. It does no
+// locking of its own, owners serialise access.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Policy = lru_cache_policy>
+class lru_cache : private noncopyable
+{
+public:
+    explicit lru_cache(std::size_t max_bytes,
+                       std::size_t max_entries = std::numeric_limits<std::size_t>::max(),
+                       Policy const& policy = Policy())
+        : policy_(policy),
+          max_bytes_(max_bytes),
+          max_entries_(max_entries) {}
+
+    // the value of `key`, now most recently used; nullptr on a miss
+    Value const* find(Key const& key)
+    {
+        auto itr = map_.find(key);
+        if (itr == map_.end())
+        {
+            ++stats_.misses;
+            return nullptr;
+        }
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, itr->second.lru);
+        return &itr->second.value;
+    }
+
+    // false if `key` is present already or `bytes` alone exceed max_bytes()
+    bool insert(Key const& key, Value const& value, std::size_t bytes)
+    {
+        if (bytes > max_bytes_ || map_.count(key) > 0) return false;
+        lru_.push_front(key);
+        map_.emplace(key, entry{value, bytes, lru_.begin()});
+        stats_.bytes += bytes;
+        stats_.entries = map_.size();
+        evict();
+        return true;
+    }
+
+    bool remove(Key const& key)
+    {
+        auto itr = map_.find(key);
+        if (itr == map_.end()) return false;
+        erase(itr);
+        return true;
+    }
+
+    // removes the entries for which pred(key, value) holds
+    template <typename Pred>
+    void remove_if(Pred pred)
+    {
+        for (auto itr = map_.begin(); itr != map_.end();)
+        {
+            auto current = itr++;
+            if (pred(current->first, current->second.value)) erase(current);
+        }
+    }
+
+    void clear()
+    {
+        for (auto const& kv : map_) policy_.erased(kv.first, kv.second.value);
+        map_.clear();
+        lru_.clear();
+        stats_.entries = 0;
+        stats_.bytes = 0;
+    }
+
+    void set_max_bytes(std::size_t max_bytes)
+    {
+        max_bytes_ = max_bytes;
+        evict();
+    }
+
+    void set_max_entries(std::size_t max_entries)
+    {
+        max_entries_ = max_entries;
+        evict();
+    }
+
+    std::size_t max_bytes() const { return max_bytes_; }
+    std::size_t max_entries() const { return max_entries_; }
+    lru_cache_stats const& stats() const { return stats_; }
+    Policy & policy() { return policy_; }
+
+private:
+    struct entry
+    {
+        Value value;
+        std::size_t bytes;
+        typename std::list<Key>::iterator lru;
+    };
+    using map_type = std::unordered_map<Key, entry, Hash>;
+
+    void erase(typename map_type::iterator itr)
+    {
+        policy_.erased(itr->first, itr->second.value);
+        stats_.bytes -= itr->second.bytes;
+        lru_.erase(itr->second.lru);
+        map_.erase(itr);
+        stats_.entries = map_.size();
+    }
+
+    void evict()
+    {
+        auto itr = lru_.end();
+        while (itr != lru_.begin() && (map_.size() > max_entries_ || stats_.bytes > max_bytes_))
+        {
+            --itr;
+            auto pos = map_.find(*itr);
+            if (!policy_.evictable(pos->first, pos->second.value)) continue;
+            ++itr;
+            erase(pos);
+            ++stats_.evictions;
+        }
+    }
+
+    map_type map_;
+    std::list<Key> lru_; // most recently used first
+    Policy policy_;
+    std::size_t max_bytes_;
+    std::size_t max_entries_;
+    lru_cache_stats stats_;
+};
+
+}} // mapnik/util
+
+#endif // MAPNIK_UTIL_LRU_CACHE_HPP
@@ -0,0 +1,452 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_UTIL_PACKED_RTREE_HPP
+#define MAPNIK_UTIL_PACKED_RTREE_HPP
+
+// mapnik
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ios>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mapnik { namespace util {
+
+// Static packed Hilbert R-tree (flatbush layout).
+//
+// Items are sorted along a Hilbert curve of their box centres and packed
+// bottom-up into nodes of `node_size` entries, so the tree is fully
+// described by flat arrays which are queried in place:
+//
+//   char[16]           "mapnik-packed"
+//   packed_rtree_header
+//   uint64[num_levels] end position of every level in the boxes array
+//   BBox[num_boxes]    leaf boxes in Hilbert order, then each parent level
+//   uint32[num_boxes]  leaves: position in the values array,
+//                      nodes: position of the first child box
+//   Value[num_items]   values in insertion order
+//
+// Values keep their insertion order, so indexes built while scanning a
+// data file return their matches in file order.
+
+static constexpr char const* packed_rtree_magic = "mapnik-packed";
+
+// header flags
+// the indexed data file was rewritten in Hilbert order (shapeindex --reorder)
+static constexpr std::uint32_t packed_rtree_sorted = 1u;
+
+struct packed_rtree_header
+{
+    std::uint32_t version;
+    std::uint32_t node_size;
+    std::uint32_t value_size;
+    std::uint32_t bbox_size;
+    std::uint64_t num_items;
+    std::uint64_t num_boxes;
+    std::uint32_t num_levels;
+    std::uint32_t flags;
+};
+
+// Position of (x, y) on a Hilbert curve over a 2^16 x 2^16 grid
+// (http://threadlocalmutex.com/?p=126, public domain)
+inline std::uint32_t hilbert_value(std::uint32_t x, std::uint32_t y)
+{
+    std::uint32_t a = x ^ y;
+    std::uint32_t b = 0xFFFF ^ a;
+    std::uint32_t c = 0xFFFF ^ (x | y);
+    std::uint32_t d = x & (y ^ 0xFFFF);
+
+    std::uint32_t A = a | (b >> 1);
+    std::uint32_t B = (a >> 1) ^ a;
+    std::uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    std::uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+    B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+    C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+    D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+    a = A; b = B; c = C; d = D;
+    A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+    B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+    C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+    D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+    a = A; b = B; c = C; d = D;
+    C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+    D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    std::uint32_t i0 = x ^ y;
+    std::uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+// Hilbert value of the centre of `box` within `extent`
+template <typename BBox>
+std::uint32_t hilbert_value(BBox const& box, BBox const& extent)
+{
+    double const hilbert_max = 0xFFFF;
+    double w = extent.width();
+    double h = extent.height();
+    double cx = 0.5 * (double(box.minx()) + double(box.maxx()));
+    double cy = 0.5 * (double(box.miny()) + double(box.maxy()));
+    double x = w > 0 ? std::floor(hilbert_max * (cx - extent.minx()) / w) : 0.0;
+    double y = h > 0 ? std::floor(hilbert_max * (cy - extent.miny()) / h) : 0.0;
+    return hilbert_value(static_cast<std::uint32_t>(std::max(0.0, std::min(hilbert_max, x))),
+                         static_cast<std::uint32_t>(std::max(0.0, std::min(hilbert_max, y))));
+}
+
+template <typename T0, typename T1 = box2d<double>>
+class packed_rtree : util::noncopyable
+{
+public:
+    using value_type = T0;
+    using bbox_type = T1;
+
+    explicit packed_rtree(unsigned node_size = 16)
+        : node_size_(std::max(2u, node_size)),
+          flags_(0),
+          extent_(),
+          values_(),
+          boxes_() {}
+
+    void insert(value_type const& data, bbox_type const& box)
+    {
+        if (values_.empty()) extent_ = box;
+        else extent_.expand_to_include(box);
+        values_.push_back(data);
+        boxes_.push_back(box);
+    }
+
+    bbox_type const& extent() const
+    {
+        return extent_;
+    }
+
+    void reserve(std::size_t count)
+    {
+        values_.reserve(count);
+        boxes_.reserve(count);
+    }
+
+    void set_flags(std::uint32_t flags)
+    {
+        flags_ = flags;
+    }
+
+    std::size_t count_items() const
+    {
+        return values_.size();
+    }
+
+    // number of inner nodes
+    std::size_t count() const
+    {
+        std::size_t n = values_.size();
+        std::size_t nodes = 0;
+        while (n > 1 || (nodes == 0 && n == 1))
+        {
+            n = (n + node_size_ - 1) / node_size_;
+            nodes += n;
+        }
+        return nodes;
+    }
+
+    template <typename OutputStream>
+    void write(OutputStream & out) const
+    {
+        static_assert(std::is_standard_layout<value_type>::value,
+                      "Values stored in packed R-tree must be standard layout types to allow serialisation");
+        std::uint64_t num_items = values_.size();
+        std::vector<std::uint64_t> level_bounds;
+        std::uint64_t num_boxes = num_items;
+        if (num_items > 0)
+        {
+            std::uint64_t n = num_items;
+            level_bounds.push_back(n);
+            do
+            {
+                n = (n + node_size_ - 1) / node_size_;
+                num_boxes += n;
+                level_bounds.push_back(num_boxes);
+            }
+            while (n != 1);
+        }
+        if (num_boxes > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("Too many items for a packed R-tree index");
+        }
+
+        // sort item positions along the Hilbert curve, ties keep insertion order
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> order;
+        order.reserve(num_items);
+        for (std::uint32_t i = 0; i < num_items; ++i)
+        {
+            order.emplace_back(hilbert_value(boxes_[i], extent_), i);
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<bbox_type> boxes;
+        std::vector<std::uint32_t> indices;
+        boxes.reserve(num_boxes);
+        indices.reserve(num_boxes);
+        for (auto const& item : order)
+        {
+            boxes.push_back(boxes_[item.second]);
+            indices.push_back(item.second);
+        }
+        std::uint64_t level_start = 0;
+        for (std::size_t level = 0; level + 1 < level_bounds.size(); ++level)
+        {
+            std::uint64_t level_end = level_bounds[level];
+            for (std::uint64_t pos = level_start; pos < level_end; pos += node_size_)
+            {
+                std::uint64_t end = std::min<std::uint64_t>(pos + node_size_, level_end);
+                bbox_type node_box = boxes[pos];
+                for (std::uint64_t i = pos + 1; i < end; ++i)
+                {
+                    node_box.expand_to_include(boxes[i]);
+                }
+                boxes.push_back(node_box);
+                indices.push_back(static_cast<std::uint32_t>(pos));
+            }
+            level_start = level_end;
+        }
+
+        char magic[16];
+        std::memset(magic, 0, 16);
+        std::strcpy(magic, packed_rtree_magic);
+        out.write(magic, 16);
+        packed_rtree_header header;
+        std::memset(&header, 0, sizeof(header));
+        header.version = 1;
+        header.node_size = node_size_;
+        header.value_size = sizeof(value_type);
+        header.bbox_size = sizeof(bbox_type);
+        header.num_items = num_items;
+        header.num_boxes = num_boxes;
+        header.num_levels = static_cast<std::uint32_t>(level_bounds.size());
+        header.flags = flags_;
+        out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.write(reinterpret_cast<char const*>(&extent_), sizeof(bbox_type));
+        out.write(reinterpret_cast<char const*>(level_bounds.data()), level_bounds.size() * sizeof(std::uint64_t));
+        out.write(reinterpret_cast<char const*>(boxes.data()), boxes.size() * sizeof(bbox_type));
+        out.write(reinterpret_cast<char const*>(indices.data()), indices.size() * sizeof(std::uint32_t));
+        out.write(reinterpret_cast<char const*>(values_.data()), values_.size() * sizeof(value_type));
+    }
+
+private:
+    unsigned node_size_;
+    std::uint32_t flags_;
+    bbox_type extent_;
+    std::vector<value_type> values_;
+    std::vector<bbox_type> boxes_;
+};
+
+namespace detail {
+
+// random access to an index held in memory (e.g. a mapped file)
+struct packed_memory_source
+{
+    char const* data;
+    std::size_t size;
+
+    void read(std::uint64_t pos, void* dst, std::size_t count) const
+    {
+        if (pos > size || count > size - pos)
+        {
+            throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+        }
+        std::memcpy(dst, data + pos, count);
+    }
+};
+
+template <typename InputStream>
+struct packed_stream_source
+{
+    InputStream & in;
+
+    void read(std::uint64_t pos, void* dst, std::size_t count) const
+    {
+        in.seekg(pos, std::ios::beg);
+        in.read(static_cast<char*>(dst), count);
+        if (!in)
+        {
+            throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+        }
+    }
+};
+
+// streams over a memory buffer (boost::interprocess::ibufferstream) are
+// read directly from the buffer
+template <typename T, typename = void>
+struct has_buffer : std::false_type {};
+
+template <typename T>
+struct has_buffer<T, decltype(void(std::declval<T&>().buffer().first))> : std::true_type {};
+
+template <typename InputStream>
+typename std::enable_if<has_buffer<InputStream>::value, packed_memory_source>::type
+make_packed_source(InputStream & in)
+{
+    auto buffer = in.buffer();
+    return packed_memory_source{buffer.first, static_cast<std::size_t>(buffer.second)};
+}
+
+template <typename InputStream>
+typename std::enable_if<!has_buffer<InputStream>::value, packed_stream_source<InputStream>>::type
+make_packed_source(InputStream & in)
+{
+    return packed_stream_source<InputStream>{in};
+}
+
+} // detail
+
+template <typename Value, typename Filter, typename BBox>
+class packed_rtree_index
+{
+public:
+    template <typename Source>
+    static BBox bounding_box(Source const& src)
+    {
+        layout l = read_layout(src);
+        return l.extent;
+    }
+
+    template <typename Source>
+    static std::uint32_t flags(Source const& src)
+    {
+        return read_layout(src).header.flags;
+    }
+
+    // Appends the values whose boxes pass `filter`, in insertion order.
+    template <typename Source>
+    static void query(Filter const& filter, Source const& src, std::vector<Value>& results,
+                      std::size_t max_count = std::numeric_limits<std::size_t>::max())
+    {
+        layout l = read_layout(src);
+        if (l.header.num_items == 0 || max_count == 0) return;
+
+        std::vector<std::uint32_t> items;
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> stack;
+        std::vector<BBox> boxes(l.header.node_size);
+        std::vector<std::uint32_t> indices(l.header.node_size);
+        std::uint64_t node_pos = l.header.num_boxes - 1;
+        std::uint32_t level = l.header.num_levels - 1;
+        while (true)
+        {
+            std::uint64_t end = std::min<std::uint64_t>(node_pos + l.header.node_size, l.level_bounds[level]);
+            if (end <= node_pos) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+            std::size_t count = static_cast<std::size_t>(end - node_pos);
+            src.read(l.boxes_offset + node_pos * sizeof(BBox), boxes.data(), count * sizeof(BBox));
+            src.read(l.indices_offset + node_pos * sizeof(std::uint32_t), indices.data(), count * sizeof(std::uint32_t));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (!filter.pass(boxes[i])) continue;
+                if (level == 0) items.push_back(indices[i]);
+                else stack.emplace_back(indices[i], level - 1);
+            }
+            if (items.size() >= max_count || stack.empty()) break;
+            node_pos = stack.back().first;
+            level = stack.back().second;
+            stack.pop_back();
+        }
+        if (items.size() > max_count) items.resize(max_count);
+        std::sort(items.begin(), items.end());
+        results.reserve(results.size() + items.size());
+        for (auto index : items)
+        {
+            if (index >= l.header.num_items) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+            Value item;
+            src.read(l.values_offset + std::uint64_t(index) * sizeof(Value), &item, sizeof(Value));
+            results.push_back(std::move(item));
+        }
+    }
+
+private:
+    struct layout
+    {
+        packed_rtree_header header;
+        BBox extent;
+        std::vector<std::uint64_t> level_bounds;
+        std::uint64_t boxes_offset;
+        std::uint64_t indices_offset;
+        std::uint64_t values_offset;
+    };
+
+    template <typename Source>
+    static layout read_layout(Source const& src)
+    {
+        static_assert(std::is_standard_layout<Value>::value, "Values stored in packed R-tree must be standard layout type");
+        layout l;
+        std::uint64_t pos = 16;
+        src.read(pos, &l.header, sizeof(packed_rtree_header));
+        pos += sizeof(packed_rtree_header);
+        if (l.header.version != 1 ||
+            l.header.value_size != sizeof(Value) ||
+            l.header.bbox_size != sizeof(BBox) ||
+            l.header.node_size < 2 ||
+            (l.header.num_items > 0 && l.header.num_levels == 0) ||
+            l.header.num_boxes < l.header.num_items)
+        {
+            throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+        }
+        src.read(pos, &l.extent, sizeof(BBox));
+        pos += sizeof(BBox);
+        l.level_bounds.resize(l.header.num_levels);
+        src.read(pos, l.level_bounds.data(), l.level_bounds.size() * sizeof(std::uint64_t));
+        pos += l.level_bounds.size() * sizeof(std::uint64_t);
+        l.boxes_offset = pos;
+        l.indices_offset = l.boxes_offset + l.header.num_boxes * sizeof(BBox);
+        l.values_offset = l.indices_offset + l.header.num_boxes * sizeof(std::uint32_t);
+        return l;
+    }
+};
+
+}} // mapnik/util
+
+#endif // MAPNIK_UTIL_PACKED_RTREE_HPP
@@ -0,0 +1,105 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_UTIL_PARALLEL_FOR_HPP
+#define MAPNIK_UTIL_PARALLEL_FOR_HPP
+
+// stl
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <vector>
+#ifdef MAPNIK_THREADSAFE
+#include <system_error>
+#include <thread>
+#endif
+
+namespace mapnik { namespace util {
+
+inline std::size_t hardware_threads()
+{
+#ifdef MAPNIK_THREADSAFE
+    return std::max(1u, std::thread::hardware_concurrency());
+#else
+    return 1;
+#endif
+}
+
+// Calls func(first, last) on contiguous chunks covering [0, count), one chunk per
+// thread, using no more threads than leave each chunk `min_chunk_size` items.
+// The calling thread processes the first chunk. After all chunks are done the
+// first exception thrown (in chunk order) is rethrown.
+template <typename Func>
+void parallel_for_chunks(std::size_t count, std::size_t threads, std::size_t min_chunk_size, Func && func)
+{
+    if (count == 0) return;
+#ifdef MAPNIK_THREADSAFE
+    threads = std::min(threads, count / std::max(min_chunk_size, std::size_t(1)));
+#else
+    threads = 1;
+#endif
+    if (threads <= 1)
+    {
+        func(std::size_t(0), count);
+        return;
+    }
+#ifdef MAPNIK_THREADSAFE
+    std::size_t const chunk_size = (count + threads - 1) / threads;
+    std::vector<std::exception_ptr> errors(threads);
+    auto run = [&](std::size_t chunk)
+    {
+        std::size_t first = chunk * chunk_size;
+        std::size_t last = std::min(count, first + chunk_size);
+        try
+        {
+            if (first < last) func(first, last);
+        }
+        catch (...)
+        {
+            errors[chunk] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (std::size_t chunk = 1; chunk < threads; ++chunk)
+    {
+        try
+        {
+            workers.emplace_back(run, chunk);
+        }
+        catch (std::system_error const&)
+        {
+            run(chunk); // can't start a thread, process the chunk here
+        }
+    }
+    run(0);
+    for (auto & worker : workers) worker.join();
+    for (auto const& error : errors)
+    {
+        if (error) std::rethrow_exception(error);
+    }
+#endif
+}
+
+}} // mapnik/util
+
+#endif // MAPNIK_UTIL_PARALLEL_FOR_HPP
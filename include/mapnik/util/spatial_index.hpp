@@ -28,6 +28,7 @@
 #include <mapnik/geometry/box2d.hpp>
 #include <mapnik/query.hpp>
 #include <mapnik/geom_util.hpp>
+#include <mapnik/util/packed_rtree.hpp>
 // stl
 #include <type_traits>
 #include <cstring>
@@ -44,13 +45,62 @@ struct index_record
     box2d<float> box;
 };
 
+// byte ranges of a feature's geometry and attributes, relative to the
+// start of its record; a size of 0 means the range is unknown
+struct feature_member_ranges
+{
+    std::uint32_t geometry_off;
+    std::uint32_t geometry_size;
+    std::uint32_t attributes_off;
+    std::uint32_t attributes_size;
+};
+
+// record written by mapnik-index into packed R-tree indexes of GeoJSON and CSV files
+struct feature_index_record
+{
+    std::uint64_t off;
+    std::uint64_t size;
+    box2d<float> box;
+    feature_member_ranges ranges;
+};
+
+enum class spatial_index_format
+{
+    unknown,
+    quad_tree,    // "mapnik-index", written by mapnik::quad_tree
+    packed_rtree  // "mapnik-packed", written by mapnik::util::packed_rtree
+};
+
 template <typename InputStream>
-bool check_spatial_index(InputStream& in)
+spatial_index_format spatial_index_type(InputStream& in)
 {
-    char header[17]; // mapnik-index
+    char header[17];
     std::memset(header, 0, 17);
     in.read(header,16);
-    return (std::strncmp(header, "mapnik-index",12) == 0);
+    if (std::strncmp(header, "mapnik-index",12) == 0) return spatial_index_format::quad_tree;
+    if (std::strncmp(header, packed_rtree_magic, 13) == 0) return spatial_index_format::packed_rtree;
+    return spatial_index_format::unknown;
+}
+
+template <typename InputStream>
+bool check_spatial_index(InputStream& in)
+{
+    return spatial_index_type(in) != spatial_index_format::unknown;
+}
+
+// size of the values stored in a packed R-tree index, 0 for other formats
+template <typename InputStream>
+std::size_t spatial_index_value_size(InputStream& in)
+{
+    std::size_t value_size = 0;
+    if (spatial_index_type(in) == spatial_index_format::packed_rtree)
+    {
+        packed_rtree_header header;
+        if (in.read(reinterpret_cast<char*>(&header), sizeof(header))) value_size = header.value_size;
+    }
+    in.clear();
+    in.seekg(0, std::ios::beg);
+    return value_size;
 }
 
 template <typename Value, typename Filter, typename InputStream, typename BBox = box2d<double> >
@@ -61,6 +111,8 @@ public:
     static void query(Filter const& filter, InputStream& in,std::vector<Value>& pos);
     static bbox_type bounding_box( InputStream& in );
     static void query_first_n(Filter const& filter, InputStream & in, std::vector<Value>& pos, std::size_t count);
+    // true if the data file is stored in index order (shapeindex --reorder)
+    static bool data_sorted(InputStream& in);
 private:
     spatial_index();
     ~spatial_index();
@@ -76,7 +128,14 @@ template <typename Value, typename Filter, typename InputStream, typename BBox>
 BBox spatial_index<Value, Filter, InputStream, BBox>::bounding_box(InputStream& in)
 {
     static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
-    if (!check_spatial_index(in)) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    spatial_index_format format = spatial_index_type(in);
+    if (format == spatial_index_format::unknown) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    if (format == spatial_index_format::packed_rtree)
+    {
+        BBox box = packed_rtree_index<Value, Filter, BBox>::bounding_box(detail::make_packed_source(in));
+        in.seekg(0, std::ios::beg);
+        return box;
+    }
     in.seekg(16 + 4, std::ios::beg);
     typename spatial_index<Value, Filter, InputStream, BBox>::bbox_type box;
     read_envelope(in, box);
@@ -84,11 +143,29 @@ BBox spatial_index<Value, Filter, InputStream, BBox>::bounding_box(InputStream&
     return box;
 }
 
+template <typename Value, typename Filter, typename InputStream, typename BBox>
+bool spatial_index<Value, Filter, InputStream, BBox>::data_sorted(InputStream& in)
+{
+    bool sorted = false;
+    if (spatial_index_type(in) == spatial_index_format::packed_rtree)
+    {
+        sorted = (packed_rtree_index<Value, Filter, BBox>::flags(detail::make_packed_source(in)) & packed_rtree_sorted) != 0;
+    }
+    in.seekg(0, std::ios::beg);
+    return sorted;
+}
+
 template <typename Value, typename Filter, typename InputStream, typename BBox>
 void spatial_index<Value, Filter, InputStream, BBox>::query(Filter const& filter, InputStream& in, std::vector<Value>& results)
 {
     static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
-    if (!check_spatial_index(in)) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    spatial_index_format format = spatial_index_type(in);
+    if (format == spatial_index_format::unknown) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    if (format == spatial_index_format::packed_rtree)
+    {
+        packed_rtree_index<Value, Filter, BBox>::query(filter, detail::make_packed_source(in), results);
+        return;
+    }
     in.seekg(16, std::ios::beg);
     query_node(filter, in, results);
 }
@@ -124,7 +201,16 @@ template <typename Value, typename Filter, typename InputStream, typename BBox>
 void spatial_index<Value, Filter, InputStream, BBox>::query_first_n(Filter const& filter, InputStream& in, std::vector<Value>& results, std::size_t count)
 {
     static_assert(std::is_standard_layout<Value>::value, "Values stored in quad-tree must be standard layout type");
-    if (!check_spatial_index(in)) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    spatial_index_format format = spatial_index_type(in);
+    if (format == spatial_index_format::unknown) throw std::runtime_error("Invalid index file (regenerate with shapeindex)");
+    if (format == spatial_index_format::packed_rtree)
+    {
+        if (results.size() < count)
+        {
+            packed_rtree_index<Value, Filter, BBox>::query(filter, detail::make_packed_source(in), results, count - results.size());
+        }
+        return;
+    }
     in.seekg(16, std::ios::beg);
     query_first_n_impl(filter, in, results, count);
 }
@@ -170,6 +256,43 @@ void spatial_index<Value, Filter, InputStream, BBox>::read_envelope(InputStream&
     in.read(reinterpret_cast<char*>(&envelope), sizeof(envelope));
 }
 
+// Queries an index written by mapnik-index: packed R-trees hold feature_index_record
+// values, quad-trees (and packed R-trees from older versions) hold index_record values
+// which are returned with empty member ranges.
+template <typename Filter, typename InputStream>
+void query_feature_index(Filter const& filter, InputStream& in, std::vector<feature_index_record>& results,
+                         std::size_t count = std::numeric_limits<std::size_t>::max())
+{
+    bool const first_n = count != std::numeric_limits<std::size_t>::max();
+    if (spatial_index_value_size(in) == sizeof(feature_index_record))
+    {
+        using index_type = spatial_index<feature_index_record, Filter, InputStream, box2d<float>>;
+        if (first_n) index_type::query_first_n(filter, in, results, count);
+        else index_type::query(filter, in, results);
+        return;
+    }
+    using index_type = spatial_index<index_record, Filter, InputStream, box2d<float>>;
+    std::vector<index_record> records;
+    if (first_n) index_type::query_first_n(filter, in, records, count);
+    else index_type::query(filter, in, records);
+    results.reserve(results.size() + records.size());
+    for (auto const& rec : records)
+    {
+        results.push_back({rec.off, rec.size, rec.box, {0, 0, 0, 0}});
+    }
+}
+
+template <typename InputStream>
+box2d<float> feature_index_bounding_box(InputStream& in)
+{
+    using filter_type = mapnik::bounding_box_filter<float>;
+    if (spatial_index_value_size(in) == sizeof(feature_index_record))
+    {
+        return spatial_index<feature_index_record, filter_type, InputStream, box2d<float>>::bounding_box(in);
+    }
+    return spatial_index<index_record, filter_type, InputStream, box2d<float>>::bounding_box(in);
+}
+
 }} // mapnik/util
 
 #endif // MAPNIK_UTIL_SPATIAL_INDEX_HPP
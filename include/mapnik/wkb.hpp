@@ -47,7 +47,8 @@ enum wkbFormat : std::uint8_t
 {
     wkbAuto=1,
     wkbGeneric=2,
-    wkbSpatiaLite=3
+    wkbSpatiaLite=3,
+    wkbGeoPackage=4
 };
 
 enum wkbByteOrder : std::uint8_t
@@ -44,6 +44,7 @@
 #include <mapnik/util/fs.hpp>
 #include <mapnik/make_unique.hpp>
 #include <mapnik/util/spatial_index.hpp>
+#include <mapnik/util/parallel_for.hpp>
 #include <mapnik/geom_util.hpp>
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
 #pragma GCC diagnostic push
@@ -75,6 +76,7 @@ csv_datasource::csv_datasource(parameters const& params)
     row_limit_ = *params.get<mapnik::value_integer>("row_limit", 0);
     manual_headers_ = mapnik::util::trim_copy(*params.get<std::string>("headers", ""));
     strict_ = *params.get<mapnik::boolean_type>("strict", false);
+    threads_ = std::max(mapnik::value_integer(1), *params.get<mapnik::value_integer>("load_threads", 1));
 
     auto quote_param = params.get<std::string>("quote");
     if (quote_param)
@@ -125,7 +127,7 @@ csv_datasource::csv_datasource(parameters const& params)
         file_source_type in;
         mapnik::mapped_region_ptr mapped_region;
         boost::optional<mapnik::mapped_region_ptr> memory =
-            mapnik::mapped_memory_cache::instance().find(filename_, true);
+            mapnik::mapped_memory_cache::instance().find(filename_, false, mapnik::mapped_access::sequential);
         if (memory)
         {
             mapped_region = *memory;
@@ -153,13 +155,9 @@ csv_datasource::csv_datasource(parameters const& params)
         if (has_disk_index_ && !extent_initialized_)
         {
             // read bounding box from *.index
-            using value_type = mapnik::util::index_record;
             std::ifstream index(filename_ + ".index", std::ios::binary);
             if (!index) throw mapnik::datasource_exception("CSV Plugin: could not open: '" + filename_ + ".index'");
-            auto ext_f = mapnik::util::spatial_index<value_type,
-                                                     mapnik::bounding_box_filter<float>,
-                                                     std::ifstream,
-                                                     mapnik::box2d<float>>::bounding_box(index);
+            auto ext_f = mapnik::util::feature_index_bounding_box(index);
             extent_ = { ext_f.minx(), ext_f.miny(),ext_f.maxx(), ext_f.maxy() };
 
         }
@@ -319,15 +317,12 @@ csv_datasource::get_geometry_type_impl(std::istream & stream) const
     else
     {
         // try reading *.index
-        using value_type = mapnik::util::index_record;
+        using value_type = mapnik::util::feature_index_record;
         std::ifstream index(filename_ + ".index", std::ios::binary);
         if (!index) throw mapnik::datasource_exception("CSV Plugin: could not open: '" + filename_ + ".index'");
         mapnik::bounding_box_filter<float> filter{mapnik::box2d<float>(extent_.minx(), extent_.miny(), extent_.maxx(), extent_.maxy())};
         std::vector<value_type> positions;
-        mapnik::util::spatial_index<value_type,
-                                    mapnik::bounding_box_filter<float>,
-                                    std::ifstream,
-                                    mapnik::box2d<float>>::query_first_n(filter, index, positions, 5);
+        mapnik::util::query_feature_index(filter, index, positions, 5);
         int multi_type = 0;
         for (auto const& val : positions)
         {
@@ -432,7 +427,7 @@ mapnik::featureset_ptr csv_datasource::features(mapnik::query const& q) const
         {
             auto const& bbox = q.get_bbox();
             mapnik::bounding_box_filter<float> const filter(mapnik::box2d<float>(bbox.minx(), bbox.miny(), bbox.maxx(), bbox.maxy()));
-            return std::make_shared<csv_index_featureset>(filename_, filter, locator_, separator_, quote_, headers_, ctx_);
+            return std::make_shared<csv_index_featureset>(filename_, filter, locator_, separator_, quote_, headers_, ctx_, q.property_names());
         }
     }
     return mapnik::make_invalid_featureset();
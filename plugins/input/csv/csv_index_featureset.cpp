@@ -33,6 +33,7 @@
 #include <vector>
 #include <deque>
 #include <fstream>
+#include <algorithm>
 
 csv_index_featureset::csv_index_featureset(std::string const& filename,
                                            mapnik::bounding_box_filter<float> const& filter,
@@ -40,12 +41,16 @@ csv_index_featureset::csv_index_featureset(std::string const& filename,
                                            char separator,
                                            char quote,
                                            std::vector<std::string> const& headers,
-                                           mapnik::context_ptr const& ctx)
+                                           mapnik::context_ptr const& ctx,
+                                           std::set<std::string> const& attribute_names)
     : separator_(separator),
       quote_(quote),
       headers_(headers),
       ctx_(ctx),
       locator_(locator),
+      geometry_locator_(locator),
+      selected_(headers.size(), false),
+      has_ranges_(false),
       tr_("utf8")
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
       //
@@ -58,7 +63,7 @@ csv_index_featureset::csv_index_featureset(std::string const& filename,
 {
 #if defined (MAPNIK_MEMORY_MAPPED_FILE)
     boost::optional<mapnik::mapped_region_ptr> memory =
-        mapnik::mapped_memory_cache::instance().find(filename, true);
+        mapnik::mapped_memory_cache::instance().find(filename, true, mapnik::mapped_access::random);
     if (memory)
     {
         mapped_region_ = *memory;
@@ -71,13 +76,26 @@ csv_index_featureset::csv_index_featureset(std::string const& filename,
     if (!file_) throw mapnik::datasource_exception("CSV Plugin: can't open file " + filename);
 #endif
 
+    for (std::size_t i = 0; i < headers_.size(); ++i)
+    {
+        selected_[i] = attribute_names.count(headers_[i]) > 0;
+    }
+    geometry_locator_.index = 0;
+    has_ranges_ = (locator_.type == locator_type::WKT || locator_.type == locator_type::GEOJSON)
+        && std::find(selected_.begin(), selected_.end(), true) == selected_.end();
+
     std::string indexname = filename + ".index";
+#if defined (MAPNIK_MEMORY_MAPPED_FILE)
+    boost::optional<mapnik::mapped_region_ptr> index_memory =
+        mapnik::mapped_memory_cache::instance().find(indexname, true, mapnik::mapped_access::random);
+    if (!index_memory) throw mapnik::datasource_exception("CSV Plugin: can't open index file " + indexname);
+    file_source_type index(static_cast<char const*>((*index_memory)->get_address()), (*index_memory)->get_size());
+#else
     std::ifstream index(indexname.c_str(), std::ios::binary);
     if (!index) throw mapnik::datasource_exception("CSV Plugin: can't open index file " + indexname);
-    mapnik::util::spatial_index<value_type,
-                                mapnik::bounding_box_filter<float>,
-                                std::ifstream,
-                                mapnik::box2d<float>>::query(filter, index, positions_);
+#endif
+    has_ranges_ = has_ranges_ && mapnik::util::spatial_index_value_size(index) == sizeof(value_type);
+    mapnik::util::query_feature_index(filter, index, positions_);
     positions_.erase(std::remove_if(positions_.begin(),
                                     positions_.end(),
                                     [&](value_type const& pos)
@@ -98,7 +116,20 @@ mapnik::feature_ptr csv_index_featureset::parse_feature(char const* beg, char co
     {
         mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx_, ++feature_id_));
         feature->set_geometry(std::move(geom));
-        csv_utils::process_properties(*feature, headers_, values, locator_, tr_);
+        csv_utils::process_properties(*feature, headers_, values, locator_, tr_, &selected_);
+        return feature;
+    }
+    return mapnik::feature_ptr();
+}
+
+mapnik::feature_ptr csv_index_featureset::parse_geometry(char const* beg, char const* end)
+{
+    auto values = csv_utils::parse_line(beg, end, separator_, quote_, 1);
+    auto geom = csv_utils::extract_geometry(values, geometry_locator_);
+    if (!geom.is<mapnik::geometry::geometry_empty>())
+    {
+        mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx_, ++feature_id_));
+        feature->set_geometry(std::move(geom));
         return feature;
     }
     return mapnik::feature_ptr();
@@ -122,7 +153,7 @@ mapnik::feature_ptr csv_index_featureset::next()
 #else
         std::fseek(file_.get(), pos.off, SEEK_SET);
         std::vector<char> record;
-        record.resize(pos.second);
+        record.resize(pos.size);
         if (std::fread(record.data(), pos.size, 1, file_.get()) != 1)
         {
             return mapnik::feature_ptr();
@@ -130,7 +161,18 @@ mapnik::feature_ptr csv_index_featureset::next()
         auto const* start = record.data();
         auto const*  end = start + record.size();
 #endif
-        auto feature = parse_feature(start, end);
+        auto const& ranges = pos.ranges;
+        mapnik::feature_ptr feature;
+        if (has_ranges_ && ranges.geometry_size > 0 &&
+            std::uint64_t(ranges.geometry_off) + ranges.geometry_size <= std::uint64_t(end - start))
+        {
+            // no attributes requested: parse the geometry column only
+            feature = parse_geometry(start + ranges.geometry_off, start + ranges.geometry_off + ranges.geometry_size);
+        }
+        else
+        {
+            feature = parse_feature(start, end);
+        }
         if (feature) return feature;
     }
     return mapnik::feature_ptr();
@@ -30,6 +30,8 @@
 #include "csv_utils.hpp"
 #include "csv_datasource.hpp"
 
+#include <set>
+
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -41,7 +43,7 @@
 
 class csv_index_featureset : public mapnik::Featureset
 {
-    using value_type = mapnik::util::index_record;
+    using value_type = mapnik::util::feature_index_record;
     using locator_type = csv_utils::geometry_column_locator;
 public:
 
@@ -51,17 +53,23 @@ public:
                          char separator,
                          char quote,
                          std::vector<std::string> const& headers,
-                         mapnik::context_ptr const& ctx);
+                         mapnik::context_ptr const& ctx,
+                         std::set<std::string> const& attribute_names);
     ~csv_index_featureset();
     mapnik::feature_ptr next();
 private:
     mapnik::feature_ptr parse_feature(char const* beg, char const* end);
+    mapnik::feature_ptr parse_geometry(char const* beg, char const* end);
     char separator_;
     char quote_;
     std::vector<std::string> headers_;
     mapnik::context_ptr ctx_;
     mapnik::value_integer feature_id_ = 0;
     locator_type const& locator_;
+    // locates the geometry column within its own field range (index records with member ranges)
+    locator_type geometry_locator_;
+    std::vector<bool> selected_;
+    bool has_ranges_;
     mapnik::transcoder tr_;
 #if defined (MAPNIK_MEMORY_MAPPED_FILE)
     using file_source_type = boost::interprocess::ibufferstream;
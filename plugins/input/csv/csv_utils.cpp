@@ -28,6 +28,7 @@
 #include <mapnik/json/geometry_parser.hpp>
 #include <mapnik/util/conversions.hpp>
 #include <mapnik/util/trim.hpp>
+#include <mapnik/util/parallel_for.hpp>
 #include <mapnik/datasource.hpp>
 // csv grammar
 #include <mapnik/csv/csv_grammar_x3_def.hpp>
@@ -216,6 +217,48 @@ mapnik::csv_line parse_line(std::string const& line_str, char separator, char qu
     return parse_line(start, end, separator, quote, 0);
 }
 
+std::pair<std::size_t, std::size_t> column_range(char const* start, char const* end, char separator, char quote, std::size_t index)
+{
+    char const* itr = start;
+    // optional line break left over from the previous record (see csv_line_grammar)
+    if (itr != end && *itr == '\r') ++itr;
+    if (itr != end && *itr == '\n') ++itr;
+    char const* column_start = itr;
+    std::size_t column = 0;
+    bool quoted = false;
+    bool leading = true; // only spaces seen in the current column, a quote here opens quoted text
+    for (; itr != end; ++itr)
+    {
+        char const c = *itr;
+        if (quoted)
+        {
+            if (c == '\\' && itr + 1 != end) ++itr;
+            else if (c == quote)
+            {
+                if (itr + 1 != end && *(itr + 1) == quote) ++itr; // doubled quote
+                else quoted = false;
+            }
+        }
+        else if (c == separator)
+        {
+            if (column == index) break;
+            ++column;
+            column_start = itr + 1;
+            leading = true;
+        }
+        else if (leading && c == quote)
+        {
+            quoted = true;
+            leading = false;
+        }
+        else if (c != ' ')
+        {
+            leading = false;
+        }
+    }
+    if (column != index) return std::make_pair(0, 0);
+    return std::make_pair(static_cast<std::size_t>(column_start - start), static_cast<std::size_t>(itr - start));
+}
 
 bool is_likely_number(std::string const& value)
 {
@@ -363,6 +406,55 @@ void csv_file_parser::parse_csv_and_boxes(std::istream & csv_file, T & boxes)
         }
     }
 
+    // rows are read sequentially (quoted fields may span lines) and parsed in
+    // batches across threads; results are then applied in file order
+    std::size_t const threads = std::max(threads_, std::size_t(1));
+    std::size_t const batch_size = has_disk_index_ ? 1 : threads * 4096;
+    std::vector<pending_row> batch;
+    std::vector<parsed_row> results;
+    batch.reserve(batch_size);
+    auto process_batch = [&]()
+    {
+        results.clear();
+        results.resize(batch.size());
+        mapnik::util::parallel_for_chunks(batch.size(), threads, 1024, [&](std::size_t first, std::size_t last)
+        {
+            for (std::size_t i = first; i < last; ++i)
+            {
+                parse_row(batch[i], results[i], num_headers);
+            }
+        });
+        for (std::size_t i = 0; i < batch.size(); ++i)
+        {
+            auto & result = results[i];
+            if (result.error_type == parsed_row::none)
+            {
+                if (!extent_initialized_)
+                {
+                    if (extent_.valid())
+                        extent_.expand_to_include(result.box);
+                    else
+                        extent_ = result.box;
+                }
+                boxes.emplace_back(box_type(result.box), std::make_pair(batch[i].offset, std::uint64_t(batch[i].line.length())));
+                add_feature(++feature_count, result.values);
+            }
+            else if (strict_)
+            {
+                throw mapnik::datasource_exception(result.error);
+            }
+            else if (result.error_type == parsed_row::datasource_error)
+            {
+                MAPNIK_LOG_ERROR(csv) << result.error << " at line: " << batch[i].line_number;
+            }
+            else
+            {
+                MAPNIK_LOG_ERROR(csv) << result.error;
+            }
+        }
+        batch.clear();
+    };
+
     while (is_first_row || csv_utils::getline_csv(csv_file, csv_line, newline, quote_))
     {
         ++line_number;
@@ -387,77 +479,70 @@ void csv_file_parser::parse_csv_and_boxes(std::istream & csv_file, T & boxes)
                 continue;
             }
         }
-
-        try
+        batch.push_back({csv_line, static_cast<std::uint64_t>(record_offset), line_number});
+        // return early if *.index is present
+        if (has_disk_index_)
         {
-            auto const* line_start = csv_line.data();
-            auto const* line_end = line_start + csv_line.size();
-            auto values = csv_utils::parse_line(line_start, line_end, separator_, quote_, num_headers);
-            unsigned num_fields = values.size();
-            if (num_fields != num_headers)
-            {
-                std::ostringstream s;
-                s << "CSV Plugin: # of columns(" << num_fields << ")";
-                if (num_fields > num_headers)
-                {
-                    s << " > ";
-                }
-                else
-                {
-                    s << " < ";
-                }
-                s << "# of headers(" << num_headers << ") parsed";
-                throw mapnik::datasource_exception(s.str());
-            }
+            process_batch();
+            return;
+        }
+        if (batch.size() == batch_size) process_batch();
+    }
+    process_batch();
+}
 
-            auto geom = extract_geometry(values, locator_);
-            if (!geom.is<mapnik::geometry::geometry_empty>())
+void csv_file_parser::parse_row(pending_row const& row, parsed_row & result, std::size_t num_headers) const
+{
+    try
+    {
+        auto const* line_start = row.line.data();
+        auto const* line_end = line_start + row.line.size();
+        result.values = csv_utils::parse_line(line_start, line_end, separator_, quote_, num_headers);
+        auto const& values = result.values;
+        unsigned num_fields = values.size();
+        if (num_fields != num_headers)
+        {
+            std::ostringstream s;
+            s << "CSV Plugin: # of columns(" << num_fields << ")";
+            if (num_fields > num_headers)
             {
-                auto box = mapnik::geometry::envelope(geom);
-                if (!extent_initialized_)
-                {
-                    if (extent_.valid())
-                        extent_.expand_to_include(box);
-                    else
-                        extent_ = box;
-                }
-                boxes.emplace_back(box_type(box), make_pair(record_offset, record_size));
-                add_feature(++feature_count, values);
+                s << " > ";
             }
             else
             {
-                std::ostringstream s;
-                s << "CSV Plugin: expected geometry column: could not parse row "
-                  << line_number << " "
-                  << values.at(locator_.index) << "'";
-                throw mapnik::datasource_exception(s.str());
+                s << " < ";
             }
+            s << "# of headers(" << num_headers << ") parsed";
+            throw mapnik::datasource_exception(s.str());
         }
-        catch (mapnik::datasource_exception const& ex )
+
+        auto geom = extract_geometry(values, locator_);
+        if (!geom.is<mapnik::geometry::geometry_empty>())
         {
-            if (strict_) throw ex;
-            else
-            {
-                MAPNIK_LOG_ERROR(csv) << ex.what() << " at line: " << line_number;
-            }
+            result.box = mapnik::geometry::envelope(geom);
         }
-        catch (std::exception const& ex)
+        else
         {
             std::ostringstream s;
-            s << "CSV Plugin: unexpected error parsing line: " << line_number
-              << " - found " << headers_.size() << " with values like: " << csv_line << "\n"
-              << " and got error like: " << ex.what();
-            if (strict_)
-            {
-                throw mapnik::datasource_exception(s.str());
-            }
-            else
-            {
-                MAPNIK_LOG_ERROR(csv) << s.str();
-            }
+            s << "CSV Plugin: expected geometry column: could not parse row "
+              << row.line_number << " "
+              << values.at(locator_.index) << "'";
+            throw mapnik::datasource_exception(s.str());
         }
-        // return early if *.index is present
-        if (has_disk_index_) return;
+    }
+    catch (mapnik::datasource_exception const& ex )
+    {
+        result.error_type = parsed_row::datasource_error;
+        result.error = ex.what();
+    }
+    catch (std::exception const& ex)
+    {
+        std::ostringstream s;
+        s << "CSV Plugin: unexpected error parsing line: " << row.line_number
+          << " - found " << headers_.size() << " with values like: " << row.line << "\n"
+          << " and got error like: " << ex.what();
+        result.error_type = parsed_row::other_error;
+        result.error = s.str();
     }
 }
 
@@ -32,8 +32,10 @@
 #include <mapnik/csv/csv_types.hpp>
 
 // std
+#include <cstdint>
 #include <iosfwd>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace csv_utils {
@@ -41,6 +43,9 @@ namespace csv_utils {
 mapnik::csv_line parse_line(char const* start, char const* end, char separator, char quote, std::size_t num_columns);
 mapnik::csv_line parse_line(std::string const& line_str, char separator, char quote);
 
+// raw byte range [first, second) of column `index` in a CSV line, (0, 0) if the line has fewer columns
+std::pair<std::size_t, std::size_t> column_range(char const* start, char const* end, char separator, char quote, std::size_t index);
+
 bool is_likely_number(std::string const& value);
 
 bool ignore_case_equal(std::string const& s0, std::string const& s1);
@@ -58,14 +63,21 @@ struct geometry_column_locator
 
 mapnik::geometry::geometry<double> extract_geometry(std::vector<std::string> const& row, geometry_column_locator const& locator);
 
+// converts the columns flagged in `selected` (all columns when null)
 template <typename Feature, typename Headers, typename Values, typename Locator, typename Transcoder>
-void process_properties(Feature & feature, Headers const& headers, Values const& values, Locator const& locator, Transcoder const& tr)
+void process_properties(Feature & feature, Headers const& headers, Values const& values, Locator const& locator, Transcoder const& tr,
+                        std::vector<bool> const* selected = nullptr)
 {
     auto val_beg = values.begin();
     auto val_end = values.end();
     auto num_headers = headers.size();
     for (std::size_t i = 0; i < num_headers; ++i)
     {
+        if (selected != nullptr && !(*selected)[i])
+        {
+            if (val_beg != val_end) ++val_beg;
+            continue;
+        }
         std::string const& fld_name = headers.at(i);
         if (val_beg == val_end)
         {
@@ -135,6 +147,23 @@ struct csv_file_parser
 
     virtual void add_feature(mapnik::value_integer index, mapnik::csv_line const & values);
 
+    struct pending_row
+    {
+        std::string line;
+        std::uint64_t offset;
+        int line_number;
+    };
+
+    struct parsed_row
+    {
+        enum { none = 0, datasource_error, other_error } error_type = none;
+        std::string error;
+        mapnik::csv_line values;
+        mapnik::box2d<double> box;
+    };
+
+    void parse_row(pending_row const& row, parsed_row & result, std::size_t num_headers) const;
+
     std::vector<std::string> headers_;
     std::string manual_headers_;
     geometry_column_locator locator_;
@@ -145,6 +174,7 @@ struct csv_file_parser
     bool strict_ = false;
     bool extent_initialized_ = false;
     bool has_disk_index_ = false;
+    std::size_t threads_ = 1; // threads parsing rows
 };
 
 } // namespace csv_utils
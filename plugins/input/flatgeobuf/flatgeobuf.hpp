@@ -0,0 +1,603 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef MAPNIK_FLATGEOBUF_HPP
+#define MAPNIK_FLATGEOBUF_HPP
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/global.hpp>
+#include <mapnik/unicode.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/util/noncopyable.hpp>
+// boost
+#include <boost/optional.hpp>
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+#include <mapnik/mapped_memory_cache.hpp>
+#endif
+
+// stl
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// FlatGeobuf (https://flatgeobuf.org) reader: a magic number, a size
+// prefixed Header flatbuffer, an optional packed Hilbert R-tree and size
+// prefixed Feature flatbuffers. Everything is read in place from the file,
+// only the index nodes and features touched by a query are visited.
+
+namespace mapnik { namespace flatgeobuf {
+
+static constexpr char magic[] = { 'f', 'g', 'b', 3, 'f', 'g', 'b' };
+static constexpr std::size_t magic_size = 8;
+
+enum geometry_type : std::uint8_t
+{
+    Unknown = 0,
+    Point = 1,
+    LineString = 2,
+    Polygon = 3,
+    MultiPoint = 4,
+    MultiLineString = 5,
+    MultiPolygon = 6,
+    GeometryCollection = 7
+};
+
+enum column_type : std::uint8_t
+{
+    Byte = 0,
+    UByte,
+    Bool,
+    Short,
+    UShort,
+    Int,
+    UInt,
+    Long,
+    ULong,
+    Float,
+    Double,
+    String,
+    Json,
+    DateTime,
+    Binary
+};
+
+// FlatGeobuf and flatbuffers store scalars little endian
+template <typename T>
+inline T read_le(char const* data)
+{
+    T val;
+#ifndef MAPNIK_BIG_ENDIAN
+    std::memcpy(&val, data, sizeof(T));
+#else
+    char bytes[sizeof(T)];
+    std::reverse_copy(data, data + sizeof(T), bytes);
+    std::memcpy(&val, bytes, sizeof(T));
+#endif
+    return val;
+}
+
+// Bounds checked view of a flatbuffer table
+class table
+{
+public:
+    table(char const* data, std::size_t size, std::size_t pos)
+        : data_(data),
+          size_(size),
+          pos_(pos),
+          vtable_(0),
+          vtable_size_(0)
+    {
+        check(pos_, 4);
+        std::int64_t vtable = static_cast<std::int64_t>(pos_) - read_le<std::int32_t>(data_ + pos_);
+        if (vtable < 0) throw std::runtime_error("FlatGeobuf: invalid table");
+        vtable_ = static_cast<std::size_t>(vtable);
+        check(vtable_, 4);
+        vtable_size_ = read_le<std::uint16_t>(data_ + vtable_);
+        check(vtable_, vtable_size_);
+    }
+
+    static table root(char const* data, std::size_t size)
+    {
+        if (size < 4) throw std::runtime_error("FlatGeobuf: truncated buffer");
+        return table(data, size, read_le<std::uint32_t>(data));
+    }
+
+    bool has(unsigned field) const
+    {
+        return field_offset(field) != 0;
+    }
+
+    template <typename T>
+    T scalar(unsigned field, T default_value) const
+    {
+        std::size_t offset = field_offset(field);
+        if (offset == 0) return default_value;
+        check(pos_ + offset, sizeof(T));
+        return read_le<T>(data_ + pos_ + offset);
+    }
+
+    // pointer to the first element and length of a vector field,
+    // {nullptr, 0} when the field is absent
+    std::pair<char const*, std::uint32_t> vector(unsigned field, std::size_t element_size) const
+    {
+        std::size_t pos = indirect(field);
+        if (pos == 0) return { nullptr, 0 };
+        check(pos, 4);
+        std::uint32_t length = read_le<std::uint32_t>(data_ + pos);
+        check(pos + 4, std::uint64_t(length) * element_size);
+        return { data_ + pos + 4, length };
+    }
+
+    std::string string(unsigned field) const
+    {
+        auto str = vector(field, 1);
+        return std::string(str.first ? str.first : "", str.second);
+    }
+
+    table child(unsigned field) const
+    {
+        std::size_t pos = indirect(field);
+        if (pos == 0) throw std::runtime_error("FlatGeobuf: missing table");
+        return table(data_, size_, pos);
+    }
+
+    // element `index` of a vector of tables
+    table child(unsigned field, std::uint32_t index) const
+    {
+        auto vec = vector(field, 4);
+        if (index >= vec.second) throw std::runtime_error("FlatGeobuf: index out of range");
+        std::size_t pos = static_cast<std::size_t>(vec.first - data_) + index * 4;
+        return table(data_, size_, pos + read_le<std::uint32_t>(data_ + pos));
+    }
+
+private:
+    void check(std::size_t pos, std::uint64_t count) const
+    {
+        if (pos > size_ || count > size_ - pos) throw std::runtime_error("FlatGeobuf: truncated buffer");
+    }
+
+    std::size_t field_offset(unsigned field) const
+    {
+        std::size_t entry = 4 + 2 * field;
+        if (entry + 2 > vtable_size_) return 0;
+        return read_le<std::uint16_t>(data_ + vtable_ + entry);
+    }
+
+    std::size_t indirect(unsigned field) const
+    {
+        std::size_t offset = field_offset(field);
+        if (offset == 0) return 0;
+        std::size_t pos = pos_ + offset;
+        check(pos, 4);
+        return pos + read_le<std::uint32_t>(data_ + pos);
+    }
+
+    char const* data_;
+    std::size_t size_;
+    std::size_t pos_;
+    std::size_t vtable_;
+    std::size_t vtable_size_;
+};
+
+struct column
+{
+    std::string name;
+    column_type type;
+};
+
+struct header
+{
+    geometry_type type = Unknown;
+    bool has_z = false;
+    bool has_m = false;
+    boost::optional<box2d<double>> envelope;
+    std::vector<column> columns;
+    std::uint64_t features_count = 0;
+    std::uint16_t index_node_size = 16;
+};
+
+inline header read_header(char const* data, std::size_t size)
+{
+    header hdr;
+    table root = table::root(data, size);
+    auto envelope = root.vector(1, 8);
+    if (envelope.second >= 4)
+    {
+        hdr.envelope = box2d<double>(read_le<double>(envelope.first),
+                                     read_le<double>(envelope.first + 8),
+                                     read_le<double>(envelope.first + 16),
+                                     read_le<double>(envelope.first + 24));
+    }
+    hdr.type = static_cast<geometry_type>(root.scalar<std::uint8_t>(2, Unknown));
+    hdr.has_z = root.scalar<std::uint8_t>(3, 0) != 0;
+    hdr.has_m = root.scalar<std::uint8_t>(4, 0) != 0;
+    std::uint32_t num_columns = root.vector(7, 4).second;
+    hdr.columns.reserve(num_columns);
+    for (std::uint32_t i = 0; i < num_columns; ++i)
+    {
+        table col = root.child(7, i);
+        hdr.columns.push_back({ col.string(0), static_cast<column_type>(col.scalar<std::uint8_t>(1, Byte)) });
+    }
+    hdr.features_count = root.scalar<std::uint64_t>(8, 0);
+    hdr.index_node_size = root.scalar<std::uint16_t>(9, 16);
+    return hdr;
+}
+
+// Packed R-tree (flatbush layout, root first) stored between the header
+// and the features. Leaf items hold the byte offset of their feature.
+struct node_item
+{
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+    std::uint64_t offset;
+};
+
+static constexpr std::size_t node_item_size = 40;
+
+inline node_item read_node(char const* data)
+{
+    return { read_le<double>(data), read_le<double>(data + 8),
+             read_le<double>(data + 16), read_le<double>(data + 24),
+             read_le<std::uint64_t>(data + 32) };
+}
+
+// [begin, end) node positions of each level, leaves first
+inline std::vector<std::pair<std::uint64_t, std::uint64_t>> level_bounds(std::uint64_t num_items, std::uint16_t node_size)
+{
+    std::vector<std::uint64_t> level_num_nodes;
+    std::uint64_t n = num_items;
+    std::uint64_t num_nodes = n;
+    level_num_nodes.push_back(n);
+    do
+    {
+        n = (n + node_size - 1) / node_size;
+        num_nodes += n;
+        level_num_nodes.push_back(n);
+    } while (n != 1);
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> bounds;
+    bounds.reserve(level_num_nodes.size());
+    n = num_nodes;
+    for (std::uint64_t size : level_num_nodes)
+    {
+        bounds.emplace_back(n - size, n);
+        n -= size;
+    }
+    return bounds;
+}
+
+inline std::uint64_t index_size(std::uint64_t num_items, std::uint16_t node_size)
+{
+    if (node_size == 0 || num_items == 0) return 0;
+    if (node_size < 2) throw std::runtime_error("FlatGeobuf: invalid index node size");
+    auto bounds = level_bounds(num_items, node_size);
+    return bounds.front().second * node_item_size;
+}
+
+struct search_result
+{
+    std::uint64_t offset; // relative to the start of the features
+    std::uint64_t index;  // position of the feature in the file
+};
+
+// Visits the nodes intersecting `box`, reading each run of siblings with
+// `read(first_node, count)` which returns a pointer to `count` node items.
+// Results are returned in file order.
+template <typename ReadNodes>
+std::vector<search_result> search(std::uint64_t num_items, std::uint16_t node_size,
+                                  box2d<double> const& box, ReadNodes && read)
+{
+    std::vector<search_result> results;
+    if (num_items == 0) return results;
+    auto bounds = level_bounds(num_items, node_size);
+    std::uint64_t const leaf_begin = bounds.front().first;
+    std::vector<std::pair<std::uint64_t, std::size_t>> queue;
+    queue.emplace_back(0, bounds.size() - 1);
+    while (!queue.empty())
+    {
+        std::uint64_t node_index = queue.back().first;
+        std::size_t level = queue.back().second;
+        queue.pop_back();
+        bool is_leaf = node_index >= leaf_begin;
+        std::uint64_t end = std::min(node_index + node_size, bounds[level].second);
+        char const* nodes = read(node_index, end - node_index);
+        if (nodes == nullptr) throw std::runtime_error("FlatGeobuf: truncated index");
+        for (std::uint64_t pos = node_index; pos < end; ++pos)
+        {
+            node_item node = read_node(nodes + (pos - node_index) * node_item_size);
+            if (box.maxx() < node.minx || box.maxy() < node.miny ||
+                box.minx() > node.maxx || box.miny() > node.maxy) continue;
+            if (is_leaf)
+            {
+                results.push_back({ node.offset, pos - leaf_begin });
+            }
+            else if (level > 0 && node.offset >= bounds[level - 1].first && node.offset < bounds[level - 1].second)
+            {
+                queue.emplace_back(node.offset, level - 1);
+            }
+        }
+    }
+    std::sort(results.begin(), results.end(),
+              [](search_result const& a, search_result const& b) { return a.offset < b.offset; });
+    return results;
+}
+
+// Random access to the file, mapped when possible
+class file_source : util::noncopyable
+{
+public:
+    explicit file_source(std::string const& filename)
+#if !defined(MAPNIK_MEMORY_MAPPED_FILE)
+        : file_(std::fopen(filename.c_str(), "rb"), std::fclose)
+#endif
+    {
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        boost::optional<mapped_region_ptr> memory = mapped_memory_cache::instance().find(filename, true);
+        if (memory) region_ = *memory;
+#else
+        if (file_)
+        {
+            std::fseek(file_.get(), 0, SEEK_END);
+            long size = std::ftell(file_.get());
+            size_ = size > 0 ? static_cast<std::uint64_t>(size) : 0;
+        }
+#endif
+    }
+
+    bool is_open() const
+    {
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        return region_ != nullptr;
+#else
+        return file_ != nullptr;
+#endif
+    }
+
+    std::uint64_t size() const
+    {
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        return region_ ? region_->get_size() : 0;
+#else
+        return size_;
+#endif
+    }
+
+    // `count` bytes at `offset`, valid until the next read;
+    // nullptr if the range is outside the file
+    char const* read(std::uint64_t offset, std::uint64_t count)
+    {
+        if (offset > size() || count > size() - offset) return nullptr;
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        return static_cast<char const*>(region_->get_address()) + offset;
+#else
+        buffer_.resize(count);
+        if (std::fseek(file_.get(), static_cast<long>(offset), SEEK_SET) != 0 ||
+            (count > 0 && std::fread(buffer_.data(), count, 1, file_.get()) != 1))
+        {
+            return nullptr;
+        }
+        return buffer_.data();
+#endif
+    }
+
+private:
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapped_region_ptr region_;
+#else
+    using file_ptr = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+    file_ptr file_;
+    std::uint64_t size_ = 0;
+    std::vector<char> buffer_;
+#endif
+};
+
+namespace detail {
+
+inline geometry::point<double> read_point(char const* xy, std::uint32_t index)
+{
+    return { read_le<double>(xy + index * 16), read_le<double>(xy + index * 16 + 8) };
+}
+
+template <typename Container>
+inline void read_points(Container & points, char const* xy, std::uint32_t begin, std::uint32_t end)
+{
+    points.reserve(end - begin);
+    for (std::uint32_t i = begin; i < end; ++i)
+    {
+        points.push_back(read_point(xy, i));
+    }
+}
+
+// calls `f(begin, end)` for every part delimited by `ends`, or once for the whole sequence
+template <typename F>
+inline void for_each_part(table const& geom, std::uint32_t num_points, F && f)
+{
+    auto ends = geom.vector(0, 4);
+    if (ends.second == 0)
+    {
+        f(0u, num_points);
+        return;
+    }
+    std::uint32_t begin = 0;
+    for (std::uint32_t i = 0; i < ends.second; ++i)
+    {
+        std::uint32_t end = std::min(read_le<std::uint32_t>(ends.first + i * 4), num_points);
+        if (end < begin) break;
+        f(begin, end);
+        begin = end;
+    }
+}
+
+inline geometry::polygon<double> read_polygon(table const& geom, char const* xy, std::uint32_t num_points)
+{
+    geometry::polygon<double> poly;
+    for_each_part(geom, num_points, [&](std::uint32_t begin, std::uint32_t end) {
+            geometry::linear_ring<double> ring;
+            read_points(ring, xy, begin, end);
+            poly.push_back(std::move(ring));
+        });
+    return poly;
+}
+
+} // namespace detail
+
+inline geometry::geometry<double> read_geometry(table const& geom, geometry_type type)
+{
+    if (type == Unknown) type = static_cast<geometry_type>(geom.scalar<std::uint8_t>(6, Unknown));
+    auto xy = geom.vector(1, 8);
+    std::uint32_t num_points = xy.second / 2;
+    switch (type)
+    {
+    case Point:
+    {
+        if (num_points == 0) break;
+        return detail::read_point(xy.first, 0);
+    }
+    case MultiPoint:
+    {
+        geometry::multi_point<double> multi_point;
+        detail::read_points(multi_point, xy.first, 0, num_points);
+        return multi_point;
+    }
+    case LineString:
+    {
+        geometry::line_string<double> line;
+        detail::read_points(line, xy.first, 0, num_points);
+        return line;
+    }
+    case MultiLineString:
+    {
+        geometry::multi_line_string<double> multi_line;
+        detail::for_each_part(geom, num_points, [&](std::uint32_t begin, std::uint32_t end) {
+                geometry::line_string<double> line;
+                detail::read_points(line, xy.first, begin, end);
+                multi_line.push_back(std::move(line));
+            });
+        return multi_line;
+    }
+    case Polygon:
+        return detail::read_polygon(geom, xy.first, num_points);
+    case MultiPolygon:
+    {
+        geometry::multi_polygon<double> multi_poly;
+        std::uint32_t num_parts = geom.vector(7, 4).second;
+        if (num_parts == 0)
+        {
+            // single part written without nesting
+            multi_poly.push_back(detail::read_polygon(geom, xy.first, num_points));
+            return multi_poly;
+        }
+        for (std::uint32_t i = 0; i < num_parts; ++i)
+        {
+            table part = geom.child(7, i);
+            auto part_xy = part.vector(1, 8);
+            multi_poly.push_back(detail::read_polygon(part, part_xy.first, part_xy.second / 2));
+        }
+        return multi_poly;
+    }
+    case GeometryCollection:
+    {
+        geometry::geometry_collection<double> collection;
+        std::uint32_t num_parts = geom.vector(7, 4).second;
+        for (std::uint32_t i = 0; i < num_parts; ++i)
+        {
+            collection.push_back(read_geometry(geom.child(7, i), Unknown));
+        }
+        return collection;
+    }
+    default:
+        break;
+    }
+    return geometry::geometry_empty();
+}
+
+// Decodes the properties of columns flagged in `selected` (indexed like `columns`)
+inline void read_properties(feature_impl & feature, char const* data, std::uint32_t size,
+                            std::vector<column> const& columns, std::vector<bool> const& selected,
+                            transcoder const& tr)
+{
+    std::uint32_t pos = 0;
+    while (pos + 2 <= size)
+    {
+        std::uint16_t index = read_le<std::uint16_t>(data + pos);
+        pos += 2;
+        if (index >= columns.size()) return;
+        column const& col = columns[index];
+        std::uint32_t length;
+        switch (col.type)
+        {
+        case Byte: case UByte: case Bool: length = 1; break;
+        case Short: case UShort: length = 2; break;
+        case Int: case UInt: case Float: length = 4; break;
+        case Long: case ULong: case Double: length = 8; break;
+        default:
+            if (pos + 4 > size) return;
+            length = read_le<std::uint32_t>(data + pos);
+            pos += 4;
+            break;
+        }
+        if (length > size - pos) return;
+        if (selected[index])
+        {
+            char const* val = data + pos;
+            switch (col.type)
+            {
+            case Byte: feature.put(col.name, value_integer(read_le<std::int8_t>(val))); break;
+            case UByte: feature.put(col.name, value_integer(read_le<std::uint8_t>(val))); break;
+            case Bool: feature.put(col.name, read_le<std::uint8_t>(val) != 0); break;
+            case Short: feature.put(col.name, value_integer(read_le<std::int16_t>(val))); break;
+            case UShort: feature.put(col.name, value_integer(read_le<std::uint16_t>(val))); break;
+            case Int: feature.put(col.name, value_integer(read_le<std::int32_t>(val))); break;
+            case UInt: feature.put(col.name, value_integer(read_le<std::uint32_t>(val))); break;
+            case Long: feature.put(col.name, value_integer(read_le<std::int64_t>(val))); break;
+            case ULong: feature.put(col.name, static_cast<value_integer>(read_le<std::uint64_t>(val))); break;
+            case Float: feature.put(col.name, value_double(read_le<float>(val))); break;
+            case Double: feature.put(col.name, read_le<double>(val)); break;
+            case String:
+            case Json:
+            case DateTime:
+                feature.put(col.name, tr.transcode(val, static_cast<std::int32_t>(length)));
+                break;
+            default: // Binary
+                break;
+            }
+        }
+        pos += length;
+    }
+}
+
+}}
+
+#endif // MAPNIK_FLATGEOBUF_HPP
@@ -0,0 +1,264 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#include "flatgeobuf_datasource.hpp"
+#include "flatgeobuf_featureset.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/debug.hpp>
+#include <mapnik/geometry/envelope.hpp>
+
+using mapnik::datasource;
+using mapnik::parameters;
+
+namespace fgb = mapnik::flatgeobuf;
+
+DATASOURCE_PLUGIN(flatgeobuf_datasource)
+
+namespace {
+
+mapnik::eAttributeType attribute_type(fgb::column_type type)
+{
+    switch (type)
+    {
+    case fgb::Bool:
+        return mapnik::Boolean;
+    case fgb::Byte:
+    case fgb::UByte:
+    case fgb::Short:
+    case fgb::UShort:
+    case fgb::Int:
+    case fgb::UInt:
+    case fgb::Long:
+    case fgb::ULong:
+        return mapnik::Integer;
+    case fgb::Float:
+    case fgb::Double:
+        return mapnik::Double;
+    default:
+        return mapnik::String;
+    }
+}
+
+// extent of files written without an envelope or an index
+mapnik::box2d<double> scan_extent(fgb::file_source & in, fgb::header const& header, std::uint64_t offset)
+{
+    mapnik::box2d<double> extent;
+    while (char const* prefix = in.read(offset, 4))
+    {
+        std::uint32_t size = fgb::read_le<std::uint32_t>(prefix);
+        char const* data = in.read(offset + 4, size);
+        if (data == nullptr) break;
+        offset += 4 + size;
+        fgb::table feature = fgb::table::root(data, size);
+        if (!feature.has(0)) continue;
+        mapnik::box2d<double> box = mapnik::geometry::envelope(fgb::read_geometry(feature.child(0), header.type));
+        if (!box.valid()) continue;
+        if (extent.valid()) extent.expand_to_include(box);
+        else extent = box;
+    }
+    return extent;
+}
+
+}
+
+flatgeobuf_datasource::flatgeobuf_datasource(parameters const& params)
+    : datasource(params),
+      type_(datasource::Vector),
+      desc_(flatgeobuf_datasource::name(), "utf-8"),
+      filename_(),
+      extent_(),
+      header_(),
+      index_offset_(0),
+      index_size_(0),
+      features_offset_(0)
+{
+    boost::optional<std::string> file = params.get<std::string>("file");
+    if (!file) throw mapnik::datasource_exception("FlatGeobuf Plugin: missing <file> parameter");
+
+    boost::optional<std::string> base = params.get<std::string>("base");
+    if (base)
+        filename_ = *base + "/" + *file;
+    else
+        filename_ = *file;
+
+    fgb::file_source in(filename_);
+    if (!in.is_open())
+    {
+        throw mapnik::datasource_exception("FlatGeobuf Plugin: could not open: '" + filename_ + "'");
+    }
+    char const* prefix = in.read(0, fgb::magic_size + 4);
+    if (prefix == nullptr
+        || std::memcmp(prefix, fgb::magic, 4) != 0
+        || std::memcmp(prefix + 4, fgb::magic + 4, 3) != 0)
+    {
+        throw mapnik::datasource_exception("FlatGeobuf Plugin: '" + filename_ + "' is not a FlatGeobuf v3 file");
+    }
+    std::uint32_t header_size = fgb::read_le<std::uint32_t>(prefix + fgb::magic_size);
+    index_offset_ = fgb::magic_size + 4 + header_size;
+    try
+    {
+        char const* data = in.read(fgb::magic_size + 4, header_size);
+        if (data == nullptr) throw std::runtime_error("FlatGeobuf: truncated header");
+        header_ = fgb::read_header(data, header_size);
+        index_size_ = fgb::index_size(header_.features_count, header_.index_node_size);
+        features_offset_ = index_offset_ + index_size_;
+        if (features_offset_ > in.size()) throw std::runtime_error("FlatGeobuf: truncated index");
+
+        if (header_.envelope && header_.envelope->valid())
+        {
+            extent_ = *header_.envelope;
+        }
+        else if (index_size_ > 0)
+        {
+            // the root node bounds every feature
+            fgb::node_item root = fgb::read_node(in.read(index_offset_, fgb::node_item_size));
+            extent_.init(root.minx, root.miny, root.maxx, root.maxy);
+        }
+        else
+        {
+            extent_ = scan_extent(in, header_, features_offset_);
+        }
+    }
+    catch (std::runtime_error const& ex)
+    {
+        throw mapnik::datasource_exception("FlatGeobuf Plugin: error reading '" + filename_ + "': " + ex.what());
+    }
+
+    for (fgb::column const& col : header_.columns)
+    {
+        if (col.type == fgb::Binary) continue;
+        desc_.add_descriptor(mapnik::attribute_descriptor(col.name, attribute_type(col.type)));
+    }
+    MAPNIK_LOG_DEBUG(flatgeobuf) << "flatgeobuf_datasource: " << filename_
+                                 << " features=" << header_.features_count
+                                 << " indexed=" << (index_size_ > 0);
+}
+
+flatgeobuf_datasource::~flatgeobuf_datasource() {}
+
+const char * flatgeobuf_datasource::name()
+{
+    return "flatgeobuf";
+}
+
+boost::optional<mapnik::datasource_geometry_t> flatgeobuf_datasource::get_geometry_type() const
+{
+    boost::optional<mapnik::datasource_geometry_t> result;
+    switch (header_.type)
+    {
+    case fgb::Point:
+    case fgb::MultiPoint:
+        result.reset(mapnik::datasource_geometry_t::Point);
+        break;
+    case fgb::LineString:
+    case fgb::MultiLineString:
+        result.reset(mapnik::datasource_geometry_t::LineString);
+        break;
+    case fgb::Polygon:
+    case fgb::MultiPolygon:
+        result.reset(mapnik::datasource_geometry_t::Polygon);
+        break;
+    case fgb::GeometryCollection:
+        result.reset(mapnik::datasource_geometry_t::Collection);
+        break;
+    default:
+        break;
+    }
+    return result;
+}
+
+mapnik::datasource::datasource_t flatgeobuf_datasource::type() const
+{
+    return type_;
+}
+
+mapnik::box2d<double> flatgeobuf_datasource::envelope() const
+{
+    return extent_;
+}
+
+mapnik::layer_descriptor flatgeobuf_datasource::get_descriptor() const
+{
+    return desc_;
+}
+
+mapnik::featureset_ptr flatgeobuf_datasource::features(mapnik::query const& q) const
+{
+    mapnik::box2d<double> const& box = q.get_bbox();
+    if (!extent_.intersects(box)) return mapnik::make_invalid_featureset();
+
+    // only decode the requested properties
+    std::set<std::string> const& names = q.property_names();
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    std::vector<bool> selected;
+    selected.reserve(header_.columns.size());
+    for (fgb::column const& col : header_.columns)
+    {
+        bool wanted = col.type != fgb::Binary && names.count(col.name) > 0;
+        if (wanted) ctx->push(col.name);
+        selected.push_back(wanted);
+    }
+
+    if (index_size_ == 0)
+    {
+        return std::make_shared<flatgeobuf_featureset>(filename_, header_, features_offset_,
+                                                       ctx, std::move(selected), box);
+    }
+    fgb::file_source in(filename_);
+    if (!in.is_open())
+    {
+        throw mapnik::datasource_exception("FlatGeobuf Plugin: could not open: '" + filename_ + "'");
+    }
+    flatgeobuf_featureset::array_type index_array;
+    try
+    {
+        index_array = fgb::search(header_.features_count, header_.index_node_size, box,
+                                  [&](std::uint64_t first, std::uint64_t count) {
+                                      return in.read(index_offset_ + first * fgb::node_item_size,
+                                                     count * fgb::node_item_size);
+                                  });
+    }
+    catch (std::runtime_error const& ex)
+    {
+        throw mapnik::datasource_exception("FlatGeobuf Plugin: error reading '" + filename_ + "': " + ex.what());
+    }
+    if (index_array.empty()) return mapnik::make_invalid_featureset();
+    return std::make_shared<flatgeobuf_featureset>(filename_, header_, features_offset_,
+                                                   ctx, std::move(selected), std::move(index_array));
+}
+
+mapnik::featureset_ptr flatgeobuf_datasource::features_at_point(mapnik::coord2d const& pt, double tol) const
+{
+    mapnik::box2d<double> query_bbox(pt, pt);
+    query_bbox.pad(tol);
+    mapnik::query q(query_bbox);
+    for (mapnik::attribute_descriptor const& attr : desc_.get_descriptors())
+    {
+        q.add_property_name(attr.get_name());
+    }
+    return features(q);
+}
@@ -0,0 +1,67 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef FLATGEOBUF_DATASOURCE_HPP
+#define FLATGEOBUF_DATASOURCE_HPP
+
+// mapnik
+#include <mapnik/datasource.hpp>
+#include <mapnik/params.hpp>
+#include <mapnik/query.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/coord.hpp>
+#include <mapnik/feature_layer_desc.hpp>
+// boost
+#include <boost/optional.hpp>
+
+// stl
+#include <string>
+#include <vector>
+
+#include "flatgeobuf.hpp"
+
+class flatgeobuf_datasource : public mapnik::datasource
+{
+public:
+    flatgeobuf_datasource(mapnik::parameters const& params);
+    virtual ~flatgeobuf_datasource ();
+    mapnik::datasource::datasource_t type() const;
+    static const char * name();
+    mapnik::featureset_ptr features(mapnik::query const& q) const;
+    mapnik::featureset_ptr features_at_point(mapnik::coord2d const& pt, double tol = 0) const;
+    mapnik::box2d<double> envelope() const;
+    mapnik::layer_descriptor get_descriptor() const;
+    boost::optional<mapnik::datasource_geometry_t> get_geometry_type() const;
+private:
+    mapnik::datasource::datasource_t type_;
+    mapnik::layer_descriptor desc_;
+    std::string filename_;
+    mapnik::box2d<double> extent_;
+    mapnik::flatgeobuf::header header_;
+    std::uint64_t index_offset_;
+    std::uint64_t index_size_;
+    std::uint64_t features_offset_;
+};
+
+
+#endif // FLATGEOBUF_DATASOURCE_HPP
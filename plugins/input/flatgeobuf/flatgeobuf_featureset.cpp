@@ -0,0 +1,123 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/geometry/envelope.hpp>
+// stl
+#include <string>
+#include <vector>
+
+#include "flatgeobuf_featureset.hpp"
+
+namespace fgb = mapnik::flatgeobuf;
+
+flatgeobuf_featureset::flatgeobuf_featureset(std::string const& filename,
+                                             fgb::header const& header,
+                                             std::uint64_t features_offset,
+                                             mapnik::context_ptr const& ctx,
+                                             std::vector<bool> && selected,
+                                             array_type && index_array)
+    : file_(filename),
+      header_(header),
+      features_offset_(features_offset),
+      ctx_(ctx),
+      selected_(std::move(selected)),
+      index_array_(std::move(index_array)),
+      index_itr_(index_array_.begin()),
+      index_end_(index_array_.end()),
+      scan_(false),
+      box_(),
+      tr_("utf8")
+{
+    if (!file_.is_open()) throw std::runtime_error("Can't open " + filename);
+}
+
+flatgeobuf_featureset::flatgeobuf_featureset(std::string const& filename,
+                                             fgb::header const& header,
+                                             std::uint64_t features_offset,
+                                             mapnik::context_ptr const& ctx,
+                                             std::vector<bool> && selected,
+                                             mapnik::box2d<double> const& box)
+    : file_(filename),
+      header_(header),
+      features_offset_(features_offset),
+      ctx_(ctx),
+      selected_(std::move(selected)),
+      index_array_(),
+      index_itr_(index_array_.begin()),
+      index_end_(index_array_.end()),
+      scan_(true),
+      box_(box),
+      tr_("utf8")
+{
+    if (!file_.is_open()) throw std::runtime_error("Can't open " + filename);
+}
+
+flatgeobuf_featureset::~flatgeobuf_featureset() {}
+
+mapnik::feature_ptr flatgeobuf_featureset::next()
+{
+    while (true)
+    {
+        std::uint64_t offset;
+        std::uint64_t index;
+        if (scan_)
+        {
+            offset = scan_offset_;
+            index = scan_index_++;
+        }
+        else
+        {
+            if (index_itr_ == index_end_) break;
+            offset = index_itr_->offset;
+            index = index_itr_->index;
+            ++index_itr_;
+        }
+        char const* prefix = file_.read(features_offset_ + offset, 4);
+        if (prefix == nullptr) break;
+        std::uint32_t size = fgb::read_le<std::uint32_t>(prefix);
+        char const* data = file_.read(features_offset_ + offset + 4, size);
+        if (data == nullptr) break;
+        scan_offset_ = offset + 4 + size;
+
+        fgb::table feature = fgb::table::root(data, size);
+        mapnik::geometry::geometry<double> geom = feature.has(0)
+            ? fgb::read_geometry(feature.child(0), header_.type)
+            : mapnik::geometry::geometry_empty();
+        if (scan_)
+        {
+            mapnik::box2d<double> box = mapnik::geometry::envelope(geom);
+            if (!box.valid() || !box.intersects(box_)) continue;
+        }
+        mapnik::feature_ptr f(mapnik::feature_factory::create(ctx_, index + 1));
+        f->set_geometry(std::move(geom));
+        auto properties = feature.vector(1, 1);
+        if (properties.second > 0)
+        {
+            fgb::read_properties(*f, properties.first, properties.second, header_.columns, selected_, tr_);
+        }
+        return f;
+    }
+    return mapnik::feature_ptr();
+}
@@ -0,0 +1,71 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef FLATGEOBUF_FEATURESET_HPP
+#define FLATGEOBUF_FEATURESET_HPP
+
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include <mapnik/unicode.hpp>
+#include "flatgeobuf.hpp"
+
+#include <string>
+#include <vector>
+
+class flatgeobuf_featureset : public mapnik::Featureset
+{
+public:
+    using array_type = std::vector<mapnik::flatgeobuf::search_result>;
+    // reads the features listed in `index_array`
+    flatgeobuf_featureset(std::string const& filename,
+                          mapnik::flatgeobuf::header const& header,
+                          std::uint64_t features_offset,
+                          mapnik::context_ptr const& ctx,
+                          std::vector<bool> && selected,
+                          array_type && index_array);
+    // reads every feature in turn, skipping those outside `box` (files without an index)
+    flatgeobuf_featureset(std::string const& filename,
+                          mapnik::flatgeobuf::header const& header,
+                          std::uint64_t features_offset,
+                          mapnik::context_ptr const& ctx,
+                          std::vector<bool> && selected,
+                          mapnik::box2d<double> const& box);
+    virtual ~flatgeobuf_featureset();
+    mapnik::feature_ptr next();
+
+private:
+    mapnik::flatgeobuf::file_source file_;
+    mapnik::flatgeobuf::header const& header_;
+    std::uint64_t features_offset_;
+    mapnik::context_ptr ctx_;
+    std::vector<bool> selected_;
+    const array_type index_array_;
+    array_type::const_iterator index_itr_;
+    array_type::const_iterator index_end_;
+    bool scan_;
+    mapnik::box2d<double> box_;
+    std::uint64_t scan_offset_ = 0;
+    std::uint64_t scan_index_ = 0;
+    mapnik::transcoder tr_;
+};
+
+#endif // FLATGEOBUF_FEATURESET_HPP
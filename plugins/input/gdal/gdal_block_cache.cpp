@@ -0,0 +1,82 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#include "gdal_block_cache.hpp"
+
+// stl
+#include <mutex>
+
+gdal_block_cache::gdal_block_cache()
+    : cache_(0) {}
+
+gdal_block_cache::block_ptr gdal_block_cache::find(mapnik::util::file_stamp const& dataset, int band, int data_type,
+                                                   int block_x, int block_y)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    block_ptr const* block = cache_.find(key_type{dataset, band, data_type, block_x, block_y});
+    return block ? *block : block_ptr();
+}
+
+void gdal_block_cache::insert(mapnik::util::file_stamp const& dataset, int band, int data_type, int block_x, int block_y,
+                              block_ptr const& block)
+{
+    std::size_t size = block->size() + sizeof(key_type) + dataset.name.size();
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.insert(key_type{dataset, band, data_type, block_x, block_y}, block, size);
+}
+
+void gdal_block_cache::clear()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.clear();
+}
+
+void gdal_block_cache::set_max_bytes(std::size_t max_bytes)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.set_max_bytes(max_bytes);
+}
+
+std::size_t gdal_block_cache::max_bytes() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.max_bytes();
+}
+
+mapnik::util::lru_cache_stats gdal_block_cache::stats() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.stats();
+}
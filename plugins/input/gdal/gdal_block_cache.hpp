@@ -0,0 +1,89 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef GDAL_BLOCK_CACHE_HPP
+#define GDAL_BLOCK_CACHE_HPP
+
+// mapnik
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+// stl
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Process wide cache of decoded GDAL raster blocks, shared by all gdal
+// datasources and featuresets. Blocks are keyed by dataset file stamp,
+// band, buffer data type and block column/row, and hold the pixels of one
+// internal block converted to the buffer data type.
+class gdal_block_cache :
+        public mapnik::singleton<gdal_block_cache, mapnik::CreateStatic>,
+        private mapnik::util::noncopyable
+{
+    friend class mapnik::CreateStatic<gdal_block_cache>;
+public:
+    using block_ptr = std::shared_ptr<std::vector<std::uint8_t> const>;
+
+    block_ptr find(mapnik::util::file_stamp const& dataset, int band, int data_type, int block_x, int block_y);
+    void insert(mapnik::util::file_stamp const& dataset, int band, int data_type, int block_x, int block_y,
+                block_ptr const& block);
+    void clear();
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+    mapnik::util::lru_cache_stats stats() const;
+
+private:
+    struct key_type
+    {
+        mapnik::util::file_stamp dataset;
+        int band;
+        int data_type;
+        int block_x;
+        int block_y;
+        bool operator==(key_type const& rhs) const
+        {
+            return block_x == rhs.block_x && block_y == rhs.block_y &&
+                band == rhs.band && data_type == rhs.data_type &&
+                dataset == rhs.dataset;
+        }
+    };
+    struct key_hash
+    {
+        std::size_t operator()(key_type const& key) const
+        {
+            std::size_t seed = key.dataset.hash();
+            for (int value : { key.band, key.data_type, key.block_x, key.block_y })
+            {
+                mapnik::util::hash_combine(seed, std::hash<int>()(value));
+            }
+            return seed;
+        }
+    };
+    gdal_block_cache();
+    mapnik::util::lru_cache<key_type, block_ptr, key_hash> cache_;
+};
+
+#endif // GDAL_BLOCK_CACHE_HPP
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef GDAL_DATASET_POOL_HPP
+#define GDAL_DATASET_POOL_HPP
+
+// mapnik
+#include <mapnik/pool.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <memory>
+#include <string>
+
+// gdal
+#include <gdal_priv.h>
+#include <gdal_version.h>
+
+// An open GDALDataset. A dataset must not be read from more than one
+// thread at a time, so each featureset borrows its own handle from the
+// datasource's pool for as long as it lives. Pooled handles are never
+// opened shared: GDALOpenShared hands every caller on a thread the same
+// dataset, which would defeat the pool.
+class gdal_dataset_handle : private mapnik::util::noncopyable
+{
+public:
+    explicit gdal_dataset_handle(std::string const& dataset_name, bool shared = false)
+        : dataset_(nullptr, &GDALClose)
+    {
+#if GDAL_VERSION_NUM >= 1600
+        if (shared)
+        {
+            dataset_.reset(static_cast<GDALDataset*>(GDALOpenShared(dataset_name.c_str(), GA_ReadOnly)));
+        }
+        else
+#endif
+        {
+            dataset_.reset(static_cast<GDALDataset*>(GDALOpen(dataset_name.c_str(), GA_ReadOnly)));
+        }
+    }
+
+    bool isOK() const
+    {
+        return dataset_ != nullptr;
+    }
+
+    GDALDataset * get() const
+    {
+        return dataset_.get();
+    }
+
+private:
+    std::unique_ptr<GDALDataset, decltype(&GDALClose)> dataset_;
+};
+
+template <typename T>
+class gdal_dataset_creator
+{
+public:
+    explicit gdal_dataset_creator(std::string const& dataset_name)
+        : dataset_name_(dataset_name) {}
+
+    T* operator()() const
+    {
+        return new T(dataset_name_);
+    }
+
+private:
+    std::string dataset_name_;
+};
+
+using gdal_dataset_pool = mapnik::Pool<gdal_dataset_handle, gdal_dataset_creator>;
+
+#endif // GDAL_DATASET_POOL_HPP
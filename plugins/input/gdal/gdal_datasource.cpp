@@ -22,6 +22,7 @@
 
 #include "gdal_datasource.hpp"
 #include "gdal_featureset.hpp"
+#include "gdal_block_cache.hpp"
 
 // mapnik
 #include <mapnik/debug.hpp>
@@ -29,10 +30,19 @@
 #include <mapnik/geom_util.hpp>
 #include <mapnik/timer.hpp>
 #include <mapnik/value/types.hpp>
+#include <mapnik/util/fs.hpp>
+#include <mapnik/util/noncopyable.hpp>
 
 #include <gdal_version.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
 #include <mutex>
+#include <sstream>
+#include <vector>
 
 using mapnik::datasource;
 using mapnik::parameters;
@@ -48,6 +58,162 @@ using mapnik::datasource_exception;
 
 static std::once_flag once_flag;
 
+namespace {
+
+#ifdef MAPNIK_THREADSAFE
+std::mutex overview_mutex;
+#endif
+
+// size and modification time of the dataset an .ovr file is built from,
+// recorded next to it in a .ovr.src file
+std::string source_stamp(std::string const& dataset_name)
+{
+    std::ostringstream stamp;
+    stamp << mapnik::util::file_size(dataset_name) << " " << mapnik::util::last_write_time(dataset_name);
+    return stamp.str();
+}
+
+// Exclusive right to write the overviews of a dataset, shared with other
+// processes through a .ovr.lock file next to it. Locks older than an hour
+// are taken to be left behind by a process that died while building.
+class overview_lock : private mapnik::util::noncopyable
+{
+public:
+    explicit overview_lock(std::string const& dataset_name)
+        : filename_(dataset_name + ".ovr.lock"),
+          locked_(acquire()) {}
+
+    ~overview_lock()
+    {
+        if (locked_) mapnik::util::remove(filename_);
+    }
+
+    explicit operator bool() const
+    {
+        return locked_;
+    }
+
+private:
+    bool create() const
+    {
+        std::FILE * file = std::fopen(filename_.c_str(), "wx");
+        if (file == nullptr) return false;
+        std::fclose(file);
+        return true;
+    }
+
+    bool acquire() const
+    {
+        if (create()) return true;
+        std::int64_t const now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::int64_t const time = mapnik::util::last_write_time(filename_);
+        if (time == 0 || now - time < std::int64_t(3600) * 1000000000) return false;
+        MAPNIK_LOG_WARN(gdal) << "gdal_datasource: Removing abandoned lock " << filename_;
+        mapnik::util::remove(filename_);
+        return create();
+    }
+
+    std::string filename_;
+    bool locked_;
+};
+
+// An external .ovr file built from a previous version of its dataset would
+// be picked up by GDAL all the same. Only files built here, which have their
+// source stamp recorded, are removed; others belong to whoever made them.
+void remove_stale_overviews(std::string const& dataset_name)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(overview_mutex);
+#endif
+    std::string ovr = dataset_name + ".ovr";
+    std::string src = ovr + ".src";
+    if (!mapnik::util::exists(ovr)) return;
+    if (!mapnik::util::exists(src))
+    {
+        if (mapnik::util::last_write_time(ovr) < mapnik::util::last_write_time(dataset_name))
+        {
+            MAPNIK_LOG_WARN(gdal) << "gdal_datasource: " << ovr << " is older than its dataset"
+                                  << " but was not built by mapnik, leaving it in place";
+        }
+        return;
+    }
+    std::string stamp;
+    {
+        std::ifstream file(src.c_str());
+        std::getline(file, stamp);
+    }
+    if (stamp == source_stamp(dataset_name)) return;
+    overview_lock building(dataset_name);
+    if (!building)
+    {
+        MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: " << ovr << " is locked, not removing it";
+        return;
+    }
+    MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: Removing stale overviews " << ovr;
+    mapnik::util::remove(src);
+    mapnik::util::remove(ovr);
+}
+
+// Builds overviews for a dataset that has none, halving it until it fits
+// into 256 pixels. Datasets opened read-only get them in an external,
+// tiled .ovr file next to the dataset, which GDAL picks up from then on.
+// Only one process builds them at a time, the others go without.
+void build_overviews(GDALDataset & dataset, std::string const& dataset_name, std::string const& resampling)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(overview_mutex);
+#endif
+    if (dataset.GetRasterCount() == 0 || dataset.GetRasterBand(1)->GetOverviewCount() > 0) return;
+    std::vector<int> factors;
+    int size = std::max(dataset.GetRasterXSize(), dataset.GetRasterYSize());
+    for (int factor = 2; size > 256; factor *= 2)
+    {
+        factors.push_back(factor);
+        size = (size + 1) / 2;
+    }
+    if (factors.empty()) return;
+
+    std::string ovr = dataset_name + ".ovr";
+    overview_lock building(dataset_name);
+    if (!building)
+    {
+        MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: " << ovr << " is being built by another process";
+        return;
+    }
+    if (mapnik::util::exists(ovr))
+    {
+        // written since the dataset was opened
+        return;
+    }
+
+    MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: Building " << factors.size() << " overviews";
+
+    std::string const stamp = source_stamp(dataset_name);
+    if (dataset.BuildOverviews(resampling.c_str(), static_cast<int>(factors.size()), factors.data(),
+                               0, nullptr, GDALDummyProgress, nullptr) == CE_Failure)
+    {
+        MAPNIK_LOG_WARN(gdal) << "gdal_datasource: failed to build overviews: " << CPLGetLastErrorMsg();
+        mapnik::util::remove(ovr);
+        return;
+    }
+    if (mapnik::util::exists(ovr))
+    {
+        std::string src = ovr + ".src";
+        std::string tmp = mapnik::util::unique_path(src);
+        {
+            std::ofstream file(tmp.c_str());
+            file << stamp << "\n";
+        }
+        if (!mapnik::util::rename(tmp, src))
+        {
+            mapnik::util::remove(tmp);
+        }
+    }
+}
+
+}
+
 extern "C" MAPNIK_EXP void on_plugin_load()
 {
     // initialize gdal formats
@@ -58,10 +224,10 @@ extern "C" MAPNIK_EXP void on_plugin_load()
 
 gdal_datasource::gdal_datasource(parameters const& params)
     : datasource(params),
-      dataset_(nullptr, &GDALClose),
       desc_(gdal_datasource::name(), "utf-8"),
       nodata_value_(params.get<double>("nodata")),
-      nodata_tolerance_(*params.get<double>("nodata_tolerance",1e-12))
+      nodata_tolerance_(*params.get<double>("nodata_tolerance",1e-12)),
+      block_cache_size_(*params.get<mapnik::value_integer>("block_cache_size", 0))
 {
     MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: Initializing...";
 
@@ -82,7 +248,6 @@ gdal_datasource::gdal_datasource(parameters const& params)
         dataset_name_ = *file;
     }
 
-    shared_dataset_ = *params.get<mapnik::boolean_type>("shared", false);
     band_ = *params.get<mapnik::value_integer>("band", -1);
     
     // Maximum memory limitation for image will be simply based on the maximum
@@ -92,29 +257,43 @@ gdal_datasource::gdal_datasource(parameters const& params)
     // max_im_area based on 50 mb limit for RGBA
     max_image_area_ = *params.get<mapnik::value_integer>("max_image_area", (50*1024*1024) / 4);
 
-#if GDAL_VERSION_NUM >= 1600
-    if (shared_dataset_)
+    // GDAL datasets are not thread safe: every featureset reads through its
+    // own handle, and up to dataset_pool_size handles are kept open for reuse
+    mapnik::value_integer pool_size = *params.get<mapnik::value_integer>("dataset_pool_size", 1);
+    if (pool_size < 1)
     {
-        auto ds = GDALOpenShared(dataset_name_.c_str(), GA_ReadOnly);
-        dataset_.reset(static_cast<GDALDataset*>(ds));
+        throw datasource_exception("GDAL Plugin: dataset_pool_size must be at least 1");
     }
-    else
-#endif
+    pool_ = std::make_unique<gdal_dataset_pool>(gdal_dataset_creator<gdal_dataset_handle>(dataset_name_),
+                                                0, static_cast<unsigned>(pool_size));
+
+    bool const overviews = *params.get<mapnik::boolean_type>("build_overviews", false);
+    if (overviews)
     {
-        auto ds = GDALOpen(dataset_name_.c_str(), GA_ReadOnly);
-        dataset_.reset(static_cast<GDALDataset*>(ds));
+        remove_stale_overviews(dataset_name_);
     }
 
-    if (! dataset_)
+    // metadata is read through a handle of its own, the only one `shared` applies to
+    gdal_dataset_handle handle(dataset_name_, *params.get<mapnik::boolean_type>("shared", false));
+    if (!handle.isOK())
     {
         throw datasource_exception(CPLGetLastErrorMsg());
     }
+    GDALDataset * dataset = handle.get();
 
-    MAPNIK_LOG_DEBUG(gdal) << "gdal_featureset: opened Dataset=" << dataset_.get();
+    MAPNIK_LOG_DEBUG(gdal) << "gdal_featureset: opened Dataset=" << dataset;
 
-    nbands_ = dataset_->GetRasterCount();
-    width_ = dataset_->GetRasterXSize();
-    height_ = dataset_->GetRasterYSize();
+    if (block_cache_size_ > 0)
+    {
+        // the cache is shared, the largest size any datasource asks for wins
+        gdal_block_cache & cache = gdal_block_cache::instance();
+        std::size_t max_bytes = static_cast<std::size_t>(block_cache_size_);
+        if (max_bytes > cache.max_bytes()) cache.set_max_bytes(max_bytes);
+    }
+
+    nbands_ = dataset->GetRasterCount();
+    width_ = dataset->GetRasterXSize();
+    height_ = dataset->GetRasterYSize();
     desc_.add_descriptor(mapnik::attribute_descriptor("nodata", mapnik::Double));
 
     double tr[6];
@@ -146,7 +325,7 @@ gdal_datasource::gdal_datasource(parameters const& params)
     }
     else
     {
-        if (dataset_->GetGeoTransform(tr) != CPLE_None)
+        if (dataset->GetGeoTransform(tr) != CPLE_None)
         {
             MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource GetGeotransform failure gives="
                                    << tr[0] << "," << tr[1] << ","
@@ -196,11 +375,40 @@ gdal_datasource::gdal_datasource(parameters const& params)
     MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: Raster Size=" << width_ << "," << height_;
     MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: Raster Extent=" << extent_;
 
+    // low zoom queries otherwise read and scale down full resolution pixels
+    if (overviews)
+    {
+        build_overviews(*dataset, dataset_name_, *params.get<std::string>("overview_resampling", "AVERAGE"));
+    }
+
 }
 
 gdal_datasource::~gdal_datasource()
 {
-    MAPNIK_LOG_DEBUG(gdal) << "gdal_featureset: Closing Dataset=" << dataset_.get();
+    if (block_cache_size_ > 0)
+    {
+        mapnik::util::lru_cache_stats stats = gdal_block_cache::instance().stats();
+        MAPNIK_LOG_DEBUG(gdal) << "gdal_datasource: Block cache hits=" << stats.hits
+                               << " misses=" << stats.misses << " entries=" << stats.entries
+                               << " bytes=" << stats.bytes << " evictions=" << stats.evictions;
+    }
+}
+
+std::shared_ptr<GDALDataset> gdal_datasource::borrow_dataset() const
+{
+    std::shared_ptr<gdal_dataset_handle> handle = pool_->borrowObject();
+    if (!handle)
+    {
+        // every pooled handle is in use: read through a handle of our own,
+        // closed again once the featureset is done with it
+        handle = std::make_shared<gdal_dataset_handle>(dataset_name_);
+        if (!handle->isOK())
+        {
+            throw datasource_exception(CPLGetLastErrorMsg());
+        }
+    }
+    // keeps the pooled handle borrowed for as long as the dataset is referenced
+    return std::shared_ptr<GDALDataset>(handle, handle->get());
 }
 
 datasource::datasource_t gdal_datasource::type() const
@@ -225,7 +433,16 @@ boost::optional<mapnik::datasource_geometry_t> gdal_datasource::get_geometry_typ
 
 layer_descriptor gdal_datasource::get_descriptor() const
 {
-    return desc_;
+    if (block_cache_size_ <= 0) return desc_;
+    // counters of the block cache, which all gdal layers share
+    layer_descriptor desc(desc_);
+    mapnik::util::lru_cache_stats stats = gdal_block_cache::instance().stats();
+    mapnik::parameters & extra_params = desc.get_extra_parameters();
+    extra_params["block_cache_hits"] = mapnik::value_integer(stats.hits);
+    extra_params["block_cache_misses"] = mapnik::value_integer(stats.misses);
+    extra_params["block_cache_entries"] = mapnik::value_integer(stats.entries);
+    extra_params["block_cache_bytes"] = mapnik::value_integer(stats.bytes);
+    return desc;
 }
 
 featureset_ptr gdal_datasource::features(query const& q) const
@@ -234,7 +451,8 @@ featureset_ptr gdal_datasource::features(query const& q) const
     mapnik::progress_timer __stats__(std::clog, "gdal_datasource::features");
 #endif
 
-    return std::make_shared<gdal_featureset>(*dataset_,
+    return std::make_shared<gdal_featureset>(borrow_dataset(),
+                                              dataset_name_,
                                               band_,
                                               gdal_query(q),
                                               extent_,
@@ -245,7 +463,8 @@ featureset_ptr gdal_datasource::features(query const& q) const
                                               dy_,
                                               nodata_value_,
                                               nodata_tolerance_,
-                                              max_image_area_);
+                                              max_image_area_,
+                                              block_cache_size_ > 0);
 }
 
 featureset_ptr gdal_datasource::features_at_point(coord2d const& pt, double tol) const
@@ -254,7 +473,8 @@ featureset_ptr gdal_datasource::features_at_point(coord2d const& pt, double tol)
     mapnik::progress_timer __stats__(std::clog, "gdal_datasource::features_at_point");
 #endif
 
-    return std::make_shared<gdal_featureset>(*dataset_,
+    return std::make_shared<gdal_featureset>(borrow_dataset(),
+                                              dataset_name_,
                                               band_,
                                               gdal_query(pt),
                                               extent_,
@@ -265,5 +485,6 @@ featureset_ptr gdal_datasource::features_at_point(coord2d const& pt, double tol)
                                               dy_,
                                               nodata_value_,
                                               nodata_tolerance_,
-                                              max_image_area_);
+                                              max_image_area_,
+                                              block_cache_size_ > 0);
 }
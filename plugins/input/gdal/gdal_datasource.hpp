@@ -42,6 +42,8 @@
 // gdal
 #include <gdal_priv.h>
 
+#include "gdal_dataset_pool.hpp"
+
 class gdal_datasource : public mapnik::datasource
 {
 public:
@@ -55,7 +57,8 @@ public:
     boost::optional<mapnik::datasource_geometry_t> get_geometry_type() const;
     mapnik::layer_descriptor get_descriptor() const;
 private:
-    std::unique_ptr<GDALDataset, decltype(&GDALClose)> dataset_;
+    std::shared_ptr<GDALDataset> borrow_dataset() const;
+    std::unique_ptr<gdal_dataset_pool> pool_;
     mapnik::box2d<double> extent_;
     std::string dataset_name_;
     int band_;
@@ -65,10 +68,10 @@ private:
     double dx_;
     double dy_;
     int nbands_;
-    bool shared_dataset_;
     boost::optional<double> nodata_value_;
     double nodata_tolerance_;
     int64_t max_image_area_;
+    mapnik::value_integer block_cache_size_;
 };
 
 #endif // GDAL_DATASOURCE_HPP
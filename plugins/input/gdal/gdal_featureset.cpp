@@ -31,11 +31,16 @@
 #include <mapnik/feature_factory.hpp>
 
 // stl
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <sstream>
+#include <vector>
 
 #include "gdal_featureset.hpp"
+#include "gdal_block_cache.hpp"
 #include <gdal_priv.h>
 
 using mapnik::box2d;
@@ -79,7 +84,95 @@ void get_overview_meta(GDALRasterBand* band)
 }
 } // anonymous ns
 #endif
-gdal_featureset::gdal_featureset(GDALDataset& dataset,
+
+namespace {
+
+// Reads a window of a band into buffer. With the block cache enabled,
+// windows read at native resolution are assembled from whole internal
+// blocks (GetBlockSize) kept in gdal_block_cache, so neighbouring tiles
+// decode each block only once. Resampled reads are left to GDAL.
+struct band_reader
+{
+    mapnik::util::file_stamp const& dataset;
+    bool block_cache;
+
+    CPLErr operator()(GDALRasterBand * band, int x_off, int y_off, int width, int height,
+                      void * buffer, int buf_width, int buf_height, GDALDataType buf_type,
+                      int pixel_space, int line_space) const
+    {
+        int block_width = 0;
+        int block_height = 0;
+        int type_size = GDALGetDataTypeSize(buf_type) / 8;
+        gdal_block_cache & cache = gdal_block_cache::instance();
+        if (block_cache && buf_width == width && buf_height == height)
+        {
+            band->GetBlockSize(&block_width, &block_height);
+            if (static_cast<std::size_t>(block_width) * block_height * type_size > cache.max_bytes())
+            {
+                block_width = 0;
+            }
+        }
+        if (block_width <= 0 || block_height <= 0)
+        {
+            return band->RasterIO(GF_Read, x_off, y_off, width, height,
+                                  buffer, buf_width, buf_height, buf_type, pixel_space, line_space);
+        }
+        if (pixel_space == 0) pixel_space = type_size;
+        if (line_space == 0) line_space = pixel_space * buf_width;
+        int raster_width = band->GetXSize();
+        int raster_height = band->GetYSize();
+        for (int block_y = y_off / block_height; block_y * block_height < y_off + height; ++block_y)
+        {
+            for (int block_x = x_off / block_width; block_x * block_width < x_off + width; ++block_x)
+            {
+                // blocks on the right and bottom edges are partial
+                int block_x_off = block_x * block_width;
+                int block_y_off = block_y * block_height;
+                int block_w = std::min(block_width, raster_width - block_x_off);
+                int block_h = std::min(block_height, raster_height - block_y_off);
+                gdal_block_cache::block_ptr block = cache.find(dataset, band->GetBand(), buf_type, block_x, block_y);
+                if (!block)
+                {
+                    auto data = std::make_shared<std::vector<std::uint8_t>>(
+                        static_cast<std::size_t>(block_w) * block_h * type_size);
+                    CPLErr err = band->RasterIO(GF_Read, block_x_off, block_y_off, block_w, block_h,
+                                                data->data(), block_w, block_h, buf_type, 0, 0);
+                    if (err == CE_Failure) return err;
+                    block = data;
+                    cache.insert(dataset, band->GetBand(), buf_type, block_x, block_y, block);
+                }
+                int x0 = std::max(x_off, block_x_off);
+                int x1 = std::min(x_off + width, block_x_off + block_w);
+                int y0 = std::max(y_off, block_y_off);
+                int y1 = std::min(y_off + height, block_y_off + block_h);
+                for (int y = y0; y < y1; ++y)
+                {
+                    std::uint8_t const* src = block->data() +
+                        (static_cast<std::size_t>(y - block_y_off) * block_w + (x0 - block_x_off)) * type_size;
+                    std::uint8_t * dst = static_cast<std::uint8_t*>(buffer) +
+                        static_cast<std::ptrdiff_t>(y - y_off) * line_space + static_cast<std::ptrdiff_t>(x0 - x_off) * pixel_space;
+                    if (pixel_space == type_size)
+                    {
+                        std::memcpy(dst, src, static_cast<std::size_t>(x1 - x0) * type_size);
+                    }
+                    else
+                    {
+                        for (int x = x0; x < x1; ++x, src += type_size, dst += pixel_space)
+                        {
+                            std::memcpy(dst, src, type_size);
+                        }
+                    }
+                }
+            }
+        }
+        return CE_None;
+    }
+};
+
+} // anonymous ns
+
+gdal_featureset::gdal_featureset(std::shared_ptr<GDALDataset> const& dataset,
+                                 std::string const& dataset_name,
                                  int band,
                                  gdal_query q,
                                  mapnik::box2d<double> extent,
@@ -90,8 +183,11 @@ gdal_featureset::gdal_featureset(GDALDataset& dataset,
                                  double dy,
                                  boost::optional<double> const& nodata,
                                  double nodata_tolerance,
-                                 int64_t max_image_area)
-    : dataset_(dataset),
+                                 int64_t max_image_area,
+                                 bool block_cache)
+    : dataset_ptr_(dataset),
+      dataset_(*dataset_ptr_),
+      dataset_name_(dataset_name),
       ctx_(std::make_shared<mapnik::context_type>()),
       band_(band),
       gquery_(q),
@@ -104,6 +200,8 @@ gdal_featureset::gdal_featureset(GDALDataset& dataset,
       nodata_value_(nodata),
       nodata_tolerance_(nodata_tolerance),
       max_image_area_(max_image_area),
+      block_cache_(block_cache),
+      dataset_key_(block_cache ? mapnik::util::file_stamp::of(dataset_name) : mapnik::util::file_stamp()),
       first_(true)
 {
     ctx_->push("nodata");
@@ -135,6 +233,7 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
     GDALRasterBand * alpha = 0;
     GDALRasterBand * grey = 0;
     CPLErr raster_io_error = CE_None;
+    band_reader read_band{dataset_key_, block_cache_};
 
     /*
 #ifdef MAPNIK_LOG
@@ -339,9 +438,9 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                 mapnik::image_gray8 image(im_width, im_height);
                 image.set(std::numeric_limits<std::uint8_t>::max());
                 raster_nodata = band->GetNoDataValue(&raster_has_nodata);
-                raster_io_error = band->RasterIO(GF_Read, x_off, y_off, width, height,
-                                                 image.data(), image.width(), image.height(),
-                                                 GDT_Byte, 0, 0);
+                raster_io_error = read_band(band, x_off, y_off, width, height,
+                                            image.data(), image.width(), image.height(),
+                                            GDT_Byte, 0, 0);
                 if (raster_io_error == CE_Failure)
                 {
                     throw datasource_exception(CPLGetLastErrorMsg());
@@ -359,9 +458,9 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                 mapnik::image_gray32f image(im_width, im_height);
                 image.set(std::numeric_limits<float>::max());
                 raster_nodata = band->GetNoDataValue(&raster_has_nodata);
-                raster_io_error = band->RasterIO(GF_Read, x_off, y_off, width, height,
-                                                 image.data(), image.width(), image.height(),
-                                                 GDT_Float32, 0, 0);
+                raster_io_error = read_band(band, x_off, y_off, width, height,
+                                            image.data(), image.width(), image.height(),
+                                            GDT_Float32, 0, 0);
                 if (raster_io_error == CE_Failure)
                 {
                     throw datasource_exception(CPLGetLastErrorMsg());
@@ -378,9 +477,9 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                 mapnik::image_gray16 image(im_width, im_height);
                 image.set(std::numeric_limits<std::uint16_t>::max());
                 raster_nodata = band->GetNoDataValue(&raster_has_nodata);
-                raster_io_error = band->RasterIO(GF_Read, x_off, y_off, width, height,
-                                                 image.data(), image.width(), image.height(),
-                                                 GDT_UInt16, 0, 0);
+                raster_io_error = read_band(band, x_off, y_off, width, height,
+                                            image.data(), image.width(), image.height(),
+                                            GDT_UInt16, 0, 0);
                 if (raster_io_error == CE_Failure)
                 {
                     throw datasource_exception(CPLGetLastErrorMsg());
@@ -398,9 +497,9 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                 mapnik::image_gray16s image(im_width, im_height);
                 image.set(std::numeric_limits<std::int16_t>::max());
                 raster_nodata = band->GetNoDataValue(&raster_has_nodata);
-                raster_io_error = band->RasterIO(GF_Read, x_off, y_off, width, height,
-                                                 image.data(), image.width(), image.height(),
-                                                 GDT_Int16, 0, 0);
+                raster_io_error = read_band(band, x_off, y_off, width, height,
+                                            image.data(), image.width(), image.height(),
+                                            GDT_Int16, 0, 0);
                 if (raster_io_error == CE_Failure)
                 {
                     throw datasource_exception(CPLGetLastErrorMsg());
@@ -507,9 +606,9 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                     // TODO - we assume here the nodata value for the red band applies to all bands
                     // more details about this at http://trac.osgeo.org/gdal/ticket/2734
                     float* imageData = (float*)image.bytes();
-                    raster_io_error = red->RasterIO(GF_Read, x_off, y_off, width, height,
-                                                    imageData, image.width(), image.height(),
-                                                    GDT_Float32, 0, 0);
+                    raster_io_error = read_band(red, x_off, y_off, width, height,
+                                                imageData, image.width(), image.height(),
+                                                GDT_Float32, 0, 0);
                     if (raster_io_error == CE_Failure) {
                         throw datasource_exception(CPLGetLastErrorMsg());
                     }
@@ -536,29 +635,42 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                         nBandsToRead = 4;
                         alpha = nullptr; // to avoid reading it again afterwards
                     }
-                    raster_io_error = dataset_.RasterIO(GF_Read, x_off, y_off, width, height,
-                                                        image.bytes(),
-                                                        image.width(), image.height(), GDT_Byte,
-                                                        nBandsToRead, nullptr,
-                                                        4, 4 * image.width(), 1);
+                    if (block_cache_ && width == (int)image.width() && height == (int)image.height())
+                    {
+                        // interleave the cached blocks of each band
+                        for (int i = 0; i < nBandsToRead && raster_io_error != CE_Failure; ++i)
+                        {
+                            raster_io_error = read_band(dataset_.GetRasterBand(i + 1), x_off, y_off, width, height,
+                                                        image.bytes() + i, image.width(), image.height(), GDT_Byte,
+                                                        4, 4 * image.width());
+                        }
+                    }
+                    else
+                    {
+                        raster_io_error = dataset_.RasterIO(GF_Read, x_off, y_off, width, height,
+                                                            image.bytes(),
+                                                            image.width(), image.height(), GDT_Byte,
+                                                            nBandsToRead, nullptr,
+                                                            4, 4 * image.width(), 1);
+                    }
                     if (raster_io_error == CE_Failure) {
                         throw datasource_exception(CPLGetLastErrorMsg());
                     }
                 }
                 else
                 {
-                    raster_io_error = red->RasterIO(GF_Read, x_off, y_off, width, height, image.bytes() + 0,
-                                                    image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                    raster_io_error = read_band(red, x_off, y_off, width, height, image.bytes() + 0,
+                                                image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
                     if (raster_io_error == CE_Failure) {
                         throw datasource_exception(CPLGetLastErrorMsg());
                     }
-                    raster_io_error = green->RasterIO(GF_Read, x_off, y_off, width, height, image.bytes() + 1,
-                                                    image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                    raster_io_error = read_band(green, x_off, y_off, width, height, image.bytes() + 1,
+                                                image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
                     if (raster_io_error == CE_Failure) {
                         throw datasource_exception(CPLGetLastErrorMsg());
                     }
-                    raster_io_error = blue->RasterIO(GF_Read, x_off, y_off, width, height, image.bytes() + 2,
-                                                    image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                    raster_io_error = read_band(blue, x_off, y_off, width, height, image.bytes() + 2,
+                                                image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
                     if (raster_io_error == CE_Failure) {
                         throw datasource_exception(CPLGetLastErrorMsg());
                     }
@@ -596,9 +708,9 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                     MAPNIK_LOG_DEBUG(gdal) << "gdal_featureset: applying nodata value for layer=" << apply_nodata;
                     // first read the data in and create an alpha channel from the nodata values
                     float* imageData = (float*)image.bytes();
-                    raster_io_error = grey->RasterIO(GF_Read, x_off, y_off, width, height,
-                                                     imageData, image.width(), image.height(),
-                                                     GDT_Float32, 0, 0);
+                    raster_io_error = read_band(grey, x_off, y_off, width, height,
+                                                imageData, image.width(), image.height(),
+                                                GDT_Float32, 0, 0);
                     if (raster_io_error == CE_Failure)
                     {
                         throw datasource_exception(CPLGetLastErrorMsg());
@@ -617,22 +729,22 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                     }
                 }
 
-                raster_io_error = grey->RasterIO(GF_Read, x_off, y_off, width, height, image.bytes() + 0,
-                                                 image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                raster_io_error = read_band(grey, x_off, y_off, width, height, image.bytes() + 0,
+                                            image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
                 if (raster_io_error == CE_Failure)
                 {
                     throw datasource_exception(CPLGetLastErrorMsg());
                 }
 
-                raster_io_error = grey->RasterIO(GF_Read,x_off, y_off, width, height, image.bytes() + 1,
-                                                 image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                raster_io_error = read_band(grey, x_off, y_off, width, height, image.bytes() + 1,
+                                            image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
                 if (raster_io_error == CE_Failure)
                 {
                     throw datasource_exception(CPLGetLastErrorMsg());
                 }
 
-                raster_io_error = grey->RasterIO(GF_Read,x_off, y_off, width, height, image.bytes() + 2,
-                                                 image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                raster_io_error = read_band(grey, x_off, y_off, width, height, image.bytes() + 2,
+                                            image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
 
                 if (raster_io_error == CE_Failure)
                 {
@@ -668,8 +780,8 @@ feature_ptr gdal_featureset::get_feature(mapnik::query const& q)
                 MAPNIK_LOG_DEBUG(gdal) << "gdal_featureset: processing alpha band...";
                 if (!raster_has_nodata || (red && green && blue))
                 {
-                    raster_io_error = alpha->RasterIO(GF_Read, x_off, y_off, width, height, image.bytes() + 3,
-                                                      image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
+                    raster_io_error = read_band(alpha, x_off, y_off, width, height, image.bytes() + 3,
+                                                image.width(), image.height(), GDT_Byte, 4, 4 * image.width());
                     if (raster_io_error == CE_Failure) {
                         throw datasource_exception(CPLGetLastErrorMsg());
                     }
@@ -27,8 +27,14 @@
 #include <mapnik/featureset.hpp>
 #include <mapnik/query.hpp>
 #include <mapnik/util/variant.hpp>
+
+#include "gdal_block_cache.hpp"
+
 // boost
 #include <boost/optional.hpp>
+// stl
+#include <memory>
+#include <string>
 
 class GDALDataset;
 class GDALRasterBand;
@@ -56,7 +62,8 @@ class gdal_featureset : public mapnik::Featureset
     };
 
 public:
-    gdal_featureset(GDALDataset& dataset,
+    gdal_featureset(std::shared_ptr<GDALDataset> const& dataset,
+                    std::string const& dataset_name,
                     int band,
                     gdal_query q,
                     mapnik::box2d<double> extent,
@@ -67,14 +74,17 @@ public:
                     double dy,
                     boost::optional<double> const& nodata,
                     double nodata_tolerance,
-                    int64_t max_image_area);
+                    int64_t max_image_area,
+                    bool block_cache);
     virtual ~gdal_featureset();
     mapnik::feature_ptr next();
 
 private:
     mapnik::feature_ptr get_feature(mapnik::query const& q);
     mapnik::feature_ptr get_feature_at_point(mapnik::coord2d const& p);
+    std::shared_ptr<GDALDataset> dataset_ptr_;
     GDALDataset & dataset_;
+    std::string dataset_name_;
     mapnik::context_ptr ctx_;
     int band_;
     gdal_query gquery_;
@@ -87,6 +97,8 @@ private:
     boost::optional<double> nodata_value_;
     double nodata_tolerance_;
     int64_t max_image_area_;
+    bool block_cache_;
+    mapnik::util::file_stamp dataset_key_;
     bool first_;
 };
 
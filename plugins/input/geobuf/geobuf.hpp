@@ -28,6 +28,7 @@
 #include <mapnik/unicode.hpp>
 #include <mapnik/feature.hpp>
 #include <mapnik/feature_factory.hpp>
+#include <mapnik/geometry/envelope.hpp>
 #include <mapnik/util/noncopyable.hpp>
 #include <cmath>
 #include <cassert>
@@ -87,6 +88,7 @@ struct geobuf : util::noncopyable
     std::vector<std::string> keys_;
     std::vector<value_type> values_;
     protozero::pbf_reader reader_;
+    char const* begin_;
     FeatureCallback & callback_;
     context_ptr ctx_;
     const std::unique_ptr<transcoder> tr_;
@@ -94,6 +96,7 @@ public:
     //ctor
     geobuf (char const* buf, std::size_t size, FeatureCallback & callback)
         : reader_(buf, size),
+          begin_(buf),
           callback_(callback),
           ctx_(std::make_shared<context_type>()),
           tr_(new transcoder("utf8")) {}
@@ -149,8 +152,99 @@ public:
         }
     }
 
+    // Reads the keys, dimensions and precision that precede the data,
+    // returns false if the buffer ends before the data starts
+    bool read_header()
+    {
+        while (reader_.next())
+        {
+            switch (reader_.tag())
+            {
+            case 1:
+                keys_.push_back(reader_.get_string());
+                break;
+            case 2:
+                dim = reader_.get_uint32();
+                break;
+            case 3:
+                precision = std::pow(10,reader_.get_uint32());
+                break;
+            case 4:
+            case 5:
+            case 6:
+                return true;
+            default:
+                reader_.skip();
+                break;
+            }
+        }
+        return false;
+    }
+
+    // Locates every Feature without decoding its properties, calling
+    // callback_(bbox, offset, size) with the position of the message in the buffer
+    void read_index()
+    {
+        while (reader_.next())
+        {
+            switch (reader_.tag())
+            {
+            case 1:
+                keys_.push_back(reader_.get_string());
+                break;
+            case 2:
+                dim = reader_.get_uint32();
+                break;
+            case 3:
+                precision = std::pow(10,reader_.get_uint32());
+                break;
+            case 4:
+            {
+                auto feature_collection = reader_.get_message();
+                while (feature_collection.next())
+                {
+                    if (feature_collection.tag() == 1) index_feature(feature_collection.get_view());
+                    else feature_collection.skip();
+                }
+                break;
+            }
+            case 5:
+                index_feature(reader_.get_view());
+                break;
+            default:
+                MAPNIK_LOG_DEBUG(geobuf) << "Unsupported tag=" << reader_.tag();
+                reader_.skip();
+                break;
+            }
+        }
+    }
+
+    // Decodes one Feature message located by read_index(), after read_header()
+    void read_feature(char const* data, std::size_t size)
+    {
+        protozero::pbf_reader message(data, size);
+        read_feature(message);
+    }
+
 private:
 
+    void index_feature(protozero::data_view const& view)
+    {
+        protozero::pbf_reader message(view);
+        box2d<double> box;
+        while (message.next())
+        {
+            if (message.tag() == 1)
+            {
+                auto geometry = message.get_message();
+                box = geometry::envelope(read_geometry(geometry));
+            }
+            else message.skip();
+        }
+        values_.clear();
+        callback_(box, static_cast<std::size_t>(view.data() - begin_), view.size());
+    }
+
     double transform(std::int64_t input)
     {
         return (transformed) ? (static_cast<double>(input)) : (input/precision);
@@ -22,6 +22,7 @@
 
 #include "geobuf_datasource.hpp"
 #include "geobuf_featureset.hpp"
+#include "geobuf_index_featureset.hpp"
 #include "geobuf.hpp"
 
 #include <fstream>
@@ -45,6 +46,17 @@
 #include <mapnik/util/file_io.hpp>
 #include <mapnik/make_unique.hpp>
 #include <mapnik/geometry/boost_adapters.hpp>
+#include <mapnik/boolean.hpp>
+#include <mapnik/util/fs.hpp>
+#include <mapnik/util/spatial_index.hpp>
+#include <mapnik/geom_util.hpp>
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+#include <mapnik/mapped_memory_cache.hpp>
+#endif
 
 using mapnik::datasource;
 using mapnik::parameters;
@@ -108,7 +120,27 @@ geobuf_datasource::geobuf_datasource(parameters const& params)
     else
         filename_ = *file;
 
-
+    has_disk_index_ = mapnik::util::exists(filename_ + ".index");
+    cache_features_ = *params.get<mapnik::boolean_type>("cache_features", true);
+    if (has_disk_index_)
+    {
+        initialise_disk_index();
+        return;
+    }
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    if (!cache_features_)
+    {
+        // scan the mapped file, features are decoded on demand
+        boost::optional<mapnik::mapped_region_ptr> mapped_region =
+            mapnik::mapped_memory_cache::instance().find(filename_, true, mapnik::mapped_access::sequential);
+        if (!mapped_region)
+        {
+            throw mapnik::datasource_exception("Geobuf Plugin: could not get file mapping for '" + filename_ + "'");
+        }
+        initialise_index(static_cast<char const*>((*mapped_region)->get_address()), (*mapped_region)->get_size());
+        return;
+    }
+#endif
     mapnik::util::file in(filename_);
     if (!in.is_open())
     {
@@ -117,7 +149,8 @@ geobuf_datasource::geobuf_datasource(parameters const& params)
     std::vector<char> geobuf;
     geobuf.resize(in.size());
     std::fread(geobuf.data(), in.size(), 1, in.get());
-    parse_geobuf(geobuf.data(), geobuf.size());
+    if (cache_features_) parse_geobuf(geobuf.data(), geobuf.size());
+    else initialise_index(geobuf.data(), geobuf.size());
 }
 
 namespace {
@@ -134,6 +167,54 @@ struct push_feature
     }
     features_container & features_;
 };
+
+template <typename T>
+struct push_position
+{
+    using values_container = T;
+    push_position(values_container & values)
+        : values_(values) {}
+
+    void operator() (mapnik::box2d<double> const& box, std::size_t offset, std::size_t size)
+    {
+        if (box.valid()) values_.emplace_back(box, std::make_pair(offset, size));
+    }
+    values_container & values_;
+};
+
+struct ignore_feature
+{
+    void operator() (mapnik::feature_ptr const&) {}
+};
+
+constexpr std::size_t num_features_to_query = 5;
+
+// leading part of the file holding the keys, dimensions and precision,
+// so featuresets can decode features out of order
+std::string read_header(std::string const& filename)
+{
+    mapnik::util::file in(filename);
+    if (!in.is_open())
+    {
+        throw mapnik::datasource_exception("Geobuf Plugin: could not open: '" + filename + "'");
+    }
+    std::string header;
+    for (std::size_t size = 65536; ; size *= 4)
+    {
+        header.resize(std::min(size, in.size()));
+        std::fseek(in.get(), 0, SEEK_SET);
+        if (!header.empty() && std::fread(&header[0], header.size(), 1, in.get()) != 1) break;
+        ignore_feature callback;
+        mapnik::util::geobuf<ignore_feature> buf(header.data(), header.size(), callback);
+        try
+        {
+            if (buf.read_header()) return header;
+        }
+        catch (protozero::end_of_buffer_exception const&) {}
+        if (header.size() == in.size()) break;
+    }
+    throw mapnik::datasource_exception("Geobuf Plugin: no features in '" + filename + "'");
+}
 }
 
 
@@ -175,6 +256,69 @@ void geobuf_datasource::parse_geobuf(char const* data, std::size_t size)
     tree_ = std::make_unique<spatial_index_type>(values);
 }
 
+void geobuf_datasource::initialise_index(char const* data, std::size_t size)
+{
+    using values_container = std::vector<item_type>;
+    values_container values;
+    push_position<values_container> callback(values);
+    mapnik::util::geobuf<push_position<values_container>> buf(data, size, callback);
+    buf.read_index();
+    for (auto const& item : values)
+    {
+        if (!extent_.valid()) extent_ = item.first;
+        else extent_.expand_to_include(item.first);
+    }
+    // packing algorithm
+    tree_ = std::make_unique<spatial_index_type>(values);
+    header_ = read_header(filename_);
+    geobuf_index_featureset::positions_type positions;
+    for (std::size_t i = 0; i < values.size() && i < num_features_to_query; ++i)
+    {
+        positions.emplace_back(values[i].second.first, values[i].second.second);
+    }
+    geobuf_index_featureset fs(filename_, header_, std::move(positions));
+    while (auto feature = fs.next())
+    {
+        initialise_descriptor(feature);
+    }
+}
+
+void geobuf_datasource::initialise_disk_index()
+{
+    std::ifstream index(filename_ + ".index", std::ios::binary);
+    if (!index) throw mapnik::datasource_exception("Geobuf Plugin: could not open: '" + filename_ + ".index'");
+    auto ext_f = mapnik::util::feature_index_bounding_box(index);
+    extent_ = { ext_f.minx(), ext_f.miny(), ext_f.maxx(), ext_f.maxy() };
+    mapnik::bounding_box_filter<float> filter(ext_f);
+    std::vector<mapnik::util::feature_index_record> records;
+    mapnik::util::query_feature_index(filter, index, records, num_features_to_query);
+    header_ = read_header(filename_);
+    geobuf_index_featureset::positions_type positions;
+    for (auto const& rec : records)
+    {
+        positions.emplace_back(rec.off, rec.size);
+    }
+    geobuf_index_featureset fs(filename_, header_, std::move(positions));
+    while (auto feature = fs.next())
+    {
+        initialise_descriptor(feature);
+    }
+}
+
+void geobuf_datasource::initialise_descriptor(mapnik::feature_ptr const& feature)
+{
+    for (auto const& kv : *feature)
+    {
+        auto const& name = std::get<0>(kv);
+        if (!desc_.has_name(name))
+        {
+            desc_.add_descriptor(mapnik::attribute_descriptor(name,
+                                                              mapnik::util::apply_visitor(attr_value_converter(),
+                                                                                          std::get<1>(kv))));
+        }
+    }
+}
+
 geobuf_datasource::~geobuf_datasource() {}
 
 const char * geobuf_datasource::name()
@@ -186,10 +330,23 @@ boost::optional<mapnik::datasource_geometry_t> geobuf_datasource::get_geometry_t
 {
     boost::optional<mapnik::datasource_geometry_t> result;
     int multi_type = 0;
-    unsigned num_features = features_.size();
-    for (unsigned i = 0; i < num_features && i < 5; ++i)
+    std::vector<mapnik::feature_ptr> sample;
+    if (cache_features_ && !has_disk_index_)
+    {
+        sample.assign(features_.begin(), features_.begin() + std::min(features_.size(), num_features_to_query));
+    }
+    else if (auto fs = features(mapnik::query(extent_)))
+    {
+        while (sample.size() < num_features_to_query)
+        {
+            auto feature = fs->next();
+            if (!feature) break;
+            sample.push_back(feature);
+        }
+    }
+    for (auto const& feature : sample)
     {
-        result = mapnik::util::to_ds_type(features_[i]->get_geometry());
+        result = mapnik::util::to_ds_type(feature->get_geometry());
         if (result)
         {
             int type = static_cast<int>(*result);
@@ -225,11 +382,39 @@ mapnik::featureset_ptr geobuf_datasource::features(mapnik::query const& q) const
     mapnik::box2d<double> const& box = q.get_bbox();
     if (extent_.intersects(box))
     {
+        if (has_disk_index_)
+        {
+            std::ifstream index(filename_ + ".index", std::ios::binary);
+            if (!index) throw mapnik::datasource_exception("Geobuf Plugin: could not open: '" + filename_ + ".index'");
+            mapnik::bounding_box_filter<float> filter(mapnik::box2d<float>(box.minx(), box.miny(), box.maxx(), box.maxy()));
+            std::vector<mapnik::util::feature_index_record> records;
+            mapnik::util::query_feature_index(filter, index, records);
+            geobuf_index_featureset::positions_type positions;
+            positions.reserve(records.size());
+            for (auto const& rec : records)
+            {
+                positions.emplace_back(rec.off, rec.size);
+            }
+            std::sort(positions.begin(), positions.end());
+            return std::make_shared<geobuf_index_featureset>(filename_, header_, std::move(positions));
+        }
         geobuf_featureset::array_type index_array;
         if (tree_)
         {
             tree_->query(boost::geometry::index::intersects(box), std::back_inserter(index_array));
-            return std::make_shared<geobuf_featureset>(features_, std::move(index_array));
+            if (cache_features_)
+            {
+                return std::make_shared<geobuf_featureset>(features_, std::move(index_array));
+            }
+            // decode in file order
+            geobuf_index_featureset::positions_type positions;
+            positions.reserve(index_array.size());
+            for (auto const& item : index_array)
+            {
+                positions.emplace_back(item.second.first, item.second.second);
+            }
+            std::sort(positions.begin(), positions.end());
+            return std::make_shared<geobuf_index_featureset>(filename_, header_, std::move(positions));
         }
     }
     return mapnik::featureset_ptr();
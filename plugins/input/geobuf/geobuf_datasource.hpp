@@ -91,6 +91,9 @@ public:
     mapnik::layer_descriptor get_descriptor() const;
     boost::optional<mapnik::datasource_geometry_t> get_geometry_type() const;
     void parse_geobuf(char const* buffer, std::size_t size);
+    void initialise_index(char const* buffer, std::size_t size);
+    void initialise_disk_index();
+    void initialise_descriptor(mapnik::feature_ptr const& feature);
 private:
     mapnik::datasource::datasource_t type_;
     mapnik::layer_descriptor desc_;
@@ -98,6 +101,10 @@ private:
     mapnik::box2d<double> extent_;
     std::vector<mapnik::feature_ptr> features_;
     std::unique_ptr<spatial_index_type> tree_;
+    bool cache_features_ = true;
+    bool has_disk_index_ = false;
+    // keys, dimensions and precision needed to decode features on demand
+    std::string header_;
 };
 
 
@@ -0,0 +1,93 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/util/utf_conv_win.hpp>
+// stl
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "geobuf_index_featureset.hpp"
+
+geobuf_index_featureset::geobuf_index_featureset(std::string const& filename,
+                                                 std::string const& header,
+                                                 positions_type && positions)
+    :
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    //
+#elif defined( _WINDOWS)
+    file_(_wfopen(mapnik::utf8_to_utf16(filename).c_str(), L"rb"), std::fclose),
+#else
+    file_(std::fopen(filename.c_str(),"rb"), std::fclose),
+#endif
+    current_(),
+    reader_(header.data(), header.size(), current_),
+    positions_(std::move(positions)),
+    itr_(positions_.begin()),
+    end_(positions_.end())
+{
+#if defined (MAPNIK_MEMORY_MAPPED_FILE)
+    boost::optional<mapnik::mapped_region_ptr> memory =
+        mapnik::mapped_memory_cache::instance().find(filename, true, mapnik::mapped_access::random);
+    if (memory)
+    {
+        mapped_region_ = *memory;
+    }
+    else
+    {
+        throw std::runtime_error("could not create file mapping for " + filename);
+    }
+#else
+    if (!file_) throw std::runtime_error("Can't open " + filename);
+#endif
+    reader_.read_header();
+}
+
+geobuf_index_featureset::~geobuf_index_featureset() {}
+
+mapnik::feature_ptr geobuf_index_featureset::next()
+{
+    while (itr_ != end_)
+    {
+        std::uint64_t offset = itr_->first;
+        std::uint64_t size = itr_->second;
+        ++itr_;
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        if (offset + size > mapped_region_->get_size()) break;
+        char const* data = static_cast<char const*>(mapped_region_->get_address()) + offset;
+#else
+        record_.resize(size);
+        if (std::fseek(file_.get(), offset, SEEK_SET) != 0 ||
+            std::fread(record_.data(), size, 1, file_.get()) != 1)
+        {
+            break;
+        }
+        char const* data = record_.data();
+#endif
+        current_.feature_.reset();
+        reader_.read_feature(data, size);
+        if (current_.feature_) return current_.feature_;
+    }
+    return mapnik::feature_ptr();
+}
@@ -0,0 +1,80 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef GEOBUF_INDEX_FEATURESET_HPP
+#define GEOBUF_INDEX_FEATURESET_HPP
+
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include "geobuf.hpp"
+
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+#include <mapnik/mapped_memory_cache.hpp>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Decodes the Feature messages at the given file positions on demand
+class geobuf_index_featureset : public mapnik::Featureset
+{
+    struct feature_holder
+    {
+        void operator() (mapnik::feature_ptr const& feature)
+        {
+            feature_ = feature;
+        }
+        mapnik::feature_ptr feature_;
+    };
+public:
+    // (offset, size) of each Feature message, in file order
+    using positions_type = std::vector<std::pair<std::uint64_t, std::uint64_t>>;
+    geobuf_index_featureset(std::string const& filename,
+                            std::string const& header,
+                            positions_type && positions);
+    virtual ~geobuf_index_featureset();
+    mapnik::feature_ptr next();
+
+private:
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapnik::mapped_region_ptr mapped_region_;
+#else
+    using file_ptr = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+    file_ptr file_;
+    std::vector<char> record_;
+#endif
+    feature_holder current_;
+    mapnik::util::geobuf<feature_holder> reader_;
+    const positions_type positions_;
+    positions_type::const_iterator itr_;
+    positions_type::const_iterator end_;
+};
+
+#endif // GEOBUF_INDEX_FEATURESET_HPP
@@ -51,6 +51,7 @@
 #include <mapnik/geometry/boost_adapters.hpp>
 #include <mapnik/util/fs.hpp>
 #include <mapnik/util/spatial_index.hpp>
+#include <mapnik/util/parallel_for.hpp>
 #include <mapnik/geom_util.hpp>
 #include <mapnik/json/parse_feature.hpp>
 #include <mapnik/json/extract_bounding_boxes_x3.hpp>
@@ -116,7 +117,8 @@ geojson_datasource::geojson_datasource(parameters const& params)
       extent_(),
       features_(),
       tree_(nullptr),
-      num_features_to_query_(std::max(mapnik::value_integer(1), *params.get<mapnik::value_integer>("num_features_to_query", 5)))
+      num_features_to_query_(std::max(mapnik::value_integer(1), *params.get<mapnik::value_integer>("num_features_to_query", 5))),
+      load_threads_(std::max(mapnik::value_integer(1), *params.get<mapnik::value_integer>("load_threads", 1)))
 {
     boost::optional<std::string> inline_string = params.get<std::string>("inline");
     if (!inline_string)
@@ -160,7 +162,7 @@ geojson_datasource::geojson_datasource(parameters const& params)
         char const* end = (count == 1) ? start + file_buffer.length() : start;
 #else
         boost::optional<mapnik::mapped_region_ptr> mapped_region =
-            mapnik::mapped_memory_cache::instance().find(filename_, false);
+            mapnik::mapped_memory_cache::instance().find(filename_, false, mapnik::mapped_access::sequential);
         if (!mapped_region)
         {
             throw std::runtime_error("could not get file mapping for "+ filename_);
@@ -206,19 +208,14 @@ void geojson_datasource::initialise_descriptor(mapnik::feature_ptr const& featur
 void geojson_datasource::initialise_disk_index(std::string const& filename)
 {
     // read extent
-    using value_type = mapnik::util::index_record;
+    using value_type = mapnik::util::feature_index_record;
     std::ifstream index(filename_ + ".index", std::ios::binary);
     if (!index) throw mapnik::datasource_exception("GeoJSON Plugin: could not open: '" + filename_ + ".index'");
-    auto ext_f = mapnik::util::spatial_index<value_type,
-                                             mapnik::bounding_box_filter<float>,
-                                             std::ifstream,
-                                             mapnik::box2d<float>>::bounding_box(index);
+    auto ext_f = mapnik::util::feature_index_bounding_box(index);
     extent_ = { ext_f.minx(), ext_f.miny(),ext_f.maxx(), ext_f.maxy() };
     mapnik::bounding_box_filter<float> filter(ext_f);
     std::vector<value_type> positions;
-    mapnik::util::spatial_index<value_type,
-                                mapnik::bounding_box_filter<float>,
-                                std::ifstream, mapnik::box2d<float>>::query_first_n(filter, index, positions, num_features_to_query_);
+    mapnik::util::query_feature_index(filter, index, positions, num_features_to_query_);
 
     mapnik::util::file file(filename_);
     if (!file) throw mapnik::datasource_exception("GeoJSON Plugin: could not open: '" + filename_ + "'");
@@ -356,6 +353,39 @@ void geojson_datasource::initialise_index(Iterator start, Iterator end)
     desc_.order_by_name();
 }
 
+// Chunks parsed after the first one collect their property names in
+// contexts of their own. Merges those into `ctx`, in feature order, and
+// moves the features over, so that all of them share one set of keys.
+void geojson_datasource::merge_contexts(mapnik::context_ptr const& ctx)
+{
+    mapnik::context_type const* merged = ctx.get();
+    for (mapnik::feature_ptr const& feature : features_)
+    {
+        mapnik::context_ptr const chunk_ctx = feature->context();
+        if (chunk_ctx.get() == merged) continue;
+        merged = chunk_ctx.get();
+        std::vector<std::string const*> names(chunk_ctx->size());
+        for (auto const& kv : *chunk_ctx) names[kv.second] = &kv.first;
+        // names already in `ctx` keep their index
+        for (std::string const* name : names) ctx->push(*name);
+    }
+    mapnik::util::parallel_for_chunks(features_.size(), load_threads_, 1024, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; ++i)
+        {
+            mapnik::feature_ptr & feature = features_[i];
+            if (feature->context() == ctx) continue;
+            mapnik::feature_ptr rebound(mapnik::feature_factory::create(ctx, feature->id()));
+            rebound->set_geometry(std::move(feature->get_geometry()));
+            for (auto const& kv : *feature)
+            {
+                rebound->put(std::get<0>(kv), std::get<1>(kv));
+            }
+            feature = std::move(rebound);
+        }
+    });
+}
+
 template <typename Iterator>
 void geojson_datasource::parse_geojson(Iterator start, Iterator end)
 {
@@ -367,18 +397,29 @@ void geojson_datasource::parse_geojson(Iterator start, Iterator end)
         boxes_type boxes;
         mapnik::json::extract_bounding_boxes(itr, end, boxes);
         if (itr != end || boxes.empty()) throw std::exception(); //ensure we've consumed all input and we extracted at least one bbox;
-        for (auto const& item : boxes)
+        // parse features in parallel, chunks split at the feature boundaries found above
+        features_.resize(boxes.size());
+        mapnik::util::parallel_for_chunks(boxes.size(), load_threads_, 1024, [&](std::size_t first, std::size_t last)
         {
-            auto const& geometry_index = std::get<1>(item);
-            Iterator itr2 = start + geometry_index.first;
-            Iterator end2 = itr2 + geometry_index.second;
-            mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, start_id++));
-            mapnik::json::parse_feature(itr2, end2, *feature, geojson_datasource_static_tr);
-            features_.push_back(std::move(feature));
-        }
+            // parsing adds property names to the context and ICU converters are not
+            // thread-safe, so each chunk has its own
+            mapnik::context_ptr chunk_ctx = (first == 0) ? ctx : std::make_shared<mapnik::context_type>();
+            mapnik::transcoder const tr("utf8");
+            for (std::size_t i = first; i < last; ++i)
+            {
+                auto const& geometry_index = std::get<1>(boxes[i]);
+                Iterator itr2 = start + geometry_index.first;
+                Iterator end2 = itr2 + geometry_index.second;
+                mapnik::feature_ptr feature(mapnik::feature_factory::create(chunk_ctx, start_id + i));
+                mapnik::json::parse_feature(itr2, end2, *feature, tr);
+                features_[i] = std::move(feature);
+            }
+        });
+        if (load_threads_ > 1) merge_contexts(ctx);
     }
     catch (...)
     {
+        features_.clear();
         itr = start;
         // try parsing as single Feature or single Geometry JSON
         mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, start_id)); // single feature
@@ -452,15 +493,12 @@ boost::optional<mapnik::datasource_geometry_t> geojson_datasource::get_geometry_
     int multi_type = 0;
     if (has_disk_index_)
     {
-        using value_type = mapnik::util::index_record;
+        using value_type = mapnik::util::feature_index_record;
         std::ifstream index(filename_ + ".index", std::ios::binary);
         if (!index) throw mapnik::datasource_exception("GeoJSON Plugin: could not open: '" + filename_ + ".index'");
         mapnik::bounding_box_filter<float> filter(mapnik::box2d<float>(extent_.minx(),extent_.miny(), extent_.maxx(),extent_.maxy()));
         std::vector<value_type> positions;
-        mapnik::util::spatial_index<value_type,
-                                    mapnik::bounding_box_filter<float>,
-                                    std::ifstream,
-                                    mapnik::box2d<float>>::query_first_n(filter, index, positions, num_features_to_query_);
+        mapnik::util::query_feature_index(filter, index, positions, num_features_to_query_);
 
         mapnik::util::file file(filename_);
 
@@ -593,7 +631,7 @@ mapnik::featureset_ptr geojson_datasource::features(mapnik::query const& q) cons
         {
             auto const& bbox = q.get_bbox();
             mapnik::bounding_box_filter<float> const filter(mapnik::box2d<float>(bbox.minx(), bbox.miny(), bbox.maxx(), bbox.maxy()));
-            return std::make_shared<geojson_index_featureset>(filename_, filter);
+            return std::make_shared<geojson_index_featureset>(filename_, filter, q.property_names());
         }
     }
     // otherwise return an empty featureset
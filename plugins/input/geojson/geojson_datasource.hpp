@@ -94,6 +94,7 @@ public:
     void initialise_disk_index(std::string const& filename);
 private:
     void initialise_descriptor(mapnik::feature_ptr const&);
+    void merge_contexts(mapnik::context_ptr const& ctx);
     mapnik::datasource::datasource_t type_;
     mapnik::layer_descriptor desc_;
     std::string filename_;
@@ -104,6 +105,7 @@ private:
     bool cache_features_ = true;
     bool has_disk_index_ = false;
     const std::size_t num_features_to_query_;
+    const std::size_t load_threads_;
 };
 
 #endif // GEOJSON_DATASOURCE_HPP
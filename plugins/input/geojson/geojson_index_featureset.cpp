@@ -35,7 +35,9 @@
 #include <fstream>
 #include <algorithm>
 
-geojson_index_featureset::geojson_index_featureset(std::string const& filename, mapnik::bounding_box_filter<float> const& filter)
+geojson_index_featureset::geojson_index_featureset(std::string const& filename,
+                                                   mapnik::bounding_box_filter<float> const& filter,
+                                                   std::set<std::string> const& attribute_names)
     :
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
     //
@@ -44,12 +46,13 @@ geojson_index_featureset::geojson_index_featureset(std::string const& filename,
 #else
     file_(std::fopen(filename.c_str(),"rb"), std::fclose),
 #endif
-    ctx_(std::make_shared<mapnik::context_type>())
+    ctx_(std::make_shared<mapnik::context_type>()),
+    partial_parse_(false)
 {
 
 #if defined (MAPNIK_MEMORY_MAPPED_FILE)
     boost::optional<mapnik::mapped_region_ptr> memory =
-        mapnik::mapped_memory_cache::instance().find(filename, true);
+        mapnik::mapped_memory_cache::instance().find(filename, true, mapnik::mapped_access::random);
     if (memory)
     {
         mapped_region_ = *memory;
@@ -62,12 +65,21 @@ geojson_index_featureset::geojson_index_featureset(std::string const& filename,
     if (!file_) throw std::runtime_error("Can't open " + filename);
 #endif
     std::string indexname = filename + ".index";
+#if defined (MAPNIK_MEMORY_MAPPED_FILE)
+    boost::optional<mapnik::mapped_region_ptr> index_memory =
+        mapnik::mapped_memory_cache::instance().find(indexname, true, mapnik::mapped_access::random);
+    if (!index_memory) throw mapnik::datasource_exception("GeoJSON Plugin: can't open index file " + indexname);
+    file_source_type index(static_cast<char const*>((*index_memory)->get_address()), (*index_memory)->get_size());
+#else
     std::ifstream index(indexname.c_str(), std::ios::binary);
     if (!index) throw mapnik::datasource_exception("GeoJSON Plugin: can't open index file " + indexname);
-    mapnik::util::spatial_index<value_type,
-                                mapnik::bounding_box_filter<float>,
-                                std::ifstream,
-                                mapnik::box2d<float>>::query(filter, index, positions_);
+#endif
+    partial_parse_ = mapnik::util::spatial_index_value_size(index) == sizeof(value_type);
+    mapnik::util::query_feature_index(filter, index, positions_);
+    if (partial_parse_)
+    {
+        for (auto const& name : attribute_names) ctx_->push(name);
+    }
 
     positions_.erase(std::remove_if(positions_.begin(),
                                     positions_.end(),
@@ -93,7 +105,7 @@ mapnik::feature_ptr geojson_index_featureset::next()
 #else
         std::fseek(file_.get(), pos.off, SEEK_SET);
         std::vector<char> record;
-        record.resize(pos.second);
+        record.resize(pos.size);
         auto count = std::fread(record.data(), pos.size, 1, file_.get());
         auto const* start = record.data();
         auto const*  end = (count == 1) ? start + record.size() : start;
@@ -101,7 +113,27 @@ mapnik::feature_ptr geojson_index_featureset::next()
         static const mapnik::transcoder tr("utf8");
         mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx_, feature_id_++));
         using mapnik::json::grammar::iterator_type;
-        mapnik::json::parse_feature(start, end, *feature, tr); // throw on failure
+        if (partial_parse_ && pos.ranges.geometry_size > 0)
+        {
+            auto const& ranges = pos.ranges;
+            std::uint64_t const size = end - start;
+            if (std::uint64_t(ranges.geometry_off) + ranges.geometry_size > size ||
+                std::uint64_t(ranges.attributes_off) + ranges.attributes_size > size)
+            {
+                throw std::runtime_error("Invalid index file (regenerate with mapnik-index)");
+            }
+            mapnik::json::parse_geometry(start + ranges.geometry_off,
+                                         start + ranges.geometry_off + ranges.geometry_size, *feature); // throw on failure
+            if (ranges.attributes_size > 0)
+            {
+                mapnik::json::parse_properties(start + ranges.attributes_off,
+                                               start + ranges.attributes_off + ranges.attributes_size, *feature, tr);
+            }
+        }
+        else
+        {
+            mapnik::json::parse_feature(start, end, *feature, tr); // throw on failure
+        }
         // skip empty geometries
         if (mapnik::geometry::is_empty(feature->get_geometry())) continue;
         return feature;
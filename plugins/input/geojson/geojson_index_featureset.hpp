@@ -38,13 +38,16 @@
 #endif
 
 #include <deque>
+#include <set>
 #include <cstdio>
 
 class geojson_index_featureset : public mapnik::Featureset
 {
-    using value_type = mapnik::util::index_record;
+    using value_type = mapnik::util::feature_index_record;
 public:
-    geojson_index_featureset(std::string const& filename, mapnik::bounding_box_filter<float> const& filter);
+    geojson_index_featureset(std::string const& filename,
+                             mapnik::bounding_box_filter<float> const& filter,
+                             std::set<std::string> const& attribute_names);
     virtual ~geojson_index_featureset();
     mapnik::feature_ptr next();
 
@@ -58,6 +61,8 @@ private:
 #endif
     mapnik::value_integer feature_id_ = 1;
     mapnik::context_ptr ctx_;
+    // index records carry member ranges: parse the geometry and requested attributes only
+    bool partial_parse_;
     std::vector<value_type> positions_;
     std::vector<value_type>::iterator itr_;
 };
@@ -29,6 +29,7 @@ plugin_env = plugin_base.Clone()
 
 plugin_sources = Split(
   """
+  %(PLUGIN_NAME)s_arrow_featureset.cpp
   %(PLUGIN_NAME)s_converter.cpp
   %(PLUGIN_NAME)s_datasource.cpp
   %(PLUGIN_NAME)s_featureset.cpp
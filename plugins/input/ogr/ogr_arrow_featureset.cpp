@@ -0,0 +1,339 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#include "ogr_arrow_featureset.hpp"
+
+#ifdef MAPNIK_OGR_ARROW_STREAM
+
+// mapnik
+#include <mapnik/debug.hpp>
+#include <mapnik/value/types.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/wkb.hpp>
+#include <mapnik/geometry/is_empty.hpp>
+
+// stl
+#include <cstring>
+
+using mapnik::feature_ptr;
+using mapnik::feature_factory;
+using mapnik::geometry_utils;
+using mapnik::transcoder;
+
+namespace {
+
+bool arrow_is_valid(ArrowArray const* array, std::int64_t i)
+{
+    if (array->null_count == 0 || array->buffers[0] == nullptr) return true;
+    auto bitmap = static_cast<std::uint8_t const*>(array->buffers[0]);
+    return (bitmap[i >> 3] >> (i & 7)) & 1;
+}
+
+template <typename T>
+T arrow_value(ArrowArray const* array, std::int64_t i)
+{
+    return static_cast<T const*>(array->buffers[1])[i];
+}
+
+// variable length value (utf8 or binary) with 32 or 64 bit offsets
+template <typename Offset>
+char const* arrow_bytes(ArrowArray const* array, std::int64_t i, std::size_t & size)
+{
+    auto offsets = static_cast<Offset const*>(array->buffers[1]);
+    size = static_cast<std::size_t>(offsets[i + 1] - offsets[i]);
+    return static_cast<char const*>(array->buffers[2]) + offsets[i];
+}
+
+// ARROW:extension:name from a schema's metadata, which is an int32 count
+// followed by length-prefixed keys and values
+std::string arrow_extension_name(char const* metadata)
+{
+    if (metadata == nullptr) return std::string();
+    std::int32_t count;
+    std::memcpy(&count, metadata, sizeof(count));
+    metadata += sizeof(count);
+    for (std::int32_t i = 0; i < count; ++i)
+    {
+        std::int32_t key_size, value_size;
+        std::memcpy(&key_size, metadata, sizeof(key_size));
+        std::string key(metadata + sizeof(key_size), key_size);
+        metadata += sizeof(key_size) + key_size;
+        std::memcpy(&value_size, metadata, sizeof(value_size));
+        std::string value(metadata + sizeof(value_size), value_size);
+        metadata += sizeof(value_size) + value_size;
+        if (key == "ARROW:extension:name") return value;
+    }
+    return std::string();
+}
+
+bool is_supported_format(std::string const& format)
+{
+    if (format.size() != 1) return false;
+    switch (format[0])
+    {
+    case 'b': case 'c': case 'C': case 's': case 'S':
+    case 'i': case 'I': case 'l': case 'L':
+    case 'f': case 'g': case 'u': case 'U':
+        return true;
+    default:
+        return false;
+    }
+}
+
+}
+
+ogr_arrow_featureset::ogr_arrow_featureset(mapnik::context_ptr const& ctx,
+                                           OGRLayer & layer,
+                                           mapnik::box2d<double> const& extent,
+                                           std::string const& encoding)
+    : ctx_(ctx),
+      layer_(layer),
+      tr_(new transcoder(encoding)),
+      row_(0),
+      fid_column_(-1),
+      geometry_column_(-1),
+      count_(0)
+{
+    std::memset(&stream_, 0, sizeof(stream_));
+    std::memset(&schema_, 0, sizeof(schema_));
+    std::memset(&array_, 0, sizeof(array_));
+
+    layer_.SetSpatialFilterRect(extent.minx(),
+                                extent.miny(),
+                                extent.maxx(),
+                                extent.maxy());
+
+    const char* options[] = { "INCLUDE_FID=YES", nullptr };
+    if (!layer_.GetArrowStream(&stream_, options))
+    {
+        stream_.release = nullptr;
+        return;
+    }
+    if (stream_.get_schema(&stream_, &schema_) != 0)
+    {
+        schema_.release = nullptr;
+        return;
+    }
+
+    std::string fid_name = layer_.GetFIDColumn();
+    if (fid_name.empty()) fid_name = "OGC_FID";
+    std::string geometry_name = layer_.GetGeometryColumn();
+    if (geometry_name.empty()) geometry_name = "wkb_geometry";
+
+    for (int i = 0; i < schema_.n_children; ++i)
+    {
+        ArrowSchema const* child = schema_.children[i];
+        std::string name(child->name);
+        std::string format(child->format);
+        if (geometry_column_ < 0 && (format == "z" || format == "Z"))
+        {
+            std::string extension = arrow_extension_name(child->metadata);
+            if (extension == "ogc.wkb" || extension == "geoarrow.wkb" || name == geometry_name)
+            {
+                geometry_column_ = i;
+                continue;
+            }
+        }
+        if (fid_column_ < 0 && name == fid_name && format == "l")
+        {
+            fid_column_ = i;
+            continue;
+        }
+        bool requested = false;
+        for (auto const& item : *ctx_)
+        {
+            if (item.first == name)
+            {
+                requested = true;
+                break;
+            }
+        }
+        if (!requested) continue;
+        if (child->dictionary != nullptr || !is_supported_format(format))
+        {
+            MAPNIK_LOG_WARN(ogr) << "ogr_arrow_featureset: Unhandled arrow format=" << format
+                                 << " for field=" << name;
+            continue;
+        }
+        columns_.push_back(column{i, name, format});
+    }
+}
+
+ogr_arrow_featureset::~ogr_arrow_featureset()
+{
+    if (array_.release) array_.release(&array_);
+    if (schema_.release) schema_.release(&schema_);
+    if (stream_.release) stream_.release(&stream_);
+}
+
+bool ogr_arrow_featureset::valid() const
+{
+    return stream_.release != nullptr && schema_.release != nullptr && geometry_column_ >= 0;
+}
+
+bool ogr_arrow_featureset::next_batch()
+{
+    if (array_.release)
+    {
+        array_.release(&array_);
+        array_.release = nullptr;
+    }
+    if (stream_.get_next(&stream_, &array_) != 0)
+    {
+        char const* error = stream_.get_last_error(&stream_);
+        MAPNIK_LOG_ERROR(ogr) << "ogr_arrow_featureset: reading record batch failed: "
+                              << (error ? error : "unknown error");
+        array_.release = nullptr;
+    }
+    else if (array_.release != nullptr && array_.n_children != schema_.n_children)
+    {
+        MAPNIK_LOG_ERROR(ogr) << "ogr_arrow_featureset: record batch does not match the stream schema";
+    }
+    else if (array_.release != nullptr)
+    {
+        row_ = 0;
+        return true;
+    }
+    // end of stream or error: release the stream so that next() stops here
+    if (array_.release)
+    {
+        array_.release(&array_);
+        array_.release = nullptr;
+    }
+    stream_.release(&stream_);
+    stream_.release = nullptr;
+    return false;
+}
+
+feature_ptr ogr_arrow_featureset::next()
+{
+    while (valid())
+    {
+        if (array_.release == nullptr || row_ >= array_.length)
+        {
+            next_batch();
+            continue;
+        }
+        std::int64_t row = array_.offset + row_++;
+
+        ArrowArray const* geom_array = array_.children[geometry_column_];
+        std::int64_t geom_index = geom_array->offset + row;
+        if (!arrow_is_valid(geom_array, geom_index)) continue;
+        std::size_t size;
+        char const* wkb = schema_.children[geometry_column_]->format[0] == 'z'
+            ? arrow_bytes<std::int32_t>(geom_array, geom_index, size)
+            : arrow_bytes<std::int64_t>(geom_array, geom_index, size);
+        auto geom = geometry_utils::from_wkb(wkb, size, mapnik::wkbGeneric);
+        if (mapnik::geometry::is_empty(geom))
+        {
+            MAPNIK_LOG_DEBUG(ogr) << "ogr_arrow_featureset: Feature with null geometry";
+            continue;
+        }
+
+        // ogr feature ids start at 0, so add one to stay
+        // consistent with other mapnik datasources that start at 1
+        mapnik::value_integer feature_id = count_ + 1;
+        if (fid_column_ >= 0)
+        {
+            ArrowArray const* fid_array = array_.children[fid_column_];
+            feature_id = arrow_value<std::int64_t>(fid_array, fid_array->offset + row) + 1;
+        }
+        feature_ptr feature(feature_factory::create(ctx_, feature_id));
+        feature->set_geometry(std::move(geom));
+        ++count_;
+
+        for (auto const& col : columns_)
+        {
+            ArrowArray const* values = array_.children[col.index];
+            std::int64_t i = values->offset + row;
+            // null fields read as 0 or "" like OGRFeature::GetFieldAs*
+            bool is_valid = arrow_is_valid(values, i);
+            switch (col.format[0])
+            {
+            case 'b':
+            {
+                bool value = false;
+                if (is_valid)
+                {
+                    auto bits = static_cast<std::uint8_t const*>(values->buffers[1]);
+                    value = (bits[i >> 3] >> (i & 7)) & 1;
+                }
+                feature->put<mapnik::value_integer>(col.name, value ? 1 : 0);
+                break;
+            }
+            case 'c':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::int8_t>(values, i) : 0);
+                break;
+            case 'C':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::uint8_t>(values, i) : 0);
+                break;
+            case 's':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::int16_t>(values, i) : 0);
+                break;
+            case 'S':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::uint16_t>(values, i) : 0);
+                break;
+            case 'i':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::int32_t>(values, i) : 0);
+                break;
+            case 'I':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::uint32_t>(values, i) : 0);
+                break;
+            case 'l':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? arrow_value<std::int64_t>(values, i) : 0);
+                break;
+            case 'L':
+                feature->put<mapnik::value_integer>(col.name, is_valid ? static_cast<mapnik::value_integer>(arrow_value<std::uint64_t>(values, i)) : 0);
+                break;
+            case 'f':
+                feature->put<mapnik::value_double>(col.name, is_valid ? arrow_value<float>(values, i) : 0.0);
+                break;
+            case 'g':
+                feature->put<mapnik::value_double>(col.name, is_valid ? arrow_value<double>(values, i) : 0.0);
+                break;
+            case 'u':
+            case 'U':
+            {
+                std::size_t length = 0;
+                char const* text = "";
+                if (is_valid)
+                {
+                    text = col.format[0] == 'u' ? arrow_bytes<std::int32_t>(values, i, length)
+                                                : arrow_bytes<std::int64_t>(values, i, length);
+                }
+                feature->put(col.name, tr_->transcode(text, static_cast<std::int32_t>(length)));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        return feature;
+    }
+
+    MAPNIK_LOG_DEBUG(ogr) << "ogr_arrow_featureset: " << count_ << " features";
+
+    return feature_ptr();
+}
+
+#endif // MAPNIK_OGR_ARROW_STREAM
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef OGR_ARROW_FEATURESET_HPP
+#define OGR_ARROW_FEATURESET_HPP
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/datasource.hpp>
+#include <mapnik/unicode.hpp>
+#include <mapnik/geometry/box2d.hpp>
+
+// stl
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gdal_version.h>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <ogrsf_frmts.h>
+#pragma GCC diagnostic pop
+
+// OGRLayer::GetArrowStream() is available from GDAL 3.6
+#if GDAL_VERSION_MAJOR > 3 || (GDAL_VERSION_MAJOR == 3 && GDAL_VERSION_MINOR >= 6)
+#define MAPNIK_OGR_ARROW_STREAM
+
+#include <ogr_recordbatch.h>
+
+// Reads a layer through its Arrow C stream: features are converted from
+// the columnar buffers of each record batch instead of one OGRFeature at a time.
+class ogr_arrow_featureset : public mapnik::Featureset
+{
+public:
+    ogr_arrow_featureset(mapnik::context_ptr const& ctx,
+                         OGRLayer & layer,
+                         mapnik::box2d<double> const& extent,
+                         std::string const& encoding);
+
+    virtual ~ogr_arrow_featureset();
+    mapnik::feature_ptr next();
+    // false if the layer has no Arrow stream with a WKB geometry column,
+    // in which case ogr_featureset should be used instead
+    bool valid() const;
+private:
+    struct column
+    {
+        int index; // child of the record batch struct array
+        std::string name;
+        std::string format;
+    };
+    bool next_batch();
+    mapnik::context_ptr ctx_;
+    OGRLayer & layer_;
+    const std::unique_ptr<mapnik::transcoder> tr_;
+    ArrowArrayStream stream_;
+    ArrowSchema schema_;
+    ArrowArray array_;
+    std::int64_t row_;
+    int fid_column_;
+    int geometry_column_;
+    std::vector<column> columns_;
+    int count_;
+};
+
+#endif // MAPNIK_OGR_ARROW_STREAM
+
+#endif // OGR_ARROW_FEATURESET_HPP
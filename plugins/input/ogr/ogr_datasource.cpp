@@ -23,6 +23,7 @@
 #include "ogr_datasource.hpp"
 #include "ogr_featureset.hpp"
 #include "ogr_index_featureset.hpp"
+#include "ogr_arrow_featureset.hpp"
 
 #include <gdal_version.h>
 
@@ -76,7 +77,8 @@ ogr_datasource::ogr_datasource(parameters const& params)
       extent_(),
       type_(datasource::Vector),
       desc_(ogr_datasource::name(), *params.get<std::string>("encoding", "utf-8")),
-      indexed_(false)
+      indexed_(false),
+      arrow_stream_(*params.get<mapnik::boolean_type>("arrow_stream", true))
 {
     init(params);
 }
@@ -519,6 +521,35 @@ void validate_attribute_names(query const& q, std::vector<attribute_descriptor>
     }
 }
 
+// Lets OGR skip reading the fields that are not in the feature context
+void set_ignored_fields(OGRLayer & layer, mapnik::context_ptr const& ctx)
+{
+    OGRFeatureDefn* layerdef = layer.GetLayerDefn();
+    std::vector<std::string> names;
+    for (int i = 0; i < layerdef->GetFieldCount(); ++i)
+    {
+        std::string name = layerdef->GetFieldDefn(i)->GetNameRef();
+        bool requested = false;
+        for (auto const& item : *ctx)
+        {
+            if (item.first == name)
+            {
+                requested = true;
+                break;
+            }
+        }
+        if (!requested) names.push_back(name);
+    }
+    names.emplace_back("OGR_STYLE");
+    std::vector<const char*> fields;
+    for (auto const& name : names) fields.push_back(name.c_str());
+    fields.push_back(nullptr);
+    if (layer.SetIgnoredFields(fields.data()) != OGRERR_NONE)
+    {
+        MAPNIK_LOG_DEBUG(ogr) << "ogr_datasource: layer does not support ignoring fields";
+    }
+}
+
 featureset_ptr ogr_datasource::features(query const& q) const
 {
 #ifdef MAPNIK_STATS
@@ -533,14 +564,15 @@ featureset_ptr ogr_datasource::features(query const& q) const
         // feature context (schema)
         mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
 
-        for (auto const& attr_info : desc_ar)
+        validate_attribute_names(q, desc_ar);
+
+        for (auto const& name : q.property_names())
         {
-            ctx->push(attr_info.get_name()); // TODO only push query attributes
+            ctx->push(name);
         }
 
-        validate_attribute_names(q, desc_ar);
-
         OGRLayer* layer = layer_.layer();
+        set_ignored_fields(*layer, ctx);
 
         if (indexed_)
         {
@@ -554,6 +586,16 @@ featureset_ptr ogr_datasource::features(query const& q) const
         }
         else
         {
+#ifdef MAPNIK_OGR_ARROW_STREAM
+            if (arrow_stream_)
+            {
+                auto fs = std::make_shared<ogr_arrow_featureset>(ctx,
+                                                                 *layer,
+                                                                 q.get_bbox(),
+                                                                 desc_.get_encoding());
+                if (fs->valid()) return fs;
+            }
+#endif
             return featureset_ptr(new ogr_featureset(ctx,
                                                       *layer,
                                                       q.get_bbox(),
@@ -582,6 +624,7 @@ featureset_ptr ogr_datasource::features_at_point(coord2d const& pt, double tol)
         }
 
         OGRLayer* layer = layer_.layer();
+        set_ignored_fields(*layer, ctx);
 
         if (indexed_)
         {
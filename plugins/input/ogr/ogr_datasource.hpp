@@ -70,6 +70,8 @@ private:
     std::string layer_name_;
     mapnik::layer_descriptor desc_;
     bool indexed_;
+    // read through OGRLayer::GetArrowStream() where GDAL supports it
+    bool arrow_stream_;
 };
 
 #endif // OGR_DATASOURCE_HPP
@@ -57,6 +57,7 @@ ogr_featureset::ogr_featureset(mapnik::context_ptr const & ctx,
       count_(0)
 
 {
+    init_fields();
     layer_.SetSpatialFilter (&extent);
 }
 
@@ -71,6 +72,7 @@ ogr_featureset::ogr_featureset(mapnik::context_ptr const& ctx,
       fidcolumn_(layer_.GetFIDColumn()), // TODO - unused
       count_(0)
 {
+    init_fields();
     layer_.SetSpatialFilterRect (extent.minx(),
                                  extent.miny(),
                                  extent.maxx(),
@@ -81,6 +83,16 @@ ogr_featureset::~ogr_featureset()
 {
 }
 
+void ogr_featureset::init_fields()
+{
+    // only the fields in the feature context are converted
+    for (auto const& item : *ctx_)
+    {
+        int index = layerdef_->GetFieldIndex(item.first.c_str());
+        if (index >= 0) fields_.push_back(index);
+    }
+}
+
 feature_ptr ogr_featureset::next()
 {
     if (count_ == 0)
@@ -115,8 +127,7 @@ feature_ptr ogr_featureset::next()
 
         ++count_;
 
-        int fld_count = layerdef_->GetFieldCount();
-        for (int i = 0; i < fld_count; i++)
+        for (int i : fields_)
         {
             OGRFieldDefn* fld = layerdef_->GetFieldDefn(i);
             const OGRFieldType type_oid = fld->GetType();
@@ -29,6 +29,9 @@
 #include <mapnik/unicode.hpp>
 #include <mapnik/geom_util.hpp>
 
+// stl
+#include <vector>
+
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
 #include <ogrsf_frmts.h>
@@ -50,9 +53,11 @@ public:
     virtual ~ogr_featureset();
     mapnik::feature_ptr next();
 private:
+    void init_fields();
     mapnik::context_ptr ctx_;
     OGRLayer& layer_;
     OGRFeatureDefn* layerdef_;
+    std::vector<int> fields_;
     const std::unique_ptr<mapnik::transcoder> tr_;
     const char* fidcolumn_;
     mutable int count_;
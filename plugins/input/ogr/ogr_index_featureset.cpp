@@ -70,9 +70,15 @@ ogr_index_featureset<filterT>::ogr_index_featureset(mapnik::context_ptr const &
       fidcolumn_(layer_.GetFIDColumn()),
       feature_envelope_()
 {
+    // only the fields in the feature context are converted
+    for (auto const& item : *ctx_)
+    {
+        int index = layerdef_->GetFieldIndex(item.first.c_str());
+        if (index >= 0) fields_.push_back(index);
+    }
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
-    boost::optional<mapnik::mapped_region_ptr> memory = mapnik::mapped_memory_cache::instance().find(index_file, true);
+    boost::optional<mapnik::mapped_region_ptr> memory = mapnik::mapped_memory_cache::instance().find(index_file, true, mapnik::mapped_access::random);
     if (memory)
     {
         boost::interprocess::ibufferstream file(static_cast<char*>((*memory)->get_address()),(*memory)->get_size());
@@ -137,8 +143,7 @@ feature_ptr ogr_index_featureset<filterT>::next()
             continue;
         }
 
-        int fld_count = layerdef_->GetFieldCount();
-        for (int i = 0; i < fld_count; i++)
+        for (int i : fields_)
         {
             OGRFieldDefn* fld = layerdef_->GetFieldDefn (i);
             OGRFieldType type_oid = fld->GetType ();
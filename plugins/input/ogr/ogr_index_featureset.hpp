@@ -45,6 +45,7 @@ private:
     mapnik::context_ptr ctx_;
     OGRLayer& layer_;
     OGRFeatureDefn* layerdef_;
+    std::vector<int> fields_;
     filterT filter_;
     std::vector<int> ids_;
     std::vector<int>::iterator itr_;
@@ -0,0 +1,369 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************
+ *
+ * Initially developed by Sandro Santilli <strk@keybit.net> for CartoDB
+ *
+ *****************************************************************************/
+
+#ifndef PGRASTER_BAND_CONVERT_HPP
+#define PGRASTER_BAND_CONVERT_HPP
+
+// stl
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef SSE_MATH
+#include <mapnik/sse.hpp>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// AVX2 kernels are compiled with a function level target attribute
+// and only called after a runtime cpu check
+#define PGRASTER_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+// Bulk band pixel conversion.
+//
+// Band payloads are arrays of fixed width values in the endianness of
+// the WKB. Like the other mapnik WKB readers the host is assumed to be
+// little endian, so NDR payloads are loaded as is and XDR payloads are
+// byte swapped. Pixel types below 8 bits are stored one value per byte.
+//
+// The vector kernels (*_sse2, *_avx2) convert the longest prefix that
+// is a multiple of their width and return its length, the dispatching
+// functions finish the remainder with the scalar code.
+
+namespace pgraster_band {
+
+template <typename T>
+inline T load_value(const uint8_t* p, bool little_endian)
+{
+    uint8_t bytes[sizeof(T)];
+    if (little_endian)
+    {
+        std::memcpy(bytes, p, sizeof(T));
+    }
+    else
+    {
+        std::reverse_copy(p, p + sizeof(T), bytes);
+    }
+    T val;
+    std::memcpy(&val, bytes, sizeof(T));
+    return val;
+}
+
+template <typename T>
+inline void convert_scalar(const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        dst[i] = static_cast<float>(load_value<T>(src + i * sizeof(T), little_endian));
+    }
+}
+
+#ifdef PGRASTER_AVX2
+
+inline bool has_avx2()
+{
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t convert_u8_avx2(const uint8_t* src, std::size_t count, float* dst)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline std::size_t convert_16_avx2(const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 2));
+        if (!little_endian)
+        {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        }
+        _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(v)));
+    }
+    return i;
+}
+
+#endif // PGRASTER_AVX2
+
+#ifdef SSE_MATH
+
+inline std::size_t convert_u8_sse2(const uint8_t* src, std::size_t count, float* dst)
+{
+    __m128i const zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_ps(dst + i + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_ps(dst + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+    }
+    return i;
+}
+
+inline std::size_t convert_16_sse2(const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    __m128i const zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 2));
+        if (!little_endian)
+        {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        }
+        _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+    }
+    return i;
+}
+
+inline std::size_t convert_f32_swap_sse2(const uint8_t* src, std::size_t count, float* dst)
+{
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 4));
+        // swap bytes within 16 bit words, then the words within 32 bit lanes
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    return i;
+}
+
+inline std::size_t convert_f64_sse2(const uint8_t* src, std::size_t count, float* dst)
+{
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<double const*>(src + i * 8)));
+        __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<double const*>(src + i * 8 + 16)));
+        _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+    }
+    return i;
+}
+
+inline std::size_t clamp_16_sse2(const uint8_t* src, std::size_t count, bool little_endian, uint8_t* dst)
+{
+    __m128i const max = _mm_set1_epi16(255);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 2));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * 2 + 16));
+        if (!little_endian)
+        {
+            lo = _mm_or_si128(_mm_slli_epi16(lo, 8), _mm_srli_epi16(lo, 8));
+            hi = _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(hi, 8));
+        }
+        // unsigned min(v, 255) in SSE2: v - saturate(v - 255)
+        lo = _mm_sub_epi16(lo, _mm_subs_epu16(lo, max));
+        hi = _mm_sub_epi16(hi, _mm_subs_epu16(hi, max));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+inline std::size_t expand_grayscale_sse2(const uint8_t* gray, std::size_t count, bool mask_nodata, int nodataval, uint8_t* rgba)
+{
+    __m128i const opaque = _mm_set1_epi8(static_cast<char>(0xff));
+    __m128i const nodata = _mm_set1_epi8(static_cast<char>(nodataval & 0xff));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(gray + i));
+        __m128i alpha = mask_nodata ? _mm_andnot_si128(_mm_cmpeq_epi8(v, nodata), opaque) : opaque;
+        __m128i vv_lo = _mm_unpacklo_epi8(v, v);
+        __m128i vv_hi = _mm_unpackhi_epi8(v, v);
+        __m128i va_lo = _mm_unpacklo_epi8(v, alpha);
+        __m128i va_hi = _mm_unpackhi_epi8(v, alpha);
+        __m128i* out = reinterpret_cast<__m128i*>(rgba + i * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(vv_lo, va_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(vv_lo, va_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(vv_hi, va_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(vv_hi, va_hi));
+    }
+    return i;
+}
+
+// Requires the red, green and blue planes, a missing alpha plane is opaque
+inline std::size_t interleave_rgba_sse2(const uint8_t* const planes[4], std::size_t count, uint8_t* rgba)
+{
+    __m128i const opaque = _mm_set1_epi8(static_cast<char>(0xff));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<__m128i const*>(planes[0] + i));
+        __m128i g = _mm_loadu_si128(reinterpret_cast<__m128i const*>(planes[1] + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(planes[2] + i));
+        __m128i a = planes[3] ? _mm_loadu_si128(reinterpret_cast<__m128i const*>(planes[3] + i)) : opaque;
+        __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+        __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+        __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+        __m128i* out = reinterpret_cast<__m128i*>(rgba + i * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+    return i;
+}
+
+#endif // SSE_MATH
+
+inline void convert_u8(const uint8_t* src, std::size_t count, float* dst)
+{
+    std::size_t i = 0;
+#ifdef PGRASTER_AVX2
+    if (has_avx2()) i = convert_u8_avx2(src, count, dst);
+#endif
+#ifdef SSE_MATH
+    i += convert_u8_sse2(src + i, count - i, dst + i);
+#endif
+    convert_scalar<uint8_t>(src + i, count - i, true, dst + i);
+}
+
+inline void convert_16(const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    std::size_t i = 0;
+#ifdef PGRASTER_AVX2
+    if (has_avx2()) i = convert_16_avx2(src, count, little_endian, dst);
+#endif
+#ifdef SSE_MATH
+    i += convert_16_sse2(src + i * 2, count - i, little_endian, dst + i);
+#endif
+    convert_scalar<uint16_t>(src + i * 2, count - i, little_endian, dst + i);
+}
+
+inline void convert_f32(const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    if (little_endian)
+    {
+        if (count > 0) std::memcpy(dst, src, count * sizeof(float));
+        return;
+    }
+    std::size_t i = 0;
+#ifdef SSE_MATH
+    i = convert_f32_swap_sse2(src, count, dst);
+#endif
+    convert_scalar<float>(src + i * 4, count - i, little_endian, dst + i);
+}
+
+inline void convert_f64(const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    std::size_t i = 0;
+#ifdef SSE_MATH
+    if (little_endian) i = convert_f64_sse2(src, count, dst);
+#endif
+    convert_scalar<double>(src + i * 8, count - i, little_endian, dst + i);
+}
+
+// Clamps 16 bit unsigned pixels to 0..255 ala GDAL
+inline void clamp_16_to_gray(const uint8_t* src, std::size_t count, bool little_endian, uint8_t* dst)
+{
+    std::size_t i = 0;
+#ifdef SSE_MATH
+    i = clamp_16_sse2(src, count, little_endian, dst);
+#endif
+    for (; i < count; ++i)
+    {
+        uint16_t val = load_value<uint16_t>(src + i * 2, little_endian);
+        dst[i] = static_cast<uint8_t>(std::min<uint16_t>(val, 255));
+    }
+}
+
+// Clamps 32 bit pixels to 0..255, values are clipped as signed integers
+inline void clamp_32_to_gray(const uint8_t* src, std::size_t count, bool little_endian, uint8_t* dst)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        int32_t val = load_value<int32_t>(src + i * 4, little_endian);
+        dst[i] = static_cast<uint8_t>(std::max(0, std::min(val, 255)));
+    }
+}
+
+// Expands clamped grey values into opaque RGBA, pixels matching
+// `nodataval` (when in 0..255) become transparent
+inline void expand_grayscale(const uint8_t* gray, std::size_t count, bool hasnodata, int nodataval, uint8_t* rgba)
+{
+    bool const mask_nodata = hasnodata && nodataval >= 0 && nodataval <= 255;
+    std::size_t i = 0;
+#ifdef SSE_MATH
+    i = expand_grayscale_sse2(gray, count, mask_nodata, nodataval, rgba);
+#endif
+    for (; i < count; ++i)
+    {
+        uint8_t val = gray[i];
+        uint8_t* px = rgba + i * 4;
+        px[0] = val;
+        px[1] = val;
+        px[2] = val;
+        px[3] = (mask_nodata && val == nodataval) ? 0x00 : 0xFF;
+    }
+}
+
+// Interleaves up to four planar 8 bit bands into RGBA. Missing planes
+// leave the corresponding channel untouched.
+inline void interleave_rgba(const uint8_t* const planes[4], std::size_t count, uint8_t* rgba)
+{
+    std::size_t i = 0;
+#ifdef SSE_MATH
+    if (planes[0] && planes[1] && planes[2])
+    {
+        i = interleave_rgba_sse2(planes, count, rgba);
+    }
+#endif
+    for (int bn = 0; bn < 4; ++bn)
+    {
+        const uint8_t* plane = planes[bn];
+        if (!plane) continue;
+        for (std::size_t j = i; j < count; ++j)
+        {
+            rgba[j * 4 + bn] = plane[j];
+        }
+    }
+}
+
+} // namespace pgraster_band
+
+#endif // PGRASTER_BAND_CONVERT_HPP
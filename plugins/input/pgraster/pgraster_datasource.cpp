@@ -28,6 +28,7 @@
 #include "../postgis/asyncresultset.hpp"
 #include "pgraster_datasource.hpp"
 #include "pgraster_featureset.hpp"
+#include "pgraster_tile_cache.hpp"
 
 // mapnik
 #include <mapnik/debug.hpp>
@@ -63,6 +64,13 @@ using mapnik::sql_utils::identifier;
 using mapnik::sql_utils::literal;
 using mapnik::value_integer;
 
+namespace {
+
+// bounds the list of cached row keys sent along with a query
+constexpr std::size_t max_cached_tiles_per_query = 4096;
+
+}
+
 pgraster_datasource::pgraster_datasource(parameters const& params)
     : datasource(params),
       table_(*params.get<std::string>("table", "")),
@@ -78,6 +86,8 @@ pgraster_datasource::pgraster_datasource(parameters const& params)
       prescale_rasters_(*params.get<mapnik::boolean_type>("prescale_rasters", false)),
       use_overviews_(*params.get<mapnik::boolean_type>("use_overviews", false)),
       clip_rasters_(*params.get<mapnik::boolean_type>("clip_rasters", false)),
+      aggregate_rasters_(*params.get<mapnik::boolean_type>("aggregate_rasters", false)),
+      tile_cache_size_(*params.get<value_integer>("tile_cache_size", 0)),
       desc_(*params.get<std::string>("type"), "utf-8"),
       creator_(params.get<std::string>("host"),
              params.get<std::string>("port"),
@@ -124,6 +134,14 @@ pgraster_datasource::pgraster_datasource(parameters const& params)
         asynchronous_request_ = true;
     }
 
+    if (tile_cache_size_ > 0)
+    {
+        // the cache is shared, the largest size any datasource asks for wins
+        pgraster_tile_cache & cache = pgraster_tile_cache::instance();
+        std::size_t max_bytes = static_cast<std::size_t>(tile_cache_size_);
+        if (max_bytes > cache.max_bytes()) cache.set_max_bytes(max_bytes);
+    }
+
     boost::optional<value_integer> initial_size = params.get<value_integer>("initial_size", 1);
     boost::optional<mapnik::boolean_type> autodetect_key_field = params.get<mapnik::boolean_type>("autodetect_key_field", false);
 
@@ -706,7 +724,7 @@ std::string pgraster_datasource::populate_tokens(std::string const& sql,
 }
 
 
-std::shared_ptr<IResultSet> pgraster_datasource::get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx) const
+std::shared_ptr<IResultSet> pgraster_datasource::get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx, mapnik::cancellation_token const& cancel) const
 {
 
     if (!ctx)
@@ -722,6 +740,7 @@ std::shared_ptr<IResultSet> pgraster_datasource::get_resultset(std::shared_ptr<C
 
             if (! conn->execute(csql.str()))
             {
+                conn->clearCancellation();
                 // TODO - better error
                 throw mapnik::datasource_exception("Pgraster Plugin: error creating cursor for data select." );
             }
@@ -732,7 +751,18 @@ std::shared_ptr<IResultSet> pgraster_datasource::get_resultset(std::shared_ptr<C
         else
         {
             // no cursor
-            return conn->executeQuery(sql, 1);
+            std::shared_ptr<ResultSet> rs;
+            try
+            {
+                rs = conn->executeQuery(sql, 1);
+            }
+            catch (...)
+            {
+                conn->clearCancellation();
+                throw;
+            }
+            conn->clearCancellation();
+            return rs;
         }
     }
     else
@@ -743,12 +773,12 @@ std::shared_ptr<IResultSet> pgraster_datasource::get_resultset(std::shared_ptr<C
         {
             // lauch async req & create asyncresult with conn
             conn->executeAsyncQuery(sql, 1);
-            return std::make_shared<AsyncResultSet>(pgis_ctxt, pool, conn, sql);
+            return std::make_shared<AsyncResultSet>(pgis_ctxt, pool, conn, sql, cancel);
         }
         else
         {
             // create asyncresult  with  null connection
-            std::shared_ptr<AsyncResultSet> res = std::make_shared<AsyncResultSet>(pgis_ctxt, pool,  conn, sql);
+            std::shared_ptr<AsyncResultSet> res = std::make_shared<AsyncResultSet>(pgis_ctxt, pool,  conn, sql, cancel);
             pgis_ctxt->add_request(res);
             return res;
         }
@@ -824,6 +854,12 @@ featureset_ptr pgraster_datasource::features_with_context(query const& q,process
             }
         }
 
+        if (conn)
+        {
+            // a deadline becomes the statement_timeout of this query
+            conn->setCancellation(q.cancellation());
+        }
+
 
         if (geometryColumn_.empty())
         {
@@ -887,22 +923,57 @@ featureset_ptr pgraster_datasource::features_with_context(query const& q,process
           boost::algorithm::replace_all(table_with_bbox, parsed_schema_, sch);
           boost::algorithm::replace_all(table_with_bbox, geometryColumn_, col);
         }
+        // identifies the (overview) table in the tile cache key
+        std::string const raster_table = table_with_bbox;
         table_with_bbox = populate_tokens(table_with_bbox, scale_denom, box,
                                           px_gw, px_gh, q.variables());
 
+        // decoded tiles only depend on the row when they are neither
+        // clipped nor resized to the query
+        std::string cache_key;
+        pgraster_tile_cache::tile_map cached;
+        if (tile_cache_size_ > 0 && !key_field_.empty() &&
+            !aggregate_rasters_ && !clip_rasters_ && !prescale_rasters_)
+        {
+            std::ostringstream k;
+            k << creator_.id() << '|' << raster_table << '|' << col << '|' << band_ << '|';
+            cache_key = k.str();
+            cached = pgraster_tile_cache::instance().find_layer(cache_key, max_cached_tiles_per_query);
+        }
+
         std::ostringstream s;
 
-        s << "SELECT ST_AsBinary(";
+        s << "SELECT ";
+
+        // rows whose tile is already decoded don't transfer the raster
+        if (!cached.empty())
+        {
+            s << "CASE WHEN " << identifier(key_field_) << " IN (";
+            bool first = true;
+            for (auto const& tile : cached)
+            {
+                if (!first) s << ',';
+                s << tile.first;
+                first = false;
+            }
+            s << ") THEN NULL ELSE ";
+        }
+
+        s << "ST_AsBinary(";
+
+        // merge the intersecting tiles, each clipped to the query box,
+        // into a single raster on the server side
+        if (aggregate_rasters_) s << "ST_Union(";
 
         if (band_) s << "ST_Band(";
 
         if (prescale_rasters_) s << "ST_Resize(";
 
-        if (clip_rasters_) s << "ST_Clip(";
+        if (clip_rasters_ || aggregate_rasters_) s << "ST_Clip(";
 
         s << identifier(col);
 
-        if (clip_rasters_) {
+        if (clip_rasters_ || aggregate_rasters_) {
           s << ", ST_Expand(" << sql_bbox(box)
             << ", greatest(abs(ST_ScaleX("
             << identifier(col) << ")), abs(ST_ScaleY("
@@ -921,14 +992,24 @@ featureset_ptr pgraster_datasource::features_with_context(query const& q,process
 
         if (band_) s << ", " << band_ << ")";
 
-        s << ") AS geom";
+        if (aggregate_rasters_) s << ")";
+
+        s << ")";
+
+        if (!cached.empty()) s << " END";
+
+        s << " AS geom";
 
         mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
         std::set<std::string> const& props = q.property_names();
         std::set<std::string>::const_iterator pos = props.begin();
         std::set<std::string>::const_iterator end = props.end();
 
-        if (! key_field_.empty())
+        if (aggregate_rasters_)
+        {
+            // attributes of the individual tiles are lost in the union
+        }
+        else if (! key_field_.empty())
         {
             s << ',' << identifier(key_field_);
             ctx->push(key_field_);
@@ -961,12 +1042,13 @@ featureset_ptr pgraster_datasource::features_with_context(query const& q,process
         MAPNIK_LOG_DEBUG(pgraster) << "pgraster_datasource: "
           "features query: " << s.str();
 
-        std::shared_ptr<IResultSet> rs = get_resultset(conn, s.str(), pool, proc_ctx);
+        std::shared_ptr<IResultSet> rs = get_resultset(conn, s.str(), pool, proc_ctx, q.cancellation());
         return std::make_shared<pgraster_featureset>(rs, ctx,
-                  desc_.get_encoding(), !key_field_.empty(),
-                  band_ ? 1 : 0 // whatever band number is given we'd have
-                                // extracted with ST_Band above so it becomes
-                                // band number 1
+                  desc_.get_encoding(), !key_field_.empty() && !aggregate_rasters_,
+                  band_ ? 1 : 0, // whatever band number is given we'd have
+                                 // extracted with ST_Band above so it becomes
+                                 // band number 1
+                  cache_key, cached
                );
 
     }
@@ -97,7 +97,7 @@ private:
                                 mapnik::attributes const& vars,
                                 bool intersect = true) const;
     std::string populate_tokens(std::string const& sql) const;
-    std::shared_ptr<IResultSet> get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx= processor_context_ptr()) const;
+    std::shared_ptr<IResultSet> get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx= processor_context_ptr(), mapnik::cancellation_token const& cancel = mapnik::cancellation_token()) const;
     static const std::string RASTER_COLUMNS;
     static const std::string RASTER_OVERVIEWS;
     static const std::string SPATIAL_REF_SYS;
@@ -130,6 +130,10 @@ private:
     bool prescale_rasters_;
     bool use_overviews_;
     bool clip_rasters_;
+    // fetch a single raster per query, unioned from the tiles clipped to the query box
+    bool aggregate_rasters_;
+    // byte budget of the shared decoded tile cache, 0 disables it
+    mapnik::value_integer tile_cache_size_;
     layer_descriptor desc_;
     ConnectionCreator<Connection> creator_;
     std::regex re_tokens_;
@@ -26,6 +26,7 @@
 
 #include "pgraster_featureset.hpp"
 #include "pgraster_wkb_reader.hpp"
+#include "pgraster_tile_cache.hpp"
 #include "../postgis/resultset.hpp"
 #include "../postgis/cursorresultset.hpp"
 #include "../postgis/numeric2string.hpp"
@@ -50,16 +51,33 @@
 using mapnik::feature_factory;
 using mapnik::context_ptr;
 
+namespace {
+
+mapnik::raster_ptr copy_raster(mapnik::raster const& raster)
+{
+    mapnik::raster_ptr copy = std::make_shared<mapnik::raster>(raster.ext_, raster.query_ext_,
+                                                               mapnik::image_any(raster.data_),
+                                                               raster.get_filter_factor());
+    copy->nodata_ = raster.nodata_;
+    return copy;
+}
+
+}
+
 pgraster_featureset::pgraster_featureset(std::shared_ptr<IResultSet> const& rs,
                                        context_ptr const& ctx,
                                        std::string const& encoding,
-                                       bool key_field, int bandno)
+                                       bool key_field, int bandno,
+                                       std::string const& cache_key,
+                                       pgraster_tile_cache::tile_map const& cached)
     : rs_(rs),
       ctx_(ctx),
       tr_(new transcoder(encoding)),
       feature_id_(1),
       key_field_(key_field),
-      band_(bandno)
+      band_(bandno),
+      cache_key_(key_field ? cache_key : std::string()),
+      cached_(cached)
 {
 }
 
@@ -119,23 +137,50 @@ feature_ptr pgraster_featureset::next()
             ++feature_id_;
         }
 
-        // null geometry is not acceptable
-        if (rs_->isNull(0))
+        mapnik::raster_ptr raster;
+        // cache_key_ is only set with a key field, whose value is the feature id
+        if (!cache_key_.empty())
         {
-            MAPNIK_LOG_WARN(pgraster) << "pgraster_featureset: null value encountered for raster";
-            continue;
+            raster = pgraster_tile_cache::instance().find(cache_key_, feature->id());
+            if (!raster)
+            {
+                // evicted since the query was built, its raster wasn't fetched
+                auto itr = cached_.find(feature->id());
+                if (itr != cached_.end()) raster = itr->second;
+            }
+            if (raster && raster->data_.is<mapnik::image_rgba8>())
+            {
+                // rgba rasters are premultiplied in place by the renderer,
+                // hand out a private copy
+                raster = copy_raster(*raster);
+            }
         }
 
-        // parse geometry
-        int size = rs_->getFieldLength(0);
-        const uint8_t *data = (const uint8_t*)rs_->getValue(0);
-
-        mapnik::raster_ptr raster = pgraster_wkb_reader::read(data, size, band_);
         if (!raster)
         {
-            MAPNIK_LOG_WARN(pgraster) << "pgraster_featureset: could not parse raster wkb";
-            // TODO: throw an exception ?
-            continue;
+            // null geometry is not acceptable
+            if (rs_->isNull(0))
+            {
+                MAPNIK_LOG_WARN(pgraster) << "pgraster_featureset: null value encountered for raster";
+                continue;
+            }
+
+            // parse geometry
+            int size = rs_->getFieldLength(0);
+            const uint8_t *data = (const uint8_t*)rs_->getValue(0);
+
+            raster = pgraster_wkb_reader::read(data, size, band_);
+            if (!raster)
+            {
+                MAPNIK_LOG_WARN(pgraster) << "pgraster_featureset: could not parse raster wkb";
+                // TODO: throw an exception ?
+                continue;
+            }
+            if (!cache_key_.empty())
+            {
+                pgraster_tile_cache::instance().insert(cache_key_, feature->id(),
+                                                       raster->data_.is<mapnik::image_rgba8>() ? copy_raster(*raster) : raster);
+            }
         }
         MAPNIK_LOG_WARN(pgraster) << "pgraster_featureset: raster of " << raster->data_.width() << "x" << raster->data_.height() << " pixels covering extent " << raster->ext_;
         feature->set_raster(raster);
@@ -33,8 +33,11 @@
 #include <mapnik/feature.hpp>
 #include <mapnik/unicode.hpp>
 
+#include "pgraster_tile_cache.hpp"
+
 // stl
 #include <memory>
+#include <string>
 
 using mapnik::Featureset;
 using mapnik::box2d;
@@ -51,11 +54,18 @@ public:
     /// @param bandno band number (1-based). 0 (default) reads all bands.
     ///               Anything else forces interpretation of colors off
     ///               (values copied verbatim)
+    /// @param cache_key prefix of the keys used to share decoded rasters
+    ///                  through pgraster_tile_cache. Empty disables caching,
+    ///                  requires key_field.
+    /// @param cached tiles of the layer found in the cache when the query
+    ///               was built, the query returns no raster for their rows
     pgraster_featureset(std::shared_ptr<IResultSet> const& rs,
                        context_ptr const& ctx,
                        std::string const& encoding,
                        bool key_field = false,
-                       int bandno = 0);
+                       int bandno = 0,
+                       std::string const& cache_key = std::string(),
+                       pgraster_tile_cache::tile_map const& cached = pgraster_tile_cache::tile_map());
     feature_ptr next();
     ~pgraster_featureset();
 
@@ -66,6 +76,8 @@ private:
     mapnik::value_integer feature_id_;
     bool key_field_;
     int band_;
+    std::string cache_key_;
+    pgraster_tile_cache::tile_map cached_;
 };
 
 #endif // PGRASTER_FEATURESET_HPP
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************
+ *
+ * Initially developed by Sandro Santilli <strk@keybit.net> for CartoDB
+ *
+ *****************************************************************************/
+
+#ifndef PGRASTER_TILE_CACHE_HPP
+#define PGRASTER_TILE_CACHE_HPP
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/raster.hpp>
+#include <mapnik/value/types.hpp>
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+// stl
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
+
+using mapnik::singleton;
+using mapnik::CreateStatic;
+
+// Process wide cache of decoded raster tiles, shared by all pgraster
+// datasources and bounded by the total number of pixel bytes it holds.
+// Tiles are keyed by a layer prefix (connection, table, column and band)
+// and their row key; a per-layer index lists the tiles of each layer.
+class pgraster_tile_cache : public singleton<pgraster_tile_cache, CreateStatic>,
+                            private mapnik::util::noncopyable
+{
+    friend class CreateStatic<pgraster_tile_cache>;
+public:
+    using tile_map = std::unordered_map<mapnik::value_integer, mapnik::raster_ptr>;
+
+private:
+    struct key_type
+    {
+        std::string layer;
+        mapnik::value_integer row;
+        bool operator==(key_type const& rhs) const
+        {
+            return row == rhs.row && layer == rhs.layer;
+        }
+    };
+    struct key_hash
+    {
+        std::size_t operator()(key_type const& key) const
+        {
+            std::size_t seed = std::hash<std::string>()(key.layer);
+            mapnik::util::hash_combine(seed, std::hash<mapnik::value_integer>()(key.row));
+            return seed;
+        }
+    };
+    // keeps the tiles of each layer in step with the cache
+    struct layer_index : mapnik::util::lru_cache_policy
+    {
+        std::unordered_map<std::string, tile_map> layers;
+        void erased(key_type const& key, mapnik::raster_ptr const&)
+        {
+            auto itr = layers.find(key.layer);
+            if (itr == layers.end()) return;
+            itr->second.erase(key.row);
+            if (itr->second.empty()) layers.erase(itr);
+        }
+    };
+    mapnik::util::lru_cache<key_type, mapnik::raster_ptr, key_hash, layer_index> cache_;
+
+    pgraster_tile_cache()
+        : cache_(0) {}
+
+public:
+    mapnik::raster_ptr find(std::string const& layer, mapnik::value_integer row)
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        mapnik::raster_ptr const* raster = cache_.find(key_type{layer, row});
+        return raster ? *raster : mapnik::raster_ptr();
+    }
+
+    void insert(std::string const& layer, mapnik::value_integer row, mapnik::raster_ptr const& raster)
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        if (cache_.insert(key_type{layer, row}, raster, raster->data_.size()))
+        {
+            cache_.policy().layers[layer].emplace(row, raster);
+        }
+    }
+
+    // Up to `max_count` tiles of a layer, by row key. The returned rasters
+    // stay valid when the cache evicts them.
+    tile_map find_layer(std::string const& layer, std::size_t max_count)
+    {
+        tile_map tiles;
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        auto const& layers = cache_.policy().layers;
+        auto itr = layers.find(layer);
+        if (itr == layers.end()) return tiles;
+        for (auto const& tile : itr->second)
+        {
+            if (tiles.size() >= max_count) break;
+            tiles.insert(tile);
+        }
+        return tiles;
+    }
+
+    void clear()
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        cache_.clear();
+    }
+
+    void set_max_bytes(std::size_t max_bytes)
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        cache_.set_max_bytes(max_bytes);
+    }
+
+    std::size_t max_bytes() const
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        return cache_.max_bytes();
+    }
+
+    mapnik::util::lru_cache_stats stats() const
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        return cache_.stats();
+    }
+};
+
+#endif // PGRASTER_TILE_CACHE_HPP
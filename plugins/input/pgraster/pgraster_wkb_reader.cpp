@@ -36,9 +36,11 @@
 #include <mapnik/util/conversions.hpp>
 #include <mapnik/util/trim.hpp>
 #include <mapnik/geometry/box2d.hpp> // for box2d
-#include <functional>
+
+#include "pgraster_band_convert.hpp"
 
 #include <cstdint>
+#include <vector>
 
 namespace {
 
@@ -132,19 +134,6 @@ read_int32(const uint8_t** from, uint8_t littleEndian) {
     return read_uint32(from, littleEndian);
 }
 
-float
-read_float32(const uint8_t** from, uint8_t littleEndian) {
-
-    union {
-        float f;
-        uint32_t i;
-    } ret;
-
-    ret.i = read_uint32(from, littleEndian);
-
-    return ret.f;
-}
-
 
 typedef enum {
     PT_1BB=0,     /* 1-bit boolean            */
@@ -174,23 +163,95 @@ typedef enum {
 #define BANDTYPE_HAS_NODATA(x) ((x)&BANDTYPE_FLAG_HASNODATA)
 #define BANDTYPE_IS_NODATA(x) ((x)&BANDTYPE_FLAG_ISNODATA)
 
+using pgraster_band::load_value;
+
+// Converts `count` pixels of type `pixtype` into floats, returns false
+// for unsupported pixel types. Signed types are read as unsigned,
+// mapnik does not support signed anyway.
+bool convert_band(int pixtype, const uint8_t* src, std::size_t count, bool little_endian, float* dst)
+{
+    switch (pixtype)
+    {
+    case PT_1BB:
+    case PT_2BUI:
+    case PT_4BUI:
+    case PT_8BSI:
+    case PT_8BUI:
+        pgraster_band::convert_u8(src, count, dst);
+        return true;
+    case PT_16BSI:
+    case PT_16BUI:
+        pgraster_band::convert_16(src, count, little_endian, dst);
+        return true;
+    case PT_32BSI:
+    case PT_32BUI:
+        pgraster_band::convert_scalar<uint32_t>(src, count, little_endian, dst);
+        return true;
+    case PT_32BF:
+        pgraster_band::convert_f32(src, count, little_endian, dst);
+        return true;
+    case PT_64BF:
+        pgraster_band::convert_f64(src, count, little_endian, dst);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Size in bytes of a single pixel value in the WKB, 0 if unsupported
+std::size_t pixel_size(int pixtype)
+{
+    switch (pixtype)
+    {
+    case PT_1BB:
+    case PT_2BUI:
+    case PT_4BUI:
+    case PT_8BSI:
+    case PT_8BUI:
+        return 1;
+    case PT_16BSI:
+    case PT_16BUI:
+        return 2;
+    case PT_32BSI:
+    case PT_32BUI:
+    case PT_32BF:
+        return 4;
+    case PT_64BF:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+// Clamps 16 and 32 bit integer pixels to 0..255 ala GDAL. 32 bit
+// values are clipped as signed integers.
+void clamp_to_gray(int pixtype, const uint8_t* src, std::size_t count, bool little_endian, uint8_t* dst)
+{
+    if (pixel_size(pixtype) == 2)
+    {
+        pgraster_band::clamp_16_to_gray(src, count, little_endian, dst);
+    }
+    else
+    {
+        pgraster_band::clamp_32_to_gray(src, count, little_endian, dst);
+    }
+}
+
 }
 
-template<typename T>
 mapnik::raster_ptr read_data_band(mapnik::box2d<double> const& bbox,
                     uint16_t width, uint16_t height,
-                    bool hasnodata, T reader)
+                    bool hasnodata, int pixtype, uint8_t endian,
+                    const uint8_t** from)
 {
+  std::size_t const ps = pixel_size(pixtype);
+  std::size_t const count = std::size_t(width) * height;
   mapnik::image_gray32f image(width, height);
-  float* data = image.data();
-  double nodataval = reader();
-  for (int y=0; y<height; ++y) {
-    for (int x=0; x<width; ++x) {
-      double val = reader();
-      int off = y * width + x;
-      data[off] = val;
-    }
-  }
+  float nodataval;
+  convert_band(pixtype, *from, 1, endian, &nodataval);
+  *from += ps;
+  convert_band(pixtype, *from, count, endian, image.data());
+  *from += count * ps;
   mapnik::raster_ptr raster = std::make_shared<mapnik::raster>(bbox, image, 1.0);
   if ( hasnodata ) raster->set_nodata(nodataval);
   return raster;
@@ -217,83 +278,47 @@ mapnik::raster_ptr pgraster_wkb_reader::read_indexed(mapnik::box2d<double> const
 
   MAPNIK_LOG_DEBUG(pgraster) << "pgraster_wkb_reader: reading " << height_ << "x" << width_ << " pixels";
 
-  switch (pixtype) {
-    case PT_1BB:
-    case PT_2BUI:
-    case PT_4BUI:
-      // all <8BPP values are wrote in full bytes anyway
-    case PT_8BSI:
-      // mapnik does not support signed anyway
-    case PT_8BUI:
-      return read_data_band(bbox, width_, height_, hasnodata,
-                     std::bind(read_uint8, &ptr_));
-      break;
-    case PT_16BSI:
-      // mapnik does not support signed anyway
-    case PT_16BUI:
-      return read_data_band(bbox, width_, height_, hasnodata,
-                     std::bind(read_uint16, &ptr_, endian_));
-      break;
-    case PT_32BSI:
-      // mapnik does not support signed anyway
-    case PT_32BUI:
-      return read_data_band(bbox, width_, height_, hasnodata,
-                     std::bind(read_uint32, &ptr_, endian_));
-      break;
-    case PT_32BF:
-      return read_data_band(bbox, width_, height_, hasnodata,
-                     std::bind(read_float32, &ptr_, endian_));
-      break;
-    case PT_64BF:
-      return read_data_band(bbox, width_, height_, hasnodata,
-                     std::bind(read_float64, &ptr_, endian_));
-      break;
-    default:
+  if ( ! pixel_size(pixtype) ) {
       std::ostringstream err;
       err << "pgraster_wkb_reader: data band type " << pixtype << " unsupported";
       // TODO: accept policy to decide on throw-or-skip ?
       //MAPNIK_LOG_WARN(pgraster) << err.str();
       throw mapnik::datasource_exception(err.str());
   }
-  return mapnik::raster_ptr();
+  // all <8BPP values are wrote in full bytes anyway
+  return read_data_band(bbox, width_, height_, hasnodata, pixtype, endian_, &ptr_);
 }
 
-template<typename T>
 mapnik::raster_ptr read_grayscale_band(mapnik::box2d<double> const& bbox,
                          uint16_t width, uint16_t height,
-                         bool hasnodata, T reader)
+                         bool hasnodata, int pixtype, uint8_t endian,
+                         const uint8_t** from)
 {
   mapnik::image_rgba8 image(width,height, true, true);
-  // Start with plain white (ABGR or RGBA depending on endiannes)
-  // TODO: set to transparent instead?
-  image.set(0xffffffff);
-
-
-  uint8_t * data = image.bytes();
-  int ps = 4; // sizeof(image::pixel_type)
-  int off;
-  int nodataval = reader();
-  for (int y=0; y<height; ++y) {
-    for (int x=0; x<width; ++x) {
-      int val = reader();
-      // Apply harsh type clipping rules ala GDAL
-      if ( val < 0 ) val = 0;
-      if ( val > 255 ) val = 255;
-      // Calculate pixel offset
-      off = y * width * ps + x * ps;
-      // Pixel space is RGBA, fill all w/ same value for Grey
-      data[off+0] = val;
-      data[off+1] = val;
-      data[off+2] = val;
-      // Set the alpha channel for transparent nodata values
-      // Nodata handling is *manual* at the driver level
-      if ( hasnodata && val == nodataval ) {
-          data[off+3] = 0x00; // transparent
-      } else {
-          data[off+3] = 0xFF; // opaque
-      }
-    }
+  std::size_t const ps = pixel_size(pixtype);
+  std::size_t const count = std::size_t(width) * height;
+  // Apply harsh type clipping rules ala GDAL
+  int nodataval;
+  if ( ps == 1 ) {
+    nodataval = **from;
+  } else if ( ps == 2 ) {
+    nodataval = load_value<uint16_t>(*from, endian);
+  } else {
+    nodataval = load_value<int32_t>(*from, endian);
+  }
+  *from += ps;
+  const uint8_t* gray = *from;
+  std::vector<uint8_t> clamped;
+  if ( ps > 1 ) {
+    clamped.resize(count);
+    clamp_to_gray(pixtype, *from, count, endian, clamped.data());
+    gray = clamped.data();
   }
+  *from += count * ps;
+  // Pixel space is RGBA, fill all w/ same value for Grey
+  // Set the alpha channel for transparent nodata values
+  // Nodata handling is *manual* at the driver level
+  pgraster_band::expand_grayscale(gray, count, hasnodata, nodataval, image.bytes());
   mapnik::raster_ptr raster = std::make_shared<mapnik::raster>(bbox, image, 1.0);
   if ( hasnodata ) raster->set_nodata(nodataval);
   return raster;
@@ -326,20 +351,12 @@ mapnik::raster_ptr pgraster_wkb_reader::read_grayscale(mapnik::box2d<double> con
     case PT_8BSI:
       // mapnik does not support signed anyway
     case PT_8BUI:
-      return read_grayscale_band(bbox, width_, height_, hasnodata,
-                          std::bind(read_uint8, &ptr_));
-      break;
     case PT_16BSI:
-      // mapnik does not support signed anyway
     case PT_16BUI:
-      return read_grayscale_band(bbox, width_, height_, hasnodata,
-                          std::bind(read_uint16, &ptr_, endian_));
-      break;
     case PT_32BSI:
-      // mapnik does not support signed anyway
     case PT_32BUI:
       return read_grayscale_band(bbox, width_, height_, hasnodata,
-                          std::bind(read_uint32, &ptr_, endian_));
+                          pixtype, endian_, &ptr_);
       break;
     default:
       std::ostringstream err;
@@ -358,6 +375,8 @@ mapnik::raster_ptr pgraster_wkb_reader::read_rgba(mapnik::box2d<double> const& b
   // Start with plain white (ABGR or RGBA depending on endiannes)
   im.set(0xffffffff);
 
+  std::size_t const count = std::size_t(width_) * height_;
+  const uint8_t* planes[4] = { nullptr, nullptr, nullptr, nullptr };
   uint8_t nodataval;
   for (int bn=0; bn<numBands_; ++bn) {
     uint8_t type = read_uint8(&ptr_);
@@ -389,19 +408,11 @@ mapnik::raster_ptr pgraster_wkb_reader::read_rgba(mapnik::box2d<double> const& b
             << " nodataval " << tmp << " != band 0 nodataval " << nodataval;
     }
 
-    int ps = 4; // sizeof(image::pixel_type)
-    uint8_t * image_data = im.bytes();
-    for (int y=0; y<height_; ++y) {
-      for (int x=0; x<width_; ++x) {
-        uint8_t val = read_uint8(&ptr_);
-        // y * width_ * ps is the row (ps is pixel size)
-        // x * ps is the column
-        int off = y * width_ * ps + x * ps;
-        // Pixel space is RGBA
-        image_data[off+bn] = val;
-      }
-    }
+    // Pixel space is RGBA, bands are interleaved once all are located
+    if ( bn < 4 ) planes[bn] = ptr_;
+    ptr_ += count;
   }
+  pgraster_band::interleave_rgba(planes, count, im.bytes());
   mapnik::raster_ptr raster = std::make_shared<mapnik::raster>(bbox, im, 1.0);
   raster->set_nodata(0xffffffff);
   return raster;
@@ -25,6 +25,7 @@
 
 #include <mapnik/debug.hpp>
 #include <mapnik/datasource.hpp>
+#include <mapnik/cancellation_token.hpp>
 
 #include "connection_manager.hpp"
 #include "resultset.hpp"
@@ -39,11 +40,13 @@ class AsyncResultSet : public IResultSet, private mapnik::util::noncopyable
 public:
     AsyncResultSet(postgis_processor_context_ptr const& ctx,
                      std::shared_ptr< Pool<Connection,ConnectionCreator> > const& pool,
-                     std::shared_ptr<Connection> const& conn, std::string const& sql )
+                     std::shared_ptr<Connection> const& conn, std::string const& sql,
+                     mapnik::cancellation_token const& cancel = mapnik::cancellation_token())
         : ctx_(ctx),
           pool_(pool),
           conn_(conn),
           sql_(sql),
+          cancel_(cancel),
           is_closed_(false)
     {
     }
@@ -79,6 +82,10 @@ public:
                 {
                     abort();
                 }
+                else
+                {
+                    conn_->clearCancellation();
+                }
                 conn_.reset();
             }
         }
@@ -99,6 +106,11 @@ public:
             {
                 rs_ = conn_->getAsyncResult();
             }
+            else if (!conn_ && cancel_.cancelled())
+            {
+                // never sent, see prepare()
+                throw mapnik::datasource_exception("Postgis Plugin: query cancelled");
+            }
             else
             {
                 throw mapnik::datasource_exception("invalid connection in AsyncResultSet::next");
@@ -165,14 +177,21 @@ private:
     std::shared_ptr< Pool<Connection,ConnectionCreator> > pool_;
     std::shared_ptr<Connection> conn_;
     std::string sql_;
+    mapnik::cancellation_token cancel_;
     std::shared_ptr<ResultSet> rs_;
     bool is_closed_;
 
     void prepare()
     {
+        if (cancel_.cancelled())
+        {
+            // don't start queued queries of an abandoned render
+            return;
+        }
         conn_ = pool_->borrowObject();
         if (conn_ && conn_->isOK())
         {
+            conn_->setCancellation(cancel_);
             conn_->executeAsyncQuery(sql_, 1);
         }
         else
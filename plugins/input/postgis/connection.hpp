@@ -27,8 +27,12 @@
 #include <mapnik/debug.hpp>
 #include <mapnik/datasource.hpp>
 #include <mapnik/timer.hpp>
+#include <mapnik/cancellation_token.hpp>
 
 // std
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <memory>
 #include <sstream>
 #include <iostream>
@@ -37,6 +41,12 @@ extern "C" {
 #include "libpq-fe.h"
 }
 
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
 #include "resultset.hpp"
 
 class Connection
@@ -45,7 +55,8 @@ public:
     Connection(std::string const& connection_str,boost::optional<std::string> const& password)
         : cursorId(0),
           closed_(false),
-          pending_(false)
+          pending_(false),
+          statement_timeout_(0)
     {
         std::string connect_with_pass = connection_str;
         if (password && !password->empty())
@@ -161,6 +172,10 @@ public:
 
     bool executeAsyncQuery(std::string const& sql, int type = 0)
     {
+        if (!cancel_ && statement_timeout_ != 0 && !setStatementTimeout(0))
+        {
+            MAPNIK_LOG_WARN(postgis) << "postgis_connection: failed to reset statement_timeout - " << status();
+        }
         int result = 0;
         if (type == 1)
         {
@@ -187,10 +202,76 @@ public:
 
     PGresult* getResult()
     {
+        if (cancel_ && !waitForResult())
+        {
+            // the caller gave up: stop the statement server side and
+            // let the error result below report it
+            MAPNIK_LOG_DEBUG(postgis) << "postgis_connection: cancelling query - " << this;
+            cancel_ = mapnik::cancellation_token();
+            cancel();
+        }
         PGresult *result = PQgetResult(conn_);
         return result;
     }
 
+    // Binds the cancellation token of the query about to run. Waiting for
+    // its results gives up once the token fires, and a deadline is passed
+    // on to the server as statement_timeout so an abandoned query doesn't
+    // keep the backend busy.
+    void setCancellation(mapnik::cancellation_token const& token)
+    {
+        cancel_ = mapnik::cancellation_token();
+        int timeout = 0;
+        if (boost::optional<std::chrono::milliseconds> remaining = token.remaining())
+        {
+            if (remaining->count() <= 0)
+            {
+                throw mapnik::datasource_exception("Postgis Plugin: query deadline exceeded");
+            }
+            timeout = statementTimeoutBucket(*remaining);
+        }
+        if (timeout != statement_timeout_ && !setStatementTimeout(timeout))
+        {
+            throw mapnik::datasource_exception("Postgis Plugin: " + status() + "in setCancellation");
+        }
+        cancel_ = token;
+    }
+
+    // Unbinds the token once the query is done. The session keeps its
+    // statement_timeout, it is reset by the next query without a deadline.
+    void clearCancellation()
+    {
+        cancel_ = mapnik::cancellation_token();
+    }
+
+    // The deadline is enforced client side, the server side timeout is
+    // only a backstop. Rounding it up to a power of two seconds lets the
+    // queries of a render share one setting instead of sending a SET for
+    // each of them.
+    static int statementTimeoutBucket(std::chrono::milliseconds remaining)
+    {
+        long long timeout = 1000;
+        while (timeout < remaining.count() && timeout * 2 <= INT_MAX)
+        {
+            timeout *= 2;
+        }
+        return static_cast<int>(timeout);
+    }
+
+    // asks the server to abandon the running statement
+    void cancel()
+    {
+        if (PGcancel * c = PQgetCancel(conn_))
+        {
+            char errbuf[256];
+            if (!PQcancel(c, errbuf, sizeof(errbuf)))
+            {
+                MAPNIK_LOG_WARN(postgis) << "postgis_connection: cancel failed - " << errbuf;
+            }
+            PQfreeCancel(c);
+        }
+    }
+
     std::shared_ptr<ResultSet> getNextAsyncResult()
     {
         PGresult *result = getResult();
@@ -240,6 +321,17 @@ public:
         return pending_;
     }
 
+    // true while a result sent with executeAsyncQuery is still in transit,
+    // i.e. when getResult() would block
+    bool isBusy()
+    {
+        if (PQconsumeInput(conn_) == 0)
+        {
+            return false; // let getResult() report the error
+        }
+        return PQisBusy(conn_) != 0;
+    }
+
     void close()
     {
         if (! closed_)
@@ -262,6 +354,55 @@ private:
     int cursorId;
     bool closed_;
     bool pending_;
+    int statement_timeout_;
+    mapnik::cancellation_token cancel_;
+
+    // SET LOCAL would need an explicit transaction, so the setting is kept
+    // per session. Runs synchronously, the connection must be idle.
+    bool setStatementTimeout(int timeout)
+    {
+        std::ostringstream s;
+        if (timeout > 0) s << "SET statement_timeout = " << timeout;
+        else s << "RESET statement_timeout";
+        PGresult *result = PQexec(conn_, s.str().c_str());
+        bool ok = (result && (PQresultStatus(result) == PGRES_COMMAND_OK));
+        if ( result ) PQclear(result);
+        if (ok) statement_timeout_ = timeout;
+        return ok;
+    }
+
+    // Waits until a result can be read without blocking, returns false
+    // as soon as the cancellation token fires
+    bool waitForResult()
+    {
+        // a token cancelled from another thread can't wake select(), so
+        // wait in short slices
+        const std::chrono::milliseconds slice(50);
+        int sock = PQsocket(conn_);
+        while (!cancel_.cancelled())
+        {
+            if (PQconsumeInput(conn_) == 0 || PQisBusy(conn_) == 0 || sock < 0)
+            {
+                return true;
+            }
+            std::chrono::milliseconds wait = slice;
+            if (boost::optional<std::chrono::milliseconds> remaining = cancel_.remaining())
+            {
+                wait = std::max(std::chrono::milliseconds(1), std::min(wait, *remaining));
+            }
+            fd_set input;
+            FD_ZERO(&input);
+            FD_SET(sock, &input);
+            timeval tv;
+            tv.tv_sec = 0;
+            tv.tv_usec = static_cast<long>(wait.count() * 1000);
+            if (select(sock + 1, &input, nullptr, nullptr, &tv) < 0)
+            {
+                return true; // let PQgetResult report the error
+            }
+        }
+        return false;
+    }
 
     void clearAsyncResult(PGresult *result)
     {
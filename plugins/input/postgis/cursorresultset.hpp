@@ -25,9 +25,17 @@
 
 #include <mapnik/debug.hpp>
 
+// stl
+#include <algorithm>
+
 #include "connection.hpp"
 #include "resultset.hpp"
 
+// Fetches the cursor in batches of `fetch_count` rows. As soon as a batch
+// arrives the next FETCH is sent asynchronously, so the following batch is
+// transferred while the current one is being rendered. The batch size grows
+// when the consumer has to wait on the server and is capped by a byte budget
+// derived from the measured row size.
 class CursorResultSet : public IResultSet, private mapnik::util::noncopyable
 {
 public:
@@ -35,8 +43,12 @@ public:
         : conn_(conn),
           cursorName_(cursorName),
           fetch_size_(fetch_count),
-          is_closed_(false)
+          min_fetch_size_(fetch_count),
+          requested_(0),
+          is_closed_(false),
+          fetch_pending_(false)
     {
+        sendFetch();
         getNextResultSet();
     }
 
@@ -51,13 +63,25 @@ public:
         if (!is_closed_)
         {
             rs_.reset();
-
-            std::ostringstream s;
-            s << "CLOSE " << cursorName_;
-
-            MAPNIK_LOG_DEBUG(postgis) << "postgis_cursor_resultset: " << s.str();
-
-            conn_->execute(s.str());
+            // a failed FETCH closes the connection, there is nothing left to clean up
+            if (conn_->isOK())
+            {
+                if (fetch_pending_)
+                {
+                    // the connection can't take new commands until the
+                    // prefetched batch has been consumed
+                    discardFetch();
+                }
+
+                std::ostringstream s;
+                s << "CLOSE " << cursorName_;
+
+                MAPNIK_LOG_DEBUG(postgis) << "postgis_cursor_resultset: " << s.str();
+
+                conn_->execute(s.str());
+                conn_->clearCancellation();
+            }
+            fetch_pending_ = false;
             is_closed_ = true;
             conn_.reset();
         }
@@ -72,12 +96,16 @@ public:
     {
         if (rs_->next()) {
             return true;
-        } else if (rs_->size() == 0) {
+        } else if (!fetch_pending_) {
             close();
             return false;
         } else {
             getNextResultSet();
-            return rs_->next();
+            if (rs_->next()) {
+                return true;
+            }
+            close();
+            return false;
         }
     }
 
@@ -122,26 +150,65 @@ public:
     }
 
 private:
-    void getNextResultSet()
+    // upper bound for the payload of a single batch
+    static constexpr std::size_t max_batch_bytes = 16 * 1024 * 1024;
+
+    void sendFetch()
     {
         std::ostringstream s;
         s << "FETCH FORWARD " << fetch_size_ << " FROM " << cursorName_;
 
         MAPNIK_LOG_DEBUG(postgis) << "postgis_cursor_resultset: " << s.str();
 
-        rs_ = conn_->executeQuery(s.str());
+        conn_->executeAsyncQuery(s.str());
+        requested_ = fetch_size_;
+        fetch_pending_ = true;
+    }
+
+    void discardFetch()
+    {
+        while (PGresult * tmp = conn_->getResult())
+        {
+            PQclear(tmp);
+        }
+        fetch_pending_ = false;
+    }
+
+    void getNextResultSet()
+    {
+        bool stalled = conn_->isBusy();
+        // consumed below, or the connection is closed when the FETCH failed
+        fetch_pending_ = false;
+        rs_ = conn_->getAsyncResult();
+        // consume the terminating NULL result so the connection is ready for the next command
+        discardFetch();
         is_closed_ = false;
 
-        MAPNIK_LOG_DEBUG(postgis) << "postgis_cursor_resultset: FETCH result (" << cursorName_ << "): " << rs_->size() << " rows";
+        int rows = rs_->size();
+        MAPNIK_LOG_DEBUG(postgis) << "postgis_cursor_resultset: FETCH result (" << cursorName_ << "): "
+                                  << rows << " rows" << (stalled ? " (stalled)" : "");
+
+        // a short batch means the cursor is exhausted
+        if (rows < requested_) return;
+
+        if (stalled)
+        {
+            // the server is slower than rendering; fetch more rows per round trip
+            std::size_t row_bytes = std::max<std::size_t>(1, rs_->byte_size() / std::max(1, rows));
+            int max_rows = static_cast<int>(std::max<std::size_t>(min_fetch_size_, max_batch_bytes / row_bytes));
+            fetch_size_ = std::min(fetch_size_ * 2, max_rows);
+        }
+        sendFetch();
     }
 
     std::shared_ptr<Connection> conn_;
     std::string cursorName_;
     std::shared_ptr<ResultSet> rs_;
     int fetch_size_;
+    int min_fetch_size_;
+    int requested_;
     bool is_closed_;
-
-
+    bool fetch_pending_;
 };
 
 #endif // POSTGIS_CURSORRESULTSET_HPP
@@ -84,6 +84,7 @@ postgis_datasource::postgis_datasource(parameters const& params)
       max_async_connections_(*params_.get<mapnik::value_integer>("max_async_connection", 1)),
       asynchronous_request_(false),
       twkb_encoding_(false),
+      tile_geometry_mode_(false),
       twkb_rounding_adjustment_(*params_.get<mapnik::value_double>("twkb_rounding_adjustment", 0.0)),
       simplify_snap_ratio_(*params_.get<mapnik::value_double>("simplify_snap_ratio", 1.0/40.0)),
       // 1/20 of pixel seems to be a good compromise to avoid
@@ -138,6 +139,20 @@ postgis_datasource::postgis_datasource(parameters const& params)
     boost::optional<mapnik::boolean_type> twkb_opt = params.get<mapnik::boolean_type>("twkb_encoding", false);
     twkb_encoding_ = twkb_opt && *twkb_opt;
 
+    boost::optional<std::string> geometry_mode = params.get<std::string>("geometry_mode");
+    if (geometry_mode)
+    {
+        if (*geometry_mode == "tile")
+        {
+            tile_geometry_mode_ = true;
+        }
+        else if (*geometry_mode != "default")
+        {
+            throw mapnik::datasource_exception("PostGIS Plugin: unknown 'geometry_mode' '" + *geometry_mode
+                                               + "' (expected 'default' or 'tile')");
+        }
+    }
+
     boost::optional<mapnik::boolean_type> simplify_preserve_opt = params.get<mapnik::boolean_type>("simplify_dp_preserve", false);
     simplify_dp_preserve_ = simplify_preserve_opt && *simplify_preserve_opt;
 
@@ -527,6 +542,20 @@ std::string postgis_datasource::sql_bbox(box2d<double> const& env) const
     return b.str();
 }
 
+std::string postgis_datasource::sql_tile_geometry(box2d<double> const& env, double res_x, double res_y) const
+{
+    // Clip to the (already buffered) query box, move into pixel space relative
+    // to its lower left corner and snap to the integer grid. TWKB with zero
+    // decimals then ships every vertex as a small delta-encoded varint.
+    std::ostringstream g;
+    g << std::setprecision(16);
+    g << "ST_AsTWKB(ST_SnapToGrid(ST_TransScale(ST_ClipByBox2D("
+      << identifier(geometryColumn_) << "," << sql_bbox(env) << "),"
+      << -env.minx() << "," << -env.miny() << ","
+      << res_x << "," << res_y << "),1),0)";
+    return g.str();
+}
+
 std::string postgis_datasource::populate_tokens(std::string const& sql) const
 {
     return populate_tokens(sql, FLT_MAX,
@@ -636,7 +665,7 @@ void postgis_datasource::append_geometry_table(std::ostream & os) const
     }
 }
 
-std::shared_ptr<IResultSet> postgis_datasource::get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx) const
+std::shared_ptr<IResultSet> postgis_datasource::get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx, mapnik::cancellation_token const& cancel) const
 {
 
     if (!ctx)
@@ -652,6 +681,7 @@ std::shared_ptr<IResultSet> postgis_datasource::get_resultset(std::shared_ptr<Co
 
             if (! conn->execute(csql.str()))
             {
+                conn->clearCancellation();
                 // TODO - better error
                 throw mapnik::datasource_exception("Postgis Plugin: error creating cursor for data select." );
             }
@@ -662,7 +692,18 @@ std::shared_ptr<IResultSet> postgis_datasource::get_resultset(std::shared_ptr<Co
         else
         {
             // no cursor
-            return conn->executeQuery(sql, 1);
+            std::shared_ptr<ResultSet> rs;
+            try
+            {
+                rs = conn->executeQuery(sql, 1);
+            }
+            catch (...)
+            {
+                conn->clearCancellation();
+                throw;
+            }
+            conn->clearCancellation();
+            return rs;
         }
     }
     else
@@ -673,12 +714,12 @@ std::shared_ptr<IResultSet> postgis_datasource::get_resultset(std::shared_ptr<Co
         {
             // lauch async req & create asyncresult with conn
             conn->executeAsyncQuery(sql, 1);
-            return std::make_shared<AsyncResultSet>(pgis_ctxt, pool, conn, sql);
+            return std::make_shared<AsyncResultSet>(pgis_ctxt, pool, conn, sql, cancel);
         }
         else
         {
             // create asyncresult  with  null connection
-            std::shared_ptr<AsyncResultSet> res = std::make_shared<AsyncResultSet>(pgis_ctxt, pool,  conn, sql);
+            std::shared_ptr<AsyncResultSet> res = std::make_shared<AsyncResultSet>(pgis_ctxt, pool,  conn, sql, cancel);
             pgis_ctxt->add_request(res);
             return res;
         }
@@ -754,6 +795,12 @@ featureset_ptr postgis_datasource::features_with_context(query const& q,processo
             }
         }
 
+        if (conn)
+        {
+            // a deadline becomes the statement_timeout of this query
+            conn->setCancellation(q.cancellation());
+        }
+
 
         if (geometryColumn_.empty())
         {
@@ -774,7 +821,12 @@ featureset_ptr postgis_datasource::features_with_context(query const& q,processo
         const double px_gh = 1.0 / std::get<1>(q.resolution());
         const double px_sz = std::min(px_gw, px_gh);
 
-        if (twkb_encoding_)
+        if (tile_geometry_mode_)
+        {
+            s << "SELECT " << sql_tile_geometry(box, std::get<0>(q.resolution()), std::get<1>(q.resolution()))
+              << " AS geom";
+        }
+        else if (twkb_encoding_)
         {
             // This will only work against PostGIS 2.2, or a back-patched version
             // that has (a) a ST_Simplify with a "preserve collapsed" flag and
@@ -897,7 +949,13 @@ featureset_ptr postgis_datasource::features_with_context(query const& q,processo
             s << " LIMIT " << row_limit_;
         }
 
-        std::shared_ptr<IResultSet> rs = get_resultset(conn, s.str(), pool, proc_ctx);
+        std::shared_ptr<IResultSet> rs = get_resultset(conn, s.str(), pool, proc_ctx, q.cancellation());
+        if (tile_geometry_mode_)
+        {
+            return std::make_shared<postgis_featureset>(rs, ctx, desc_.get_encoding(), !key_field_.empty(),
+                                                        key_field_as_attribute_, true,
+                                                        tile_transform{box.minx(), box.miny(), px_gw, px_gh});
+        }
         return std::make_shared<postgis_featureset>(rs, ctx, desc_.get_encoding(), !key_field_.empty(),
                                                     key_field_as_attribute_, twkb_encoding_);
 
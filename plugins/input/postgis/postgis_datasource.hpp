@@ -79,6 +79,7 @@ public:
 
 private:
     std::string sql_bbox(box2d<double> const& env) const;
+    std::string sql_tile_geometry(box2d<double> const& env, double res_x, double res_y) const;
     std::string populate_tokens(std::string const& sql,
                                 double scale_denom,
                                 box2d<double> const& env,
@@ -88,7 +89,7 @@ private:
                                 bool intersect = true) const;
     std::string populate_tokens(std::string const& sql) const;
     void append_geometry_table(std::ostream & os) const;
-    std::shared_ptr<IResultSet> get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx= processor_context_ptr()) const;
+    std::shared_ptr<IResultSet> get_resultset(std::shared_ptr<Connection> &conn, std::string const& sql, CnxPool_ptr const& pool, processor_context_ptr ctx= processor_context_ptr(), mapnik::cancellation_token const& cancel = mapnik::cancellation_token()) const;
     static const std::string GEOMETRY_COLUMNS;
     static const std::string SPATIAL_REF_SYS;
 
@@ -118,6 +119,7 @@ private:
     int max_async_connections_;
     bool asynchronous_request_;
     bool twkb_encoding_;
+    bool tile_geometry_mode_;
     mapnik::value_double twkb_rounding_adjustment_;
     mapnik::value_double simplify_snap_ratio_;
     mapnik::value_double simplify_dp_ratio_;
@@ -45,12 +45,44 @@ using mapnik::geometry_utils;
 using mapnik::feature_factory;
 using mapnik::context_ptr;
 
+namespace {
+
+struct apply_tile_transform
+{
+    explicit apply_tile_transform(tile_transform const& tr)
+        : tr_(tr) {}
+
+    void operator() (mapnik::geometry::geometry_empty &) const {}
+
+    void operator() (mapnik::geometry::point<double> & pt) const
+    {
+        pt.x = tr_.origin_x + pt.x * tr_.pixel_width;
+        pt.y = tr_.origin_y + pt.y * tr_.pixel_height;
+    }
+
+    template <typename Container>
+    void operator() (Container & container) const
+    {
+        for (auto & item : container) (*this)(item);
+    }
+
+    void operator() (mapnik::geometry::geometry<double> & geom) const
+    {
+        mapnik::util::apply_visitor(*this, geom);
+    }
+
+    tile_transform const& tr_;
+};
+
+}
+
 postgis_featureset::postgis_featureset(std::shared_ptr<IResultSet> const& rs,
                                        context_ptr const& ctx,
                                        std::string const& encoding,
                                        bool key_field,
                                        bool key_field_as_attribute,
-                                       bool twkb_encoding)
+                                       bool twkb_encoding,
+                                       boost::optional<tile_transform> const& tile_tr)
     : rs_(rs),
       ctx_(ctx),
       tr_(new transcoder(encoding)),
@@ -58,7 +90,8 @@ postgis_featureset::postgis_featureset(std::shared_ptr<IResultSet> const& rs,
       feature_id_(1),
       key_field_(key_field),
       key_field_as_attribute_(key_field_as_attribute),
-      twkb_encoding_(twkb_encoding)
+      twkb_encoding_(twkb_encoding),
+      tile_tr_(tile_tr)
 {
 }
 
@@ -125,7 +158,14 @@ feature_ptr postgis_featureset::next()
         int size = rs_->getFieldLength(0);
         const char *data = rs_->getValue(0);
 
-        if (twkb_encoding_ )
+        if (tile_tr_)
+        {
+            mapnik::geometry::geometry<double> geom = geometry_utils::from_twkb(data, size);
+            apply_tile_transform transform(*tile_tr_);
+            transform(geom);
+            feature->set_geometry(std::move(geom));
+        }
+        else if (twkb_encoding_ )
         {
             feature->set_geometry(geometry_utils::from_twkb(data, size));
         }
@@ -29,6 +29,9 @@
 #include <mapnik/feature.hpp>
 #include <mapnik/unicode.hpp>
 
+// boost
+#include <boost/optional.hpp>
+
 using mapnik::Featureset;
 using mapnik::box2d;
 using mapnik::feature_ptr;
@@ -37,6 +40,15 @@ using mapnik::context_ptr;
 
 class IResultSet;
 
+// maps integer pixel coordinates returned with geometry_mode=tile back to map units
+struct tile_transform
+{
+    double origin_x;
+    double origin_y;
+    double pixel_width;
+    double pixel_height;
+};
+
 class postgis_featureset : public mapnik::Featureset
 {
 public:
@@ -45,7 +57,8 @@ public:
                        std::string const& encoding,
                        bool key_field,
                        bool key_field_as_attribute,
-                       bool twkb_encoding);
+                       bool twkb_encoding,
+                       boost::optional<tile_transform> const& tile_tr = boost::none);
     feature_ptr next();
     ~postgis_featureset();
 
@@ -58,6 +71,7 @@ private:
     bool key_field_;
     bool key_field_as_attribute_;
     bool twkb_encoding_;
+    boost::optional<tile_transform> tile_tr_;
 };
 
 #endif // POSTGIS_FEATURESET_HPP
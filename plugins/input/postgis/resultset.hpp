@@ -27,6 +27,9 @@ extern "C" {
 #include "libpq-fe.h"
 }
 
+// stl
+#include <cstddef>
+
 class IResultSet
 {
 public:
@@ -81,6 +84,21 @@ public:
         return numTuples_;
     }
 
+    // total payload of all tuples in bytes
+    std::size_t byte_size() const
+    {
+        std::size_t bytes = 0;
+        int num_fields = PQnfields(res_);
+        for (int row = 0; row < numTuples_; ++row)
+        {
+            for (int col = 0; col < num_fields; ++col)
+            {
+                bytes += PQgetlength(res_, row, col);
+            }
+        }
+        return bytes;
+    }
+
     virtual bool next()
     {
         return (++pos_ < numTuples_);
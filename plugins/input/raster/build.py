@@ -31,6 +31,8 @@ plugin_sources = Split(
   %(PLUGIN_NAME)s_datasource.cpp
   %(PLUGIN_NAME)s_featureset.cpp
   %(PLUGIN_NAME)s_info.cpp
+  %(PLUGIN_NAME)s_pyramid.cpp
+  %(PLUGIN_NAME)s_pyramid_featureset.cpp
   """ % locals()
 )
 
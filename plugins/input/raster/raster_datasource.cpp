@@ -29,10 +29,22 @@
 #include <mapnik/image_util.hpp>
 #include <mapnik/image_reader.hpp>
 #include <mapnik/boolean.hpp>
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#include <mapnik/mapped_memory_cache.hpp>
+#endif
 
 #include "raster_featureset.hpp"
 #include "raster_info.hpp"
 #include "raster_datasource.hpp"
+#include "raster_pyramid.hpp"
+#include "raster_pyramid_featureset.hpp"
+
+// stl
+#include <algorithm>
+#include <cmath>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
 
 using mapnik::layer_descriptor;
 using mapnik::featureset_ptr;
@@ -45,6 +57,16 @@ using mapnik::image_reader;
 
 DATASOURCE_PLUGIN(raster_datasource)
 
+namespace {
+
+constexpr unsigned pyramid_tile_size = 256;
+
+#ifdef MAPNIK_THREADSAFE
+std::mutex pyramid_mutex;
+#endif
+
+}
+
 raster_datasource::raster_datasource(parameters const& params)
   : datasource(params),
     desc_(raster_datasource::name(), "utf-8"),
@@ -64,6 +86,12 @@ raster_datasource::raster_datasource(parameters const& params)
     multi_tiles_ = *params.get<mapnik::boolean_type>("multi", false);
     tile_size_ = *params.get<mapnik::value_integer>("tile_size", 1024);
     tile_stride_ = *params.get<mapnik::value_integer>("tile_stride", 1);
+    decode_threads_ = static_cast<std::size_t>(std::max(mapnik::value_integer(1),
+        *params.get<mapnik::value_integer>("decode_threads", 1)));
+    readers_ = std::make_shared<raster_reader_pool>(static_cast<std::size_t>(
+        std::max(mapnik::value_integer(0), *params.get<mapnik::value_integer>("reader_cache_size", 16))));
+    max_mosaic_pixels_ = static_cast<std::uint64_t>(std::max(mapnik::value_integer(0),
+        *params.get<mapnik::value_integer>("max_mosaic_pixels", mapnik::value_integer(4096 * 4096))));
 
     boost::optional<std::string> format_from_filename = mapnik::type_from_filename(*file);
     format_ = *params.get<std::string>("format",format_from_filename?(*format_from_filename) : "tiff");
@@ -133,6 +161,13 @@ raster_datasource::raster_datasource(parameters const& params)
             {
                 width_ = reader->width();
                 height_ = reader->height();
+                if (*params.get<mapnik::boolean_type>("use_overviews", true))
+                {
+                    for (unsigned level = 1; level <= reader->overviews(); ++level)
+                    {
+                        overviews_.emplace_back(reader->overview_width(level), reader->overview_height(level));
+                    }
+                }
             }
         }
         catch (mapnik::image_reader_exception const& ex)
@@ -151,6 +186,80 @@ raster_datasource::raster_datasource(parameters const& params)
 
     MAPNIK_LOG_DEBUG(raster) << "raster_datasource: Raster size=" << width_ << "," << height_;
 
+    if (*params.get<mapnik::boolean_type>("pyramid", false))
+    {
+        if (multi_tiles_)
+        {
+            MAPNIK_LOG_WARN(raster) << "raster_datasource: pyramid is not supported for multi-tiled data sources";
+        }
+        else
+        {
+            init_pyramid(*params.get<std::string>("pyramid_file", filename_ + ".mip"));
+        }
+    }
+}
+
+// Opens the downsampled levels of the raster, building them on first use.
+// Low zoom queries then read from the level closest to their resolution
+// instead of decoding and scaling down full resolution pixels.
+void raster_datasource::init_pyramid(std::string const& pyramid_file)
+{
+    if (std::max(width_, height_) <= pyramid_tile_size) return;
+    try
+    {
+        std::unique_ptr<image_reader> reader(mapnik::get_image_reader(filename_, format_));
+        if (!reader) return;
+        // levels are stored as RGBA, rasters holding data values are read at full resolution
+        if (reader->read(0, 0, 1, 1).get_dtype() != mapnik::image_dtype_rgba8)
+        {
+            MAPNIK_LOG_WARN(raster) << "raster_datasource: pyramid is only supported for RGBA images, ignoring it for " << filename_;
+            return;
+        }
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(pyramid_mutex);
+#endif
+        pyramid_ = std::make_shared<raster_pyramid>(pyramid_file, filename_, width_, height_);
+        if (!pyramid_->valid())
+        {
+            MAPNIK_LOG_DEBUG(raster) << "raster_datasource: Building pyramid " << pyramid_file;
+            pyramid_.reset();
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+            mapnik::mapped_memory_cache::instance().remove(pyramid_file);
+#endif
+            raster_pyramid::build(filename_, format_, pyramid_file, pyramid_tile_size);
+            pyramid_ = std::make_shared<raster_pyramid>(pyramid_file, filename_, width_, height_);
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        MAPNIK_LOG_WARN(raster) << "raster_datasource: failed to build pyramid " << pyramid_file << ": " << ex.what();
+    }
+    if (pyramid_ && !pyramid_->valid()) pyramid_.reset();
+}
+
+// the coarsest level still holding at least one pixel per output pixel
+unsigned raster_datasource::pyramid_level(query const& q) const
+{
+    double ratio_x = width_ / (extent_.width() * std::get<0>(q.resolution()));
+    double ratio_y = height_ / (extent_.height() * std::get<1>(q.resolution()));
+    double ratio = std::min(ratio_x, ratio_y);
+    if (!(ratio >= 2.0)) return 0;
+    return std::min(static_cast<unsigned>(std::log2(ratio)), pyramid_->levels());
+}
+
+// the smallest overview stored in the file still holding at least one pixel per output pixel
+unsigned raster_datasource::overview_level(query const& q) const
+{
+    double output_width = extent_.width() * std::get<0>(q.resolution());
+    double output_height = extent_.height() * std::get<1>(q.resolution());
+    unsigned level = 0;
+    while (level < overviews_.size() &&
+           overviews_[level].first >= output_width &&
+           overviews_[level].second >= output_height)
+    {
+        ++level;
+    }
+    return level;
 }
 
 raster_datasource::~raster_datasource()
@@ -193,13 +302,38 @@ featureset_ptr raster_datasource::features(query const& q) const
 
     MAPNIK_LOG_DEBUG(raster) << "raster_datasource: Box size=" << width << "," << height;
 
+    if (pyramid_)
+    {
+        unsigned level = pyramid_level(q);
+        if (level > 0)
+        {
+            MAPNIK_LOG_DEBUG(raster) << "raster_datasource: Pyramid level " << level;
+
+            return std::make_shared<raster_pyramid_featureset>(pyramid_, level, extent_, q);
+        }
+    }
+
+    if (!overviews_.empty())
+    {
+        unsigned level = overview_level(q);
+        if (level > 0)
+        {
+            MAPNIK_LOG_DEBUG(raster) << "raster_datasource: Overview " << level;
+
+            raster_info info(filename_, format_, extent_, overviews_[level - 1].first, overviews_[level - 1].second);
+            single_file_policy policy(info);
+
+            return std::make_shared<raster_featureset<single_file_policy> >(policy, extent_, q, readers_, decode_threads_, max_mosaic_pixels_, level);
+        }
+    }
+
     if (multi_tiles_)
     {
         MAPNIK_LOG_DEBUG(raster) << "raster_datasource: Multi-Tiled policy";
 
         tiled_multi_file_policy policy(filename_, format_, tile_size_, extent_, q.get_bbox(), width_, height_, tile_stride_);
 
-        return std::make_shared<raster_featureset<tiled_multi_file_policy> >(policy, extent_, q);
+        return std::make_shared<raster_featureset<tiled_multi_file_policy> >(policy, extent_, q, readers_, decode_threads_, max_mosaic_pixels_);
     }
     else if (width * height > static_cast<int>(tile_size_ * tile_size_ << 2))
     {
@@ -207,7 +341,7 @@ featureset_ptr raster_datasource::features(query const& q) const
 
         tiled_file_policy policy(filename_, format_, tile_size_, extent_, q.get_bbox(), width_, height_);
 
-        return std::make_shared<raster_featureset<tiled_file_policy> >(policy, extent_, q);
+        return std::make_shared<raster_featureset<tiled_file_policy> >(policy, extent_, q, readers_, decode_threads_, max_mosaic_pixels_);
     }
     else
     {
@@ -216,7 +350,7 @@ featureset_ptr raster_datasource::features(query const& q) const
         raster_info info(filename_, format_, extent_, width_, height_);
         single_file_policy policy(info);
 
-        return std::make_shared<raster_featureset<single_file_policy> >(policy, extent_, q);
+        return std::make_shared<raster_featureset<single_file_policy> >(policy, extent_, q, readers_, decode_threads_, max_mosaic_pixels_);
     }
 }
 
@@ -37,9 +37,13 @@
 #include <memory>
 
 // stl
+#include <cstdint>
+#include <utility>
 #include <vector>
 #include <string>
 
+class raster_pyramid;
+class raster_reader_pool;
 
 class raster_datasource : public mapnik::datasource
 {
@@ -56,6 +60,10 @@ public:
     bool log_enabled() const;
 
 private:
+    void init_pyramid(std::string const& pyramid_file);
+    unsigned pyramid_level(mapnik::query const& q) const;
+    unsigned overview_level(mapnik::query const& q) const;
+
     mapnik::layer_descriptor desc_;
     std::string filename_;
     std::string format_;
@@ -66,6 +74,11 @@ private:
     unsigned tile_stride_;
     unsigned width_;
     unsigned height_;
+    std::shared_ptr<raster_pyramid> pyramid_;
+    std::vector<std::pair<unsigned, unsigned> > overviews_; // sizes of the overviews stored in the file
+    std::shared_ptr<raster_reader_pool> readers_;
+    std::size_t decode_threads_;
+    std::uint64_t max_mosaic_pixels_;
 };
 
 #endif // RASTER_DATASOURCE_HPP
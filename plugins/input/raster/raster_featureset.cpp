@@ -29,6 +29,7 @@
 #include <mapnik/image_util.hpp>
 #include <mapnik/feature_factory.hpp>
 #include <mapnik/util/variant.hpp>
+#include <mapnik/util/parallel_for.hpp>
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -38,6 +39,14 @@
 
 #include "raster_featureset.hpp"
 
+// stl
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
+
 using mapnik::query;
 using mapnik::image_reader;
 using mapnik::feature_ptr;
@@ -45,10 +54,40 @@ using mapnik::image_rgba8;
 using mapnik::raster;
 using mapnik::feature_factory;
 
+namespace {
+
+// copies `tile` into `mosaic` with its top left corner at (x, y)
+void copy_tile(mapnik::image_any & mosaic, int x, int y, mapnik::image_any const& tile)
+{
+    if (tile.get_dtype() != mosaic.get_dtype())
+    {
+        MAPNIK_LOG_WARN(raster) << "Raster Plugin: skipping tile with a different pixel type";
+        return;
+    }
+    if (mosaic.width() == 0 || tile.width() == 0) return;
+    std::size_t pixel_size = mosaic.row_size() / mosaic.width();
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + static_cast<int>(tile.width()), static_cast<int>(mosaic.width()));
+    int y1 = std::min(y + static_cast<int>(tile.height()), static_cast<int>(mosaic.height()));
+    for (int row = y0; row < y1; ++row)
+    {
+        std::memcpy(mosaic.bytes() + row * mosaic.row_size() + x0 * pixel_size,
+                    tile.bytes() + (row - y) * tile.row_size() + (x0 - x) * pixel_size,
+                    (x1 - x0) * pixel_size);
+    }
+}
+
+}
+
 template <typename LookupPolicy>
 raster_featureset<LookupPolicy>::raster_featureset(LookupPolicy const& policy,
                                                    box2d<double> const& extent,
-                                                   query const& q)
+                                                   query const& q,
+                                                   std::shared_ptr<raster_reader_pool> const& readers,
+                                                   std::size_t threads,
+                                                   std::uint64_t max_mosaic_pixels,
+                                                   unsigned overview)
     : policy_(policy),
       feature_id_(1),
       ctx_(std::make_shared<mapnik::context_type>()),
@@ -56,7 +95,12 @@ raster_featureset<LookupPolicy>::raster_featureset(LookupPolicy const& policy,
       bbox_(q.get_bbox()),
       curIter_(policy_.begin()),
       endIter_(policy_.end()),
-      filter_factor_(q.get_filter_factor())
+      filter_factor_(q.get_filter_factor()),
+      readers_(readers),
+      threads_(threads),
+      max_mosaic_pixels_(max_mosaic_pixels),
+      overview_(overview),
+      next_pending_(0)
 {
 }
 
@@ -66,78 +110,179 @@ raster_featureset<LookupPolicy>::~raster_featureset()
 }
 
 template <typename LookupPolicy>
-feature_ptr raster_featureset<LookupPolicy>::next()
+typename raster_featureset<LookupPolicy>::tile_window
+raster_featureset<LookupPolicy>::window(raster_info const& info, int image_width, int image_height) const
 {
-    if (curIter_ != endIter_)
+    mapnik::view_transform t(image_width, image_height, extent_, 0, 0);
+    box2d<double> intersect = bbox_.intersect(info.envelope());
+    box2d<double> ext = t.forward(intersect);
+    box2d<double> rem = policy_.transform(ext);
+    // select minimum raster containing whole ext
+    int x_off = static_cast<int>(std::floor(ext.minx()));
+    int y_off = static_cast<int>(std::floor(ext.miny()));
+    int end_x = static_cast<int>(std::ceil(ext.maxx()));
+    int end_y = static_cast<int>(std::ceil(ext.maxy()));
+
+    // clip to available data
+    if (x_off >= image_width) x_off = image_width - 1;
+    if (y_off >= image_height) y_off = image_height - 1;
+    if (x_off < 0) x_off = 0;
+    if (y_off < 0) y_off = 0;
+    if (end_x > image_width)  end_x = image_width;
+    if (end_y > image_height) end_y = image_height;
+
+    int width = end_x - x_off;
+    int height = end_y - y_off;
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+
+    // rem is the tile's offset within the whole raster
+    return tile_window{intersect, x_off, y_off, width, height,
+                       static_cast<int>(rem.minx()) + x_off, static_cast<int>(rem.miny()) + y_off,
+                       image_width, image_height};
+}
+
+template <typename LookupPolicy>
+bool raster_featureset<LookupPolicy>::read_tile(raster_info const& info, tile_window & w, mapnik::image_any & data,
+                                                std::size_t decode_threads) const
+{
+    try
     {
-        feature_ptr feature(feature_factory::create(ctx_,feature_id_++));
+        raster_reader_pool::reader_ptr reader = readers_->acquire(info.file(), info.format());
 
-        try
-        {
-            std::unique_ptr<image_reader> reader(mapnik::get_image_reader(curIter_->file(),curIter_->format()));
+        MAPNIK_LOG_DEBUG(raster) << "raster_featureset: Reader=" << info.format() << "," << info.file()
+                                 << ",size(" << info.width() << "," << info.height() << ")";
 
-            MAPNIK_LOG_DEBUG(raster) << "raster_featureset: Reader=" << curIter_->format() << "," << curIter_->file()
-                                     << ",size(" << curIter_->width() << "," << curIter_->height() << ")";
+        if (!reader) return false;
+        int image_width = policy_.img_width(reader->overview_width(overview_));
+        int image_height = policy_.img_height(reader->overview_height(overview_));
+        if (image_width <= 0 || image_height <= 0) return false;
+        w = window(info, image_width, image_height);
+        reader->set_decode_threads(decode_threads);
+        data = reader->read_overview(overview_, w.x_off, w.y_off, w.width, w.height);
+        readers_->release(info.file(), std::move(reader));
+        return true;
+    }
+    catch (mapnik::image_reader_exception const& ex)
+    {
+        MAPNIK_LOG_ERROR(raster) << "Raster Plugin: image reader exception caught: " << ex.what();
+    }
+    catch (std::exception const& ex)
+    {
+        MAPNIK_LOG_ERROR(raster) << "Raster Plugin: " << ex.what();
+    }
+    catch (...)
+    {
+        MAPNIK_LOG_ERROR(raster) << "Raster Plugin: exception caught";
+    }
+    return false;
+}
 
-            if (reader.get())
-            {
-                int image_width = policy_.img_width(reader->width());
-                int image_height = policy_.img_height(reader->height());
-
-                if (image_width > 0 && image_height > 0)
-                {
-                    mapnik::view_transform t(image_width, image_height, extent_, 0, 0);
-                    box2d<double> intersect = bbox_.intersect(curIter_->envelope());
-                    box2d<double> ext = t.forward(intersect);
-                    box2d<double> rem = policy_.transform(ext);
-                    // select minimum raster containing whole ext
-                    int x_off = static_cast<int>(std::floor(ext.minx()));
-                    int y_off = static_cast<int>(std::floor(ext.miny()));
-                    int end_x = static_cast<int>(std::ceil(ext.maxx()));
-                    int end_y = static_cast<int>(std::ceil(ext.maxy()));
-
-                    // clip to available data
-                    if (x_off >= image_width) x_off = image_width - 1;
-                    if (y_off >= image_height) y_off = image_height - 1;
-                    if (x_off < 0) x_off = 0;
-                    if (y_off < 0) y_off = 0;
-                    if (end_x > image_width)  end_x = image_width;
-                    if (end_y > image_height) end_y = image_height;
-
-                    int width = end_x - x_off;
-                    int height = end_y - y_off;
-                    if (width < 1) width = 1;
-                    if (height < 1) height = 1;
-
-                    // calculate actual box2d of returned raster
-                    box2d<double> feature_raster_extent(rem.minx() + x_off,
-                                                        rem.miny() + y_off,
-                                                        rem.maxx() + x_off + width,
-                                                        rem.maxy() + y_off + height);
-                    feature_raster_extent = t.backward(feature_raster_extent);
-                    mapnik::image_any data = reader->read(x_off, y_off, width, height);
-                    mapnik::raster_ptr raster = std::make_shared<mapnik::raster>(feature_raster_extent, intersect, std::move(data), filter_factor_);
-                    feature->set_raster(raster);
-                }
-            }
-        }
-        catch (mapnik::image_reader_exception const& ex)
-        {
-            MAPNIK_LOG_ERROR(raster) << "Raster Plugin: image reader exception caught: " << ex.what();
-        }
-        catch (std::exception const& ex)
+template <typename LookupPolicy>
+feature_ptr raster_featureset<LookupPolicy>::tile_feature(tile_window const& w, mapnik::image_any && data)
+{
+    feature_ptr feature(feature_factory::create(ctx_, feature_id_++));
+    mapnik::view_transform t(w.image_width, w.image_height, extent_, 0, 0);
+    box2d<double> feature_raster_extent(w.raster_x, w.raster_y, w.raster_x + w.width, w.raster_y + w.height);
+    feature_raster_extent = t.backward(feature_raster_extent);
+    feature->set_raster(std::make_shared<mapnik::raster>(feature_raster_extent, w.intersect,
+                                                         std::move(data), filter_factor_));
+    return feature;
+}
+
+template <typename LookupPolicy>
+feature_ptr raster_featureset<LookupPolicy>::next()
+{
+    while (next_pending_ < pending_.size())
+    {
+        tile_window w;
+        mapnik::image_any data;
+        if (read_tile(pending_[next_pending_++], w, data, threads_))
         {
-            MAPNIK_LOG_ERROR(raster) << "Raster Plugin: " << ex.what();
+            return tile_feature(w, std::move(data));
         }
-        catch (...)
+    }
+
+    std::vector<raster_info> tiles;
+    for (; curIter_ != endIter_; ++curIter_)
+    {
+        tiles.push_back(*curIter_);
+    }
+
+    // the first tile read fixes the image size and pixel type of the mosaic
+    std::size_t seed = 0;
+    tile_window seed_window;
+    mapnik::image_any seed_data;
+    while (seed < tiles.size() && !read_tile(tiles[seed], seed_window, seed_data, threads_)) ++seed;
+    if (seed == tiles.size()) return feature_ptr();
+
+    if (seed + 1 == tiles.size())
+    {
+        return tile_feature(seed_window, std::move(seed_data));
+    }
+
+    box2d<double> intersect = seed_window.intersect;
+    int x0 = seed_window.raster_x;
+    int y0 = seed_window.raster_y;
+    int x1 = x0 + seed_window.width;
+    int y1 = y0 + seed_window.height;
+    for (std::size_t i = seed + 1; i < tiles.size(); ++i)
+    {
+        tile_window w = window(tiles[i], seed_window.image_width, seed_window.image_height);
+        intersect.expand_to_include(w.intersect);
+        x0 = std::min(x0, w.raster_x);
+        y0 = std::min(y0, w.raster_y);
+        x1 = std::max(x1, w.raster_x + w.width);
+        y1 = std::max(y1, w.raster_y + w.height);
+    }
+
+    if (max_mosaic_pixels_ > 0 &&
+        static_cast<std::uint64_t>(x1 - x0) * static_cast<std::uint64_t>(y1 - y0) > max_mosaic_pixels_)
+    {
+        MAPNIK_LOG_DEBUG(raster) << "raster_featureset: Mosaic of " << tiles.size() << " tiles, size("
+                                 << x1 - x0 << "," << y1 - y0 << ") exceeds max_mosaic_pixels, returning tiles";
+        pending_.assign(tiles.begin() + seed + 1, tiles.end());
+        next_pending_ = 0;
+        return tile_feature(seed_window, std::move(seed_data));
+    }
+
+    MAPNIK_LOG_DEBUG(raster) << "raster_featureset: Mosaic of " << tiles.size() << " tiles, size("
+                             << x1 - x0 << "," << y1 - y0 << ")";
+
+    mapnik::image_any mosaic(x1 - x0, y1 - y0, seed_data.get_dtype(), true, seed_data.get_premultiplied());
+    mosaic.set_offset(seed_data.get_offset());
+    mosaic.set_scaling(seed_data.get_scaling());
+    copy_tile(mosaic, seed_window.raster_x - x0, seed_window.raster_y - y0, seed_data);
+    seed_data = mapnik::image_any();
+
+    // tiles are decoded concurrently first, threads left over go to the readers
+    std::size_t const remaining = tiles.size() - seed - 1;
+    std::size_t const reader_threads = std::max(std::size_t(1), threads_ / std::min(threads_, remaining));
+#ifdef MAPNIK_THREADSAFE
+    std::mutex mosaic_mutex;
+#endif
+    mapnik::util::parallel_for_chunks(remaining, threads_, 1, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; ++i)
         {
-            MAPNIK_LOG_ERROR(raster) << "Raster Plugin: exception caught";
+            tile_window w;
+            mapnik::image_any data;
+            if (read_tile(tiles[seed + 1 + i], w, data, reader_threads))
+            {
+#ifdef MAPNIK_THREADSAFE
+                std::lock_guard<std::mutex> lock(mosaic_mutex);
+#endif
+                copy_tile(mosaic, w.raster_x - x0, w.raster_y - y0, data);
+            }
         }
+    });
 
-        ++curIter_;
-        return feature;
-    }
-    return feature_ptr();
+    feature_ptr feature(feature_factory::create(ctx_, feature_id_++));
+    mapnik::view_transform t(seed_window.image_width, seed_window.image_height, extent_, 0, 0);
+    box2d<double> feature_raster_extent = t.backward(box2d<double>(x0, y0, x1, y1));
+    feature->set_raster(std::make_shared<mapnik::raster>(feature_raster_extent, intersect,
+                                                         std::move(mosaic), filter_factor_));
+    return feature;
 }
 
 std::string tiled_multi_file_policy::interpolate(std::string const& pattern, int x, int y) const
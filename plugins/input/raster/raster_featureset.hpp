@@ -25,12 +25,15 @@
 
 #include "raster_datasource.hpp"
 #include "raster_info.hpp"
+#include "raster_reader_pool.hpp"
 
 // mapnik
 #include <mapnik/feature.hpp>
 #include <mapnik/debug.hpp>
 
 // stl
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 // boost
@@ -301,19 +304,49 @@ private:
     std::vector<raster_info> infos_;
 };
 
+// Returns a single feature holding the part of the raster intersecting the
+// query. The tiles listed by the policy are decoded on up to `threads`
+// threads and copied into one mosaic as they complete. Tiles read on
+// their own may use all `threads` within the image reader instead. A mosaic larger than
+// `max_mosaic_pixels` (0 for no limit) is not allocated; the tiles are then
+// returned as one feature each. A non-zero `overview` reads the files'
+// reduced resolution images instead (see image_reader).
 template <typename LookupPolicy>
 class raster_featureset : public mapnik::Featureset
 {
     using iterator_type = typename LookupPolicy::const_iterator;
 
+    // a tile's window in its own image and in the whole raster
+    struct tile_window
+    {
+        box2d<double> intersect;
+        int x_off;
+        int y_off;
+        int width;
+        int height;
+        int raster_x;
+        int raster_y;
+        int image_width;
+        int image_height;
+    };
+
 public:
     raster_featureset(LookupPolicy const& policy,
                       box2d<double> const& exttent,
-                      mapnik::query const& q);
+                      mapnik::query const& q,
+                      std::shared_ptr<raster_reader_pool> const& readers,
+                      std::size_t threads,
+                      std::uint64_t max_mosaic_pixels,
+                      unsigned overview = 0);
     virtual ~raster_featureset();
     mapnik::feature_ptr next();
 
 private:
+    tile_window window(raster_info const& info, int image_width, int image_height) const;
+    bool read_tile(raster_info const& info, tile_window & w, mapnik::image_any & data,
+                   std::size_t decode_threads) const;
+    mapnik::feature_ptr tile_feature(tile_window const& w, mapnik::image_any && data);
+
     LookupPolicy policy_;
     mapnik::value_integer feature_id_;
     mapnik::context_ptr ctx_;
@@ -322,6 +355,12 @@ private:
     iterator_type curIter_;
     iterator_type endIter_;
     double filter_factor_;
+    std::shared_ptr<raster_reader_pool> readers_;
+    std::size_t threads_;
+    std::uint64_t max_mosaic_pixels_;
+    unsigned overview_;
+    std::vector<raster_info> pending_; // tiles left to return one by one
+    std::size_t next_pending_;
 };
 
 #endif // RASTER_FEATURESET_HPP
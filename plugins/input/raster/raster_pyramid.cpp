@@ -0,0 +1,391 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/image_reader.hpp>
+#include <mapnik/util/fs.hpp>
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+#endif
+
+#include "raster_pyramid.hpp"
+
+// stl
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+char const magic[8] = {'m', 'n', 'k', 'p', 'y', 'r', 'm', 'd'};
+constexpr std::uint32_t version = 2;
+constexpr std::uint64_t page_size = 4096;
+constexpr std::size_t fixed_header_size = sizeof(magic) + 5 * sizeof(std::uint32_t) + sizeof(std::uint64_t) + sizeof(std::int64_t);
+constexpr std::size_t level_header_size = 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+using file_ptr = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+
+std::uint64_t align(std::uint64_t offset)
+{
+    return (offset + page_size - 1) / page_size * page_size;
+}
+
+unsigned tile_count(unsigned size, unsigned tile_size)
+{
+    return (size + tile_size - 1) / tile_size;
+}
+
+std::uint64_t tile_bytes(unsigned tile_size)
+{
+    return static_cast<std::uint64_t>(tile_size) * tile_size * 4;
+}
+
+template <typename T>
+void put(std::vector<std::uint8_t> & buffer, T value)
+{
+    std::uint8_t const* bytes = reinterpret_cast<std::uint8_t const*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T get(std::uint8_t const*& data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+void write_at(std::FILE * file, std::uint64_t offset, void const* data, std::size_t size)
+{
+    if (std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0 ||
+        std::fwrite(data, size, 1, file) != 1)
+    {
+        throw std::runtime_error("failed to write raster pyramid");
+    }
+}
+
+void read_at(std::FILE * file, std::uint64_t offset, void * data, std::size_t size)
+{
+    if (std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0 ||
+        std::fread(data, size, 1, file) != 1)
+    {
+        throw std::runtime_error("failed to read raster pyramid");
+    }
+}
+
+// 2x2 box filter with colours weighted by alpha; pixels past the
+// right and bottom edges of an odd sized source are left out
+void downsample(mapnik::image_rgba8 const& src, mapnik::image_rgba8 & dst)
+{
+    for (unsigned y = 0; y < dst.height(); ++y)
+    {
+        std::uint8_t * out = reinterpret_cast<std::uint8_t *>(dst.get_row(y));
+        for (unsigned x = 0; x < dst.width(); ++x, out += 4)
+        {
+            unsigned sum[3] = { 0, 0, 0 };
+            unsigned alpha = 0;
+            unsigned count = 0;
+            for (unsigned sy = 2 * y; sy < std::min(2 * y + 2, static_cast<unsigned>(src.height())); ++sy)
+            {
+                std::uint8_t const* row = reinterpret_cast<std::uint8_t const*>(src.get_row(sy));
+                for (unsigned sx = 2 * x; sx < std::min(2 * x + 2, static_cast<unsigned>(src.width())); ++sx)
+                {
+                    std::uint8_t const* pixel = row + 4 * sx;
+                    for (unsigned c = 0; c < 3; ++c) sum[c] += pixel[c] * pixel[3];
+                    alpha += pixel[3];
+                    ++count;
+                }
+            }
+            for (unsigned c = 0; c < 3; ++c)
+            {
+                out[c] = alpha > 0 ? static_cast<std::uint8_t>((sum[c] + alpha / 2) / alpha) : 0;
+            }
+            out[3] = static_cast<std::uint8_t>((alpha + count / 2) / count);
+        }
+    }
+}
+
+// writes `image` as the `row`th row of tiles of `level`, padding partial tiles
+void write_tile_row(std::FILE * file, raster_pyramid::level const& level, unsigned row,
+                    unsigned tile_size, mapnik::image_rgba8 const& image)
+{
+    std::vector<std::uint8_t> tile(tile_bytes(tile_size));
+    unsigned tiles_x = tile_count(level.width, tile_size);
+    for (unsigned tx = 0; tx < tiles_x; ++tx)
+    {
+        std::fill(tile.begin(), tile.end(), 0);
+        unsigned x0 = tx * tile_size;
+        unsigned columns = std::min(tile_size, level.width - x0);
+        for (unsigned y = 0; y < image.height(); ++y)
+        {
+            std::memcpy(tile.data() + static_cast<std::size_t>(y) * tile_size * 4,
+                        image.get_row(y) + x0, columns * 4);
+        }
+        write_at(file, level.offset + (static_cast<std::uint64_t>(row) * tiles_x + tx) * tile.size(),
+                 tile.data(), tile.size());
+    }
+}
+
+// reads `image.height()` rows of `level`, starting at the `row`th row of tiles
+void read_tile_rows(std::FILE * file, raster_pyramid::level const& level, unsigned row,
+                    unsigned tile_size, mapnik::image_rgba8 & image)
+{
+    std::vector<std::uint8_t> tile(tile_bytes(tile_size));
+    unsigned tiles_x = tile_count(level.width, tile_size);
+    for (unsigned ty = row; ty * tile_size < row * tile_size + image.height(); ++ty)
+    {
+        for (unsigned tx = 0; tx < tiles_x; ++tx)
+        {
+            read_at(file, level.offset + (static_cast<std::uint64_t>(ty) * tiles_x + tx) * tile.size(),
+                    tile.data(), tile.size());
+            unsigned x0 = tx * tile_size;
+            unsigned columns = std::min(tile_size, level.width - x0);
+            for (unsigned y = 0; y < tile_size; ++y)
+            {
+                unsigned image_y = (ty - row) * tile_size + y;
+                if (image_y >= image.height()) break;
+                std::memcpy(image.get_row(image_y) + x0,
+                            tile.data() + static_cast<std::size_t>(y) * tile_size * 4, columns * 4);
+            }
+        }
+    }
+}
+
+} // anonymous ns
+
+void raster_pyramid::build(std::string const& source,
+                           std::string const& format,
+                           std::string const& pyramid_file,
+                           unsigned tile_size)
+{
+    std::unique_ptr<mapnik::image_reader> reader(mapnik::get_image_reader(source, format));
+    if (!reader) throw std::runtime_error("failed to create reader for " + source);
+    unsigned width = reader->width();
+    unsigned height = reader->height();
+
+    std::vector<level> levels;
+    unsigned level_width = width;
+    unsigned level_height = height;
+    while (level_width > tile_size || level_height > tile_size)
+    {
+        level_width = (level_width + 1) / 2;
+        level_height = (level_height + 1) / 2;
+        levels.push_back(level{level_width, level_height, 0});
+    }
+    if (levels.empty()) throw std::runtime_error(source + " fits into a single pyramid tile");
+
+    std::uint64_t offset = align(fixed_header_size + levels.size() * level_header_size);
+    for (auto & l : levels)
+    {
+        l.offset = offset;
+        offset = align(offset + static_cast<std::uint64_t>(tile_count(l.width, tile_size)) *
+                       tile_count(l.height, tile_size) * tile_bytes(tile_size));
+    }
+
+    std::vector<std::uint8_t> header(magic, magic + sizeof(magic));
+    put<std::uint32_t>(header, version);
+    put<std::uint32_t>(header, tile_size);
+    put<std::uint32_t>(header, static_cast<std::uint32_t>(levels.size()));
+    put<std::uint32_t>(header, width);
+    put<std::uint32_t>(header, height);
+    put<std::uint64_t>(header, mapnik::util::file_size(source));
+    put<std::int64_t>(header, mapnik::util::last_write_time(source));
+    for (auto const& l : levels)
+    {
+        put<std::uint32_t>(header, l.width);
+        put<std::uint32_t>(header, l.height);
+        put<std::uint64_t>(header, l.offset);
+    }
+
+    // written to a uniquely named temporary file first and renamed over
+    // `pyramid_file`, so readers never see a partial pyramid and concurrent
+    // builds don't write into each other's files
+    std::string temp_file = mapnik::util::unique_path(pyramid_file);
+    file_ptr file(std::fopen(temp_file.c_str(), "w+b"), std::fclose);
+    if (!file) throw std::runtime_error("failed to create " + temp_file);
+    try
+    {
+        write_at(file.get(), 0, header.data(), header.size());
+        // level 1 from the source, reading two rows of tiles worth of pixels at a time
+        for (unsigned row = 0; row < tile_count(levels[0].height, tile_size); ++row)
+        {
+            unsigned y0 = 2 * row * tile_size;
+            mapnik::image_rgba8 src(width, std::min(2 * tile_size, height - y0));
+            reader->read(0, y0, src);
+            mapnik::image_rgba8 dst(levels[0].width, (src.height() + 1) / 2);
+            downsample(src, dst);
+            write_tile_row(file.get(), levels[0], row, tile_size, dst);
+        }
+        // every further level from the one before
+        for (std::size_t index = 1; index < levels.size(); ++index)
+        {
+            level const& prev = levels[index - 1];
+            level const& current = levels[index];
+            for (unsigned row = 0; row < tile_count(current.height, tile_size); ++row)
+            {
+                unsigned y0 = 2 * row * tile_size;
+                mapnik::image_rgba8 src(prev.width, std::min(2 * tile_size, prev.height - y0));
+                read_tile_rows(file.get(), prev, 2 * row, tile_size, src);
+                mapnik::image_rgba8 dst(current.width, (src.height() + 1) / 2);
+                downsample(src, dst);
+                write_tile_row(file.get(), current, row, tile_size, dst);
+            }
+        }
+        // pad the last level up to its page aligned end
+        std::uint8_t zero = 0;
+        write_at(file.get(), offset - 1, &zero, 1);
+        if (std::fflush(file.get()) != 0) throw std::runtime_error("failed to write " + temp_file);
+    }
+    catch (...)
+    {
+        file.reset();
+        std::remove(temp_file.c_str());
+        throw;
+    }
+    file.reset();
+    if (!mapnik::util::rename(temp_file, pyramid_file))
+    {
+        std::remove(temp_file.c_str());
+        throw std::runtime_error("failed to create " + pyramid_file);
+    }
+}
+
+raster_pyramid::raster_pyramid(std::string const& pyramid_file,
+                               std::string const& source,
+                               unsigned source_width,
+                               unsigned source_height)
+    : tile_size_(0),
+      source_width_(source_width),
+      source_height_(source_height),
+#if !defined(MAPNIK_MEMORY_MAPPED_FILE)
+      file_(std::fopen(pyramid_file.c_str(), "rb"), std::fclose),
+#endif
+      size_(0)
+{
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    boost::optional<mapnik::mapped_region_ptr> memory =
+        mapnik::mapped_memory_cache::instance().find(pyramid_file, true, mapnik::mapped_access::random);
+    if (!memory) return;
+    region_ = *memory;
+    size_ = region_->get_size();
+#else
+    if (!file_) return;
+    std::fseek(file_.get(), 0, SEEK_END);
+    long size = std::ftell(file_.get());
+    if (size <= 0) return;
+    size_ = static_cast<std::uint64_t>(size);
+#endif
+    std::vector<std::uint8_t> header(fixed_header_size);
+    if (!read_bytes(0, header.size(), header.data())) return;
+    if (!std::equal(magic, magic + sizeof(magic), header.begin())) return;
+    std::uint8_t const* data = header.data() + sizeof(magic);
+    std::uint32_t file_version = get<std::uint32_t>(data);
+    std::uint32_t tile_size = get<std::uint32_t>(data);
+    std::uint32_t count = get<std::uint32_t>(data);
+    std::uint32_t width = get<std::uint32_t>(data);
+    std::uint32_t height = get<std::uint32_t>(data);
+    std::uint64_t file_size = get<std::uint64_t>(data);
+    std::int64_t file_time = get<std::int64_t>(data);
+    if (file_version != version || tile_size == 0 || count == 0 || count > 32 ||
+        width != source_width || height != source_height ||
+        file_size != mapnik::util::file_size(source) || file_time != mapnik::util::last_write_time(source))
+    {
+        return;
+    }
+    header.resize(count * level_header_size);
+    if (!read_bytes(fixed_header_size, header.size(), header.data())) return;
+    data = header.data();
+    std::vector<level> levels;
+    for (std::uint32_t index = 0; index < count; ++index)
+    {
+        level l;
+        l.width = get<std::uint32_t>(data);
+        l.height = get<std::uint32_t>(data);
+        l.offset = get<std::uint64_t>(data);
+        std::uint64_t bytes = static_cast<std::uint64_t>(tile_count(l.width, tile_size)) *
+            tile_count(l.height, tile_size) * tile_bytes(tile_size);
+        if (l.width == 0 || l.height == 0 || l.offset > size_ || bytes > size_ - l.offset) return;
+        levels.push_back(l);
+    }
+    tile_size_ = tile_size;
+    levels_ = std::move(levels);
+}
+
+mapnik::box2d<double> raster_pyramid::level_extent(unsigned index, mapnik::box2d<double> const& extent) const
+{
+    level const& l = get_level(index);
+    double scale = static_cast<double>(1u << index);
+    double width = extent.width() * l.width * scale / source_width_;
+    double height = extent.height() * l.height * scale / source_height_;
+    return mapnik::box2d<double>(extent.minx(), extent.maxy() - height, extent.minx() + width, extent.maxy());
+}
+
+mapnik::image_rgba8 raster_pyramid::read(unsigned index, unsigned x, unsigned y, unsigned width, unsigned height) const
+{
+    level const& l = get_level(index);
+    mapnik::image_rgba8 image(width, height);
+    unsigned tiles_x = tile_count(l.width, tile_size_);
+    unsigned end_x = std::min(x + width, l.width);
+    unsigned end_y = std::min(y + height, l.height);
+    for (unsigned ty = y / tile_size_; ty * tile_size_ < end_y; ++ty)
+    {
+        for (unsigned tx = x / tile_size_; tx * tile_size_ < end_x; ++tx)
+        {
+            std::uint64_t tile_offset = l.offset + (static_cast<std::uint64_t>(ty) * tiles_x + tx) * tile_bytes(tile_size_);
+            unsigned x0 = std::max(x, tx * tile_size_);
+            unsigned x1 = std::min(end_x, (tx + 1) * tile_size_);
+            unsigned y0 = std::max(y, ty * tile_size_);
+            unsigned y1 = std::min(end_y, (ty + 1) * tile_size_);
+            for (unsigned row = y0; row < y1; ++row)
+            {
+                std::uint64_t offset = tile_offset +
+                    (static_cast<std::uint64_t>(row - ty * tile_size_) * tile_size_ + (x0 - tx * tile_size_)) * 4;
+                std::uint8_t * out = reinterpret_cast<std::uint8_t *>(image.get_row(row - y) + (x0 - x));
+                if (!read_bytes(offset, (x1 - x0) * 4, out))
+                {
+                    throw std::runtime_error("failed to read raster pyramid");
+                }
+            }
+        }
+    }
+    return image;
+}
+
+bool raster_pyramid::read_bytes(std::uint64_t offset, std::size_t size, std::uint8_t * out) const
+{
+    if (offset > size_ || size > size_ - offset) return false;
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    std::memcpy(out, static_cast<std::uint8_t const*>(region_->get_address()) + offset, size);
+    return true;
+#else
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return std::fseek(file_.get(), static_cast<long>(offset), SEEK_SET) == 0 &&
+        std::fread(out, size, 1, file_.get()) == 1;
+#endif
+}
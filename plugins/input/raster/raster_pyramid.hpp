@@ -0,0 +1,109 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef RASTER_PYRAMID_HPP
+#define RASTER_PYRAMID_HPP
+
+// mapnik
+#include <mapnik/image.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#include <mapnik/mapped_memory_cache.hpp>
+#endif
+
+// stl
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
+
+// Sidecar file holding downsampled copies (levels) of an RGBA raster.
+// Level k is 2^k times smaller than the source image in each direction
+// and stored as uncompressed tile_size x tile_size RGBA tiles, row by
+// row, so a window of any level is read from a few contiguous tiles of
+// the (memory mapped) file.
+//
+// Layout, native byte order:
+//   char[8]   "mnkpyrmd"
+//   uint32    version, tile size, level count, source width, source height
+//   uint64    source file size
+//   int64     source modification time, nanoseconds since the epoch
+//   levels x  { uint32 width, uint32 height, uint64 offset }
+//   tiles of level 1, level 2, ... starting at page aligned offsets
+class raster_pyramid : private mapnik::util::noncopyable
+{
+public:
+    struct level
+    {
+        unsigned width;
+        unsigned height;
+        std::uint64_t offset;
+    };
+
+    // Downsamples `source` level by level until it fits into a single tile
+    // and writes the result to `pyramid_file`. Throws on failure.
+    static void build(std::string const& source,
+                      std::string const& format,
+                      std::string const& pyramid_file,
+                      unsigned tile_size);
+
+    // Opens `pyramid_file`; valid() is false when it is missing, corrupt or
+    // was built from a different source, or from an older version of it.
+    raster_pyramid(std::string const& pyramid_file,
+                   std::string const& source,
+                   unsigned source_width,
+                   unsigned source_height);
+
+    bool valid() const { return !levels_.empty(); }
+    // number of downsampled levels, level 0 being the source itself
+    unsigned levels() const { return static_cast<unsigned>(levels_.size()); }
+    level const& get_level(unsigned index) const { return levels_[index - 1]; }
+    // extent covered by a level, its edge pixels can overhang the source extent
+    mapnik::box2d<double> level_extent(unsigned index, mapnik::box2d<double> const& extent) const;
+    mapnik::image_rgba8 read(unsigned index, unsigned x, unsigned y, unsigned width, unsigned height) const;
+
+private:
+    bool read_bytes(std::uint64_t offset, std::size_t size, std::uint8_t * out) const;
+
+    unsigned tile_size_;
+    unsigned source_width_;
+    unsigned source_height_;
+    std::vector<level> levels_;
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapnik::mapped_region_ptr region_;
+#else
+    using file_ptr = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+    file_ptr file_;
+#ifdef MAPNIK_THREADSAFE
+    mutable std::mutex mutex_;
+#endif
+#endif
+    std::uint64_t size_;
+};
+
+#endif // RASTER_PYRAMID_HPP
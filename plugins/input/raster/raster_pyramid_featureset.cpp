@@ -0,0 +1,95 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+// mapnik
+#include <mapnik/debug.hpp>
+#include <mapnik/raster.hpp>
+#include <mapnik/view_transform.hpp>
+#include <mapnik/feature_factory.hpp>
+
+#include "raster_pyramid_featureset.hpp"
+
+// stl
+#include <cmath>
+
+using mapnik::box2d;
+using mapnik::feature_ptr;
+
+raster_pyramid_featureset::raster_pyramid_featureset(std::shared_ptr<raster_pyramid> const& pyramid,
+                                                     unsigned level,
+                                                     box2d<double> const& extent,
+                                                     mapnik::query const& q)
+    : pyramid_(pyramid),
+      level_(level),
+      ctx_(std::make_shared<mapnik::context_type>()),
+      extent_(extent),
+      bbox_(q.get_bbox()),
+      filter_factor_(q.get_filter_factor()),
+      first_(true)
+{
+}
+
+raster_pyramid_featureset::~raster_pyramid_featureset()
+{
+}
+
+feature_ptr raster_pyramid_featureset::next()
+{
+    if (!first_) return feature_ptr();
+    first_ = false;
+
+    raster_pyramid::level const& level = pyramid_->get_level(level_);
+    int image_width = static_cast<int>(level.width);
+    int image_height = static_cast<int>(level.height);
+    mapnik::view_transform t(image_width, image_height, pyramid_->level_extent(level_, extent_), 0, 0);
+    box2d<double> intersect = bbox_.intersect(extent_);
+    box2d<double> ext = t.forward(intersect);
+
+    // select minimum raster containing whole ext
+    int x_off = static_cast<int>(std::floor(ext.minx()));
+    int y_off = static_cast<int>(std::floor(ext.miny()));
+    int end_x = static_cast<int>(std::ceil(ext.maxx()));
+    int end_y = static_cast<int>(std::ceil(ext.maxy()));
+
+    // clip to available data
+    if (x_off >= image_width) x_off = image_width - 1;
+    if (y_off >= image_height) y_off = image_height - 1;
+    if (x_off < 0) x_off = 0;
+    if (y_off < 0) y_off = 0;
+    if (end_x > image_width)  end_x = image_width;
+    if (end_y > image_height) end_y = image_height;
+
+    int width = end_x - x_off;
+    int height = end_y - y_off;
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+
+    MAPNIK_LOG_DEBUG(raster) << "raster_pyramid_featureset: Level=" << level_
+                             << " window=(" << x_off << "," << y_off << "," << width << "," << height << ")";
+
+    box2d<double> feature_raster_extent = t.backward(box2d<double>(x_off, y_off, x_off + width, y_off + height));
+    mapnik::image_any data(pyramid_->read(level_, x_off, y_off, width, height));
+    feature_ptr feature(mapnik::feature_factory::create(ctx_, 1));
+    feature->set_raster(std::make_shared<mapnik::raster>(feature_raster_extent, intersect, std::move(data), filter_factor_));
+    return feature;
+}
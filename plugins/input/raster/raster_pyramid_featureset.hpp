@@ -0,0 +1,58 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef RASTER_PYRAMID_FEATURESET_HPP
+#define RASTER_PYRAMID_FEATURESET_HPP
+
+#include "raster_pyramid.hpp"
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include <mapnik/query.hpp>
+
+// stl
+#include <memory>
+
+// Single feature read from one downsampled level of a raster_pyramid
+class raster_pyramid_featureset : public mapnik::Featureset
+{
+public:
+    raster_pyramid_featureset(std::shared_ptr<raster_pyramid> const& pyramid,
+                              unsigned level,
+                              mapnik::box2d<double> const& extent,
+                              mapnik::query const& q);
+    virtual ~raster_pyramid_featureset();
+    mapnik::feature_ptr next();
+
+private:
+    std::shared_ptr<raster_pyramid> pyramid_;
+    unsigned level_;
+    mapnik::context_ptr ctx_;
+    mapnik::box2d<double> extent_;
+    mapnik::box2d<double> bbox_;
+    double filter_factor_;
+    bool first_;
+};
+
+#endif // RASTER_PYRAMID_FEATURESET_HPP
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#ifndef RASTER_READER_POOL_HPP
+#define RASTER_READER_POOL_HPP
+
+// mapnik
+#include <mapnik/image_reader.hpp>
+#include <mapnik/util/noncopyable.hpp>
+
+// stl
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
+
+// Idle image readers of a raster datasource, kept open so that repeated
+// queries don't reopen the same files and parse their headers again.
+// A reader is only ever used by one thread: it leaves the pool while in
+// use and the least recently returned readers are closed first.
+class raster_reader_pool : private mapnik::util::noncopyable
+{
+public:
+    using reader_ptr = std::unique_ptr<mapnik::image_reader>;
+
+    explicit raster_reader_pool(std::size_t max_size)
+        : max_size_(max_size) {}
+
+    reader_ptr acquire(std::string const& file, std::string const& format)
+    {
+        {
+#ifdef MAPNIK_THREADSAFE
+            std::lock_guard<std::mutex> lock(mutex_);
+#endif
+            for (auto itr = idle_.begin(); itr != idle_.end(); ++itr)
+            {
+                if (itr->first == file)
+                {
+                    reader_ptr reader = std::move(itr->second);
+                    idle_.erase(itr);
+                    return reader;
+                }
+            }
+        }
+        return reader_ptr(mapnik::get_image_reader(file, format));
+    }
+
+    void release(std::string const& file, reader_ptr && reader)
+    {
+        if (!reader || max_size_ == 0) return;
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        idle_.emplace_front(file, std::move(reader));
+        if (idle_.size() > max_size_) idle_.pop_back();
+    }
+
+private:
+    std::list<std::pair<std::string, reader_ptr>> idle_; // most recently returned first
+    std::size_t max_size_;
+#ifdef MAPNIK_THREADSAFE
+    std::mutex mutex_;
+#endif
+};
+
+#endif // RASTER_READER_POOL_HPP
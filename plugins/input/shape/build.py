@@ -30,7 +30,9 @@ plugin_sources = Split(
   """
   %(PLUGIN_NAME)s_datasource.cpp
   %(PLUGIN_NAME)s_featureset.cpp
+  %(PLUGIN_NAME)s_geometry_cache.cpp
   %(PLUGIN_NAME)s_index_featureset.cpp
+  %(PLUGIN_NAME)s_index_cache.cpp
   %(PLUGIN_NAME)s_io.cpp
   %(PLUGIN_NAME)s_utils.cpp
   dbfile.cpp
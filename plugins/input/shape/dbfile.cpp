@@ -20,6 +20,7 @@
  *
  *****************************************************************************/
 // mapnik
+#include <mapnik/debug.hpp>
 #include <mapnik/value/types.hpp>
 #include <mapnik/global.hpp>
 #include <mapnik/util/utf_conv_win.hpp>
@@ -27,6 +28,7 @@
 #include <mapnik/util/trim.hpp>
 
 #include "dbfile.hpp"
+#include "shapefile.hpp"
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -42,14 +44,18 @@
 #include <string>
 #include <cstring>
 #include <stdexcept>
+#include <algorithm>
+#include <limits>
 
 dbf_file::dbf_file()
     : num_records_(0),
       num_fields_(0),
       record_length_(0),
-      record_(0) {}
+      record_(0),
+      record_data_(nullptr),
+      current_(0) {}
 
-dbf_file::dbf_file(std::string const& file_name)
+dbf_file::dbf_file(std::string const& file_name, mapnik::mapped_access access)
     :num_records_(0),
      num_fields_(0),
      record_length_(0),
@@ -60,11 +66,13 @@ dbf_file::dbf_file(std::string const& file_name)
 #else
      file_(file_name.c_str() ,std::ios::in | std::ios::binary),
 #endif
-     record_(0)
+     record_(0),
+     record_data_(nullptr),
+     current_(0)
 {
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
-    boost::optional<mapnik::mapped_region_ptr> memory = mapnik::mapped_memory_cache::instance().find(file_name,true);
+    boost::optional<mapnik::mapped_region_ptr> memory = mapnik::mapped_memory_cache::instance().find(file_name, true, access);
     if (memory)
     {
         mapped_region_ = *memory;
@@ -74,6 +82,8 @@ dbf_file::dbf_file(std::string const& file_name)
     {
         throw std::runtime_error("could not create file mapping for "+file_name);
     }
+#else
+    (void)access;
 #endif
     if (file_)
     {
@@ -113,18 +123,54 @@ void dbf_file::move_to(int index)
 {
     if (index>0 && index<=num_records_)
     {
-        std::streampos pos=(num_fields_<<5)+34+(index-1)*(record_length_+1);
-        file_.seekg(pos,std::ios::beg);
-        file_.read(record_,record_length_);
+        std::size_t pos=(num_fields_<<5)+34+std::size_t(index-1)*(record_length_+1);
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        // records are decoded in place
+        if (pos + record_length_ <= file_.buffer().second)
+        {
+            record_data_ = file_.buffer().first + pos;
+            current_ = index;
+            return;
+        }
+#else
+        if (index == current_ + 1 && current_ > 0)
+        {
+            file_.ignore(1); // deletion flag of the next record
+        }
+        else
+        {
+            file_.seekg(pos,std::ios::beg);
+        }
+        if (file_.read(record_,record_length_))
+        {
+            record_data_ = record_;
+            current_ = index;
+            return;
+        }
+#endif
     }
+    record_data_ = nullptr;
+    current_ = 0;
+}
+
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+void dbf_file::will_need(int first, int last) const
+{
+    if (first > last || last < 1 || first > num_records_) return;
+    first = std::max(first, 1);
+    last = std::min(last, num_records_);
+    std::uint64_t begin = (num_fields_<<5)+34+std::uint64_t(first-1)*(record_length_+1);
+    std::uint64_t end = (num_fields_<<5)+34+std::uint64_t(last)*(record_length_+1);
+    ::will_need(mapped_region_, begin, end);
 }
+#endif
 
 
 std::string dbf_file::string_value(int col) const
 {
-    if (col>=0 && col<num_fields_)
+    if (record_data_ && col>=0 && col<num_fields_)
     {
-        return std::string(record_+fields_[col].offset_,fields_[col].length_);
+        return std::string(record_data_+fields_[col].offset_,fields_[col].length_);
     }
     return "";
 }
@@ -136,82 +182,200 @@ const field_descriptor& dbf_file::descriptor(int col) const
     return fields_[col];
 }
 
+namespace {
 
-void dbf_file::add_attribute(int col, mapnik::transcoder const& tr, mapnik::feature_impl & f) const
+// Fixed width fast path for right aligned DBF numbers ("  -12.50"),
+// anything else (exponents, garbage, overlong fields) returns false
+template <typename T>
+bool parse_fixed(char const* itr, char const* end, T & val, int & scale)
 {
+    while (itr != end && *itr == ' ') ++itr;
+    while (end != itr && *(end - 1) == ' ') --end;
+    bool negative = false;
+    if (itr != end && (*itr == '-' || *itr == '+'))
+    {
+        negative = (*itr == '-');
+        ++itr;
+    }
+    T result = 0;
+    int digits = 0;
+    scale = -1;
+    for (; itr != end; ++itr)
+    {
+        unsigned digit = static_cast<unsigned char>(*itr) - '0';
+        if (digit < 10)
+        {
+            if (++digits > std::numeric_limits<T>::digits10) return false;
+            result = result * 10 + static_cast<T>(digit);
+            if (scale >= 0) ++scale;
+        }
+        else if (*itr == '.' && scale < 0) scale = 0;
+        else return false;
+    }
+    if (digits == 0) return false;
+    if (scale < 0) scale = 0;
+    val = negative ? -result : result;
+    return true;
+}
+
+bool parse_integer(char const* itr, char const* end, mapnik::value_integer & val)
+{
+    int scale;
+    if (parse_fixed(itr, end, val, scale) && scale == 0) return true;
     using namespace boost::spirit;
+    x3::ascii::space_type space;
+    static x3::int_parser<mapnik::value_integer,10,1,-1> numeric_parser;
+    return x3::phrase_parse(itr, end, numeric_parser, space, val);
+}
 
-    if (col>=0 && col<num_fields_)
+bool parse_double(char const* itr, char const* end, double & val)
+{
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                                    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    std::int64_t mantissa;
+    int scale;
+    // exact below 2^53, so the division rounds correctly
+    if (parse_fixed(itr, end, mantissa, scale) && scale <= 15 &&
+        mantissa < (std::int64_t(1) << 53) && mantissa > -(std::int64_t(1) << 53))
     {
-        std::string const& name=fields_[col].name_;
+        val = static_cast<double>(mantissa) / pow10[scale];
+        return true;
+    }
+    using namespace boost::spirit;
+    x3::ascii::space_type space;
+    static x3::double_type double_;
+    return x3::phrase_parse(itr, end, double_, space, val);
+}
 
-        // NOTE: ensure types handled here are matched in shape_datasource.cpp
-        switch (fields_[col].type_)
-        {
-        case 'C':
-        case 'D':
+// NOTE: ensure types handled here are matched in shape_datasource.cpp
+bool decode_field(field_descriptor const& field, char const* record,
+                  mapnik::transcoder const& tr, mapnik::value & val)
+{
+    char const* data = record + field.offset_;
+    switch (field.type_)
+    {
+    case 'C':
+    case 'D':
+    {
+        char const* end = data + field.length_;
+        while (data != end && !mapnik::util::not_whitespace(*data)) ++data;
+        while (end != data && !mapnik::util::not_whitespace(*(end - 1))) --end;
+        end = std::find(data, end, '\0');
+        val = tr.transcode(data, static_cast<std::int32_t>(end - data));
+        return true;
+    }
+    case 'L':
+    {
+        char ch = *data;
+        // NOTE: null logical fields use '?'
+        val = (ch == '1' || ch == 't' || ch == 'T' || ch == 'y' || ch == 'Y');
+        return true;
+    }
+    case 'N': // numeric
+    case 'O': // double
+    case 'F': // float
+    {
+        if (*data == '*')
         {
-            // FIXME - avoid constructing std::string on stack
-            std::string str(record_+fields_[col].offset_,fields_[col].length_);
-            mapnik::util::trim(str);
-            f.put(name,tr.transcode(str.c_str()));
-            break;
+            // NOTE: we intentionally do not store null here
+            // since it is equivalent to the attribute not existing
+            return false;
         }
-        case 'L':
+        if (field.dec_ > 0)
         {
-            char ch = record_[fields_[col].offset_];
-            if ( ch == '1' || ch == 't' || ch == 'T' || ch == 'y' || ch == 'Y')
-            {
-                f.put(name,true);
-            }
-            else
-            {
-                // NOTE: null logical fields use '?'
-                f.put(name,false);
-            }
-            break;
+            double d = 0.0;
+            if (!parse_double(data, data + field.length_, d)) return false;
+            val = d;
         }
-        case 'N': // numeric
-        case 'O': // double
-        case 'F': // float
+        else
         {
+            mapnik::value_integer i = 0;
+            if (!parse_integer(data, data + field.length_, i)) return false;
+            val = i;
+        }
+        return true;
+    }
+    }
+    return false;
+}
 
-            if (record_[fields_[col].offset_] == '*')
-            {
-                // NOTE: we intentionally do not store null here
-                // since it is equivalent to the attribute not existing
-                break;
-            }
-            if ( fields_[col].dec_>0 )
-            {
-                double val = 0.0;
-                const char *itr = record_+fields_[col].offset_;
-                const char *end = itr + fields_[col].length_;
-                x3::ascii::space_type space;
-                static x3::double_type double_;
-                if (x3::phrase_parse(itr,end,double_,space,val))
-                {
-                    f.put(name,val);
-                }
-            }
-            else
+class dbf_record : public mapnik::feature_attribute_decoder
+{
+public:
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    dbf_record(dbf_columns_ptr const& columns, char const* data, std::size_t)
+        : columns_(columns),
+          data_(data) {}
+#else
+    dbf_record(dbf_columns_ptr const& columns, char const* data, std::size_t size)
+        : columns_(columns),
+          buffer_(data, size),
+          data_(buffer_.data()) {}
+#endif
+
+    bool decode(std::size_t index, mapnik::value & val) const override
+    {
+        if (index >= columns_->fields.size()) return false;
+        field_descriptor const& field = columns_->fields[index];
+        try
+        {
+#ifdef MAPNIK_THREADSAFE
+            if (field.type_ == 'C' || field.type_ == 'D')
             {
-                mapnik::value_integer val = 0;
-                const char *itr = record_+fields_[col].offset_;
-                const char *end = itr + fields_[col].length_;
-                x3::ascii::space_type space;
-                static x3::int_parser<mapnik::value_integer,10,1,-1> numeric_parser;
-                if (x3::phrase_parse(itr, end, numeric_parser, space, val))
-                {
-                    f.put(name,val);
-                }
+                std::lock_guard<std::mutex> lock(columns_->tr_mutex);
+                return decode_field(field, data_, columns_->tr, val);
             }
-            break;
+#endif
+            return decode_field(field, data_, columns_->tr, val);
+        }
+        catch (...)
+        {
+            MAPNIK_LOG_ERROR(shape) << "Shape Plugin: error processing attributes";
         }
+        return false;
+    }
+
+private:
+    dbf_columns_ptr columns_;
+#if !defined(MAPNIK_MEMORY_MAPPED_FILE)
+    std::string buffer_;
+#endif
+    char const* data_;
+};
+
+} // anonymous namespace
+
+void dbf_file::add_attribute(int col, mapnik::transcoder const& tr, mapnik::feature_impl & f) const
+{
+    if (record_data_ && col>=0 && col<num_fields_)
+    {
+        mapnik::value val;
+        if (decode_field(fields_[col], record_data_, tr, val))
+        {
+            f.put(fields_[col].name_, std::move(val));
         }
     }
 }
 
+dbf_columns_ptr dbf_file::columns(std::vector<int> const& ids, std::string const& encoding) const
+{
+    auto columns = std::make_shared<dbf_columns>(encoding);
+    for (auto id : ids)
+    {
+        columns->fields.push_back(descriptor(id));
+    }
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    columns->region = mapped_region_;
+#endif
+    return columns;
+}
+
+mapnik::feature_attribute_decoder_ptr dbf_file::record(dbf_columns_ptr const& columns) const
+{
+    if (!record_data_ || !columns || columns->fields.empty()) return mapnik::feature_attribute_decoder_ptr();
+    return std::make_shared<dbf_record>(columns, record_data_, record_length_);
+}
+
 void dbf_file::read_header()
 {
     char c=file_.get();
@@ -27,9 +27,9 @@
 #include <mapnik/feature.hpp>
 #include <mapnik/util/noncopyable.hpp>
 #include <mapnik/unicode.hpp>
+#include <mapnik/mapped_memory_cache.hpp>
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
-#include <mapnik/mapped_memory_cache.hpp>
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
 #include <boost/interprocess/streams/bufferstream.hpp>
@@ -39,8 +39,12 @@
 // stl
 #include <vector>
 #include <string>
+#include <memory>
 #include <cassert>
 #include <fstream>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
 
 struct field_descriptor
 {
@@ -53,6 +57,27 @@ struct field_descriptor
 };
 
 
+// Requested columns of a DBF file in feature context order,
+// shared by all records decoded for a featureset
+struct dbf_columns : private mapnik::util::noncopyable
+{
+    explicit dbf_columns(std::string const& encoding)
+        : fields(),
+          tr(encoding) {}
+    std::vector<field_descriptor> fields;
+    mapnik::transcoder tr;
+#ifdef MAPNIK_THREADSAFE
+    // features may be decoded from several threads, the ICU converter
+    // behind `tr` is not thread safe
+    mutable std::mutex tr_mutex;
+#endif
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapnik::mapped_region_ptr region; // keeps mapped records alive
+#endif
+};
+
+using dbf_columns_ptr = std::shared_ptr<dbf_columns const>;
+
 class dbf_file : private mapnik::util::noncopyable
 {
 private:
@@ -67,17 +92,26 @@ private:
     std::ifstream file_;
 #endif
     char* record_;
+    char const* record_data_;
+    int current_;
 public:
     dbf_file();
-    dbf_file(std::string const& file_name);
+    dbf_file(std::string const& file_name,
+             mapnik::mapped_access access = mapnik::mapped_access::normal);
     ~dbf_file();
     bool is_open();
     int num_records() const;
     int num_fields() const;
     field_descriptor const& descriptor(int col) const;
     void move_to(int index);
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    void will_need(int first, int last) const;
+#endif
     std::string string_value(int col) const;
     void add_attribute(int col, mapnik::transcoder const& tr, mapnik::feature_impl & f) const;
+    dbf_columns_ptr columns(std::vector<int> const& ids, std::string const& encoding) const;
+    // attributes of the current record, decoded on first access
+    mapnik::feature_attribute_decoder_ptr record(dbf_columns_ptr const& columns) const;
 private:
     void read_header();
     int read_short();
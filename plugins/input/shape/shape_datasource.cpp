@@ -23,6 +23,8 @@
 #include "shape_datasource.hpp"
 #include "shape_featureset.hpp"
 #include "shape_index_featureset.hpp"
+#include "shape_geometry_cache.hpp"
+#include "shape_index_cache.hpp"
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -64,6 +66,8 @@ shape_datasource::shape_datasource(parameters const& params)
       file_length_(0),
       indexed_(false),
       row_limit_(*params.get<mapnik::value_integer>("row_limit",0)),
+      geometry_cache_(*params.get<mapnik::boolean_type>("geometry_cache", false)),
+      populate_(*params.get<mapnik::boolean_type>("populate", false)),
       desc_(shape_datasource::name(), *params.get<std::string>("encoding","utf-8"))
 {
 #ifdef MAPNIK_STATS
@@ -98,7 +102,8 @@ shape_datasource::shape_datasource(parameters const& params)
         mapnik::progress_timer __stats2__(std::clog, "shape_datasource::init(get_column_description)");
 #endif
 
-        shape_io shape(shape_name_);
+        // populated files are read into memory while loading the layer
+        shape_io shape(shape_name_, true, access(mapnik::mapped_access::normal));
         init(shape);
         for (int i = 0; i < shape.dbf().num_fields(); ++i)
         {
@@ -190,6 +195,21 @@ void shape_datasource::init(shape_io& shape)
     if (shape_type_ == shape_io::shape_multipatch)
         throw datasource_exception("Shape Plugin: shapefile multipatch type is not supported");
 
+    switch (shape_type_)
+    {
+    case shape_io::shape_point:
+    case shape_io::shape_pointm:
+    case shape_io::shape_pointz:
+    case shape_io::shape_multipoint:
+    case shape_io::shape_multipointm:
+    case shape_io::shape_multipointz:
+        // points are cheap to decode and have nothing to simplify
+        geometry_cache_ = false;
+        break;
+    default:
+        break;
+    }
+
     const double lox = header.read_double();
     const double loy = header.read_double();
     const double hix = header.read_double();
@@ -213,7 +233,16 @@ void shape_datasource::init(shape_io& shape)
     MAPNIK_LOG_DEBUG(shape) << "shape_datasource: Shape type=" << shape_type_;
 }
 
-shape_datasource::~shape_datasource() {}
+shape_datasource::~shape_datasource()
+{
+    if (geometry_cache_)
+    {
+        mapnik::util::lru_cache_stats stats = shape_geometry_cache::instance().stats();
+        MAPNIK_LOG_DEBUG(shape) << "shape_datasource: Geometry cache hits=" << stats.hits
+                                << " misses=" << stats.misses << " entries=" << stats.entries
+                                << " bytes=" << stats.bytes << " evictions=" << stats.evictions;
+    }
+}
 
 const char * shape_datasource::name()
 {
@@ -225,9 +254,23 @@ datasource::datasource_t shape_datasource::type() const
     return type_;
 }
 
+mapnik::mapped_access shape_datasource::access(mapnik::mapped_access reading) const
+{
+    return populate_ ? mapnik::mapped_access::populate : reading;
+}
+
 layer_descriptor shape_datasource::get_descriptor() const
 {
-    return desc_;
+    if (!geometry_cache_) return desc_;
+    // counters of the geometry cache, which all shape layers share
+    layer_descriptor desc(desc_);
+    mapnik::util::lru_cache_stats stats = shape_geometry_cache::instance().stats();
+    mapnik::parameters & extra_params = desc.get_extra_parameters();
+    extra_params["geometry_cache_hits"] = mapnik::value_integer(stats.hits);
+    extra_params["geometry_cache_misses"] = mapnik::value_integer(stats.misses);
+    extra_params["geometry_cache_entries"] = mapnik::value_integer(stats.entries);
+    extra_params["geometry_cache_bytes"] = mapnik::value_integer(stats.bytes);
+    return desc;
 }
 
 featureset_ptr shape_datasource::features(query const& q) const
@@ -237,10 +280,18 @@ featureset_ptr shape_datasource::features(query const& q) const
 #endif
 
     auto const& query_box = q.get_bbox();
+    boost::optional<int> geometry_bucket;
+    auto const& resolution = q.resolution();
+    if (geometry_cache_ && std::get<0>(resolution) > 0 && std::get<1>(resolution) > 0)
+    {
+        geometry_bucket = shape_geometry_cache::resolution_bucket(std::get<0>(resolution), std::get<1>(resolution));
+    }
 
-    if (indexed_)
+    // files without a .index get an in-memory one on first use
+    shape_index_cache::index_ptr memory_index;
+    if (indexed_ || (memory_index = shape_index_cache::instance().find(shape_name_)))
     {
-        std::unique_ptr<shape_io> shape_ptr = std::make_unique<shape_io>(shape_name_);
+        std::unique_ptr<shape_io> shape_ptr = std::make_unique<shape_io>(shape_name_, indexed_, access(mapnik::mapped_access::random));
         mapnik::bounding_box_filter<float> filter(mapnik::box2d<float>(query_box.minx(), query_box.miny(), query_box.maxx(), query_box.maxy()));
         return featureset_ptr
             (new shape_index_featureset<mapnik::bounding_box_filter<float>>(filter,
@@ -248,7 +299,9 @@ featureset_ptr shape_datasource::features(query const& q) const
                                                                             q.property_names(),
                                                                             desc_.get_encoding(),
                                                                             shape_name_,
-                                                                            row_limit_));
+                                                                            row_limit_,
+                                                                            geometry_bucket,
+                                                                            memory_index));
     }
     else
     {
@@ -257,7 +310,9 @@ featureset_ptr shape_datasource::features(query const& q) const
                                                                   shape_name_,
                                                                   q.property_names(),
                                                                   desc_.get_encoding(),
-                                                                  row_limit_);
+                                                                  row_limit_,
+                                                                  geometry_bucket,
+                                                                  access(mapnik::mapped_access::sequential));
     }
 }
 
@@ -277,17 +332,22 @@ featureset_ptr shape_datasource::features_at_point(coord2d const& pt, double tol
         names.insert(attr_info.get_name());
     }
 
-    if (indexed_)
+    // hit tests read exact geometries, bypassing the geometry cache
+    shape_index_cache::index_ptr memory_index;
+    if (indexed_ || (memory_index = shape_index_cache::instance().find(shape_name_)))
     {
-        std::unique_ptr<shape_io> shape_ptr = std::make_unique<shape_io>(shape_name_);
-        mapnik::at_point_filter<float> filter(mapnik::coord2f(pt.x, pt.y));
+        std::unique_ptr<shape_io> shape_ptr = std::make_unique<shape_io>(shape_name_, indexed_, access(mapnik::mapped_access::random));
+        // the in-memory index replaces a sequential scan, which honours the tolerance
+        mapnik::at_point_filter<float> filter(mapnik::coord2f(pt.x, pt.y), memory_index ? tol : 0.0);
         return featureset_ptr
             (new shape_index_featureset<mapnik::at_point_filter<float>>(filter,
                                                                         std::move(shape_ptr),
                                                                         names,
                                                                         desc_.get_encoding(),
                                                                         shape_name_,
-                                                                        row_limit_));
+                                                                        row_limit_,
+                                                                        boost::none,
+                                                                        memory_index));
     }
     else
     {
@@ -296,7 +356,9 @@ featureset_ptr shape_datasource::features_at_point(coord2d const& pt, double tol
                                                                     shape_name_,
                                                                     names,
                                                                     desc_.get_encoding(),
-                                                                    row_limit_);
+                                                                    row_limit_,
+                                                                    boost::none,
+                                                                    access(mapnik::mapped_access::sequential));
     }
 }
 
@@ -64,6 +64,8 @@ public:
     layer_descriptor get_descriptor() const;
 private:
     void init(shape_io& shape);
+    // `reading` unless the files are to be populated
+    mapnik::mapped_access access(mapnik::mapped_access reading) const;
 
     datasource::datasource_t type_;
     std::string shape_name_;
@@ -72,6 +74,8 @@ private:
     box2d<double> extent_;
     bool indexed_;
     const int row_limit_;
+    bool geometry_cache_;
+    const bool populate_;
     layer_descriptor desc_;
 };
 
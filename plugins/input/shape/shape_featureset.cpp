@@ -41,16 +41,20 @@ shape_featureset<filterT>::shape_featureset(filterT const& filter,
                                             std::string const& shape_name,
                                             std::set<std::string> const& attribute_names,
                                             std::string const& encoding,
-                                            int row_limit)
+                                            int row_limit,
+                                            boost::optional<int> const& geometry_bucket,
+                                            mapnik::mapped_access access)
     : filter_(filter),
-      shape_(shape_name, false),
+      shape_(shape_name, false, access),
       query_ext_(),
       feature_bbox_(),
-      tr_(new transcoder(encoding)),
+      columns_(),
       shx_file_length_(0),
       row_limit_(row_limit),
       count_(0),
-      ctx_(std::make_shared<mapnik::context_type>())
+      ctx_(std::make_shared<mapnik::context_type>()),
+      geometry_file_(geometry_bucket ? mapnik::util::file_stamp::of(shape_name + ".shp") : mapnik::util::file_stamp()),
+      geometry_bucket_(geometry_bucket)
 {
     if (!shape_.shx().is_open())
     {
@@ -61,6 +65,7 @@ shape_featureset<filterT>::shape_featureset(filterT const& filter,
     shx_header.skip(6 * 4);
     shx_file_length_ = shx_header.read_xdr_integer();
     setup_attributes(ctx_, attribute_names, shape_name, shape_, attr_ids_);
+    columns_ = shape_.dbf().columns(attr_ids_, encoding);
 }
 
 template <typename filterT>
@@ -79,14 +84,23 @@ feature_ptr shape_featureset<filterT>::next()
         shape_.move_to(2 * offset);
         mapnik::value_integer feature_id = shape_.id();
         assert(record_length == shape_.reclength_);
-        shape_file::record_type record(record_length * 2);
-        shape_.shp().read_record(record);
-        int type = record.read_ndr_integer();
-
+        // test the bbox in the record header before reading the record
+        int type = shape_io::shape_null;
+        if (!shape_io::read_header(shape_.shp(), record_length, type, feature_bbox_)) continue;
         // skip null shapes
         if (type == shape_io::shape_null) continue;
+        if (!filter_.pass(feature_bbox_)) continue;
 
         feature_ptr feature(feature_factory::create(ctx_, feature_id));
+        if (geometry_bucket_ && shape_geometry_cache::instance().get(geometry_file_, 2 * offset, *geometry_bucket_, *feature))
+        {
+            set_attributes(*feature);
+            ++count_;
+            return feature;
+        }
+        shape_file::record_type record(record_length * 2);
+        shape_.shp().read_record(record);
+        record.skip(4);
         switch (type)
         {
         case shape_io::shape_point:
@@ -95,8 +109,6 @@ feature_ptr shape_featureset<filterT>::next()
         {
             double x = record.read_double();
             double y = record.read_double();
-            if (!filter_.pass(mapnik::box2d<double>(x,y,x,y)))
-                continue;
             feature->set_geometry(mapnik::geometry::point<double>(x,y));
             break;
         }
@@ -104,16 +116,10 @@ feature_ptr shape_featureset<filterT>::next()
         case shape_io::shape_multipointm:
         case shape_io::shape_multipointz:
         {
-            shape_io::read_bbox(record, feature_bbox_);
-            if (!filter_.pass(feature_bbox_)) continue;
+            record.skip(4 * 8);
             int num_points = record.read_ndr_integer();
             mapnik::geometry::multi_point<double> multi_point;
-            for (int i = 0; i < num_points; ++i)
-            {
-                double x = record.read_double();
-                double y = record.read_double();
-                multi_point.emplace_back(mapnik::geometry::point<double>(x, y));
-            }
+            record.read_points(multi_point, num_points);
             feature->set_geometry(std::move(multi_point));
             break;
         }
@@ -122,18 +128,18 @@ feature_ptr shape_featureset<filterT>::next()
         case shape_io::shape_polylinem:
         case shape_io::shape_polylinez:
         {
-            shape_io::read_bbox(record, feature_bbox_);
-            if (!filter_.pass(feature_bbox_)) continue;
-            feature->set_geometry(shape_io::read_polyline(record));
+            record.skip(4 * 8);
+            if (geometry_bucket_) shape_geometry_cache::instance().put(geometry_file_, 2 * offset, *geometry_bucket_, shape_io::read_polyline(record), *feature);
+            else feature->set_geometry(shape_io::read_polyline(record));
             break;
         }
         case shape_io::shape_polygon:
         case shape_io::shape_polygonm:
         case shape_io::shape_polygonz:
         {
-            shape_io::read_bbox(record, feature_bbox_);
-            if (!filter_.pass(feature_bbox_)) continue;
-            feature->set_geometry(shape_io::read_polygon(record));
+            record.skip(4 * 8);
+            if (geometry_bucket_) shape_geometry_cache::instance().put(geometry_file_, 2 * offset, *geometry_bucket_, shape_io::read_polygon(record), *feature);
+            else feature->set_geometry(shape_io::read_polygon(record));
             break;
         }
         default :
@@ -141,21 +147,7 @@ feature_ptr shape_featureset<filterT>::next()
             return feature_ptr();
         }
 
-        if (attr_ids_.size())
-        {
-            shape_.dbf().move_to(shape_.id_);
-            try
-            {
-                for (auto id : attr_ids_)
-                {
-                    shape_.dbf().add_attribute(id, *tr_, *feature); //TODO optimize!!!
-                }
-            }
-            catch (...)
-            {
-                MAPNIK_LOG_ERROR(shape) << "Shape Plugin: error processing attributes";
-            }
-        }
+        set_attributes(*feature);
         ++count_;
         return feature;
     }
@@ -164,6 +156,17 @@ feature_ptr shape_featureset<filterT>::next()
     return feature_ptr();
 }
 
+template <typename filterT>
+void shape_featureset<filterT>::set_attributes(mapnik::feature_impl & feature)
+{
+    if (attr_ids_.size())
+    {
+        // attributes are decoded when first read
+        shape_.dbf().move_to(shape_.id_);
+        feature.set_decoder(shape_.dbf().record(columns_));
+    }
+}
+
 template <typename filterT>
 shape_featureset<filterT>::~shape_featureset() {}
 
@@ -30,6 +30,7 @@
 #include <mapnik/unicode.hpp>
 #include <mapnik/value/types.hpp>
 
+#include "shape_geometry_cache.hpp"
 #include "shape_io.hpp"
 
 //boost
@@ -50,21 +51,26 @@ public:
                      std::string const& shape_file,
                      std::set<std::string> const& attribute_names,
                      std::string const& encoding,
-                     int row_limit);
+                     int row_limit,
+                     boost::optional<int> const& geometry_bucket,
+                     mapnik::mapped_access access);
     virtual ~shape_featureset();
     feature_ptr next();
 
 private:
+    void set_attributes(mapnik::feature_impl & feature);
     filterT filter_;
     shape_io shape_;
     box2d<double> query_ext_;
     mutable box2d<double> feature_bbox_;
-    const std::unique_ptr<transcoder> tr_;
+    dbf_columns_ptr columns_;
     long shx_file_length_;
     std::vector<int> attr_ids_;
     mapnik::value_integer row_limit_;
     mutable int count_;
     context_ptr ctx_;
+    mapnik::util::file_stamp geometry_file_;
+    boost::optional<int> geometry_bucket_;
 };
 
 #endif //SHAPE_FEATURESET_HPP
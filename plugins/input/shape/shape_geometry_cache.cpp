@@ -0,0 +1,229 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/geometry/boost_adapters.hpp>
+#include <mapnik/util/fs.hpp>
+
+#include "shape_geometry_cache.hpp"
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/geometry/algorithms/simplify.hpp>
+#pragma GCC diagnostic pop
+
+// stl
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace {
+
+using mapnik::geometry::geometry;
+
+struct geometry_bytes
+{
+    template <typename Points>
+    std::size_t points(Points const& pts) const
+    {
+        return sizeof(pts) + pts.capacity() * sizeof(typename Points::value_type);
+    }
+
+    template <typename Geometries, typename Bytes>
+    std::size_t sum(Geometries const& geoms, Bytes bytes) const
+    {
+        std::size_t size = sizeof(geoms);
+        for (auto const& geom : geoms) size += bytes(geom);
+        return size;
+    }
+
+    std::size_t polygon(mapnik::geometry::polygon<double> const& poly) const
+    {
+        return sum(poly, [this](mapnik::geometry::linear_ring<double> const& ring) { return points(ring); });
+    }
+
+    std::size_t operator()(mapnik::geometry::line_string<double> const& line) const
+    {
+        return points(line);
+    }
+
+    std::size_t operator()(mapnik::geometry::multi_line_string<double> const& lines) const
+    {
+        return sum(lines, [this](mapnik::geometry::line_string<double> const& line) { return points(line); });
+    }
+
+    std::size_t operator()(mapnik::geometry::polygon<double> const& poly) const
+    {
+        return polygon(poly);
+    }
+
+    std::size_t operator()(mapnik::geometry::multi_polygon<double> const& polys) const
+    {
+        return sum(polys, [this](mapnik::geometry::polygon<double> const& poly) { return polygon(poly); });
+    }
+
+    template <typename T>
+    std::size_t operator()(T const&) const
+    {
+        return sizeof(T);
+    }
+};
+
+// Douglas-Peucker per line and ring; lines and rings that would collapse are kept as is
+struct simplify_geometry
+{
+    double tolerance;
+
+    template <typename Points>
+    Points simplify(Points const& points, std::size_t min_size) const
+    {
+        Points result;
+        boost::geometry::simplify(points, result, tolerance);
+        if (result.size() < min_size) return points;
+        return result;
+    }
+
+    mapnik::geometry::polygon<double> polygon(mapnik::geometry::polygon<double> const& poly) const
+    {
+        mapnik::geometry::polygon<double> result;
+        result.reserve(poly.size());
+        for (auto const& ring : poly) result.push_back(simplify(ring, 4));
+        return result;
+    }
+
+    geometry<double> operator()(mapnik::geometry::line_string<double> const& line) const
+    {
+        return simplify(line, 2);
+    }
+
+    geometry<double> operator()(mapnik::geometry::multi_line_string<double> const& lines) const
+    {
+        mapnik::geometry::multi_line_string<double> result;
+        result.reserve(lines.size());
+        for (auto const& line : lines) result.push_back(simplify(line, 2));
+        return result;
+    }
+
+    geometry<double> operator()(mapnik::geometry::polygon<double> const& poly) const
+    {
+        return polygon(poly);
+    }
+
+    geometry<double> operator()(mapnik::geometry::multi_polygon<double> const& polys) const
+    {
+        mapnik::geometry::multi_polygon<double> result;
+        result.reserve(polys.size());
+        for (auto const& poly : polys) result.push_back(polygon(poly));
+        return result;
+    }
+
+    template <typename T>
+    geometry<double> operator()(T const& geom) const
+    {
+        return geom;
+    }
+};
+
+}
+
+shape_geometry_cache::shape_geometry_cache()
+    : cache_(64u << 20) {}
+
+int shape_geometry_cache::resolution_bucket(double resolution)
+{
+    return static_cast<int>(std::floor(std::log2(resolution)));
+}
+
+int shape_geometry_cache::resolution_bucket(double x_resolution, double y_resolution)
+{
+    return resolution_bucket(std::max(x_resolution, y_resolution));
+}
+
+shape_geometry_cache::geometry_ptr shape_geometry_cache::find(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    geometry_ptr const* geom = cache_.find(key_type{file, offset, bucket});
+    return geom ? *geom : geometry_ptr();
+}
+
+shape_geometry_cache::geometry_ptr shape_geometry_cache::insert(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket,
+                                                                mapnik::geometry::geometry<double> const& geom)
+{
+    // half the pixel size at the finest resolution (2^(bucket + 1)) of the bucket
+    double tolerance = std::ldexp(1.0, -(bucket + 2));
+    geometry_ptr simplified = std::make_shared<geometry<double> const>(
+        mapnik::util::apply_visitor(simplify_geometry{tolerance}, geom));
+    std::size_t size = mapnik::util::apply_visitor(geometry_bytes(), *simplified) + sizeof(key_type) + file.name.size();
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.insert(key_type{file, offset, bucket}, simplified, size);
+    return simplified;
+}
+
+bool shape_geometry_cache::get(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket, mapnik::feature_impl & feature)
+{
+    geometry_ptr geom = find(file, offset, bucket);
+    if (!geom) return false;
+    feature.set_geometry_copy(*geom);
+    return true;
+}
+
+void shape_geometry_cache::put(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket,
+                               mapnik::geometry::geometry<double> const& geom, mapnik::feature_impl & feature)
+{
+    feature.set_geometry_copy(*insert(file, offset, bucket, geom));
+}
+
+void shape_geometry_cache::clear()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.clear();
+}
+
+void shape_geometry_cache::set_max_bytes(std::size_t max_bytes)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.set_max_bytes(max_bytes);
+}
+
+std::size_t shape_geometry_cache::max_bytes() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.max_bytes();
+}
+
+mapnik::util::lru_cache_stats shape_geometry_cache::stats() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.stats();
+}
@@ -0,0 +1,96 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef SHAPE_GEOMETRY_CACHE_HPP
+#define SHAPE_GEOMETRY_CACHE_HPP
+
+// mapnik
+#include <mapnik/feature.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+// stl
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Polylines and polygons decoded for layers with `geometry_cache=true`,
+// keyed by the .shp file stamp, record offset and resolution bucket. Each
+// entry is simplified to half a pixel at the finest resolution of its
+// bucket, so repeated tiles at the same zoom neither re-decode nor carry
+// more vertices than they can draw.
+class shape_geometry_cache :
+        public mapnik::singleton<shape_geometry_cache, mapnik::CreateStatic>,
+        private mapnik::util::noncopyable
+{
+    friend class mapnik::CreateStatic<shape_geometry_cache>;
+public:
+    using geometry_ptr = std::shared_ptr<mapnik::geometry::geometry<double> const>;
+
+    // buckets are powers of two of the query resolution (pixels per unit)
+    static int resolution_bucket(double resolution);
+    // the bucket of the finer axis, so that simplification stays within half
+    // a pixel on both axes of anisotropic queries
+    static int resolution_bucket(double x_resolution, double y_resolution);
+
+    geometry_ptr find(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket);
+    geometry_ptr insert(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket,
+                        mapnik::geometry::geometry<double> const& geom);
+    // sets the cached geometry on `feature`, false on a miss
+    bool get(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket, mapnik::feature_impl & feature);
+    // caches `geom` and sets its simplified version on `feature`
+    void put(mapnik::util::file_stamp const& file, std::uint64_t offset, int bucket,
+             mapnik::geometry::geometry<double> const& geom, mapnik::feature_impl & feature);
+    void clear();
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+    mapnik::util::lru_cache_stats stats() const;
+
+private:
+    struct key_type
+    {
+        mapnik::util::file_stamp file;
+        std::uint64_t offset;
+        int bucket;
+        bool operator==(key_type const& rhs) const
+        {
+            return offset == rhs.offset && bucket == rhs.bucket && file == rhs.file;
+        }
+    };
+    struct key_hash
+    {
+        std::size_t operator()(key_type const& key) const
+        {
+            std::size_t seed = key.file.hash();
+            mapnik::util::hash_combine(seed, std::hash<std::uint64_t>()(key.offset));
+            mapnik::util::hash_combine(seed, std::hash<int>()(key.bucket));
+            return seed;
+        }
+    };
+    shape_geometry_cache();
+    mapnik::util::lru_cache<key_type, geometry_ptr, key_hash> cache_;
+};
+
+#endif // SHAPE_GEOMETRY_CACHE_HPP
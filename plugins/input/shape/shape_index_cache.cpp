@@ -0,0 +1,154 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+// mapnik
+#include <mapnik/debug.hpp>
+#include <mapnik/util/fs.hpp>
+#include <mapnik/util/packed_rtree.hpp>
+
+#include "shape_index_cache.hpp"
+#include "shape_index_featureset.hpp"
+#include "shape_io.hpp"
+
+// stl
+#include <sstream>
+
+namespace {
+
+// leaf entries plus (generously) the interior nodes of the tree
+constexpr std::size_t bytes_per_record = sizeof(mapnik::detail::node)
+    + 2 * (sizeof(mapnik::box2d<float>) + sizeof(std::uint32_t));
+
+std::size_t index_bytes(shape_index_cache::index_ptr const& index)
+{
+    return index ? index->size() : 0;
+}
+
+}
+
+shape_index_cache::shape_index_cache()
+    : cache_(256u << 20) {}
+
+shape_index_cache::index_ptr shape_index_cache::find(std::string const& shape_name)
+{
+    mapnik::util::file_stamp shp = mapnik::util::file_stamp::of(shape_name + shape_io::SHP);
+    mapnik::util::file_stamp shx = mapnik::util::file_stamp::of(shape_name + shape_io::SHX);
+    std::size_t max_bytes;
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(mutex_);
+#endif
+        if (entry const* cached = cache_.find(shape_name))
+        {
+            if (cached->shp == shp && cached->shx == shx) return cached->index;
+            MAPNIK_LOG_DEBUG(shape) << "shape_index_cache: " << shape_name << " changed, re-indexing";
+            cache_.remove(shape_name);
+        }
+        max_bytes = cache_.max_bytes();
+    }
+    // scan the file without holding the lock; a concurrent build of the
+    // same file is harmless, the first one inserted wins
+    index_ptr index = build(shape_name, max_bytes);
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    if (entry const* cached = cache_.find(shape_name))
+    {
+        if (cached->shp == shp && cached->shx == shx) return cached->index;
+        // replace a tree of another version, inserted concurrently
+        cache_.remove(shape_name);
+    }
+    cache_.insert(shape_name, entry{shp, shx, index}, index_bytes(index));
+    return index;
+}
+
+bool shape_index_cache::remove(std::string const& shape_name)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.remove(shape_name);
+}
+
+void shape_index_cache::clear()
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.clear();
+}
+
+void shape_index_cache::set_max_bytes(std::size_t max_bytes)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    // files rejected under the old limit may fit now
+    cache_.remove_if([](std::string const&, entry const& e) { return !e.index; });
+    cache_.set_max_bytes(max_bytes);
+}
+
+std::size_t shape_index_cache::max_bytes() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.max_bytes();
+}
+
+shape_index_cache::index_ptr shape_index_cache::build(std::string const& shape_name, std::size_t max_bytes)
+{
+    shape_io shape(shape_name, false);
+    shape_file & shx = shape.shx();
+    if (!shx.is_open()) return index_ptr();
+    shx.seek(24);
+    int file_length = shx.read_xdr_integer();
+    std::size_t num_records = file_length > 50 ? static_cast<std::size_t>(file_length - 50) / 4 : 0;
+    if (num_records * bytes_per_record > max_bytes)
+    {
+        MAPNIK_LOG_DEBUG(shape) << "shape_index_cache: Not indexing " << shape_name
+                                << " in memory, " << num_records << " records";
+        return index_ptr();
+    }
+
+    mapnik::util::packed_rtree<mapnik::detail::node, mapnik::box2d<float>> tree(16);
+    tree.reserve(num_records);
+    shx.seek(100);
+    for (std::size_t i = 0; i < num_records && shx.is_good(); ++i)
+    {
+        int offset = shx.read_xdr_integer();
+        int record_length = shx.read_xdr_integer();
+        shape.move_to(2 * offset);
+        int type = shape_io::shape_null;
+        mapnik::box2d<double> box;
+        if (!shape_io::read_header(shape.shp(), record_length, type, box)) continue;
+        if (type == shape_io::shape_null || !box.valid()) continue;
+        mapnik::box2d<float> box_f(static_cast<float>(box.minx()), static_cast<float>(box.miny()),
+                                   static_cast<float>(box.maxx()), static_cast<float>(box.maxy()));
+        tree.insert(mapnik::detail::node(2 * static_cast<std::uint64_t>(offset), -1, 0, mapnik::box2d<float>(box_f)), box_f);
+    }
+    std::ostringstream out(std::ios::binary);
+    tree.write(out);
+    MAPNIK_LOG_DEBUG(shape) << "shape_index_cache: Indexed " << shape_name << " in memory, "
+                            << tree.count_items() << " records";
+    return std::make_shared<std::string const>(out.str());
+}
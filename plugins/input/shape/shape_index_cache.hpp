@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#ifndef SHAPE_INDEX_CACHE_HPP
+#define SHAPE_INDEX_CACHE_HPP
+
+// mapnik
+#include <mapnik/util/singleton.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/util/lru_cache.hpp>
+
+// stl
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Packed R-trees built in memory for shapefiles that have no .index file,
+// so only the first query against such a file scans all of its records.
+// Files whose tree alone would exceed max_bytes() are not indexed and are
+// read sequentially instead; that outcome is cached too, so they are not
+// rescanned on every query. Trees are rebuilt when the stamp of the .shp
+// or .shx changes.
+class shape_index_cache :
+        public mapnik::singleton<shape_index_cache, mapnik::CreateStatic>,
+        private mapnik::util::noncopyable
+{
+    friend class mapnik::CreateStatic<shape_index_cache>;
+public:
+    // serialized mapnik::util::packed_rtree of mapnik::detail::node
+    using index_ptr = std::shared_ptr<std::string const>;
+
+    index_ptr find(std::string const& shape_name);
+    bool remove(std::string const& shape_name);
+    void clear();
+    void set_max_bytes(std::size_t max_bytes);
+    std::size_t max_bytes() const;
+
+private:
+    struct entry
+    {
+        mapnik::util::file_stamp shp;
+        mapnik::util::file_stamp shx;
+        index_ptr index; // null if the file can't be indexed in memory
+    };
+    shape_index_cache();
+    static index_ptr build(std::string const& shape_name, std::size_t max_bytes);
+    mapnik::util::lru_cache<std::string, entry> cache_;
+};
+
+#endif // SHAPE_INDEX_CACHE_HPP
@@ -47,35 +47,50 @@ shape_index_featureset<filterT>::shape_index_featureset(filterT const& filter,
                                                         std::set<std::string> const& attribute_names,
                                                         std::string const& encoding,
                                                         std::string const& shape_name,
-                                                        int row_limit)
+                                                        int row_limit,
+                                                        boost::optional<int> const& geometry_bucket,
+                                                        shape_index_cache::index_ptr const& memory_index)
     : filter_(filter),
       ctx_(std::make_shared<mapnik::context_type>()),
       shape_ptr_(std::move(shape_ptr)),
-      tr_(new mapnik::transcoder(encoding)),
+      columns_(),
       positions_(),
       itr_(),
       attr_ids_(),
       row_limit_(row_limit),
       count_(0),
-      feature_bbox_()
+      feature_bbox_(),
+      geometry_file_(geometry_bucket ? mapnik::util::file_stamp::of(shape_name + ".shp") : mapnik::util::file_stamp()),
+      geometry_bucket_(geometry_bucket)
 {
     shape_ptr_->shp().skip(100);
     setup_attributes(ctx_, attribute_names, shape_name, *shape_ptr_, attr_ids_);
+    columns_ = shape_ptr_->dbf().columns(attr_ids_, encoding);
 
     auto index = shape_ptr_->index();
+    bool sorted = false;
     if (index)
     {
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
-        mapnik::util::spatial_index<mapnik::detail::node,
-                                    filterT,
-                                    boost::interprocess::ibufferstream,
-                                    mapnik::box2d<typename filterT::value_type>>::query(filter, index->file(), positions_);
+        using spatial_index_type = mapnik::util::spatial_index<mapnik::detail::node,
+                                                               filterT,
+                                                               boost::interprocess::ibufferstream,
+                                                               mapnik::box2d<typename filterT::value_type>>;
 #else
-        mapnik::util::spatial_index<mapnik::detail::node,
-                                    filterT,
-                                    std::ifstream,
-                                    mapnik::box2d<typename filterT::value_type>>::query(filter, index->file(), positions_);
+        using spatial_index_type = mapnik::util::spatial_index<mapnik::detail::node,
+                                                               filterT,
+                                                               std::ifstream,
+                                                               mapnik::box2d<typename filterT::value_type>>;
 #endif
+        spatial_index_type::query(filter, index->file(), positions_);
+        sorted = spatial_index_type::data_sorted(index->file());
+    }
+    else if (memory_index)
+    {
+        using packed_index_type = mapnik::util::packed_rtree_index<mapnik::detail::node,
+                                                                   filterT,
+                                                                   mapnik::box2d<typename filterT::value_type>>;
+        packed_index_type::query(filter, mapnik::util::detail::packed_memory_source{memory_index->data(), memory_index->size()}, positions_);
     }
     // filter
     positions_.erase(std::remove_if(positions_.begin(),
@@ -83,12 +98,52 @@ shape_index_featureset<filterT>::shape_index_featureset(filterT const& filter,
                                     [&](mapnik::detail::node const& pos)
                                     { return !pos.box.intersects(filter.box_);}),
                      positions_.end());
-    std::sort(positions_.begin(), positions_.end(), [](mapnik::detail::node const& n0, mapnik::detail::node const& n1)
-              {return n0.offset != n1.offset ? n0.offset < n1.offset : n0.start < n1.start;});
+    // packed indexes return records in file order already
+    auto file_order = [](mapnik::detail::node const& n0, mapnik::detail::node const& n1)
+        {return n0.offset != n1.offset ? n0.offset < n1.offset : n0.start < n1.start;};
+    if (!std::is_sorted(positions_.begin(), positions_.end(), file_order))
+    {
+        std::sort(positions_.begin(), positions_.end(), file_order);
+    }
     MAPNIK_LOG_DEBUG(shape) << "shape_index_featureset: Query size=" << positions_.size();
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    if (sorted) read_ahead();
+#endif
     itr_ = positions_.begin();
 }
 
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+// Hilbert sorted files answer a bbox query with a few contiguous runs of
+// records: hint each run to the kernel so it is paged in with large
+// sequential reads instead of a fault per record.
+template <typename filterT>
+void shape_index_featureset<filterT>::read_ahead()
+{
+    std::uint64_t const max_gap = 4096;
+    shape_file const& shp = shape_ptr_->shp();
+    std::size_t runs = 0;
+    auto itr = positions_.begin();
+    while (itr != positions_.end())
+    {
+        std::uint64_t begin = itr->offset;
+        std::uint64_t end = shp.record_end(begin);
+        auto last = itr;
+        while (++itr != positions_.end() && itr->offset <= end + max_gap)
+        {
+            end = std::max(end, shp.record_end(itr->offset));
+            last = itr;
+        }
+        shp.will_need(begin, end);
+        if (attr_ids_.size())
+        {
+            shape_ptr_->dbf().will_need(shp.record_number(begin), shp.record_number(last->offset));
+        }
+        ++runs;
+    }
+    MAPNIK_LOG_DEBUG(shape) << "shape_index_featureset: Sorted file, " << runs << " runs";
+}
+#endif
+
 template <typename filterT>
 feature_ptr shape_index_featureset<filterT>::next()
 {
@@ -108,10 +163,18 @@ feature_ptr shape_index_featureset<filterT>::next()
             ++itr_;
         }
         mapnik::value_integer feature_id = shape_ptr_->id();
+        feature_ptr feature(feature_factory::create(ctx_, feature_id));
+        // whole polylines and polygons go through the geometry cache
+        bool use_cache = geometry_bucket_ && parts.size() < 2;
+        if (use_cache && shape_geometry_cache::instance().get(geometry_file_, offset, *geometry_bucket_, *feature))
+        {
+            set_attributes(*feature);
+            ++count_;
+            return feature;
+        }
         shape_file::record_type record(shape_ptr_->reclength_ * 2);
         shape_ptr_->shp().read_record(record);
         int type = record.read_ndr_integer();
-        feature_ptr feature(feature_factory::create(ctx_, feature_id));
 
         switch (type)
         {
@@ -132,12 +195,7 @@ feature_ptr shape_index_featureset<filterT>::next()
             //if (!filter_.pass(feature_bbox_)) continue;
             int num_points = record.read_ndr_integer();
             mapnik::geometry::multi_point<double> multi_point;
-            for (int i = 0; i < num_points; ++i)
-            {
-                double x = record.read_double();
-                double y = record.read_double();
-                multi_point.emplace_back(mapnik::geometry::point<double>(x, y));
-            }
+            record.read_points(multi_point, num_points);
             feature->set_geometry(std::move(multi_point));
             break;
         }
@@ -147,7 +205,8 @@ feature_ptr shape_index_featureset<filterT>::next()
         {
             shape_io::read_bbox(record, feature_bbox_);
             //if (!filter_.pass(feature_bbox_)) continue;
-            if (parts.size() < 2) feature->set_geometry(shape_io::read_polyline(record));
+            if (use_cache) shape_geometry_cache::instance().put(geometry_file_, offset, *geometry_bucket_, shape_io::read_polyline(record), *feature);
+            else if (parts.size() < 2) feature->set_geometry(shape_io::read_polyline(record));
             else feature->set_geometry(shape_io::read_polyline_parts(record, parts));
             break;
         }
@@ -157,7 +216,8 @@ feature_ptr shape_index_featureset<filterT>::next()
         {
             shape_io::read_bbox(record, feature_bbox_);
             //if (!filter_.pass(feature_bbox_)) continue;
-            if (parts.size() < 2) feature->set_geometry(shape_io::read_polygon(record));
+            if (use_cache) shape_geometry_cache::instance().put(geometry_file_, offset, *geometry_bucket_, shape_io::read_polygon(record), *feature);
+            else if (parts.size() < 2) feature->set_geometry(shape_io::read_polygon(record));
             else feature->set_geometry(shape_io::read_polygon_parts(record, parts));
             break;
         }
@@ -166,21 +226,7 @@ feature_ptr shape_index_featureset<filterT>::next()
             return feature_ptr();
         }
 
-        if (attr_ids_.size())
-        {
-            shape_ptr_->dbf().move_to(shape_ptr_->id_);
-            try
-            {
-                for (auto id : attr_ids_)
-                {
-                    shape_ptr_->dbf().add_attribute(id, *tr_, *feature);
-                }
-            }
-            catch (...)
-            {
-                MAPNIK_LOG_ERROR(shape) << "Shape Plugin: error processing attributes";
-            }
-        }
+        set_attributes(*feature);
         ++count_;
         return feature;
     }
@@ -189,6 +235,17 @@ feature_ptr shape_index_featureset<filterT>::next()
     return feature_ptr();
 }
 
+template <typename filterT>
+void shape_index_featureset<filterT>::set_attributes(mapnik::feature_impl & feature)
+{
+    if (attr_ids_.size())
+    {
+        // attributes are decoded when first read
+        shape_ptr_->dbf().move_to(shape_ptr_->id_);
+        feature.set_decoder(shape_ptr_->dbf().record(columns_));
+    }
+}
+
 
 template <typename filterT>
 shape_index_featureset<filterT>::~shape_index_featureset() {}
@@ -38,6 +38,8 @@
 #include <boost/utility.hpp>
 
 #include "shape_datasource.hpp"
+#include "shape_geometry_cache.hpp"
+#include "shape_index_cache.hpp"
 #include "shape_io.hpp"
 
 using mapnik::Featureset;
@@ -71,21 +73,29 @@ public:
                            std::set<std::string> const& attribute_names,
                            std::string const& encoding,
                            std::string const& shape_name,
-                           int row_limit);
+                           int row_limit,
+                           boost::optional<int> const& geometry_bucket,
+                           shape_index_cache::index_ptr const& memory_index);
     virtual ~shape_index_featureset();
     feature_ptr next();
 
 private:
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    void read_ahead();
+#endif
+    void set_attributes(mapnik::feature_impl & feature);
     filterT filter_;
     context_ptr ctx_;
     std::unique_ptr<shape_io> shape_ptr_;
-    const std::unique_ptr<mapnik::transcoder> tr_;
+    dbf_columns_ptr columns_;
     std::vector<mapnik::detail::node> positions_;
     std::vector<mapnik::detail::node>::iterator itr_;
     std::vector<int> attr_ids_;
     mapnik::value_integer row_limit_;
     mutable int count_;
     mutable box2d<double> feature_bbox_;
+    mapnik::util::file_stamp geometry_file_;
+    boost::optional<int> geometry_bucket_;
 };
 
 #endif // SHAPE_INDEX_FEATURESET_HPP
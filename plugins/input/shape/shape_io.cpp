@@ -35,11 +35,11 @@ const std::string shape_io::SHX = ".shx";
 const std::string shape_io::DBF = ".dbf";
 const std::string shape_io::INDEX = ".index";
 
-shape_io::shape_io(std::string const& shape_name, bool open_index)
+shape_io::shape_io(std::string const& shape_name, bool open_index, mapnik::mapped_access access)
     : type_(shape_null),
-      shp_(shape_name + SHP),
-      shx_(shape_name + SHX),
-      dbf_(shape_name + DBF),
+      shp_(shape_name + SHP, access),
+      shx_(shape_name + SHX, access == mapnik::mapped_access::populate ? access : mapnik::mapped_access::normal),
+      dbf_(shape_name + DBF, access),
       reclength_(0),
       id_(0)
 {
@@ -53,7 +53,9 @@ shape_io::shape_io(std::string const& shape_name, bool open_index)
     {
         try
         {
-            index_ = std::make_unique<shape_file>(shape_name + INDEX);
+            // the tree is searched, not scanned
+            index_ = std::make_unique<shape_file>(shape_name + INDEX, access == mapnik::mapped_access::populate
+                                                  ? access : mapnik::mapped_access::random);
         }
         catch (...)
         {
@@ -70,7 +72,9 @@ shape_io::~shape_io() {}
 
 void shape_io::move_to(std::streampos pos)
 {
-    shp_.seek(pos);
+    // consecutive records (Hilbert sorted files) are read without seeking,
+    // which would discard the stream buffer
+    if (shp_.pos() != pos) shp_.seek(pos);
     id_ = shp_.read_xdr_integer();
     reclength_ = shp_.read_xdr_integer();
 }
@@ -99,6 +103,37 @@ void shape_io::read_bbox(shape_file::record_type & record, mapnik::box2d<double>
     bbox.init(lox, loy, hix, hiy);
 }
 
+// Peeks at the type and bounding box at the start of the next record
+// (`reclength` in 16-bit words) without reading the record itself: x/y
+// for points, the stored envelope for everything else.
+bool shape_io::read_header(shape_file & shp, int reclength, int & type, mapnik::box2d<double> & bbox)
+{
+    char header[36];
+    std::size_t size = std::min<std::size_t>(sizeof(header), 2 * static_cast<std::size_t>(std::max(0, reclength)));
+    if (size < 4 || !shp.peek(header, size)) return false;
+    std::int32_t shape_type;
+    mapnik::read_int32_ndr(header, shape_type);
+    type = shape_type;
+    double x, y;
+    switch (type)
+    {
+    case shape_null:
+        return true;
+    case shape_point:
+    case shape_pointm:
+    case shape_pointz:
+        if (size < 20) return false;
+        mapnik::read_double_ndr(header + 4, x);
+        mapnik::read_double_ndr(header + 12, y);
+        bbox.init(x, y, x, y);
+        return true;
+    default:
+        if (size < 36) return false;
+        std::memcpy(&bbox, header + 4, sizeof(bbox));
+        return true;
+    }
+}
+
 mapnik::geometry::geometry<double> shape_io::read_polyline(shape_file::record_type & record)
 {
     mapnik::geometry::geometry<double> geom; // default empty
@@ -108,44 +143,31 @@ mapnik::geometry::geometry<double> shape_io::read_polyline(shape_file::record_ty
     if (num_parts == 1)
     {
         mapnik::geometry::line_string<double> line;
-        line.reserve(num_points);
         record.skip(4);
-        for (int i = 0; i < num_points; ++i)
-        {
-            double x = record.read_double();
-            double y = record.read_double();
-            line.emplace_back(x, y);
-        }
+        record.read_points(line, num_points);
         geom = std::move(line);
     }
     else
     {
-        std::vector<int> parts;
-        parts.resize(num_parts);
-        std::for_each(parts.begin(), parts.end(), [&](int & part) { part = record.read_ndr_integer();});
+        std::size_t parts_pos = record.pos;
+        record.skip(4 * num_parts);
         int start, end;
         mapnik::geometry::multi_line_string<double> multi_line;
         multi_line.reserve(num_parts);
         for (int k = 0; k < num_parts; ++k)
         {
-            start = parts[k];
+            start = record.ndr_integer_at(parts_pos + 4 * k);
             if (k == num_parts - 1)
             {
                 end = num_points;
             }
             else
             {
-                end = parts[k + 1];
+                end = record.ndr_integer_at(parts_pos + 4 * (k + 1));
             }
 
             mapnik::geometry::line_string<double> line;
-            line.reserve(end - start);
-            for (int j = start; j < end; ++j)
-            {
-                double x = record.read_double();
-                double y = record.read_double();
-                line.emplace_back(x, y);
-            }
+            record.read_points(line, end - start);
             multi_line.push_back(std::move(line));
         }
         geom = std::move(multi_line);
@@ -168,13 +190,7 @@ mapnik::geometry::geometry<double> shape_io::read_polyline_parts(shape_file::rec
         record.set_pos(pos);
 
         mapnik::geometry::line_string<double> line;
-        line.reserve(end - start);
-        for (int j = start; j < end; ++j)
-        {
-            double x = record.read_double();
-            double y = record.read_double();
-            line.emplace_back(x, y);
-        }
+        record.read_points(line, end - start);
         multi_line.push_back(std::move(line));
     }
     geom = std::move(multi_line);
@@ -188,26 +204,19 @@ mapnik::geometry::geometry<double> shape_io::read_polygon(shape_file::record_typ
     int num_parts = record.read_ndr_integer();
     int num_points = record.read_ndr_integer();
 
-    std::vector<int> parts;
-    parts.resize(num_parts);
-    std::for_each(parts.begin(), parts.end(), [&](int & part) { part = record.read_ndr_integer();});
+    std::size_t parts_pos = record.pos;
+    record.skip(4 * num_parts);
     mapnik::geometry::polygon<double> poly;
     mapnik::geometry::multi_polygon<double> multi_poly;
     for (int k = 0; k < num_parts; ++k)
     {
-        int start = parts[k];
+        int start = record.ndr_integer_at(parts_pos + 4 * k);
         int end;
         if (k == num_parts - 1) end = num_points;
-        else end = parts[k + 1];
+        else end = record.ndr_integer_at(parts_pos + 4 * (k + 1));
 
         mapnik::geometry::linear_ring<double> ring;
-        ring.reserve(end - start);
-        for (int j = start; j < end; ++j)
-        {
-            double x = record.read_double();
-            double y = record.read_double();
-            ring.emplace_back(x, y);
-        }
+        record.read_points(ring, end - start);
         if (k == 0)
         {
             poly.push_back(std::move(ring));
@@ -251,13 +260,7 @@ mapnik::geometry::geometry<double> shape_io::read_polygon_parts(shape_file::reco
         unsigned pos = 4 + 32 + 8 + 4 * total_num_parts + start * 16;
         record.set_pos(pos);
         mapnik::geometry::linear_ring<double> ring;
-        ring.reserve(end - start);
-        for (int j = start; j < end; ++j)
-        {
-            double x = record.read_double();
-            double y = record.read_double();
-            ring.emplace_back(x, y);
-        }
+        record.read_points(ring, end - start);
         if (k == 0)
         {
             poly.push_back(std::move(ring));
@@ -57,7 +57,9 @@ public:
         shape_multipatch = 31
     };
 
-    shape_io(std::string const& shape_name, bool open_index=true);
+    // `access` hints how the .shp, .dbf and .index files are going to be read
+    shape_io(std::string const& shape_name, bool open_index=true,
+             mapnik::mapped_access access = mapnik::mapped_access::normal);
     ~shape_io();
 
     shape_file& shp();
@@ -84,6 +86,7 @@ public:
     inline int id() const { return id_;}
     void move_to(std::streampos pos);
     static void read_bbox(shape_file::record_type & record, mapnik::box2d<double> & bbox);
+    static bool read_header(shape_file & shp, int reclength, int & type, mapnik::box2d<double> & bbox);
     static mapnik::geometry::geometry<double> read_polyline(shape_file::record_type & record);
     static mapnik::geometry::geometry<double> read_polygon(shape_file::record_type & record);
     static mapnik::geometry::geometry<double> read_polyline_parts(shape_file::record_type & record,std::vector<std::pair<int,int>> const& parts);
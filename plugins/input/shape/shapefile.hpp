@@ -28,11 +28,14 @@
 #include <fstream>
 #include <stdexcept>
 #include <cstdint>
+#include <algorithm>
+#include <vector>
 
 // mapnik
 #include <mapnik/global.hpp>
 #include <mapnik/util/utf_conv_win.hpp>
 #include <mapnik/geometry/box2d.hpp>
+#include <mapnik/mapped_memory_cache.hpp>
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
 #pragma GCC diagnostic push
@@ -40,7 +43,10 @@
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/streams/bufferstream.hpp>
 #pragma GCC diagnostic pop
-#include <mapnik/mapped_memory_cache.hpp>
+#if !defined(_WINDOWS)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #endif
 #include <mapnik/util/noncopyable.hpp>
 
@@ -50,52 +56,44 @@ using mapnik::read_int32_xdr;
 using mapnik::read_double_ndr;
 using mapnik::read_double_xdr;
 
-
-struct RecordTag
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+// hint that bytes [begin, end) of a mapped file are about to be read
+inline void will_need(mapnik::mapped_region_ptr const& region, std::uint64_t begin, std::uint64_t end)
 {
-    using data_type = char*;
-    static data_type alloc(unsigned size)
-    {
-        return static_cast<data_type>(::operator new(sizeof(char)*size));
-    }
+#if !defined(_WINDOWS)
+    if (!region) return;
+    std::uint64_t size = region->get_size();
+    if (end > size) end = size;
+    if (begin >= end) return;
+    std::uint64_t page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+    std::uint64_t aligned = begin - begin % page;
+    char * addr = static_cast<char*>(region->get_address()) + aligned;
+    ::madvise(addr, end - aligned, MADV_WILLNEED);
+#endif
+}
+#endif
 
-    static void dealloc(data_type data)
-    {
-        ::operator delete(data);
-    }
-};
 
-struct MappedRecordTag
-{
-    using data_type = const char*;
-    static data_type alloc(unsigned) { return 0; }
-    static void dealloc(data_type ) {}
-};
-
-template <typename Tag>
+// View of one record, either directly into the mapped file or into the
+// shape_file's scratch buffer; valid until the next read_record()
 struct shape_record
 {
-    typename Tag::data_type data;
+    char const* data;
     std::size_t size;
     mutable std::size_t pos;
 
-    explicit shape_record(size_t size_)
-        : data(Tag::alloc(size_)),
+    explicit shape_record(std::size_t size_)
+        : data(nullptr),
           size(size_),
           pos(0)
     {}
 
-    ~shape_record()
-    {
-        Tag::dealloc(data);
-    }
-
-    void set_data(typename Tag::data_type data_)
+    void set_data(char const* data_)
     {
         data = data_;
     }
 
-    typename Tag::data_type get_data()
+    char const* get_data()
     {
         return data;
     }
@@ -134,6 +132,42 @@ struct shape_record
         return val;
     }
 
+    // int32 at byte offset `at`, without moving the read position
+    int ndr_integer_at(std::size_t at) const
+    {
+        std::int32_t val;
+        read_int32_ndr(&data[at], val);
+        return val;
+    }
+
+    // Reads `num_points` x/y pairs into `points`, truncated to what is
+    // left in the record. On little endian hosts the doubles are copied
+    // in one go, points must be two packed doubles.
+    template <typename Points>
+    void read_points(Points & points, int num_points)
+    {
+        using point_type = typename Points::value_type;
+        std::size_t const point_size = 2 * sizeof(double);
+        std::size_t available = pos < size ? (size - pos) / point_size : 0;
+        std::size_t count = num_points > 0 ? static_cast<std::size_t>(num_points) : 0;
+        if (count > available) count = available;
+#ifndef MAPNIK_BIG_ENDIAN
+        static_assert(sizeof(point_type) == point_size, "points must be two packed doubles");
+        points.resize(count);
+        if (count > 0) std::memcpy(points.data(), &data[pos], count * point_size);
+        pos += count * point_size;
+#else
+        points.clear();
+        points.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            double x = read_double();
+            double y = read_double();
+            points.emplace_back(x, y);
+        }
+#endif
+    }
+
     long remains()
     {
         return (size - pos);
@@ -146,20 +180,22 @@ class shape_file : mapnik::util::noncopyable
 {
 public:
 
+    using record_type = shape_record;
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
     using file_source_type = boost::interprocess::ibufferstream;
-    using record_type = shape_record<MappedRecordTag>;
     mapnik::mapped_region_ptr mapped_region_;
 #else
     using file_source_type = std::ifstream;
-    using record_type = shape_record<RecordTag>;
+    std::vector<char> buffer_; // reused by read_record
 #endif
 
     file_source_type file_;
 
     shape_file() {}
 
-    shape_file(std::string  const& file_name) :
+    // `access` hints how a memory mapped file is going to be read
+    shape_file(std::string  const& file_name,
+               mapnik::mapped_access access = mapnik::mapped_access::normal) :
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
         file_()
 #elif defined (_WINDOWS)
@@ -170,7 +206,7 @@ public:
     {
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
         boost::optional<mapnik::mapped_region_ptr> memory =
-            mapnik::mapped_memory_cache::instance().find(file_name,true);
+            mapnik::mapped_memory_cache::instance().find(file_name, true, access);
 
         if (memory)
         {
@@ -181,6 +217,8 @@ public:
         {
             throw std::runtime_error("could not create file mapping for "+file_name);
         }
+#else
+        (void)access;
 #endif
     }
 
@@ -206,10 +244,27 @@ public:
         rec.set_data(file_.buffer().first + file_.tellg());
         file_.seekg(rec.size, std::ios::cur);
 #else
-        file_.read(rec.get_data(), rec.size);
+        if (buffer_.size() < rec.size) buffer_.resize(rec.size);
+        file_.read(buffer_.data(), rec.size);
+        rec.set_data(buffer_.data());
 #endif
     }
 
+    // Copies the next `count` bytes without consuming them, so that a
+    // record header can be tested before the record itself is read
+    inline bool peek(char * dst, std::size_t count)
+    {
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        std::streamoff pos = file_.tellg();
+        if (pos < 0 || static_cast<std::size_t>(pos) + count > static_cast<std::size_t>(file_.buffer().second)) return false;
+        std::memcpy(dst, file_.buffer().first + pos, count);
+#else
+        if (!file_.read(dst, count)) return false;
+        file_.seekg(-static_cast<std::streamoff>(count), std::ios::cur);
+#endif
+        return true;
+    }
+
     inline int read_xdr_integer()
     {
         char b[4];
@@ -240,6 +295,30 @@ public:
         file_.read(reinterpret_cast<char*>(&envelope), sizeof(envelope));
     }
 
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    // record number and end of the record starting at `offset`, read in place
+    inline int record_number(std::uint64_t offset) const
+    {
+        if (offset + 8 > file_.buffer().second) return 0;
+        std::int32_t val;
+        read_int32_xdr(file_.buffer().first + offset, val);
+        return val;
+    }
+
+    inline std::uint64_t record_end(std::uint64_t offset) const
+    {
+        if (offset + 8 > file_.buffer().second) return offset;
+        std::int32_t length;
+        read_int32_xdr(file_.buffer().first + offset + 4, length);
+        return offset + 8 + 2 * static_cast<std::uint64_t>(std::max(0, length));
+    }
+
+    inline void will_need(std::uint64_t begin, std::uint64_t end) const
+    {
+        ::will_need(mapped_region_, begin, end);
+    }
+#endif
+
     inline void skip(std::streampos bytes)
     {
         file_.seekg(bytes, std::ios::cur);
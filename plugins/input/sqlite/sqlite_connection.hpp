@@ -26,6 +26,9 @@
 // stl
 #include <string.h>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 // mapnik
 #include <mapnik/datasource.hpp>
@@ -47,7 +50,7 @@ extern "C" {
 
 //==============================================================================
 
-class sqlite_connection
+class sqlite_connection : public std::enable_shared_from_this<sqlite_connection>
 {
 public:
 
@@ -101,12 +104,18 @@ public:
 
     virtual ~sqlite_connection ()
     {
+        clear_statements();
         if (db_)
         {
             sqlite3_close (db_);
         }
     }
 
+    bool isOK() const
+    {
+        return db_ != 0;
+    }
+
     void throw_sqlite_error(std::string const& sql)
     {
         std::ostringstream s;
@@ -138,6 +147,32 @@ public:
         return std::make_shared<sqlite_resultset>(stmt);
     }
 
+    // Like execute_query() but keeps the prepared statement for the next
+    // query with the same sql. The returned resultset keeps this connection
+    // alive and busy, so it must not be shared between threads.
+    std::shared_ptr<sqlite_resultset> execute_cached(std::string const& sql)
+    {
+#ifdef MAPNIK_STATS
+        mapnik::progress_timer __stats__(std::clog, std::string("sqlite_resultset::execute_cached ") + sql);
+#endif
+        auto itr = statements_.find(sql);
+        if (itr == statements_.end())
+        {
+            if (statements_.size() >= max_cached_statements)
+            {
+                clear_statements();
+            }
+            sqlite3_stmt* stmt = 0;
+            const int rc = sqlite3_prepare_v2 (db_, sql.c_str(), -1, &stmt, 0);
+            if (rc != SQLITE_OK)
+            {
+                throw_sqlite_error(sql);
+            }
+            itr = statements_.emplace(sql, stmt).first;
+        }
+        return std::make_shared<sqlite_resultset>(itr->second, shared_from_this());
+    }
+
     void execute(std::string const& sql)
     {
 #ifdef MAPNIK_STATS
@@ -175,8 +210,66 @@ public:
 
 private:
 
+    void clear_statements()
+    {
+        for (auto const& item : statements_)
+        {
+            sqlite3_finalize(item.second);
+        }
+        statements_.clear();
+    }
+
+    static const std::size_t max_cached_statements = 32;
     sqlite3* db_;
     std::string file_;
+    std::unordered_map<std::string, sqlite3_stmt*> statements_;
+};
+
+// Opens the connections pooled by sqlite_datasource. They are read-only
+// unless `read_only` is false, which sqlite_datasource requests when user
+// supplied attachdb/initdb statements may write; attached databases must
+// then exist, as for the datasource's own connection.
+template <typename T>
+class sqlite_connection_creator
+{
+public:
+    sqlite_connection_creator(std::string const& file,
+                              std::vector<std::string> const& init_statements,
+                              mapnik::value_integer mmap_size,
+                              bool read_only = true)
+        : file_(file),
+          init_statements_(init_statements),
+          mmap_size_(mmap_size),
+          read_only_(read_only) {}
+
+    T* operator()() const
+    {
+        int flags = read_only_ ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE;
+#if SQLITE_VERSION_NUMBER >= 3006018
+        if (sqlite3_libversion_number() >= 3007015)
+        {
+            flags |= SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_SHAREDCACHE;
+        }
+#endif
+        std::unique_ptr<T> conn(new T(file_, flags));
+        sqlite3_busy_timeout(*(*conn), 5000);
+        if (mmap_size_ > 0)
+        {
+            // ignored by builds without memory-mapped I/O
+            conn->execute_with_code("PRAGMA mmap_size=" + std::to_string(mmap_size_));
+        }
+        for (auto const& sql : init_statements_)
+        {
+            conn->execute(sql);
+        }
+        return conn.release();
+    }
+
+private:
+    std::string file_;
+    std::vector<std::string> init_statements_;
+    mapnik::value_integer mmap_size_;
+    bool read_only_;
 };
 
 #endif // MAPNIK_SQLITE_CONNECTION_HPP
@@ -40,6 +40,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/tokenizer.hpp>
 
+// stl
+#include <algorithm>
+
 using mapnik::box2d;
 using mapnik::coord2d;
 using mapnik::query;
@@ -114,6 +117,10 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
         {
             format_ = mapnik::wkbGeneric;
         }
+        else if (*wkb == "geopackage")
+        {
+            format_ = mapnik::wkbGeoPackage;
+        }
         else if (*wkb == "twkb")
         {
             format_ = mapnik::wkbGeneric;
@@ -213,6 +220,23 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
         dataset_->execute(*iter);
     }
 
+    // GeoPackage: geometry column and extent come from gpkg_geometry_columns
+    // and gpkg_contents, features are stored as GeoPackageBinary blobs
+    mapnik::box2d<double> geopackage_extent;
+    bool geopackage = sqlite_utils::geopackage_info(geometry_table_,
+                                                    geometry_field_,
+                                                    geopackage_extent,
+                                                    dataset_);
+    if (geopackage)
+    {
+        if (!wkb) format_ = mapnik::wkbGeoPackage;
+        if (!extent_initialized_ && geopackage_extent.valid())
+        {
+            extent_ = geopackage_extent;
+            extent_initialized_ = true;
+        }
+    }
+
     bool found_types_via_subquery = false;
     if (using_subquery_)
     {
@@ -259,6 +283,17 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
         throw datasource_exception(s.str());
     }
 
+    if (geopackage)
+    {
+        // geometry columns are declared with their geometry type name, which
+        // table_info() reports as a string attribute
+        auto & descriptors = desc_.get_descriptors();
+        descriptors.erase(std::remove_if(descriptors.begin(), descriptors.end(),
+                                         [&](attribute_descriptor const& attr)
+                                         { return attr.get_name() == geometry_field_; }),
+                          descriptors.end());
+    }
+
     if (geometry_field_.empty())
     {
         std::ostringstream s;
@@ -269,6 +304,17 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
         throw datasource_exception(s.str());
     }
 
+    geopackage_index_ = false;
+    if (index_table_.empty() && geopackage && use_spatial_index_)
+    {
+        std::string rtree_table = sqlite_utils::geopackage_index_for_table(geometry_table_, geometry_field_);
+        if (sqlite_utils::has_rtree(rtree_table, dataset_, true))
+        {
+            index_table_ = rtree_table;
+            geopackage_index_ = true;
+        }
+    }
+
     if (index_table_.empty())
     {
         // Generate implicit index_table name - need to do this after
@@ -279,7 +325,11 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
     std::string index_db = sqlite_utils::index_for_db(dataset_name_);
 
     has_spatial_index_ = false;
-    if (use_spatial_index_)
+    if (use_spatial_index_ && geopackage_index_)
+    {
+        has_spatial_index_ = true;
+    }
+    else if (use_spatial_index_)
     {
 #ifdef MAPNIK_STATS
         mapnik::progress_timer __stats2__(std::clog, "sqlite_datasource::init(use_spatial_index)");
@@ -288,7 +338,8 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
         bool index_db_attached = false;
         if (mapnik::util::exists(index_db))
         {
-            dataset_->execute("attach database '" + index_db + "' as " + index_table_);
+            init_statements_.push_back("attach database '" + index_db + "' as " + index_table_);
+            dataset_->execute(init_statements_.back());
             index_db_attached = true;
         }
         has_spatial_index_ = sqlite_utils::has_rtree(index_table_,dataset_);
@@ -315,7 +366,8 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
                     has_spatial_index_ = true;
                     if (!index_db_attached && mapnik::util::exists(index_db))
                     {
-                        dataset_->execute("attach database '" + index_db + "' as " + index_table_);
+                        init_statements_.push_back("attach database '" + index_db + "' as " + index_table_);
+                        dataset_->execute(init_statements_.back());
                     }
                 }
             }
@@ -348,7 +400,8 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
                                          geometry_field_,
                                          geometry_table_,
                                          key_field_,
-                                         query))
+                                         query,
+                                         geopackage_index_))
         {
             std::ostringstream s;
             s << "Sqlite Plugin: extent could not be determined for table '"
@@ -360,6 +413,20 @@ sqlite_datasource::sqlite_datasource(parameters const& params)
         }
     }
 
+    // An in-memory database can't be reopened, so it keeps using dataset_
+    if (dataset_name_ != ":memory:")
+    {
+        // attachdb and initdb statements may write, so they get read-write connections
+        creator_ = std::make_unique<sqlite_connection_creator<sqlite_connection>>(
+            dataset_name_,
+            init_statements_,
+            *params.get<mapnik::value_integer>("mmap_size", 268435456),
+            !attachdb && !initdb);
+        pool_ = std::make_unique<mapnik::Pool<sqlite_connection, sqlite_connection_creator>>(
+            *creator_,
+            *params.get<mapnik::value_integer>("initial_size", 1),
+            *params.get<mapnik::value_integer>("max_size", 10));
+    }
 }
 
 std::string sqlite_datasource::populate_tokens(std::string const& sql) const
@@ -377,6 +444,32 @@ sqlite_datasource::~sqlite_datasource()
 {
 }
 
+std::shared_ptr<sqlite_resultset> sqlite_datasource::execute_features_query(std::string const& sql,
+                                                                            bool filtered,
+                                                                            mapnik::box2d<double> const& e) const
+{
+    std::shared_ptr<sqlite_resultset> rs;
+    if (pool_)
+    {
+        std::shared_ptr<sqlite_connection> conn = pool_->borrowObject();
+        if (!conn)
+        {
+            // pool exhausted: use a connection for this query only
+            conn.reset((*creator_)());
+        }
+        rs = conn->execute_cached(sql);
+    }
+    else
+    {
+        rs = dataset_->execute_query(sql);
+    }
+    if (filtered)
+    {
+        sqlite_utils::bind_spatial_filter(*rs, e);
+    }
+    return rs;
+}
+
 void sqlite_datasource::parse_attachdb(std::string const& attachdb) const
 {
     boost::char_separator<char> sep(",");
@@ -518,17 +611,18 @@ featureset_ptr sqlite_datasource::features(query const& q) const
         s << " FROM ";
 
         std::string query(table_);
+        bool filtered = false;
 
         if (! key_field_.empty() && has_spatial_index_)
         {
             // TODO - debug warn if fails
-            sqlite_utils::apply_spatial_filter(query,
-                                               e,
-                                               table_,
-                                               key_field_,
-                                               index_table_,
-                                               geometry_table_,
-                                               intersects_token_);
+            filtered = sqlite_utils::apply_spatial_filter(query,
+                                                          table_,
+                                                          key_field_,
+                                                          index_table_,
+                                                          geometry_table_,
+                                                          intersects_token_,
+                                                          geopackage_index_);
         }
         else
         {
@@ -549,7 +643,7 @@ featureset_ptr sqlite_datasource::features(query const& q) const
 
         MAPNIK_LOG_DEBUG(sqlite) << "sqlite_datasource: " << s.str();
 
-        std::shared_ptr<sqlite_resultset> rs(dataset_->execute_query(s.str()));
+        std::shared_ptr<sqlite_resultset> rs(execute_features_query(s.str(), filtered, e));
 
         return std::make_shared<sqlite_featureset>(rs,
                                                      ctx,
@@ -599,17 +693,18 @@ featureset_ptr sqlite_datasource::features_at_point(coord2d const& pt, double to
         s << " FROM ";
 
         std::string query(table_);
+        bool filtered = false;
 
         if (! key_field_.empty() && has_spatial_index_)
         {
             // TODO - debug warn if fails
-            sqlite_utils::apply_spatial_filter(query,
-                                               e,
-                                               table_,
-                                               key_field_,
-                                               index_table_,
-                                               geometry_table_,
-                                               intersects_token_);
+            filtered = sqlite_utils::apply_spatial_filter(query,
+                                                          table_,
+                                                          key_field_,
+                                                          index_table_,
+                                                          geometry_table_,
+                                                          intersects_token_,
+                                                          geopackage_index_);
         }
         else
         {
@@ -630,7 +725,7 @@ featureset_ptr sqlite_datasource::features_at_point(coord2d const& pt, double to
 
         MAPNIK_LOG_DEBUG(sqlite) << "sqlite_datasource: " << s.str();
 
-        std::shared_ptr<sqlite_resultset> rs(dataset_->execute_query(s.str()));
+        std::shared_ptr<sqlite_resultset> rs(execute_features_query(s.str(), filtered, e));
 
         return std::make_shared<sqlite_featureset>(rs,
                                                      ctx,
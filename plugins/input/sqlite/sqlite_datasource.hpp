@@ -33,6 +33,7 @@
 #include <mapnik/feature_layer_desc.hpp>
 #include <mapnik/wkb.hpp>
 #include <mapnik/value/types.hpp>
+#include <mapnik/pool.hpp>
 
 // boost
 #include <boost/optional.hpp>
@@ -63,12 +64,19 @@ private:
     // needed to attach auxillary databases
     void parse_attachdb(std::string const& attachdb) const;
     std::string populate_tokens(std::string const& sql) const;
+    // runs a features query, binding the spatial filter extent when `filtered`
+    std::shared_ptr<sqlite_resultset> execute_features_query(std::string const& sql,
+                                                             bool filtered,
+                                                             mapnik::box2d<double> const& e) const;
 
     mapnik::box2d<double> extent_;
     bool extent_initialized_;
     mapnik::datasource::datasource_t type_;
     std::string dataset_name_;
     std::shared_ptr<sqlite_connection> dataset_;
+    // read-only connections for features queries, one per concurrent query
+    std::unique_ptr<sqlite_connection_creator<sqlite_connection>> creator_;
+    std::unique_ptr<mapnik::Pool<sqlite_connection, sqlite_connection_creator>> pool_;
     std::string table_;
     std::string fields_;
     std::string metadata_;
@@ -85,6 +93,8 @@ private:
     bool twkb_encoding_;
     bool use_spatial_index_;
     bool has_spatial_index_;
+    // index_table_ is the GeoPackage "rtree_<table>_<column>" index
+    bool geopackage_index_;
     bool using_subquery_;
     mutable std::vector<std::string> init_statements_;
 };
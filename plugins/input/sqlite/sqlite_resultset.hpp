@@ -30,6 +30,8 @@
 
 // stl
 #include <string.h>
+#include <memory>
+#include <sstream>
 
 // sqlite
 extern "C" {
@@ -49,11 +51,38 @@ public:
     {
     }
 
+    // statement owned by a connection's statement cache: it is reset
+    // rather than finalized and `owner` is kept alive until then
+    sqlite_resultset (sqlite3_stmt* stmt, std::shared_ptr<void> owner)
+        : owner_(owner),
+          stmt_(stmt)
+    {
+    }
+
     ~sqlite_resultset ()
     {
         if (stmt_)
         {
-            sqlite3_finalize (stmt_);
+            if (owner_)
+            {
+                sqlite3_reset (stmt_);
+                sqlite3_clear_bindings (stmt_);
+            }
+            else
+            {
+                sqlite3_finalize (stmt_);
+            }
+        }
+    }
+
+    void bind (int index, double value)
+    {
+        if (sqlite3_bind_double (stmt_, index, value) != SQLITE_OK)
+        {
+            std::ostringstream s;
+            s << "SQLite Plugin: binding parameter " << index << " failed: "
+              << sqlite3_errmsg(sqlite3_db_handle(stmt_));
+            throw mapnik::datasource_exception(s.str());
         }
     }
 
@@ -139,6 +168,7 @@ public:
 
 private:
 
+    std::shared_ptr<void> owner_;
     sqlite3_stmt* stmt_;
 };
 
@@ -99,6 +99,16 @@ public:
         return "\"idx_" + table_trimmed + "_" + field + "\"";
     }
 
+    // GeoPackage keeps its spatial index in "rtree_<table>_<column>"
+    static std::string geopackage_index_for_table(std::string const& table, std::string const& field)
+    {
+        std::string table_trimmed = table;
+        dequote(table_trimmed);
+        std::string field_trimmed = field;
+        dequote(field_trimmed);
+        return "\"rtree_" + table_trimmed + "_" + field_trimmed + "\"";
+    }
+
     static std::string index_for_db(std::string const& file)
     {
         //std::size_t idx = file.find_last_of(".");
@@ -111,19 +121,29 @@ public:
         //}
     }
 
+    // The filter extent is left as parameters ?1..?4 so that the sql is the
+    // same for every query; bind it with bind_spatial_filter()
     static bool apply_spatial_filter(std::string & query,
-                                     mapnik::box2d<double> const& e,
                                      std::string const& table,
                                      std::string const& key_field,
                                      std::string const& index_table,
                                      std::string const& geometry_table,
-                                     std::string const& intersects_token)
+                                     std::string const& intersects_token,
+                                     bool geopackage_index = false)
     {
         std::ostringstream spatial_sql;
-        spatial_sql << std::setprecision(16);
-        spatial_sql << key_field << " IN (SELECT pkid FROM " << index_table;
-        spatial_sql << " WHERE xmax>=" << e.minx() << " AND xmin<=" << e.maxx() ;
-        spatial_sql << " AND ymax>=" << e.miny() << " AND ymin<=" << e.maxy() << ")";
+        if (geopackage_index)
+        {
+            spatial_sql << key_field << " IN (SELECT id FROM " << index_table;
+            spatial_sql << " WHERE maxx>=?1 AND minx<=?2";
+            spatial_sql << " AND maxy>=?3 AND miny<=?4)";
+        }
+        else
+        {
+            spatial_sql << key_field << " IN (SELECT pkid FROM " << index_table;
+            spatial_sql << " WHERE xmax>=?1 AND xmin<=?2";
+            spatial_sql << " AND ymax>=?3 AND ymin<=?4)";
+        }
         if (boost::algorithm::ifind_first(query,  intersects_token))
         {
             boost::algorithm::ireplace_all(query, intersects_token, spatial_sql.str());
@@ -147,6 +167,14 @@ public:
         return false;
     }
 
+    static void bind_spatial_filter(sqlite_resultset & rs, mapnik::box2d<double> const& e)
+    {
+        rs.bind(1, e.minx());
+        rs.bind(2, e.maxx());
+        rs.bind(3, e.miny());
+        rs.bind(4, e.maxy());
+    }
+
     static void get_tables(std::shared_ptr<sqlite_connection> ds,
                            std::vector<std::string> & tables)
     {
@@ -476,7 +504,8 @@ public:
                               std::string const& geometry_field,
                               std::string const& geometry_table,
                               std::string const& key_field,
-                              std::string const& table
+                              std::string const& table,
+                              bool geopackage_index = false
         )
     {
         if (! metadata.empty())
@@ -499,8 +528,15 @@ public:
         else if (has_spatial_index)
         {
             std::ostringstream s;
-            s << "SELECT MIN(xmin), MIN(ymin), MAX(xmax), MAX(ymax) FROM "
-              << index_table;
+            if (geopackage_index)
+            {
+                s << "SELECT MIN(minx), MIN(miny), MAX(maxx), MAX(maxy) FROM ";
+            }
+            else
+            {
+                s << "SELECT MIN(xmin), MIN(ymin), MAX(xmax), MAX(ymax) FROM ";
+            }
+            s << index_table;
             MAPNIK_LOG_DEBUG(sqlite) << "sqlite_datasource: executing: '" << s.str() << "'";
             std::shared_ptr<sqlite_resultset> rs(ds->execute_query(s.str()));
             if (rs->is_valid() && rs->step_next())
@@ -530,12 +566,20 @@ public:
         return false;
     }
 
-    static bool has_rtree(std::string const& index_table,std::shared_ptr<sqlite_connection> ds)
+    static bool has_rtree(std::string const& index_table,std::shared_ptr<sqlite_connection> ds,
+                          bool geopackage_index = false)
     {
         try
         {
             std::ostringstream s;
-            s << "SELECT pkid,xmin,xmax,ymin,ymax FROM " << index_table << " LIMIT 1";
+            if (geopackage_index)
+            {
+                s << "SELECT id,minx,maxx,miny,maxy FROM " << index_table << " LIMIT 1";
+            }
+            else
+            {
+                s << "SELECT pkid,xmin,xmax,ymin,ymax FROM " << index_table << " LIMIT 1";
+            }
             std::shared_ptr<sqlite_resultset> rs = ds->execute_query(s.str());
             if (rs->is_valid() && rs->step_next())
             {
@@ -550,6 +594,46 @@ public:
         return false;
     }
 
+    // Looks `table` up in the GeoPackage metadata tables. Returns false for
+    // databases that aren't GeoPackages or don't describe `table`.
+    static bool geopackage_info(std::string const& table,
+                                std::string & geometry_field,
+                                mapnik::box2d<double> & extent,
+                                std::shared_ptr<sqlite_connection> ds)
+    {
+        std::string table_trimmed = table;
+        dequote(table_trimmed);
+        boost::algorithm::replace_all(table_trimmed, "'", "''");
+        try
+        {
+            std::ostringstream s;
+            s << "SELECT g.column_name, c.min_x, c.min_y, c.max_x, c.max_y"
+              << " FROM gpkg_geometry_columns g LEFT JOIN gpkg_contents c"
+              << " ON LOWER(c.table_name) = LOWER(g.table_name)"
+              << " WHERE LOWER(g.table_name) = LOWER('" << table_trimmed << "')";
+            std::shared_ptr<sqlite_resultset> rs = ds->execute_query(s.str());
+            if (rs->is_valid() && rs->step_next())
+            {
+                if (geometry_field.empty())
+                {
+                    geometry_field = rs->column_text(0);
+                }
+                if (!rs->column_isnull(1) && !rs->column_isnull(2) &&
+                    !rs->column_isnull(3) && !rs->column_isnull(4))
+                {
+                    extent.init(rs->column_double(1), rs->column_double(2),
+                                rs->column_double(3), rs->column_double(4));
+                }
+                return true;
+            }
+        }
+        catch (std::exception const& ex)
+        {
+            MAPNIK_LOG_DEBUG(sqlite) << "geopackage_info returned:" << ex.what();
+        }
+        return false;
+    }
+
     static bool detect_types_from_subquery(std::string const& query,
                                            std::string & geometry_field,
                                            mapnik::layer_descriptor & desc,
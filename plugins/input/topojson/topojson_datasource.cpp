@@ -38,6 +38,7 @@
 #include <mapnik/json/topojson_utils.hpp>
 #include <mapnik/util/variant.hpp>
 #include <mapnik/util/file_io.hpp>
+#include <mapnik/util/parallel_for.hpp>
 #include <mapnik/make_unique.hpp>
 
 using mapnik::datasource;
@@ -140,7 +141,8 @@ topojson_datasource::topojson_datasource(parameters const& params)
     inline_string_(),
     extent_(),
     tr_(new mapnik::transcoder(*params.get<std::string>("encoding","utf-8"))),
-    tree_(nullptr)
+    tree_(nullptr),
+    load_threads_(std::max(mapnik::value_integer(1), *params.get<mapnik::value_integer>("load_threads", 1)))
 {
     boost::optional<std::string> inline_string = params.get<std::string>("inline");
     if (inline_string)
@@ -199,11 +201,21 @@ void topojson_datasource::parse_topojson(T const& buffer)
     values_container values;
     values.reserve(topo_.geometries.size());
 
+    // bounding boxes need the arcs of each geometry decoded, compute them in parallel
+    std::vector<mapnik::box2d<double>> boxes(topo_.geometries.size());
+    mapnik::util::parallel_for_chunks(boxes.size(), load_threads_, 1024, [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; i < last; ++i)
+        {
+            boxes[i] = mapnik::util::apply_visitor(mapnik::topojson::bounding_box_visitor(topo_), topo_.geometries[i]);
+        }
+    });
+
     std::size_t geometry_index = 0;
     bool first = true;
     for (auto const& geom : topo_.geometries)
     {
-        mapnik::box2d<double> box = mapnik::util::apply_visitor(mapnik::topojson::bounding_box_visitor(topo_), geom);
+        mapnik::box2d<double> const& box = boxes[geometry_index];
         if (box.valid())
         {
             if (first)
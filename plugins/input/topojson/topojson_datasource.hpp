@@ -80,6 +80,7 @@ private:
     std::unique_ptr<mapnik::transcoder> tr_;
     mapnik::topojson::topology topo_;
     std::unique_ptr<spatial_index_type> tree_;
+    const std::size_t load_threads_;
 };
 
 
@@ -32,7 +32,11 @@
 #pragma GCC diagnostic pop
 
 // stl
+#include <ctime>
 #include <stdexcept>
+#ifndef _WINDOWS
+#include <sys/stat.h>
+#endif
 
 namespace mapnik {
 
@@ -137,6 +141,52 @@ namespace util {
         return listing;
     }
 
+    std::uint64_t file_size(std::string const& filepath)
+    {
+        boost::system::error_code ec;
+#ifdef _WINDOWS
+        std::uintmax_t size = boost::filesystem::file_size(mapnik::utf8_to_utf16(filepath), ec);
+#else
+        std::uintmax_t size = boost::filesystem::file_size(filepath, ec);
+#endif
+        return ec ? 0 : static_cast<std::uint64_t>(size);
+    }
+
+    std::int64_t last_write_time(std::string const& filepath)
+    {
+#ifdef _WINDOWS
+        // boost::filesystem only reports whole seconds
+        boost::system::error_code ec;
+        std::time_t time = boost::filesystem::last_write_time(mapnik::utf8_to_utf16(filepath), ec);
+        return ec ? 0 : static_cast<std::int64_t>(time) * 1000000000;
+#else
+        struct stat st;
+        if (::stat(filepath.c_str(), &st) != 0) return 0;
+#if defined(__APPLE__)
+        struct timespec const& time = st.st_mtimespec;
+#else
+        struct timespec const& time = st.st_mtim;
+#endif
+        return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + static_cast<std::int64_t>(time.tv_nsec);
+#endif
+    }
+
+    std::string unique_path(std::string const& filepath)
+    {
+        return filepath + boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%.tmp").string();
+    }
+
+    bool rename(std::string const& from, std::string const& to)
+    {
+        boost::system::error_code ec;
+#ifdef _WINDOWS
+        boost::filesystem::rename(mapnik::utf8_to_utf16(from), mapnik::utf8_to_utf16(to), ec);
+#else
+        boost::filesystem::rename(from, to, ec);
+#endif
+        return !ec;
+    }
+
 
 } // end namespace util
 
@@ -23,9 +23,88 @@
 #include <mapnik/json/parse_feature.hpp>
 #include <mapnik/json/json_grammar_config.hpp>
 #include <mapnik/json/feature_grammar_x3.hpp>
+#include <mapnik/json/generic_json_grammar_x3.hpp>
+#include <mapnik/json/unicode_string_grammar_x3.hpp>
+#include <mapnik/json/attribute_value_visitor.hpp>
+// stl
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 
 namespace mapnik { namespace json {
 
+namespace {
+
+template <typename Iterator>
+void skip_space(Iterator& itr, Iterator end)
+{
+    while (itr != end && std::isspace(static_cast<unsigned char>(*itr))) ++itr;
+}
+
+// expects `itr` at the opening quote
+template <typename Iterator>
+bool skip_string(Iterator& itr, Iterator end)
+{
+    for (++itr; itr != end; ++itr)
+    {
+        if (*itr == '\\')
+        {
+            if (++itr == end) break;
+        }
+        else if (*itr == '"')
+        {
+            ++itr;
+            return true;
+        }
+    }
+    return false;
+}
+
+// skips a JSON value checking only that strings, objects and arrays are terminated
+template <typename Iterator>
+bool skip_value(Iterator& itr, Iterator end)
+{
+    skip_space(itr, end);
+    if (itr == end) return false;
+    char const c = *itr;
+    if (c == '"') return skip_string(itr, end);
+    if (c == '{' || c == '[')
+    {
+        std::size_t depth = 0;
+        while (itr != end)
+        {
+            char const c2 = *itr;
+            if (c2 == '"')
+            {
+                if (!skip_string(itr, end)) return false;
+                continue;
+            }
+            if (c2 == '{' || c2 == '[') ++depth;
+            else if ((c2 == '}' || c2 == ']') && --depth == 0)
+            {
+                ++itr;
+                return true;
+            }
+            ++itr;
+        }
+        return false;
+    }
+    // number, true, false or null
+    Iterator begin = itr;
+    while (itr != end && *itr != ',' && *itr != '}' && *itr != ']'
+           && !std::isspace(static_cast<unsigned char>(*itr))) ++itr;
+    return itr != begin;
+}
+
+template <typename Iterator>
+bool match_key(Iterator begin, Iterator end, char const* key)
+{
+    std::size_t const size = std::strlen(key);
+    return static_cast<std::size_t>(end - begin) == size && std::equal(begin, end, key);
+}
+
+} // anonymous ns
+
 template <typename Iterator>
 void parse_feature(Iterator start, Iterator end, feature_impl& feature, mapnik::transcoder const& tr)
 {
@@ -52,8 +131,89 @@ void parse_geometry(Iterator start, Iterator end, feature_impl& feature)
     }
 }
 
+template <typename Iterator>
+void parse_properties(Iterator start, Iterator end, feature_impl& feature, mapnik::transcoder const& tr)
+{
+    namespace x3 = boost::spirit::x3;
+    using space_type = mapnik::json::grammar::space_type;
+    auto const& key_grammar = mapnik::json::unicode_string_grammar();
+    auto const& value_grammar = mapnik::json::generic_json_grammar();
+    Iterator itr = start;
+    skip_space(itr, end);
+    if (itr == end || *itr++ != '{') throw std::runtime_error("Can't parse GeoJSON properties");
+    skip_space(itr, end);
+    if (itr != end && *itr == '}') return;
+    while (true)
+    {
+        std::string key;
+        if (!x3::phrase_parse(itr, end, key_grammar, space_type(), key)
+            || itr == end || *itr++ != ':')
+        {
+            throw std::runtime_error("Can't parse GeoJSON properties");
+        }
+        if (feature.has_key(key))
+        {
+            json_value value;
+            if (!x3::phrase_parse(itr, end, value_grammar, space_type(), value))
+            {
+                throw std::runtime_error("Can't parse GeoJSON properties");
+            }
+            feature.put(key, mapnik::util::apply_visitor(attribute_value_visitor(tr), value));
+        }
+        else if (!skip_value(itr, end))
+        {
+            throw std::runtime_error("Can't parse GeoJSON properties");
+        }
+        skip_space(itr, end);
+        if (itr == end) break;
+        char const c = *itr++;
+        if (c == '}') return;
+        if (c != ',') break;
+    }
+    throw std::runtime_error("Can't parse GeoJSON properties");
+}
+
+template <typename Iterator>
+bool locate_feature_members(Iterator start, Iterator end,
+                            std::pair<std::size_t, std::size_t>& geometry,
+                            std::pair<std::size_t, std::size_t>& properties)
+{
+    geometry = properties = std::make_pair(0, 0);
+    Iterator itr = start;
+    skip_space(itr, end);
+    if (itr == end || *itr++ != '{') return false;
+    skip_space(itr, end);
+    if (itr != end && *itr == '}') return true;
+    while (true)
+    {
+        skip_space(itr, end);
+        if (itr == end || *itr != '"') return false;
+        Iterator key_begin = itr;
+        if (!skip_string(itr, end)) return false;
+        Iterator key_end = itr;
+        skip_space(itr, end);
+        if (itr == end || *itr++ != ':') return false;
+        skip_space(itr, end);
+        Iterator value_begin = itr;
+        if (!skip_value(itr, end)) return false;
+        auto range = std::make_pair(static_cast<std::size_t>(value_begin - start),
+                                    static_cast<std::size_t>(itr - value_begin));
+        if (match_key(key_begin, key_end, "\"geometry\"")) geometry = range;
+        else if (match_key(key_begin, key_end, "\"properties\"")) properties = range;
+        skip_space(itr, end);
+        if (itr == end) return false;
+        char const c = *itr++;
+        if (c == '}') return true;
+        if (c != ',') return false;
+    }
+}
+
 using iterator_type = mapnik::json::grammar::iterator_type;
 template void parse_feature<iterator_type>(iterator_type,iterator_type, feature_impl& feature, mapnik::transcoder const& tr);
 template void parse_geometry<iterator_type>(iterator_type,iterator_type, feature_impl& feature);
+template void parse_properties<iterator_type>(iterator_type,iterator_type, feature_impl& feature, mapnik::transcoder const& tr);
+template bool locate_feature_members<iterator_type>(iterator_type,iterator_type,
+                                                    std::pair<std::size_t, std::size_t>&,
+                                                    std::pair<std::size_t, std::size_t>&);
 
 }}
@@ -34,17 +34,49 @@
 #include <boost/interprocess/file_mapping.hpp>
 #pragma GCC diagnostic pop
 
+#if !defined(_WINDOWS)
+#include <sys/mman.h>
+#endif
+
 namespace mapnik
 {
 
 template class singleton<mapped_memory_cache, CreateStatic>;
 
+namespace {
+
+void advise(boost::interprocess::mapped_region & region, mapped_access access)
+{
+    using boost::interprocess::mapped_region;
+    switch (access)
+    {
+    case mapped_access::sequential:
+        region.advise(mapped_region::advice_sequential);
+        break;
+    case mapped_access::random:
+        region.advise(mapped_region::advice_random);
+        break;
+    case mapped_access::populate:
+#if !defined(MAP_POPULATE)
+        region.advise(mapped_region::advice_willneed);
+#endif
+        break;
+    case mapped_access::normal:
+        break;
+    }
+}
+
+}
+
+mapped_memory_cache::mapped_memory_cache()
+    : cache_(sizeof(void*) > 4 ? (std::size_t(64) << 30) : (std::size_t(1) << 30), 1024) {}
+
 void mapped_memory_cache::clear()
 {
 #ifdef MAPNIK_THREADSAFE
     std::lock_guard<std::mutex> lock(mutex_);
 #endif
-    return cache_.clear();
+    cache_.clear();
 }
 
 bool mapped_memory_cache::insert(std::string const& uri, mapped_region_ptr mem)
@@ -52,21 +84,39 @@ bool mapped_memory_cache::insert(std::string const& uri, mapped_region_ptr mem)
 #ifdef MAPNIK_THREADSAFE
     std::lock_guard<std::mutex> lock(mutex_);
 #endif
-    return cache_.emplace(uri,mem).second;
+    return insert_impl(uri, mem);
 }
 
-boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const& uri, bool update_cache)
+bool mapped_memory_cache::remove(std::string const& uri)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.remove(uri);
+}
+
+bool mapped_memory_cache::insert_impl(std::string const& uri, mapped_region_ptr const& mem)
+{
+    // mappings larger than max_bytes() are returned by find() but not kept
+    return mem && cache_.insert(uri, mem, mem->get_size());
+}
+
+boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const& uri, bool update_cache, mapped_access access)
 {
 #ifdef MAPNIK_THREADSAFE
     std::lock_guard<std::mutex> lock(mutex_);
 #endif
 
-    using iterator_type = std::unordered_map<std::string, mapped_region_ptr>::const_iterator;
     boost::optional<mapped_region_ptr> result;
-    iterator_type itr = cache_.find(uri);
-    if (itr != cache_.end())
+    if (mapped_region_ptr const* region = cache_.find(uri))
     {
-        result.reset(itr->second);
+        // a cached mapping follows the access pattern of its latest reader,
+        // populated ones are resident already
+        if (access == mapped_access::sequential || access == mapped_access::random)
+        {
+            advise(**region, access);
+        }
+        result.reset(*region);
         return result;
     }
 
@@ -74,12 +124,19 @@ boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const&
     {
         try
         {
+            using boost::interprocess::mapped_region;
             boost::interprocess::file_mapping mapping(uri.c_str(),boost::interprocess::read_only);
-            mapped_region_ptr region(std::make_shared<boost::interprocess::mapped_region>(mapping,boost::interprocess::read_only));
+            boost::interprocess::map_options_t options = boost::interprocess::default_map_options;
+#if defined(MAP_POPULATE)
+            if (access == mapped_access::populate) options = MAP_POPULATE;
+#endif
+            mapped_region_ptr region(std::make_shared<mapped_region>(mapping, boost::interprocess::read_only,
+                                                                     0, 0, nullptr, options));
+            advise(*region, access);
             result.reset(region);
             if (update_cache)
             {
-                cache_.emplace(uri, *result);
+                insert_impl(uri, region);
             }
             return result;
         }
@@ -99,6 +156,46 @@ boost::optional<mapped_region_ptr> mapped_memory_cache::find(std::string const&
     return result;
 }
 
+void mapped_memory_cache::set_max_entries(std::size_t max_entries)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.set_max_entries(max_entries);
+}
+
+void mapped_memory_cache::set_max_bytes(std::size_t max_bytes)
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    cache_.set_max_bytes(max_bytes);
+}
+
+std::size_t mapped_memory_cache::max_entries() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.max_entries();
+}
+
+std::size_t mapped_memory_cache::max_bytes() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.max_bytes();
+}
+
+util::lru_cache_stats mapped_memory_cache::stats() const
+{
+#ifdef MAPNIK_THREADSAFE
+    std::lock_guard<std::mutex> lock(mutex_);
+#endif
+    return cache_.stats();
+}
+
 }
 
 #endif
@@ -28,9 +28,19 @@
 #include <mapnik/memory_featureset.hpp>
 #include <mapnik/boolean.hpp>
 #include <mapnik/geometry/envelope.hpp>
+#include <mapnik/geometry/boost_adapters.hpp>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#pragma GCC diagnostic pop
 
 // stl
 #include <algorithm>
+#include <utility>
+#ifdef MAPNIK_THREADSAFE
+#include <mutex>
+#endif
 
 using mapnik::datasource;
 using mapnik::parameters;
@@ -39,28 +49,27 @@ DATASOURCE_PLUGIN(mapnik::memory_datasource)
 
 namespace mapnik {
 
-struct accumulate_extent
+namespace {
+
+box2d<double> feature_box(feature_ptr const& feature)
 {
-    accumulate_extent(box2d<double> & ext)
-        : ext_(ext),first_(true) {}
+    raster_ptr const& source = feature->get_raster();
+    if (source) return source->ext_;
+    return geometry::envelope(feature->get_geometry());
+}
 
-    void operator() (feature_ptr const& feat)
-    {
-        auto const& geom = feat->get_geometry();
-        auto bbox = geometry::envelope(geom);
-        if ( first_ )
-        {
-            first_ = false;
-            ext_ = bbox;
-        }
-        else
-        {
-            ext_.expand_to_include(bbox);
-        }
-    }
+}
 
-    box2d<double> & ext_;
-    bool first_;
+// R-tree over feature boxes, packed on the first filtered query and
+// updated in place by push() afterwards.
+struct memory_datasource::spatial_index
+{
+    using item_type = std::pair<box2d<double>, std::size_t>;
+    using tree_type = boost::geometry::index::rtree<item_type, boost::geometry::index::linear<16, 4>>;
+    std::unique_ptr<tree_type> tree;
+#ifdef MAPNIK_THREADSAFE
+    std::mutex mutex;
+#endif
 };
 
 const char * memory_datasource::name()
@@ -70,6 +79,7 @@ const char * memory_datasource::name()
 
 memory_datasource::memory_datasource(parameters const& _params)
     : datasource(_params),
+      index_(std::make_unique<spatial_index>()),
       desc_(memory_datasource::name(),
             *params_.get<std::string>("encoding","utf-8")),
       type_(datasource::Vector),
@@ -106,10 +116,49 @@ void memory_datasource::push(feature_ptr feature)
             throw std::runtime_error("Can not add a vector feature to a memory datasource that contains rasters");
         }
     }
+    box2d<double> box = feature_box(feature);
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(index_->mutex);
+#endif
+        if (index_->tree && box.valid())
+        {
+            index_->tree->insert(std::make_pair(box, features_.size()));
+        }
+    }
     features_.push_back(feature);
+    boxes_.push_back(box);
     dirty_extent_ = true;
 }
 
+std::vector<std::size_t> memory_datasource::query_index(box2d<double> const& box) const
+{
+    std::vector<spatial_index::item_type> items;
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(index_->mutex);
+#endif
+        if (!index_->tree)
+        {
+            items.reserve(boxes_.size());
+            for (std::size_t i = 0; i < boxes_.size(); ++i)
+            {
+                if (boxes_[i].valid()) items.emplace_back(boxes_[i], i);
+            }
+            // packing constructor
+            index_->tree = std::make_unique<spatial_index::tree_type>(items);
+            items.clear();
+        }
+        index_->tree->query(boost::geometry::index::intersects(box), std::back_inserter(items));
+    }
+    std::vector<std::size_t> indices;
+    indices.reserve(items.size());
+    for (auto const& item : items) indices.push_back(item.second);
+    // keep features in the order they were pushed
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
 datasource::datasource_t memory_datasource::type() const
 {
     return type_;
@@ -121,7 +170,11 @@ featureset_ptr memory_datasource::features(const query& q) const
     {
         return mapnik::make_invalid_featureset();
     }
-    return std::make_shared<memory_featureset>(q.get_bbox(),*this,bbox_check_);
+    if (!bbox_check_)
+    {
+        return std::make_shared<memory_featureset>(q.get_bbox(),*this,bbox_check_);
+    }
+    return std::make_shared<memory_featureset>(features_, query_index(q.get_bbox()));
 }
 
 
@@ -134,7 +187,7 @@ featureset_ptr memory_datasource::features_at_point(coord2d const& pt, double to
     box2d<double> box = box2d<double>(pt.x, pt.y, pt.x, pt.y);
     box.pad(tol);
     MAPNIK_LOG_DEBUG(memory_datasource) << "memory_datasource: Box=" << box << ", Point x=" << pt.x << ",y=" << pt.y;
-    return std::make_shared<memory_featureset>(box,*this);
+    return std::make_shared<memory_featureset>(features_, query_index(box));
 }
 
 void memory_datasource::set_envelope(box2d<double> const& box)
@@ -147,8 +200,20 @@ box2d<double> memory_datasource::envelope() const
 {
     if (!extent_.valid() || dirty_extent_)
     {
-        accumulate_extent func(extent_);
-        std::for_each(features_.begin(),features_.end(),func);
+        extent_ = box2d<double>();
+        bool first = true;
+        for (auto const& box : boxes_)
+        {
+            if (first)
+            {
+                first = false;
+                extent_ = box;
+            }
+            else
+            {
+                extent_.expand_to_include(box);
+            }
+        }
         dirty_extent_ = false;
     }
     return extent_;
@@ -173,6 +238,14 @@ size_t memory_datasource::size() const
 void memory_datasource::clear()
 {
     features_.clear();
+    boxes_.clear();
+    {
+#ifdef MAPNIK_THREADSAFE
+        std::lock_guard<std::mutex> lock(index_->mutex);
+#endif
+        index_->tree.reset();
+    }
+    dirty_extent_ = true;
 }
 
 }
@@ -24,6 +24,7 @@
 #include <mapnik/debug.hpp>
 #include <mapnik/image_reader.hpp>
 #include <mapnik/util/char_array_buffer.hpp>
+#include <mapnik/util/parallel_for.hpp>
 extern "C"
 {
 #include <tiffio.h>
@@ -39,8 +40,12 @@ extern "C"
 #endif
 
 // stl
+#include <algorithm>
 #include <memory>
 #include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace mapnik { namespace detail {
 
@@ -102,6 +107,23 @@ static int tiff_map_proc(thandle_t, tdata_t* , toff_t*)
     return 0;
 }
 
+static TIFF* tiff_client_open(std::istream & input)
+{
+    return TIFFClientOpen("tiff_input_stream", "rcm",
+                          reinterpret_cast<thandle_t>(&input),
+                          tiff_read_proc,
+                          tiff_write_proc,
+                          tiff_seek_proc,
+                          tiff_close_proc,
+                          tiff_size_proc,
+                          tiff_map_proc,
+                          tiff_unmap_proc);
+}
+
+// tiles decoded by each thread of a parallel read, every thread
+// opens its own TIFF handle so a few tiles are not worth it
+constexpr std::size_t tiff_min_tiles_per_thread = 4;
+
 template <typename T>
 struct tiff_io_traits
 {
@@ -135,6 +157,16 @@ class tiff_reader : public image_reader
         }
     };
 
+    // a tiled image directory, the full resolution image or an overview
+    struct tiff_level
+    {
+        tdir_t directory;
+        std::size_t width;
+        std::size_t height;
+        std::size_t tile_width;
+        std::size_t tile_height;
+    };
+
 private:
     source_type source_;
     input_stream stream_;
@@ -154,6 +186,12 @@ private:
     unsigned compression_;
     bool has_alpha_;
     bool is_tiled_;
+    std::string filename_;
+    char const* data_;
+    std::size_t size_;
+    std::vector<tiff_level> overviews_;
+    tdir_t directory_;
+    std::size_t decode_threads_;
 
 public:
     enum TiffType {
@@ -170,6 +208,11 @@ public:
     inline bool has_alpha() const final { return has_alpha_; }
     void read(unsigned x,unsigned y,image_rgba8& image) final;
     image_any read(unsigned x, unsigned y, unsigned width, unsigned height) final;
+    unsigned overviews() const final;
+    unsigned overview_width(unsigned level) const final;
+    unsigned overview_height(unsigned level) const final;
+    image_any read_overview(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height) final;
+    void set_decode_threads(std::size_t threads) final { decode_threads_ = std::max(std::size_t(1), threads); }
     // methods specific to tiff reader
     unsigned bits_per_sample() const { return bps_; }
     unsigned sample_format() const { return sample_format_; }
@@ -184,6 +227,8 @@ private:
     tiff_reader(const tiff_reader&);
     tiff_reader& operator=(const tiff_reader&);
     void init();
+    void init_overviews(TIFF* tif);
+    tiff_level level(unsigned index) const;
 
     template <typename ImageData>
     void read_generic(std::size_t x,std::size_t y, ImageData & image);
@@ -192,12 +237,14 @@ private:
     void read_stripped(std::size_t x,std::size_t y, ImageData & image);
 
     template <typename ImageData>
-    void read_tiled(std::size_t x,std::size_t y, ImageData & image);
+    void read_tiled(tiff_level const& level, std::size_t x,std::size_t y, ImageData & image);
 
     template <typename ImageData>
-    image_any read_any_gray(std::size_t x, std::size_t y, std::size_t width, std::size_t height);
+    image_any read_any_gray(unsigned level, std::size_t x, std::size_t y, std::size_t width, std::size_t height);
 
     TIFF* open(std::istream & input);
+    TIFF* select(tdir_t directory);
+    std::unique_ptr<std::streambuf> open_buffer() const;
 };
 
 namespace
@@ -246,7 +293,12 @@ tiff_reader<T>::tiff_reader(std::string const& filename)
     planar_config_(PLANARCONFIG_CONTIG),
     compression_(COMPRESSION_NONE),
     has_alpha_(false),
-    is_tiled_(false)
+    is_tiled_(false),
+    filename_(filename),
+    data_(nullptr),
+    size_(0),
+    directory_(0),
+    decode_threads_(1)
 {
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
@@ -257,6 +309,8 @@ tiff_reader<T>::tiff_reader(std::string const& filename)
      {
          mapped_region_ = *memory;
          stream_.buffer(static_cast<char*>(mapped_region_->get_address()),mapped_region_->get_size());
+         data_ = static_cast<char const*>(mapped_region_->get_address());
+         size_ = mapped_region_->get_size();
      }
      else
      {
@@ -287,7 +341,11 @@ tiff_reader<T>::tiff_reader(char const* data, std::size_t size)
       planar_config_(PLANARCONFIG_CONTIG),
       compression_(COMPRESSION_NONE),
       has_alpha_(false),
-      is_tiled_(false)
+      is_tiled_(false),
+      data_(data),
+      size_(size),
+      directory_(0),
+      decode_threads_(1)
 {
     if (!stream_) throw image_reader_exception("TIFF reader: cannot open image stream ");
     init();
@@ -392,6 +450,62 @@ void tiff_reader<T>::init()
             }
         }
     }
+    if (is_tiled_)
+    {
+        init_overviews(tif);
+    }
+}
+
+// Overviews are further tiled directories marked as reduced resolution
+// images with the same pixel layout, e.g. in a cloud optimized GeoTIFF.
+// Transparency masks (also reduced resolution directories) are skipped.
+template <typename T>
+void tiff_reader<T>::init_overviews(TIFF* tif)
+{
+    tdir_t count = TIFFNumberOfDirectories(tif);
+    for (tdir_t dir = 1; dir < count && TIFFSetDirectory(tif, dir); ++dir)
+    {
+        std::uint32_t subfile_type = 0;
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint32_t tile_width = 0;
+        std::uint32_t tile_height = 0;
+        std::uint16_t bps = 0;
+        std::uint16_t sample_format = SAMPLEFORMAT_UINT;
+        std::uint16_t photometric = 0;
+        std::uint16_t bands = 1;
+        std::uint16_t planar_config = PLANARCONFIG_CONTIG;
+        TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfile_type);
+        if (!(subfile_type & FILETYPE_REDUCEDIMAGE) || (subfile_type & FILETYPE_MASK) || !TIFFIsTiled(tif))
+        {
+            continue;
+        }
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tile_width);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &tile_height);
+        TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+        TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT, &sample_format);
+        TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+        TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &bands);
+        TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &planar_config);
+        if (width == 0 || height == 0 || width > width_ || height > height_ ||
+            (width == width_ && height == height_) ||
+            tile_width == 0 || tile_height == 0 ||
+            bps != bps_ || sample_format != sample_format_ || photometric != photometric_ ||
+            bands != bands_ || planar_config != planar_config_)
+        {
+            continue;
+        }
+        MAPNIK_LOG_DEBUG(tiff_reader) << "overview: " << width << "x" << height << " in directory " << dir;
+        overviews_.push_back(tiff_level{dir, width, height, tile_width, tile_height});
+    }
+    if (count > 1 && !TIFFSetDirectory(tif, 0))
+    {
+        throw image_reader_exception("TIFF reader: can't read the first directory");
+    }
+    std::stable_sort(overviews_.begin(), overviews_.end(),
+                     [](tiff_level const& a, tiff_level const& b) { return a.width > b.width; });
 }
 
 template <typename T>
@@ -417,6 +531,35 @@ boost::optional<box2d<double> > tiff_reader<T>::bounding_box() const
     return bbox_;
 }
 
+template <typename T>
+unsigned tiff_reader<T>::overviews() const
+{
+    return overviews_.size();
+}
+
+template <typename T>
+unsigned tiff_reader<T>::overview_width(unsigned level) const
+{
+    if (level == 0) return width_;
+    return level <= overviews_.size() ? overviews_[level - 1].width : 0;
+}
+
+template <typename T>
+unsigned tiff_reader<T>::overview_height(unsigned level) const
+{
+    if (level == 0) return height_;
+    return level <= overviews_.size() ? overviews_[level - 1].height : 0;
+}
+
+template <typename T>
+typename tiff_reader<T>::tiff_level tiff_reader<T>::level(unsigned index) const
+{
+    if (index == 0) return tiff_level{0, width_, height_,
+                                      static_cast<std::size_t>(tile_width_),
+                                      static_cast<std::size_t>(tile_height_)};
+    return overviews_[index - 1];
+}
+
 template <typename T>
 void tiff_reader<T>::read(unsigned x,unsigned y,image_rgba8& image)
 {
@@ -426,7 +569,7 @@ void tiff_reader<T>::read(unsigned x,unsigned y,image_rgba8& image)
     }
     else if (read_method_==tiled)
     {
-        read_tiled(static_cast<std::size_t>(x),static_cast<std::size_t>(y),image);
+        read_tiled(level(0), static_cast<std::size_t>(x),static_cast<std::size_t>(y),image);
     }
     else
     {
@@ -436,14 +579,14 @@ void tiff_reader<T>::read(unsigned x,unsigned y,image_rgba8& image)
 
 template <typename T>
 template <typename ImageData>
-image_any tiff_reader<T>::read_any_gray(std::size_t x0, std::size_t y0, std::size_t width, std::size_t height)
+image_any tiff_reader<T>::read_any_gray(unsigned index, std::size_t x0, std::size_t y0, std::size_t width, std::size_t height)
 {
     using image_type = ImageData;
     using pixel_type = typename image_type::pixel_type;
     if (read_method_ == tiled)
     {
         image_type data(width, height);
-        read_tiled<image_type>(x0, y0, data);
+        read_tiled<image_type>(level(index), x0, y0, data);
         return image_any(std::move(data));
     }
     else if (read_method_ == stripped)
@@ -454,7 +597,7 @@ image_any tiff_reader<T>::read_any_gray(std::size_t x0, std::size_t y0, std::siz
     }
     else
     {
-        TIFF* tif = open(stream_);
+        TIFF* tif = select(0);
         if (tif)
         {
             image_type data(width, height);
@@ -578,6 +721,16 @@ struct tiff_reader_traits<image_rgba8>
 template <typename T>
 image_any tiff_reader<T>::read(unsigned x, unsigned y, unsigned width, unsigned height)
 {
+    return read_overview(0, x, y, width, height);
+}
+
+template <typename T>
+image_any tiff_reader<T>::read_overview(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height)
+{
+    if (level > overviews_.size())
+    {
+        throw image_reader_exception("TIFF reader: overview " + std::to_string(level) + " does not exist");
+    }
     if (width > 10000 || height > 10000)
     {
         throw image_reader_exception("Can't allocate tiff > 10000x10000");
@@ -597,11 +750,11 @@ image_any tiff_reader<T>::read(unsigned x, unsigned y, unsigned width, unsigned
             {
             case SAMPLEFORMAT_UINT:
             {
-                return read_any_gray<image_gray8>(x0, y0, width, height);
+                return read_any_gray<image_gray8>(level, x0, y0, width, height);
             }
             case SAMPLEFORMAT_INT:
             {
-                return read_any_gray<image_gray8s>(x0, y0, width, height);
+                return read_any_gray<image_gray8s>(level, x0, y0, width, height);
             }
             default:
             {
@@ -615,11 +768,11 @@ image_any tiff_reader<T>::read(unsigned x, unsigned y, unsigned width, unsigned
             {
             case SAMPLEFORMAT_UINT:
             {
-                return read_any_gray<image_gray16>(x0, y0, width, height);
+                return read_any_gray<image_gray16>(level, x0, y0, width, height);
             }
             case SAMPLEFORMAT_INT:
             {
-                return read_any_gray<image_gray16s>(x0, y0, width, height);
+                return read_any_gray<image_gray16s>(level, x0, y0, width, height);
             }
             default:
             {
@@ -633,15 +786,15 @@ image_any tiff_reader<T>::read(unsigned x, unsigned y, unsigned width, unsigned
             {
             case SAMPLEFORMAT_UINT:
             {
-                return read_any_gray<image_gray32>(x0, y0, width, height);
+                return read_any_gray<image_gray32>(level, x0, y0, width, height);
             }
             case SAMPLEFORMAT_INT:
             {
-                return read_any_gray<image_gray32s>(x0, y0, width, height);
+                return read_any_gray<image_gray32s>(level, x0, y0, width, height);
             }
             case SAMPLEFORMAT_IEEEFP:
             {
-                return read_any_gray<image_gray32f>(x0, y0, width, height);
+                return read_any_gray<image_gray32f>(level, x0, y0, width, height);
             }
             default:
             {
@@ -655,15 +808,15 @@ image_any tiff_reader<T>::read(unsigned x, unsigned y, unsigned width, unsigned
             {
             case SAMPLEFORMAT_UINT:
             {
-                return read_any_gray<image_gray64>(x0, y0, width, height);
+                return read_any_gray<image_gray64>(level, x0, y0, width, height);
             }
             case SAMPLEFORMAT_INT:
             {
-                return read_any_gray<image_gray64s>(x0, y0, width, height);
+                return read_any_gray<image_gray64s>(level, x0, y0, width, height);
             }
             case SAMPLEFORMAT_IEEEFP:
             {
-                return read_any_gray<image_gray64f>(x0, y0, width, height);
+                return read_any_gray<image_gray64f>(level, x0, y0, width, height);
             }
             default:
             {
@@ -685,7 +838,14 @@ image_any tiff_reader<T>::read(unsigned x, unsigned y, unsigned width, unsigned
         //PHOTOMETRIC_LOGL = 32844;
         //PHOTOMETRIC_LOGLUV = 32845;
         image_rgba8 data(width,height, true, true);
-        read(x0, y0, data);
+        if (level == 0)
+        {
+            read(x0, y0, data);
+        }
+        else
+        {
+            read_tiled(this->level(level), x0, y0, data);
+        }
         return image_any(std::move(data));
     }
     }
@@ -701,65 +861,99 @@ void tiff_reader<T>::read_generic(std::size_t, std::size_t, ImageData &)
 
 template <typename T>
 template <typename ImageData>
-void tiff_reader<T>::read_tiled(std::size_t x0,std::size_t y0, ImageData & image)
+void tiff_reader<T>::read_tiled(tiff_level const& level, std::size_t x0,std::size_t y0, ImageData & image)
 {
     using pixel_type = typename detail::tiff_reader_traits<ImageData>::pixel_type;
 
-    TIFF* tif = open(stream_);
-    if (tif)
+    std::size_t width = image.width();
+    std::size_t height = image.height();
+    std::size_t tile_width = level.tile_width;
+    std::size_t tile_height = level.tile_height;
+    if (tile_width == 0 || tile_height == 0) return;
+    // only the tiles intersecting the window are decoded
+    std::size_t end_y = std::min(y0 + height, level.height);
+    std::size_t end_x = std::min(x0 + width, level.width);
+    std::vector<std::pair<std::size_t, std::size_t>> tiles;
+    for (std::size_t y = (y0 / tile_height) * tile_height; y < end_y; y += tile_height)
+    {
+        for (std::size_t x = (x0 / tile_width) * tile_width; x < end_x; x += tile_width)
+        {
+            tiles.emplace_back(x, y);
+        }
+    }
+
+    // tiles cover disjoint parts of the image, so they can be decoded concurrently
+    auto decode = [&](TIFF * tif, std::size_t first, std::size_t last)
     {
         std::uint32_t tile_size = TIFFTileSize(tif);
         std::unique_ptr<pixel_type[]> tile(new pixel_type[tile_size]);
-        std::size_t width = image.width();
-        std::size_t height = image.height();
-        std::size_t start_y = (y0 / tile_height_) * tile_height_;
-        std::size_t end_y = ((y0 + height) / tile_height_ + 1) * tile_height_;
-        std::size_t start_x = (x0 / tile_width_) * tile_width_;
-        std::size_t end_x = ((x0 + width) / tile_width_ + 1) * tile_width_;
-        end_y = std::min(end_y, height_);
-        end_x = std::min(end_x, width_);
-        bool pick_first_band = (bands_ > 1) && (tile_size / (tile_width_ * tile_height_ * sizeof(pixel_type)) == bands_);
-        for (std::size_t y = start_y; y < end_y; y += tile_height_)
+        bool pick_first_band = (bands_ > 1) && (tile_size / (tile_width * tile_height * sizeof(pixel_type)) == bands_);
+        for (std::size_t i = first; i < last; ++i)
         {
-            std::size_t ty0 = std::max(y0, y) - y;
-            std::size_t ty1 = std::min(height + y0, y + tile_height_) - y;
-
-            for (std::size_t x = start_x; x < end_x; x += tile_width_)
+            std::size_t x = tiles[i].first;
+            std::size_t y = tiles[i].second;
+            if (!detail::tiff_reader_traits<ImageData>::read_tile(tif, x, y, tile.get(), tile_width, tile_height))
             {
-                if (!detail::tiff_reader_traits<ImageData>::read_tile(tif, x, y, tile.get(), tile_width_, tile_height_))
-                {
-                    MAPNIK_LOG_DEBUG(tiff_reader) <<  "read_tile(...) failed at " << x << "/" << y << " for " << width_ << "/" << height_ << "\n";
-                    break;
-                }
-                if (pick_first_band)
+                MAPNIK_LOG_DEBUG(tiff_reader) <<  "read_tile(...) failed at " << x << "/" << y << " for " << level.width << "/" << level.height << "\n";
+                continue;
+            }
+            if (pick_first_band)
+            {
+                std::uint32_t size = tile_width * tile_height * sizeof(pixel_type);
+                for (std::uint32_t n = 0; n < size; ++n)
                 {
-                    std::uint32_t size = tile_width_ * tile_height_ * sizeof(pixel_type);
-                    for (std::uint32_t n = 0; n < size; ++n)
-                    {
-                        tile[n] = tile[n * bands_];
-                    }
+                    tile[n] = tile[n * bands_];
                 }
-                std::size_t tx0 = std::max(x0, x);
-                std::size_t tx1 = std::min(width + x0, x + tile_width_);
-                std::size_t row_index = y + ty0 - y0;
+            }
+            std::size_t ty0 = std::max(y0, y) - y;
+            std::size_t ty1 = std::min(height + y0, y + tile_height) - y;
+            std::size_t tx0 = std::max(x0, x);
+            std::size_t tx1 = std::min(width + x0, x + tile_width);
+            std::size_t row_index = y + ty0 - y0;
 
-                if (detail::tiff_reader_traits<ImageData>::reverse)
+            if (detail::tiff_reader_traits<ImageData>::reverse)
+            {
+                for (std::size_t ty = ty0; ty < ty1; ++ty, ++row_index)
                 {
-                    for (std::size_t ty = ty0; ty < ty1; ++ty, ++row_index)
-                    {
-                        // This is in reverse because the TIFFReadRGBATile reads are inverted
-                        image.set_row(row_index, tx0 - x0, tx1 - x0, &tile[(tile_height_ - ty - 1) * tile_width_ + tx0 - x]);
-                    }
+                    // This is in reverse because the TIFFReadRGBATile reads are inverted
+                    image.set_row(row_index, tx0 - x0, tx1 - x0, &tile[(tile_height - ty - 1) * tile_width + tx0 - x]);
                 }
-                else
+            }
+            else
+            {
+                for (std::size_t ty = ty0; ty < ty1; ++ty, ++row_index)
                 {
-                    for (std::size_t ty = ty0; ty < ty1; ++ty, ++row_index)
-                    {
-                        image.set_row(row_index, tx0 - x0, tx1 - x0, &tile[ty * tile_width_ + tx0 - x]);
-                    }
+                    image.set_row(row_index, tx0 - x0, tx1 - x0, &tile[ty * tile_width + tx0 - x]);
                 }
             }
         }
+    };
+
+    std::size_t threads = std::min(decode_threads_, tiles.size() / detail::tiff_min_tiles_per_thread);
+    if (threads > 1)
+    {
+        // libtiff handles can't be shared between threads, each chunk reads
+        // its tiles through its own handle on the same file or buffer
+        util::parallel_for_chunks(tiles.size(), threads, detail::tiff_min_tiles_per_thread,
+                                  [&](std::size_t first, std::size_t last)
+        {
+            std::unique_ptr<std::streambuf> buffer = open_buffer();
+            std::istream input(buffer.get());
+            tiff_ptr tif(detail::tiff_client_open(input), tiff_closer());
+            if (!tif || (level.directory != 0 && !TIFFSetDirectory(tif.get(), level.directory)))
+            {
+                throw image_reader_exception("TIFF reader: can't reopen image for decoding");
+            }
+            decode(tif.get(), first, last);
+        });
+    }
+    else
+    {
+        TIFF* tif = select(level.directory);
+        if (tif)
+        {
+            decode(tif, 0, tiles.size());
+        }
     }
 }
 
@@ -768,7 +962,7 @@ template <typename ImageData>
 void tiff_reader<T>::read_stripped(std::size_t x0, std::size_t y0, ImageData & image)
 {
     using pixel_type = typename detail::tiff_reader_traits<ImageData>::pixel_type;
-    TIFF* tif = open(stream_);
+    TIFF* tif = select(0);
     if (tif)
     {
         std::uint32_t strip_size = TIFFStripSize(tif);
@@ -827,17 +1021,39 @@ TIFF* tiff_reader<T>::open(std::istream & input)
 {
     if (!tif_)
     {
-        tif_ = tiff_ptr(TIFFClientOpen("tiff_input_stream", "rcm",
-                                       reinterpret_cast<thandle_t>(&input),
-                                       detail::tiff_read_proc,
-                                       detail::tiff_write_proc,
-                                       detail::tiff_seek_proc,
-                                       detail::tiff_close_proc,
-                                       detail::tiff_size_proc,
-                                       detail::tiff_map_proc,
-                                       detail::tiff_unmap_proc), tiff_closer());
+        tif_ = tiff_ptr(detail::tiff_client_open(input), tiff_closer());
     }
     return tif_.get();
 }
 
+template <typename T>
+TIFF* tiff_reader<T>::select(tdir_t directory)
+{
+    TIFF* tif = open(stream_);
+    if (tif && directory != directory_)
+    {
+        if (!TIFFSetDirectory(tif, directory))
+        {
+            throw image_reader_exception("TIFF reader: can't read directory " + std::to_string(directory));
+        }
+        directory_ = directory;
+    }
+    return tif;
+}
+
+template <typename T>
+std::unique_ptr<std::streambuf> tiff_reader<T>::open_buffer() const
+{
+    if (data_)
+    {
+        return std::unique_ptr<std::streambuf>(new util::char_array_buffer(data_, size_));
+    }
+    std::unique_ptr<std::filebuf> file(new std::filebuf());
+    if (!file->open(filename_, std::ios_base::in | std::ios_base::binary))
+    {
+        throw image_reader_exception("TIFF reader: cannot open file " + filename_);
+    }
+    return std::unique_ptr<std::streambuf>(file.release());
+}
+
 } // namespace mapnik
@@ -89,7 +89,11 @@ public:
         // try to determine WKB format automatically
         if (format_ == wkbAuto)
         {
-            if (size_ >= 44
+            if (size_ >= 8 && wkb_[0] == 'G' && wkb_[1] == 'P')
+            {
+                format_ = wkbGeoPackage;
+            }
+            else if (size_ >= 44
                 && static_cast<unsigned char>(wkb_[0]) == static_cast<unsigned char>(0x00)
                 && static_cast<unsigned char>(wkb_[38]) == static_cast<unsigned char>(0x7C)
                 && static_cast<unsigned char>(wkb_[size_ - 1]) == static_cast<unsigned char>(0xFE))
@@ -109,6 +113,28 @@ public:
             pos_ = 39;
             break;
 
+        case wkbGeoPackage:
+        {
+            // GeoPackageBinary header: "GP", version, flags, srs_id and an
+            // optional envelope, followed by standard WKB
+            static const std::size_t envelope_sizes[] = { 0, 32, 48, 48, 64 };
+            std::uint8_t flags = size_ >= 8 ? static_cast<std::uint8_t>(wkb_[3]) : 0x10;
+            std::uint8_t envelope = (flags >> 1) & 0x07;
+            std::size_t header_size = 8 + (envelope < 5 ? envelope_sizes[envelope] : size_);
+            if ((flags & 0x10) || (flags & 0x20) || header_size + 5 > size_)
+            {
+                // empty or extended (non-standard) geometry: nothing to read
+                byteOrder_ = wkbNDR;
+                pos_ = size_;
+            }
+            else
+            {
+                byteOrder_ = static_cast<wkbByteOrder>(wkb_[header_size]);
+                pos_ = header_size + 1;
+            }
+            break;
+        }
+
         case wkbGeneric:
         default:
             byteOrder_ = static_cast<wkbByteOrder>(wkb_[0]);
@@ -122,6 +148,7 @@ public:
     mapnik::geometry::geometry<double> read()
     {
         mapnik::geometry::geometry<double> geom = mapnik::geometry::geometry_empty();
+        if (pos_ + 4 > size_) return geom;
         int type = read_integer();
         switch (type)
         {
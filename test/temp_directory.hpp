@@ -0,0 +1,53 @@
+#ifndef TEST_TEMP_DIRECTORY_HPP
+#define TEST_TEMP_DIRECTORY_HPP
+
+#include <string>
+
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#pragma GCC diagnostic pop
+
+namespace testing {
+
+// A uniquely named directory under the system temp directory, removed
+// with everything in it when the object goes out of scope (including
+// when a REQUIRE fails), so tests don't leave fixtures behind.
+class temp_directory
+{
+public:
+    temp_directory()
+        : path_(boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("mapnik-test-%%%%-%%%%-%%%%"))
+    {
+        boost::filesystem::create_directories(path_);
+    }
+
+    ~temp_directory()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(path_, ec);
+    }
+
+    temp_directory(temp_directory const&) = delete;
+    temp_directory& operator=(temp_directory const&) = delete;
+
+    // path of `name` inside the directory
+    std::string file(std::string const& name) const
+    {
+        return (path_ / name).string();
+    }
+
+    std::string path() const
+    {
+        return path_.string();
+    }
+
+private:
+    boost::filesystem::path path_;
+};
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include "catch.hpp"
+
+#include <mapnik/feature.hpp>
+#include <mapnik/value.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct counting_decoder : mapnik::feature_attribute_decoder
+{
+    mutable int calls = 0;
+    bool decode(std::size_t index, mapnik::value & val) const override
+    {
+        ++calls;
+        if (index > 1) return false;
+        val = mapnik::value_integer(index * 10 + 1);
+        return true;
+    }
+};
+
+struct slow_decoder : mapnik::feature_attribute_decoder
+{
+    mutable std::atomic<int> calls{0};
+    bool decode(std::size_t index, mapnik::value & val) const override
+    {
+        ++calls;
+        std::this_thread::yield();
+        val = mapnik::value_integer(index);
+        return true;
+    }
+};
+
+}
+
+TEST_CASE("feature") {
+
+SECTION("lazy attribute decoding") {
+
+    auto ctx = std::make_shared<mapnik::context_type>();
+    ctx->push("a");
+    ctx->push("b");
+    ctx->push("c");
+    mapnik::feature_impl feature(ctx, 1);
+    auto decoder = std::make_shared<counting_decoder>();
+    feature.set_decoder(decoder);
+    CHECK(decoder->calls == 0);
+
+    // decoded on first access only
+    CHECK(feature.get("b") == mapnik::value_integer(11));
+    CHECK(feature.get("b") == mapnik::value_integer(11));
+    CHECK(decoder->calls == 1);
+
+    // explicit values win over the decoder
+    feature.put("a", mapnik::value_integer(42));
+    CHECK(feature.get("a") == mapnik::value_integer(42));
+    CHECK(decoder->calls == 1);
+
+    // attributes the decoder does not provide stay null
+    CHECK(feature.get("c").is_null());
+    CHECK(decoder->calls == 2);
+
+    auto const& data = feature.get_data();
+    REQUIRE(data.size() == 3);
+    CHECK(data[0] == mapnik::value_integer(42));
+    CHECK(data[1] == mapnik::value_integer(11));
+    CHECK(decoder->calls == 2);
+}
+
+SECTION("get_data decodes pending attributes") {
+
+    auto ctx = std::make_shared<mapnik::context_type>();
+    ctx->push("a");
+    ctx->push("b");
+    mapnik::feature_impl feature(ctx, 1);
+    auto decoder = std::make_shared<counting_decoder>();
+    feature.set_decoder(decoder);
+    auto const& data = feature.get_data();
+    CHECK(decoder->calls == 2);
+    CHECK(data[0] == mapnik::value_integer(1));
+    CHECK(data[1] == mapnik::value_integer(11));
+}
+
+#ifdef MAPNIK_THREADSAFE
+SECTION("lazy attribute decoding from several threads") {
+
+    auto ctx = std::make_shared<mapnik::context_type>();
+    std::size_t const num_keys = 64;
+    for (std::size_t i = 0; i < num_keys; ++i)
+    {
+        ctx->push("k" + std::to_string(i));
+    }
+    for (int round = 0; round < 20; ++round)
+    {
+        mapnik::feature_impl feature(ctx, 1);
+        auto decoder = std::make_shared<slow_decoder>();
+        feature.set_decoder(decoder);
+        std::atomic<int> mismatches{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t)
+        {
+            readers.emplace_back([&feature, &mismatches, t, num_keys] {
+                // threads walk the attributes in different orders
+                for (std::size_t i = 0; i < num_keys; ++i)
+                {
+                    std::size_t index = (t % 2 == 0) ? i : num_keys - 1 - i;
+                    if (feature.get(index) != mapnik::value_integer(index)) ++mismatches;
+                }
+            });
+        }
+        for (auto & reader : readers) reader.join();
+        CHECK(mismatches == 0);
+        // every value is decoded exactly once
+        CHECK(decoder->calls == static_cast<int>(num_keys));
+    }
+}
+#endif
+
+}
@@ -0,0 +1,73 @@
+#include "catch.hpp"
+
+#include <mapnik/mapped_memory_cache.hpp>
+#include <mapnik/util/fs.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+
+namespace {
+
+std::string make_file(std::string const& name, std::size_t size)
+{
+    std::ofstream out(name.c_str(), std::ios::binary | std::ios::trunc);
+    out << std::string(size, 'x');
+    return name;
+}
+
+}
+
+TEST_CASE("mapped_memory_cache") {
+
+SECTION("evicts least recently used unreferenced mappings") {
+
+    auto & cache = mapnik::mapped_memory_cache::instance();
+    cache.clear();
+    std::size_t max_entries = cache.max_entries();
+    std::string a = make_file("./mapped_memory_cache_a.tmp", 100);
+    std::string b = make_file("./mapped_memory_cache_b.tmp", 100);
+    std::string c = make_file("./mapped_memory_cache_c.tmp", 100);
+
+    cache.set_max_entries(2);
+    auto evictions = cache.stats().evictions;
+    {
+        auto region_a = cache.find(a, true, mapnik::mapped_access::random);
+        REQUIRE(region_a);
+        CHECK(cache.find(b, true));
+        CHECK(cache.stats().entries == 2);
+        CHECK(cache.stats().bytes == 200);
+        // `a` is still referenced, so `b` goes
+        CHECK(cache.find(c, true, mapnik::mapped_access::populate));
+        CHECK(cache.stats().entries == 2);
+        CHECK(cache.stats().evictions == evictions + 1);
+        auto hits = cache.stats().hits;
+        CHECK(cache.find(a));
+        CHECK(cache.stats().hits == hits + 1);
+        // hits with another access pattern share the cached mapping
+        auto sequential_a = cache.find(a, true, mapnik::mapped_access::sequential);
+        REQUIRE(sequential_a);
+        CHECK(*sequential_a == *region_a);
+    }
+    // nothing is referenced any more, `c` is least recently used
+    cache.set_max_entries(1);
+    CHECK(cache.stats().entries == 1);
+    auto hits = cache.stats().hits;
+    CHECK(cache.find(a));
+    CHECK(cache.stats().hits == hits + 1);
+    CHECK(cache.remove(a));
+    CHECK(cache.stats().entries == 0);
+    CHECK(cache.stats().bytes == 0);
+
+    cache.set_max_entries(max_entries);
+    cache.clear();
+    mapnik::util::remove(a);
+    mapnik::util::remove(b);
+    mapnik::util::remove(c);
+}
+
+}
+
+#endif
@@ -80,6 +80,20 @@ mapnik::datasource_ptr get_csv_ds(std::string const& file_name, bool strict = tr
     return ds;
 }
 
+// enough rows for several load_threads chunks of 1024
+std::string many_rows_csv(std::size_t count)
+{
+    std::string csv = "x,y,id,name,value\n";
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        csv += std::to_string(static_cast<double>(i % 360) - 180) + "," +
+               std::to_string(static_cast<double>(i % 180) - 90) + "," +
+               std::to_string(i) + ",\"row " + std::to_string(i) + "\"," +
+               std::to_string(static_cast<double>(i) / 4) + "\n";
+    }
+    return csv;
+}
+
 } // anonymous namespace
 
 TEST_CASE("csv") {
@@ -1046,6 +1060,10 @@ TEST_CASE("csv") {
             CHECK(box.maxy() ==   90);
         } // END SECTION
 
+        SECTION("load_threads") {
+            require_same_features_for_load_threads("csv", many_rows_csv(10000));
+        } // END SECTION
+
         SECTION("inline geojson") {
             std::string csv_string = "geojson\n'{\"coordinates\":[-92.22568,38.59553],\"type\":\"Point\"}'";
             mapnik::parameters params;
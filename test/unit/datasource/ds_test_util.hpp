@@ -31,6 +31,13 @@
 #include <mapnik/geometry.hpp>
 #include <mapnik/geometry/geometry_types.hpp>
 #include <mapnik/geometry/geometry_type.hpp>
+#include <mapnik/util/geometry_to_wkt.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -105,6 +112,51 @@ inline std::size_t count_features(mapnik::featureset_ptr features) {
     return count;
 }
 
+// features of both sets must match one by one, in order
+inline void require_same_features(mapnik::featureset_ptr expected, mapnik::featureset_ptr actual) {
+    REQUIRE(bool(expected));
+    REQUIRE(bool(actual));
+    std::size_t count = 0;
+    while (mapnik::feature_ptr feature = expected->next()) {
+        mapnik::feature_ptr other = actual->next();
+        REQUIRE(bool(other));
+        CHECK(other->id() == feature->id());
+        CHECK(other->to_string() == feature->to_string());
+        std::vector<std::string> keys, other_keys;
+        for (auto const& kv : *feature) keys.push_back(std::get<0>(kv));
+        for (auto const& kv : *other) other_keys.push_back(std::get<0>(kv));
+        CHECK(other_keys == keys);
+        std::string wkt, other_wkt;
+        REQUIRE(mapnik::util::to_wkt(wkt, feature->get_geometry()));
+        REQUIRE(mapnik::util::to_wkt(other_wkt, other->get_geometry()));
+        CHECK(other_wkt == wkt);
+        ++count;
+    }
+    CHECK(!actual->next());
+    CHECK(count > 0);
+}
+
+// parsing `inline_data` on several threads must give the same datasource
+// of plugin `type` as parsing it on one
+inline void require_same_features_for_load_threads(std::string const& type, std::string const& inline_data) {
+    mapnik::parameters params;
+    params["type"] = type;
+    params["inline"] = inline_data;
+    params["load_threads"] = mapnik::value_integer(1);
+    auto expected = mapnik::datasource_cache::instance().create(params);
+    REQUIRE(bool(expected));
+    for (mapnik::value_integer threads : { 2, 3, 4, 8 }) {
+        INFO("load_threads=" << threads);
+        params["load_threads"] = threads;
+        auto actual = mapnik::datasource_cache::instance().create(params);
+        REQUIRE(bool(actual));
+        CHECK(actual->envelope() == expected->envelope());
+        CHECK(vector_to_string(actual->get_descriptor().get_descriptors()) ==
+              vector_to_string(expected->get_descriptor().get_descriptors()));
+        require_same_features(all_features(expected), all_features(actual));
+    }
+}
+
 using attr = std::tuple<std::string, mapnik::value>;
 
 #define REQUIRE_ATTRIBUTES(feature, attrs) \
@@ -209,6 +261,136 @@ inline int create_disk_index(std::string const& filename, bool silent = true)
     return std::system(cmd.c_str());
 }
 
+inline void write_xdr(std::ostream & out, std::int32_t val)
+{
+    std::uint32_t u = static_cast<std::uint32_t>(val);
+    for (int shift : { 24, 16, 8, 0 }) out.put(static_cast<char>((u >> shift) & 0xff));
+}
+
+inline void write_ndr(std::ostream & out, std::uint64_t val, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) out.put(static_cast<char>((val >> (8 * i)) & 0xff));
+}
+
+inline void write_ndr(std::ostream & out, double val)
+{
+    std::uint64_t u;
+    std::memcpy(&u, &val, 8);
+    write_ndr(out, u, 8);
+}
+
+// Writes the .dbf of a shapefile with an integer "id" attribute
+inline void write_id_dbf(std::string const& base, std::int32_t num_records)
+{
+    std::ofstream dbf((base + ".dbf").c_str(), std::ios::binary);
+    dbf.put(0x03);
+    dbf.write("\x79\x01\x01", 3);
+    write_ndr(dbf, static_cast<std::uint64_t>(num_records), 4);
+    write_ndr(dbf, 32 + 32 + 1, 2);
+    write_ndr(dbf, 1 + 4, 2);
+    for (int i = 0; i < 20; ++i) dbf.put(0);
+    char field[32] = "id";
+    field[11] = 'N';
+    field[16] = 4;
+    dbf.write(field, 32);
+    dbf.put(0x0d);
+    for (std::int32_t i = 0; i < num_records; ++i)
+    {
+        std::string row = " " + std::string(3, ' ') + std::to_string(i % 10);
+        dbf.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+    dbf.put(0x1a);
+}
+
+// Writes a point shapefile with an integer "id" attribute, the header
+// extent is written as given
+inline void write_point_shapefile(std::string const& base,
+                           std::vector<std::pair<double, double>> const& points,
+                           double minx, double miny, double maxx, double maxy)
+{
+    std::int32_t const record_words = 4 + 10;
+    std::int32_t const num_points = static_cast<std::int32_t>(points.size());
+    std::ofstream shp((base + ".shp").c_str(), std::ios::binary);
+    std::ofstream shx((base + ".shx").c_str(), std::ios::binary);
+    for (auto * out : { &shp, &shx })
+    {
+        write_xdr(*out, 9994);
+        for (int i = 0; i < 5; ++i) write_xdr(*out, 0);
+        write_xdr(*out, out == &shp ? 50 + record_words * num_points : 50 + 4 * num_points);
+        write_ndr(*out, 1000, 4);
+        write_ndr(*out, 1, 4); // point
+        for (double v : { minx, miny, maxx, maxy, 0.0, 0.0, 0.0, 0.0 }) write_ndr(*out, v);
+    }
+    for (std::int32_t i = 0; i < num_points; ++i)
+    {
+        write_xdr(shp, i + 1);
+        write_xdr(shp, 10);
+        write_ndr(shp, 1, 4);
+        write_ndr(shp, points[i].first);
+        write_ndr(shp, points[i].second);
+        write_xdr(shx, 50 + record_words * i);
+        write_xdr(shx, 10);
+    }
+    write_id_dbf(base, num_points);
+}
+
+// Writes a polyline shapefile of one single part record per line, with an
+// integer "id" attribute
+inline void write_line_shapefile(std::string const& base,
+                                 std::vector<std::vector<std::pair<double, double>>> const& lines)
+{
+    std::vector<mapnik::box2d<double>> boxes;
+    mapnik::box2d<double> extent;
+    std::int32_t shp_words = 50;
+    for (auto const& line : lines)
+    {
+        mapnik::box2d<double> box;
+        for (auto const& pt : line)
+        {
+            if (box.valid()) box.expand_to_include(pt.first, pt.second);
+            else box.init(pt.first, pt.second, pt.first, pt.second);
+        }
+        boxes.push_back(box);
+        if (extent.valid()) extent.expand_to_include(box);
+        else extent = box;
+        shp_words += 4 + 24 + 8 * static_cast<std::int32_t>(line.size());
+    }
+    std::int32_t const num_lines = static_cast<std::int32_t>(lines.size());
+    std::ofstream shp((base + ".shp").c_str(), std::ios::binary);
+    std::ofstream shx((base + ".shx").c_str(), std::ios::binary);
+    for (auto * out : { &shp, &shx })
+    {
+        write_xdr(*out, 9994);
+        for (int i = 0; i < 5; ++i) write_xdr(*out, 0);
+        write_xdr(*out, out == &shp ? shp_words : 50 + 4 * num_lines);
+        write_ndr(*out, 1000, 4);
+        write_ndr(*out, 3, 4); // polyline
+        for (double v : { extent.minx(), extent.miny(), extent.maxx(), extent.maxy(), 0.0, 0.0, 0.0, 0.0 }) write_ndr(*out, v);
+    }
+    std::int32_t offset = 50;
+    for (std::int32_t i = 0; i < num_lines; ++i)
+    {
+        auto const& line = lines[i];
+        std::int32_t const content_words = 24 + 8 * static_cast<std::int32_t>(line.size());
+        write_xdr(shp, i + 1);
+        write_xdr(shp, content_words);
+        write_ndr(shp, 3, 4);
+        for (double v : { boxes[i].minx(), boxes[i].miny(), boxes[i].maxx(), boxes[i].maxy() }) write_ndr(shp, v);
+        write_ndr(shp, 1, 4);
+        write_ndr(shp, line.size(), 4);
+        write_ndr(shp, 0, 4);
+        for (auto const& pt : line)
+        {
+            write_ndr(shp, pt.first);
+            write_ndr(shp, pt.second);
+        }
+        write_xdr(shx, offset);
+        write_xdr(shx, content_words);
+        offset += 4 + content_words;
+    }
+    write_id_dbf(base, num_lines);
+}
+
 }
 
 #endif // MAPNIK_UNIT_DATSOURCE_UTIL
@@ -21,16 +21,29 @@
  *****************************************************************************/
 
 #include "catch.hpp"
+#include "temp_directory.hpp"
 
 #include <mapnik/datasource.hpp>
 #include <mapnik/datasource_cache.hpp>
+#include <mapnik/image.hpp>
+#include <mapnik/image_util.hpp>
 #include <mapnik/raster.hpp>
 #include <mapnik/util/fs.hpp>
 
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
 namespace {
 
 mapnik::datasource_ptr get_gdal_ds(std::string const& file_name,
-                                   boost::optional<mapnik::value_integer> band)
+                                   boost::optional<mapnik::value_integer> band,
+                                   mapnik::parameters params = mapnik::parameters())
 {
     std::string gdal_plugin("./plugins/input/gdal.input");
     if (!mapnik::util::exists(gdal_plugin))
@@ -38,7 +51,6 @@ mapnik::datasource_ptr get_gdal_ds(std::string const& file_name,
         return mapnik::datasource_ptr();
     }
 
-    mapnik::parameters params;
     params["type"] = std::string("gdal");
     params["file"] = file_name;
     if (band)
@@ -52,6 +64,40 @@ mapnik::datasource_ptr get_gdal_ds(std::string const& file_name,
     return ds;
 }
 
+// a 600x400 image, large enough to get two levels of overviews
+void write_gradient(std::string const& file_name, unsigned offset)
+{
+    mapnik::image_rgba8 image(600, 400);
+    for (unsigned y = 0; y < image.height(); ++y)
+    {
+        for (unsigned x = 0; x < image.width(); ++x)
+        {
+            image(x, y) = 0xff000000 | ((x + offset) % 256) | (((y + offset) % 256) << 8);
+        }
+    }
+    mapnik::save_to_file(image, file_name, "png");
+}
+
+std::string read_file(std::string const& file_name)
+{
+    std::ifstream file(file_name.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+std::string source_stamp(std::string const& file_name)
+{
+    return std::to_string(mapnik::util::file_size(file_name)) + " " +
+        std::to_string(mapnik::util::last_write_time(file_name)) + "\n";
+}
+
+mapnik::datasource_ptr get_overviews_ds(std::string const& file_name, std::string const& resampling = "AVERAGE")
+{
+    mapnik::parameters params;
+    params["build_overviews"] = mapnik::boolean_type(true);
+    params["overview_resampling"] = resampling;
+    return get_gdal_ds(file_name, boost::none, params);
+}
+
 } // anonymous namespace
 
 TEST_CASE("gdal") {
@@ -86,4 +132,162 @@ TEST_CASE("gdal") {
         CHECK(raster->data_.height() == 256);
     }
 
+    SECTION("block cache")
+    {
+        std::string dataset = "test/data/tiff/ndvi_256x256_gray32f_tiled.tif";
+        mapnik::parameters params;
+        params["block_cache_size"] = mapnik::value_integer(1024 * 1024);
+        params["dataset_pool_size"] = mapnik::value_integer(2);
+        mapnik::datasource_ptr cached_ds = get_gdal_ds(dataset, 1, params);
+        mapnik::datasource_ptr ds = get_gdal_ds(dataset, 1);
+
+        if (!ds)
+        {
+            // GDAL plugin not built.
+            return;
+        }
+
+        auto block_cache_hits = [&cached_ds]() {
+            return *cached_ds->get_descriptor().get_extra_parameters().get<mapnik::value_integer>("block_cache_hits");
+        };
+
+        // overlapping windows at native resolution share blocks
+        std::vector<mapnik::value_integer> hits;
+        for (auto const& bbox : { mapnik::box2d<double>(0, 0, 100, 100),
+                                  mapnik::box2d<double>(50, 50, 150, 150),
+                                  mapnik::box2d<double>(0, 0, 100, 100) })
+        {
+            hits.push_back(block_cache_hits());
+            mapnik::query query(bbox, mapnik::query::resolution_type(1.0, 1.0), 1.0);
+            // both featuresets are open at the same time and read through separate handles
+            auto cached_features = cached_ds->features(query);
+            auto other_features = cached_ds->features(query);
+            auto features = ds->features(query);
+            auto cached_feature = cached_features->next();
+            auto other_feature = other_features->next();
+            auto feature = features->next();
+            REQUIRE(cached_feature != nullptr);
+            REQUIRE(other_feature != nullptr);
+            REQUIRE(feature != nullptr);
+            mapnik::raster_ptr cached_raster = cached_feature->get_raster();
+            mapnik::raster_ptr raster = feature->get_raster();
+            REQUIRE(cached_raster != nullptr);
+            REQUIRE(raster != nullptr);
+            REQUIRE(cached_raster->data_.width() == raster->data_.width());
+            REQUIRE(cached_raster->data_.height() == raster->data_.height());
+            CHECK(std::equal(cached_raster->data_.bytes(),
+                             cached_raster->data_.bytes() + cached_raster->data_.size(),
+                             raster->data_.bytes()));
+            CHECK(std::equal(other_feature->get_raster()->data_.bytes(),
+                             other_feature->get_raster()->data_.bytes() + cached_raster->data_.size(),
+                             raster->data_.bytes()));
+        }
+        hits.push_back(block_cache_hits());
+        // the repeated window is read from the cache
+        CHECK(hits[3] > hits[2]);
+    }
+
+
+#if defined(HAVE_PNG)
+    SECTION("build_overviews")
+    {
+        testing::temp_directory dir;
+        std::string const file = dir.file("overviews.png");
+        std::string const ovr = file + ".ovr";
+        write_gradient(file, 0);
+        mapnik::datasource_ptr ds = get_overviews_ds(file);
+        if (!ds)
+        {
+            // GDAL plugin not built.
+            return;
+        }
+        CHECK(mapnik::util::exists(ovr));
+        CHECK(read_file(ovr + ".src") == source_stamp(file));
+        CHECK(!mapnik::util::exists(ovr + ".lock"));
+
+        // low resolution queries read through the overviews
+        mapnik::query query(ds->envelope(), mapnik::query::resolution_type(0.25, 0.25), 1.0);
+        auto feature = ds->features(query)->next();
+        REQUIRE(feature != nullptr);
+        REQUIRE(feature->get_raster() != nullptr);
+        CHECK(feature->get_raster()->data_.width() == 150);
+        CHECK(feature->get_raster()->data_.height() == 100);
+
+        // opening it again reuses the overviews
+        std::string const built = read_file(ovr);
+        ds = get_overviews_ds(file);
+        CHECK(read_file(ovr) == built);
+    }
+
+    SECTION("overview_resampling")
+    {
+        testing::temp_directory dir;
+        std::string const nearest = dir.file("nearest.png");
+        std::string const average = dir.file("average.png");
+        write_gradient(nearest, 0);
+        write_gradient(average, 0);
+        if (!get_overviews_ds(nearest, "NEAREST"))
+        {
+            // GDAL plugin not built.
+            return;
+        }
+        REQUIRE(get_overviews_ds(average, "AVERAGE"));
+        REQUIRE(mapnik::util::exists(nearest + ".ovr"));
+        REQUIRE(mapnik::util::exists(average + ".ovr"));
+        CHECK(read_file(nearest + ".ovr") != read_file(average + ".ovr"));
+    }
+
+    SECTION("stale overviews")
+    {
+        testing::temp_directory dir;
+        std::string const file = dir.file("stale.png");
+        std::string const ovr = file + ".ovr";
+        write_gradient(file, 0);
+        if (!get_overviews_ds(file))
+        {
+            // GDAL plugin not built.
+            return;
+        }
+        REQUIRE(mapnik::util::exists(ovr));
+        std::string const built = read_file(ovr);
+
+        auto rewrite = [&](unsigned offset) {
+            std::time_t const time = boost::filesystem::last_write_time(file);
+            write_gradient(file, offset);
+            boost::filesystem::last_write_time(file, time + 10);
+        };
+
+        // overviews built here are rebuilt once the dataset changes
+        rewrite(64);
+        REQUIRE(get_overviews_ds(file));
+        REQUIRE(mapnik::util::exists(ovr));
+        CHECK(read_file(ovr + ".src") == source_stamp(file));
+        CHECK(read_file(ovr) != built);
+
+        // others are left alone
+        std::string const foreign = read_file(ovr);
+        mapnik::util::remove(ovr + ".src");
+        rewrite(128);
+        REQUIRE(get_overviews_ds(file));
+        CHECK(read_file(ovr) == foreign);
+        CHECK(!mapnik::util::exists(ovr + ".src"));
+    }
+
+    SECTION("overviews locked by another process")
+    {
+        testing::temp_directory dir;
+        std::string const file = dir.file("locked.png");
+        std::string const lock = file + ".ovr.lock";
+        write_gradient(file, 0);
+        std::ofstream(lock.c_str()).close();
+        if (!get_overviews_ds(file))
+        {
+            // GDAL plugin not built.
+            return;
+        }
+        // the dataset is read without overviews, the lock stays with its owner
+        CHECK(!mapnik::util::exists(file + ".ovr"));
+        CHECK(mapnik::util::exists(lock));
+    }
+#endif
 } // END TEST CASE
@@ -28,6 +28,7 @@
 #include <mapnik/datasource_cache.hpp>
 #include <mapnik/geometry.hpp>
 #include <mapnik/geometry/geometry_type.hpp>
+#include <mapnik/geometry/envelope.hpp>
 #include <mapnik/util/fs.hpp>
 #include <cstdlib>
 #include <algorithm>
@@ -250,5 +251,56 @@ TEST_CASE("Geobuf") {
             REQUIRE(line[1].y == 1);
             CHECK(fs->next() == nullptr);
         }
+
+        SECTION("cache_features=false and disk index")
+        {
+            for (std::string filename : {"./test/data/geobuf/point.geobuf",
+                                         "./test/data/geobuf/multipolygon.geobuf",
+                                         "./test/data/geobuf/geometrycollection.geobuf"})
+            {
+                mapnik::parameters params;
+                params["type"] = "geobuf";
+                params["file"] = filename;
+                auto expected_ds = mapnik::datasource_cache::instance().create(params);
+                auto expected = all_features(expected_ds)->next();
+                REQUIRE(expected != nullptr);
+                for (auto create_index : { true, false })
+                {
+                    if (create_index)
+                    {
+                        int ret = create_disk_index(filename);
+                        int ret_posix = (ret >> 8) & 0x000000ff;
+                        INFO(ret);
+                        INFO(ret_posix);
+                        CHECK(mapnik::util::exists(filename + ".index"));
+                    }
+                    for (auto cache_features : {true, false})
+                    {
+                        params["cache_features"] = cache_features;
+                        auto ds = mapnik::datasource_cache::instance().create(params);
+                        CHECK(ds->envelope() == expected_ds->envelope());
+                        CHECK(ds->get_descriptor().get_descriptors().size() ==
+                              expected_ds->get_descriptor().get_descriptors().size());
+                        auto fs = all_features(ds);
+                        auto f = fs->next();
+                        REQUIRE(f != nullptr);
+                        CHECK(mapnik::geometry::geometry_type(f->get_geometry()) ==
+                              mapnik::geometry::geometry_type(expected->get_geometry()));
+                        CHECK(mapnik::geometry::envelope(f->get_geometry()) ==
+                              mapnik::geometry::envelope(expected->get_geometry()));
+                        for (auto const& kv : *expected)
+                        {
+                            CHECK(f->get(std::get<0>(kv)) == std::get<1>(kv));
+                        }
+                        CHECK(fs->next() == nullptr);
+                    }
+                    // cleanup
+                    if (create_index && mapnik::util::exists(filename + ".index"))
+                    {
+                        mapnik::util::remove(filename + ".index");
+                    }
+                }
+            }
+        }
     }
 }
@@ -67,6 +67,25 @@ std::pair<mapnik::datasource_ptr,mapnik::feature_ptr> fetch_first_feature(std::s
     return std::make_pair(ds,feature);
 }
 
+// enough features for several load_threads chunks of 1024
+std::string many_features_geojson(std::size_t count)
+{
+    std::string json = "{\"type\":\"FeatureCollection\",\"features\":[";
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::string const x = std::to_string(static_cast<double>(i % 360) - 180);
+        std::string const y = std::to_string(static_cast<double>(i % 180) - 90);
+        if (i > 0) json += ",";
+        json += "{\"type\":\"Feature\",\"geometry\":";
+        if (i % 2 == 0) json += "{\"type\":\"Point\",\"coordinates\":[" + x + "," + y + "]}";
+        else json += "{\"type\":\"LineString\",\"coordinates\":[[" + x + "," + y + "],[0,0]]}";
+        json += ",\"properties\":{\"id\":" + std::to_string(i) + ",\"name\":\"feature " + std::to_string(i) + "\"";
+        if (i % 3 == 0) json += ",\"flag\":true";
+        json += "}}";
+    }
+    return json + "]}";
+}
+
 }
 
 TEST_CASE("geojson") {
@@ -100,6 +119,42 @@ TEST_CASE("geojson") {
             }
         }
 
+        SECTION("GeoJSON load_threads")
+        {
+            require_same_features_for_load_threads("geojson", many_features_geojson(5000));
+        }
+
+        SECTION("GeoJSON load_threads with property names varying by chunk")
+        {
+            // the first and the last features have property names of their own
+            std::string json = "{\"type\":\"FeatureCollection\",\"features\":[";
+            for (std::size_t i = 0; i < 3000; ++i)
+            {
+                if (i > 0) json += ",";
+                json += "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[" +
+                    std::to_string(i % 100) + ",0]},\"properties\":{\"" + (i < 1500 ? "early" : "late") +
+                    "\":" + std::to_string(i) + "}}";
+            }
+            json += "]}";
+            require_same_features_for_load_threads("geojson", json);
+
+            mapnik::parameters params;
+            params["type"] = "geojson";
+            params["inline"] = json;
+            params["load_threads"] = mapnik::value_integer(4);
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(bool(ds));
+            auto features = all_features(ds);
+            std::size_t count = 0;
+            while (auto feature = features->next())
+            {
+                CHECK(feature->has_key("early"));
+                CHECK(feature->has_key("late"));
+                ++count;
+            }
+            CHECK(count == 3000);
+        }
+
         SECTION("GeoJSON an empty FeatureCollection")
         {
             for (auto cache_features : {true, false})
@@ -27,6 +27,8 @@
 #include <mapnik/datasource.hpp>
 #include <mapnik/memory_datasource.hpp>
 #include <mapnik/datasource_cache.hpp>
+#include <mapnik/feature_factory.hpp>
+#include <mapnik/geometry.hpp>
 
 
 TEST_CASE("memory datasource") {
@@ -43,4 +45,47 @@ TEST_CASE("memory datasource") {
             CHECK(false); // shouldn't get here
         }
     }
+
+    SECTION("bbox queries")
+    {
+        mapnik::parameters params;
+        auto ds = std::make_shared<mapnik::memory_datasource>(params);
+        mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+        auto push_point = [&](mapnik::value_integer id, double x, double y) {
+            mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, id));
+            feature->set_geometry(mapnik::geometry::point<double>(x, y));
+            ds->push(feature);
+        };
+        for (int i = 0; i < 100; ++i)
+        {
+            push_point(i + 1, i, i);
+        }
+        CHECK(ds->envelope() == mapnik::box2d<double>(0, 0, 99, 99));
+        auto fs = ds->features(mapnik::query(mapnik::box2d<double>(9.5, 9.5, 20, 20)));
+        mapnik::value_integer expected = 11;
+        while (auto f = fs->next())
+        {
+            CHECK(f->id() == expected++);
+        }
+        CHECK(expected == 22);
+        // features pushed after the index has been built are found as well
+        push_point(101, 15, 15);
+        push_point(102, 200, 200);
+        CHECK(ds->envelope() == mapnik::box2d<double>(0, 0, 200, 200));
+        fs = ds->features(mapnik::query(mapnik::box2d<double>(14, 14, 16, 16)));
+        std::vector<mapnik::value_integer> ids;
+        while (auto f = fs->next())
+        {
+            ids.push_back(f->id());
+        }
+        CHECK(ids == std::vector<mapnik::value_integer>({15, 16, 17, 101}));
+        fs = ds->features_at_point(mapnik::coord2d(200, 200), 0.5);
+        auto f = fs->next();
+        REQUIRE(f != nullptr);
+        CHECK(f->id() == 102);
+        CHECK(fs->next() == nullptr);
+        ds->clear();
+        CHECK(ds->size() == 0);
+        CHECK(!mapnik::is_valid(all_features(ds)));
+    }
 }
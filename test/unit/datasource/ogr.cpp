@@ -29,6 +29,54 @@
 #include <mapnik/image_reader.hpp>
 #include <mapnik/image_util.hpp>
 #include <mapnik/util/fs.hpp>
+#include <mapnik/datasource.hpp>
+#include <mapnik/datasource_cache.hpp>
+#include <mapnik/unicode.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// features i = 0..count-1 at (i, i) with name "n<i>", value i * 1.5 and count i
+std::string numbered_points_geojson(int count)
+{
+    std::string json = "{\"type\":\"FeatureCollection\",\"features\":[";
+    for (int i = 0; i < count; ++i)
+    {
+        if (i > 0) json += ",";
+        json += "{\"type\":\"Feature\",\"geometry\":{\"type\":\"Point\",\"coordinates\":[" +
+                std::to_string(i) + "," + std::to_string(i) + "]},\"properties\":{\"name\":\"n" +
+                std::to_string(i) + "\",\"value\":" + std::to_string(i * 1.5) + ",\"count\":" + std::to_string(i) + "}}";
+    }
+    return json + "]}";
+}
+
+// every feature carries exactly the requested attributes, with their values
+void check_attributes(mapnik::datasource_ptr ds, std::vector<std::string> const& names, int count)
+{
+    mapnik::query q(ds->envelope());
+    for (auto const& name : names) q.add_property_name(name);
+    auto features = ds->features(q);
+    REQUIRE(bool(features));
+    mapnik::transcoder tr("utf8");
+    int i = 0;
+    while (mapnik::feature_ptr feature = features->next())
+    {
+        CHECK(feature->context()->size() == names.size());
+        for (auto const& name : names)
+        {
+            REQUIRE(feature->has_key(name));
+            if (name == "name") CHECK(feature->get(name) == tr.transcode(("n" + std::to_string(i)).c_str()));
+            else if (name == "value") CHECK(feature->get(name) == mapnik::value_double(i * 1.5));
+            else if (name == "count") CHECK(feature->get(name) == mapnik::value_integer(i));
+        }
+        ++i;
+    }
+    CHECK(i == count);
+}
+
+}
 
 TEST_CASE("ogr") {
 
@@ -55,5 +103,25 @@ TEST_CASE("ogr") {
             REQUIRE(mapnik::compare(expected, im) == 0);
         }
 
+        SECTION("ogr queries with different attributes on one datasource")
+        {
+            for (bool arrow_stream : {true, false})
+            {
+                mapnik::parameters params;
+                params["type"] = "ogr";
+                params["inline"] = numbered_points_geojson(20);
+                params["layer_by_index"] = mapnik::value_integer(0);
+                params["arrow_stream"] = mapnik::value_bool(arrow_stream);
+                auto ds = mapnik::datasource_cache::instance().create(params);
+                REQUIRE(bool(ds));
+                // ignored fields set for one query must not leak into the next
+                check_attributes(ds, {"name"}, 20);
+                check_attributes(ds, {"name", "value", "count"}, 20);
+                check_attributes(ds, {"value"}, 20);
+                check_attributes(ds, {}, 20);
+                check_attributes(ds, {"count", "name"}, 20);
+            }
+        }
+
     }
 }
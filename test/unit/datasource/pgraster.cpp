@@ -0,0 +1,281 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#include "catch.hpp"
+
+#include <mapnik/image.hpp>
+#include <mapnik/raster.hpp>
+#include "../../../plugins/input/pgraster/pgraster_band_convert.hpp"
+#include "../../../plugins/input/pgraster/pgraster_tile_cache.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+mapnik::raster_ptr make_tile()
+{
+    mapnik::box2d<double> ext(0, 0, 10, 10);
+    return std::make_shared<mapnik::raster>(ext, ext, mapnik::image_gray8(10, 10), 1.0);
+}
+
+// Lengths around the 4, 8 and 16 lane widths of the vector kernels
+constexpr std::size_t max_pixels = 67;
+
+// Serializes `values` as a WKB band payload of the given endianness
+template <typename T>
+std::vector<uint8_t> to_band(std::vector<T> const& values, bool little_endian)
+{
+    std::vector<uint8_t> band(values.size() * sizeof(T));
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+        uint8_t* p = band.data() + i * sizeof(T);
+        std::memcpy(p, &values[i], sizeof(T));
+        if (!little_endian) std::reverse(p, p + sizeof(T));
+    }
+    return band;
+}
+
+template <typename T, typename Kernel>
+void check_convert(Kernel kernel, std::vector<T> const& values, bool little_endian)
+{
+    std::vector<uint8_t> band = to_band(values, little_endian);
+    for (std::size_t count = 0; count <= values.size(); ++count)
+    {
+        std::vector<float> expected(count);
+        std::vector<float> actual(count);
+        pgraster_band::convert_scalar<T>(band.data(), count, little_endian, expected.data());
+        kernel(band.data(), count, little_endian, actual.data());
+        INFO("count " << count << (little_endian ? " NDR" : " XDR"));
+        CHECK(actual == expected);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            REQUIRE(expected[i] == static_cast<float>(values[i]));
+        }
+    }
+}
+
+// Checks that a vector kernel converts a prefix that is a multiple of
+// its `lanes` exactly like the scalar code
+template <typename T, typename Kernel>
+void check_prefix(Kernel kernel, std::size_t lanes, std::vector<T> const& values, bool little_endian)
+{
+    std::vector<uint8_t> band = to_band(values, little_endian);
+    for (std::size_t count = 0; count <= values.size(); ++count)
+    {
+        std::vector<float> expected(count);
+        std::vector<float> actual(count, -1.0f);
+        pgraster_band::convert_scalar<T>(band.data(), count, little_endian, expected.data());
+        std::size_t done = kernel(band.data(), count, little_endian, actual.data());
+        INFO("count " << count << (little_endian ? " NDR" : " XDR"));
+        REQUIRE(done == count - count % lanes);
+        CHECK(std::equal(actual.begin(), actual.begin() + done, expected.begin()));
+        CHECK(std::all_of(actual.begin() + done, actual.end(), [](float v) { return v == -1.0f; }));
+    }
+}
+
+template <typename T>
+std::vector<T> random_integers(std::mt19937 & gen)
+{
+    std::uniform_int_distribution<uint32_t> dist(0, static_cast<uint32_t>(std::numeric_limits<T>::max()));
+    std::vector<T> values(max_pixels);
+    for (auto & v : values) v = static_cast<T>(dist(gen));
+    return values;
+}
+
+template <typename T>
+std::vector<T> random_reals(std::mt19937 & gen)
+{
+    std::uniform_real_distribution<T> dist(-1e6, 1e6);
+    std::vector<T> values(max_pixels);
+    for (auto & v : values) v = dist(gen);
+    return values;
+}
+
+}
+
+TEST_CASE("pgraster") {
+
+    SECTION("band conversion kernels match the scalar code")
+    {
+        std::mt19937 gen(42);
+        auto u8 = random_integers<uint8_t>(gen);
+        auto u16 = random_integers<uint16_t>(gen);
+        auto u32 = random_integers<uint32_t>(gen);
+        auto f32 = random_reals<float>(gen);
+        auto f64 = random_reals<double>(gen);
+
+        for (bool little_endian : { true, false })
+        {
+            check_convert(
+                [](uint8_t const* src, std::size_t count, bool, float* dst) { pgraster_band::convert_u8(src, count, dst); },
+                u8, little_endian);
+            check_convert(pgraster_band::convert_16, u16, little_endian);
+            check_convert(pgraster_band::convert_scalar<uint32_t>, u32, little_endian);
+            check_convert(pgraster_band::convert_f32, f32, little_endian);
+            check_convert(pgraster_band::convert_f64, f64, little_endian);
+        }
+
+#ifdef SSE_MATH
+        for (bool little_endian : { true, false })
+        {
+            check_prefix(
+                [](uint8_t const* src, std::size_t count, bool, float* dst) { return pgraster_band::convert_u8_sse2(src, count, dst); },
+                16, u8, little_endian);
+            check_prefix(pgraster_band::convert_16_sse2, 8, u16, little_endian);
+        }
+        check_prefix(
+            [](uint8_t const* src, std::size_t count, bool, float* dst) { return pgraster_band::convert_f32_swap_sse2(src, count, dst); },
+            4, f32, false);
+        check_prefix(
+            [](uint8_t const* src, std::size_t count, bool, float* dst) { return pgraster_band::convert_f64_sse2(src, count, dst); },
+            4, f64, true);
+#endif
+#ifdef PGRASTER_AVX2
+        if (pgraster_band::has_avx2())
+        {
+            for (bool little_endian : { true, false })
+            {
+                check_prefix(
+                    [](uint8_t const* src, std::size_t count, bool, float* dst) { return pgraster_band::convert_u8_avx2(src, count, dst); },
+                    8, u8, little_endian);
+                check_prefix(pgraster_band::convert_16_avx2, 8, u16, little_endian);
+            }
+        }
+#endif
+    }
+
+    SECTION("grayscale and rgba kernels match the scalar code")
+    {
+        std::mt19937 gen(7);
+        auto u16 = random_integers<uint16_t>(gen);
+        // make sure both sides of the clamp are hit
+        for (std::size_t i = 0; i < u16.size(); i += 3) u16[i] %= 256;
+        auto red = random_integers<uint8_t>(gen);
+        auto green = random_integers<uint8_t>(gen);
+        auto blue = random_integers<uint8_t>(gen);
+        auto alpha = random_integers<uint8_t>(gen);
+        int const nodata = red[5];
+
+        for (std::size_t count = 0; count <= max_pixels; ++count)
+        {
+            INFO("count " << count);
+            for (bool little_endian : { true, false })
+            {
+                std::vector<uint8_t> band = to_band(u16, little_endian);
+                std::vector<uint8_t> gray(count);
+                pgraster_band::clamp_16_to_gray(band.data(), count, little_endian, gray.data());
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    REQUIRE(gray[i] == std::min<uint16_t>(u16[i], 255));
+                }
+            }
+
+            for (bool hasnodata : { true, false })
+            {
+                std::vector<uint8_t> rgba(count * 4);
+                pgraster_band::expand_grayscale(red.data(), count, hasnodata, nodata, rgba.data());
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    uint8_t v = red[i];
+                    REQUIRE(rgba[i * 4] == v);
+                    REQUIRE(rgba[i * 4 + 1] == v);
+                    REQUIRE(rgba[i * 4 + 2] == v);
+                    REQUIRE(rgba[i * 4 + 3] == ((hasnodata && v == nodata) ? 0 : 255));
+                }
+            }
+
+            for (bool has_alpha : { true, false })
+            {
+                uint8_t const* planes[4] = { red.data(), green.data(), blue.data(),
+                                             has_alpha ? alpha.data() : nullptr };
+                // readers start from opaque pixels
+                std::vector<uint8_t> rgba(count * 4, 0xff);
+                pgraster_band::interleave_rgba(planes, count, rgba.data());
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    REQUIRE(rgba[i * 4] == red[i]);
+                    REQUIRE(rgba[i * 4 + 1] == green[i]);
+                    REQUIRE(rgba[i * 4 + 2] == blue[i]);
+                    REQUIRE(rgba[i * 4 + 3] == (has_alpha ? alpha[i] : 255));
+                }
+            }
+        }
+    }
+
+    SECTION("tile cache")
+    {
+        pgraster_tile_cache & cache = pgraster_tile_cache::instance();
+        std::size_t const max_bytes = cache.max_bytes();
+        cache.clear();
+        cache.set_max_bytes(300); // three 10x10 gray8 tiles
+        auto tile1 = make_tile();
+        cache.insert("a|", 1, tile1);
+        cache.insert("a|", 2, make_tile());
+        cache.insert("b|", 1, make_tile());
+        mapnik::util::lru_cache_stats stats = cache.stats();
+        CHECK(stats.entries == 3);
+        CHECK(stats.bytes == 300);
+
+        CHECK(cache.find("a|", 1) == tile1);
+        CHECK(cache.find("a|", 9) == nullptr);
+        CHECK(cache.stats().hits == stats.hits + 1);
+        CHECK(cache.stats().misses == stats.misses + 1);
+
+        // tiles of one layer by row key
+        auto tiles = cache.find_layer("a|", 10);
+        CHECK(tiles.size() == 2);
+        CHECK(tiles.count(1) == 1);
+        CHECK(tiles.count(2) == 1);
+        CHECK(tiles[1] == tile1);
+        CHECK(cache.find_layer("a|", 1).size() == 1);
+        CHECK(cache.find_layer("c|", 10).empty());
+
+        // row 2 of "a|" is the least recently used tile, and leaves the
+        // layer when it is evicted
+        cache.insert("a|", 4, make_tile());
+        CHECK(cache.stats().entries == 3);
+        CHECK(cache.find("a|", 2) == nullptr);
+        tiles = cache.find_layer("a|", 10);
+        CHECK(tiles.size() == 2);
+        CHECK(tiles.count(2) == 0);
+        CHECK(tiles.count(4) == 1);
+
+        // tiles larger than the whole cache are not kept
+        cache.insert("a|", 5, std::make_shared<mapnik::raster>(mapnik::box2d<double>(0, 0, 1, 1), mapnik::box2d<double>(0, 0, 1, 1),
+                                                               mapnik::image_gray8(20, 20), 1.0));
+        CHECK(cache.find("a|", 5) == nullptr);
+        CHECK(cache.find_layer("a|", 10).count(5) == 0);
+        CHECK(cache.stats().entries == 3);
+
+        cache.clear();
+        CHECK(cache.stats().entries == 0);
+        CHECK(cache.find_layer("a|", 10).empty());
+        CHECK(cache.find_layer("b|", 10).empty());
+        cache.set_max_bytes(max_bytes);
+    }
+}
@@ -36,6 +36,8 @@
 
 #include <boost/optional/optional_io.hpp>
 
+#include <chrono>
+
 namespace {
 
 bool run(std::string const& command, bool okay_to_fail = false)
@@ -274,6 +276,115 @@ TEST_CASE("postgis") {
             require_geometry(featureset->next(), 3, mapnik::geometry::geometry_types::GeometryCollection);
         }
 
+        SECTION("Postgis cursorresultset survives losing the connection")
+        {
+            mapnik::parameters params(base_params);
+            // the backend terminates itself while the third batch is fetched
+            params["table"] = "(SELECT * FROM test WHERE CASE WHEN gid > 4 "
+                              "THEN pg_terminate_backend(pg_backend_pid()) ELSE true END) as data";
+            params["extent"] = "-2,-2,5,4";
+            params["cursor_size"] = "2";
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            {
+                auto featureset = all_features(ds);
+                CHECK_THROWS(count_features(featureset));
+                // destroying the result set must not touch the closed connection
+            }
+            // the pool replaces the dead connection
+            params["table"] = "test";
+            params.erase("extent");
+            ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            CHECK(count_features(all_features(ds)) == 8);
+        }
+
+        SECTION("Postgis should throw with invalid 'geometry_mode'")
+        {
+            mapnik::parameters params(base_params);
+            params["table"] = "test";
+            params["geometry_mode"] = "not_a_mode";
+            CHECK_THROWS(mapnik::datasource_cache::instance().create(params));
+        }
+
+        SECTION("Postgis geometry_mode=tile")
+        {
+            mapnik::parameters params(base_params);
+            params["table"] = "(SELECT * FROM test) as data";
+            params["geometry_mode"] = "tile";
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            auto featureset = all_features(ds);
+            CHECK(count_features(featureset) == 8);
+
+            featureset = all_features(ds);
+            auto feature = featureset->next();
+            REQUIRE(feature != nullptr);
+            require_geometry(feature, 1, mapnik::geometry::geometry_types::Point);
+            auto const& pt = mapnik::util::get<mapnik::geometry::point<double>>(feature->get_geometry());
+            mapnik::box2d<double> ext = ds->envelope();
+            CHECK(ext.contains(pt.x, pt.y));
+        }
+
+        SECTION("Postgis should throw when the query deadline has passed")
+        {
+            mapnik::parameters params(base_params);
+            params["table"] = "test";
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            mapnik::query q(ds->envelope());
+            q.set_cancellation(mapnik::cancellation_token::create(std::chrono::milliseconds(-1)));
+            CHECK_THROWS(ds->features(q));
+        }
+
+        SECTION("Postgis cancels a query running past its deadline")
+        {
+            mapnik::parameters params(base_params);
+            params["table"] = "(SELECT * FROM test WHERE pg_sleep(5) IS NOT NULL) as data";
+            params["extent"] = "-2,-2,5,4";
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            mapnik::query q(ds->envelope());
+            q.set_cancellation(mapnik::cancellation_token::create(std::chrono::milliseconds(200)));
+            auto start = std::chrono::steady_clock::now();
+            CHECK_THROWS(count_features(ds->features(q)));
+            CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+            // the pooled connection is usable again afterwards
+            params["table"] = "test";
+            params.erase("extent");
+            ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            CHECK(count_features(all_features(ds)) == 8);
+        }
+
+        SECTION("Postgis sends deadlines as a coarse statement_timeout")
+        {
+            mapnik::parameters params(base_params);
+            params["table"] = "(SELECT *, current_setting('statement_timeout') AS timeout FROM test) as data";
+            params["extent"] = "-2,-2,5,4";
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            auto session_timeout = [&ds](mapnik::cancellation_token const& token) {
+                mapnik::query q(ds->envelope());
+                q.add_property_name("timeout");
+                q.set_cancellation(token);
+                auto featureset = ds->features(q);
+                REQUIRE(featureset != nullptr);
+                auto feature = featureset->next();
+                REQUIRE(feature != nullptr);
+                return feature->get("timeout").to_string();
+            };
+            // rounded up to a power of two seconds, kept while it fits
+            CHECK(session_timeout(mapnik::cancellation_token::create(std::chrono::seconds(10))) == "16s");
+            CHECK(session_timeout(mapnik::cancellation_token::create(std::chrono::seconds(9))) == "16s");
+            CHECK(session_timeout(mapnik::cancellation_token::create(std::chrono::seconds(20))) == "32s");
+            CHECK(session_timeout(mapnik::cancellation_token::create(std::chrono::seconds(3))) == "4s");
+            // reset by the next query without a deadline
+            CHECK(session_timeout(mapnik::cancellation_token()) == "0");
+            CHECK(session_timeout(mapnik::cancellation_token::create(std::chrono::seconds(1))) == "1s");
+            CHECK(session_timeout(mapnik::cancellation_token::create()) == "0");
+        }
+
         SECTION("Postgis bbox query")
         {
             mapnik::parameters params(base_params);
@@ -0,0 +1,228 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#include "catch.hpp"
+#include "temp_directory.hpp"
+#if defined(HAVE_TIFF)
+#include "unit/imaging/tiff_overviews.hpp"
+#endif
+
+#include <mapnik/color.hpp>
+#include <mapnik/datasource.hpp>
+#include <mapnik/datasource_cache.hpp>
+#include <mapnik/image.hpp>
+#include <mapnik/image_util.hpp>
+#include <mapnik/raster.hpp>
+#include <mapnik/util/fs.hpp>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <ctime>
+
+TEST_CASE("raster") {
+
+    std::string raster_plugin("./plugins/input/raster.input");
+    if (mapnik::util::exists(raster_plugin))
+    {
+#if defined(HAVE_PNG)
+        SECTION("pyramid")
+        {
+            testing::temp_directory dir;
+            std::string const file = dir.file("raster_pyramid.png");
+            std::string const pyramid_file = file + ".mip";
+            mapnik::image_rgba8 image(1000, 600);
+            mapnik::fill(image, mapnik::color(10, 20, 30, 255));
+            mapnik::save_to_file(image, file, "png");
+
+            mapnik::parameters params;
+            params["type"] = "raster";
+            params["file"] = file;
+            params["extent"] = "0,0,1000,600";
+            params["pyramid"] = true;
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            // built on first access
+            CHECK(mapnik::util::exists(pyramid_file));
+            // and renamed into place, no temporary files are left behind
+            CHECK(mapnik::util::list_directory(dir.path()).size() == 2);
+
+            auto read = [&](double resolution, mapnik::color const& color) {
+                mapnik::query q(ds->envelope(), mapnik::query::resolution_type(resolution, resolution), 1.0);
+                auto feature = ds->features(q)->next();
+                REQUIRE(feature != nullptr);
+                mapnik::raster_ptr raster = feature->get_raster();
+                REQUIRE(raster != nullptr);
+                CHECK(raster->ext_ == ds->envelope());
+                CHECK(mapnik::get_pixel<mapnik::color>(raster->data_, 0, 0) == color);
+                return raster->data_.width();
+            };
+            // full resolution from the image, lower ones from the closest level
+            mapnik::color const first(10, 20, 30, 255);
+            CHECK(read(1.0, first) == 1000);
+            CHECK(read(0.5, first) == 500);
+            CHECK(read(0.3, first) == 500);
+            CHECK(read(0.25, first) == 250);
+            CHECK(read(0.01, first) == 250);
+
+            // the same dimensions and, being a flat fill, the same size; only
+            // the modification time tells the new image apart
+            mapnik::color const second(40, 50, 60, 255);
+            std::time_t const time = boost::filesystem::last_write_time(file);
+            mapnik::fill(image, second);
+            mapnik::save_to_file(image, file, "png");
+            boost::filesystem::last_write_time(file, time + 10);
+            ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(ds != nullptr);
+            CHECK(read(1.0, second) == 1000);
+            CHECK(read(0.5, second) == 500);
+            CHECK(read(0.25, second) == 250);
+            CHECK(mapnik::util::list_directory(dir.path()).size() == 2);
+        }
+
+        SECTION("max_mosaic_pixels")
+        {
+            testing::temp_directory dir;
+            std::string const file = dir.file("raster_tiles.png");
+            // every pixel differs from its neighbours, so misplaced tiles show
+            mapnik::image_rgba8 image(1000, 600);
+            for (unsigned y = 0; y < image.height(); ++y)
+            {
+                for (unsigned x = 0; x < image.width(); ++x)
+                {
+                    mapnik::set_pixel(image, x, y, mapnik::color(x % 256, y % 256, (x / 256) * 64 + y / 256, 255));
+                }
+            }
+            mapnik::save_to_file(image, file, "png");
+
+            mapnik::parameters params;
+            params["type"] = "raster";
+            params["file"] = file;
+            params["extent"] = "0,0,1000,600";
+
+            // pixels of `raster` not matching the source image at its position
+            auto mismatches = [&](mapnik::raster const& raster) {
+                int const x0 = static_cast<int>(raster.ext_.minx() + 0.5);
+                int const y0 = static_cast<int>(600 - raster.ext_.maxy() + 0.5);
+                std::size_t count = 0;
+                for (unsigned y = 0; y < raster.data_.height(); ++y)
+                {
+                    for (unsigned x = 0; x < raster.data_.width(); ++x)
+                    {
+                        if (!(mapnik::get_pixel<mapnik::color>(raster.data_, x, y) ==
+                              mapnik::get_pixel<mapnik::color>(image, x0 + x, y0 + y))) ++count;
+                    }
+                }
+                return count;
+            };
+            auto read = [&](std::size_t & pixels, std::size_t & wrong) {
+                auto ds = mapnik::datasource_cache::instance().create(params);
+                REQUIRE(ds != nullptr);
+                mapnik::query q(ds->envelope());
+                auto fs = ds->features(q);
+                std::size_t features = 0;
+                pixels = 0;
+                wrong = 0;
+                for (auto feature = fs->next(); feature; feature = fs->next())
+                {
+                    mapnik::raster_ptr raster = feature->get_raster();
+                    REQUIRE(raster != nullptr);
+                    pixels += raster->data_.width() * raster->data_.height();
+                    wrong += mismatches(*raster);
+                    ++features;
+                }
+                return features;
+            };
+
+            // untiled, the whole image is read at once
+            std::size_t pixels = 0;
+            std::size_t wrong = 0;
+            CHECK(read(pixels, wrong) == 1);
+            CHECK(pixels == 1000 * 600);
+            CHECK(wrong == 0);
+
+            params["tile_size"] = 256;
+            for (mapnik::value_integer threads : {1, 2, 4})
+            {
+                for (mapnik::value_integer readers : {0, 1, 16})
+                {
+                    INFO("decode_threads " << threads << ", reader_cache_size " << readers);
+                    params["decode_threads"] = threads;
+                    params["reader_cache_size"] = readers;
+                    // the tiles are copied into a single mosaic by default
+                    params["max_mosaic_pixels"] = 4096 * 4096;
+                    CHECK(read(pixels, wrong) == 1);
+                    CHECK(pixels == 1000 * 600);
+                    CHECK(wrong == 0);
+                    // and returned one by one when it would be too large
+                    params["max_mosaic_pixels"] = 256 * 256;
+                    CHECK(read(pixels, wrong) == 12);
+                    CHECK(pixels == 1000 * 600);
+                    CHECK(wrong == 0);
+                }
+            }
+        }
+#endif
+
+#if defined(HAVE_TIFF)
+        SECTION("use_overviews")
+        {
+            testing::temp_directory dir;
+            std::string const file = dir.file("raster_overviews.tif");
+            REQUIRE(testing::write_tiff_overviews(file));
+
+            mapnik::parameters params;
+            params["type"] = "raster";
+            params["file"] = file;
+            params["extent"] = "0,0,1000,700";
+
+            // the width of the image read and whether it came from `level`
+            auto read = [&](double resolution, unsigned level) {
+                auto ds = mapnik::datasource_cache::instance().create(params);
+                REQUIRE(ds != nullptr);
+                mapnik::query q(ds->envelope(), mapnik::query::resolution_type(resolution, resolution), 1.0);
+                auto feature = ds->features(q)->next();
+                REQUIRE(feature != nullptr);
+                mapnik::raster_ptr raster = feature->get_raster();
+                REQUIRE(raster != nullptr);
+                CHECK(raster->ext_ == ds->envelope());
+                REQUIRE(raster->data_.is<mapnik::image_gray16>());
+                auto const& image = mapnik::util::get<mapnik::image_gray16>(raster->data_);
+                unsigned const x = image.width() - 1;
+                unsigned const y = image.height() - 1;
+                CHECK(image(0, 0) == testing::tiff_overview_value(level, 0, 0));
+                CHECK(image(x, y) == testing::tiff_overview_value(level, x, y));
+                return image.width();
+            };
+            // the smallest overview still as large as the output
+            CHECK(read(1.0, 0) == 1000);
+            CHECK(read(0.6, 0) == 1000);
+            CHECK(read(0.5, 1) == 500);
+            CHECK(read(0.3, 1) == 500);
+            CHECK(read(0.25, 2) == 250);
+            CHECK(read(0.01, 2) == 250);
+            // or the full image only
+            params["use_overviews"] = false;
+            CHECK(read(0.25, 0) == 1000);
+        }
+#endif
+    }
+}
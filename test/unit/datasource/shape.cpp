@@ -0,0 +1,321 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+
+#include "catch.hpp"
+#include "ds_test_util.hpp"
+#include "temp_directory.hpp"
+
+#include <mapnik/datasource.hpp>
+#include <mapnik/datasource_cache.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/mapped_memory_cache.hpp>
+#include <mapnik/util/fs.hpp>
+#include "../../../plugins/input/shape/shapefile.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Builds records byte by byte, so the expected layout doesn't depend on
+// the byte order of the host
+struct record_writer
+{
+    std::vector<char> bytes;
+
+    void integer(std::int32_t val)
+    {
+        std::uint32_t u = static_cast<std::uint32_t>(val);
+        for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<char>((u >> (8 * i)) & 0xff));
+    }
+
+    void real(double val)
+    {
+        std::uint64_t u;
+        std::memcpy(&u, &val, 8);
+        for (int i = 0; i < 8; ++i) bytes.push_back(static_cast<char>((u >> (8 * i)) & 0xff));
+    }
+};
+
+std::size_t count_points(std::string const& filename, mapnik::box2d<double> const& box, bool populate = false)
+{
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapnik::mapped_memory_cache::instance().clear();
+#endif
+    mapnik::parameters params;
+    params["type"] = "shape";
+    params["file"] = filename;
+    params["populate"] = mapnik::boolean_type(populate);
+    auto ds = mapnik::datasource_cache::instance().create(params);
+    REQUIRE(ds != nullptr);
+    mapnik::query q(box);
+    q.add_property_name("id");
+    auto features = ds->features(q);
+    REQUIRE(features != nullptr);
+    std::size_t count = 0;
+    while (features->next()) ++count;
+    return count;
+}
+
+// a zigzag of one unit amplitude
+std::vector<std::pair<double, double>> make_line(std::size_t size)
+{
+    std::vector<std::pair<double, double>> line;
+    for (std::size_t i = 0; i < size; ++i) line.emplace_back(static_cast<double>(i), static_cast<double>(i % 2));
+    return line;
+}
+
+mapnik::datasource_ptr make_cached_ds(std::string const& base)
+{
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapnik::mapped_memory_cache::instance().clear();
+#endif
+    mapnik::parameters params;
+    params["type"] = "shape";
+    params["file"] = base + ".shp";
+    params["geometry_cache"] = mapnik::boolean_type(true);
+    auto ds = mapnik::datasource_cache::instance().create(params);
+    REQUIRE(ds != nullptr);
+    return ds;
+}
+
+struct cache_counters
+{
+    mapnik::value_integer hits;
+    mapnik::value_integer misses;
+};
+
+cache_counters counters(mapnik::datasource_ptr const& ds)
+{
+    mapnik::parameters const params = ds->get_descriptor().get_extra_parameters();
+    auto hits = params.get<mapnik::value_integer>("geometry_cache_hits");
+    auto misses = params.get<mapnik::value_integer>("geometry_cache_misses");
+    REQUIRE(hits);
+    REQUIRE(misses);
+    return cache_counters{*hits, *misses};
+}
+
+// the line strings of all features in `box`, at the given query resolution
+std::vector<mapnik::geometry::line_string<double>> read_lines(mapnik::datasource_ptr const& ds,
+                                                              mapnik::box2d<double> const& box,
+                                                              double x_resolution, double y_resolution)
+{
+    mapnik::query q(box, mapnik::query::resolution_type(x_resolution, y_resolution), 1.0);
+    auto features = ds->features(q);
+    REQUIRE(features != nullptr);
+    std::vector<mapnik::geometry::line_string<double>> lines;
+    while (auto feature = features->next())
+    {
+        auto const& geom = feature->get_geometry();
+        REQUIRE(geom.is<mapnik::geometry::line_string<double>>());
+        lines.push_back(geom.get<mapnik::geometry::line_string<double>>());
+    }
+    return lines;
+}
+
+}
+
+TEST_CASE("shape") {
+
+    SECTION("read polyline record")
+    {
+        // shape type, box, num_parts, num_points, parts, points
+        record_writer w;
+        w.integer(3);
+        for (double v : { -1.5, 0.0, 3.25, 7.0 }) w.real(v);
+        w.integer(2);
+        w.integer(5);
+        w.integer(0);
+        w.integer(2);
+        double const coords[] = { -1.5, 0.0, 0.5, 1.0, 1.0, 2.0, 3.25, 7.0, 2.0, 6.5 };
+        for (double v : coords) w.real(v);
+
+        shape_record record(w.bytes.size());
+        record.set_data(w.bytes.data());
+        CHECK(record.read_ndr_integer() == 3);
+        record.skip(32);
+        CHECK(record.read_ndr_integer() == 2);
+        CHECK(record.read_ndr_integer() == 5);
+        std::size_t parts_pos = record.pos;
+        record.skip(8);
+        CHECK(record.ndr_integer_at(parts_pos + 4) == 2);
+
+        mapnik::geometry::line_string<double> first;
+        record.read_points(first, 2);
+        REQUIRE(first.size() == 2);
+        CHECK(first[0].x == -1.5);
+        CHECK(first[0].y == 0.0);
+        CHECK(first[1].x == 0.5);
+        CHECK(first[1].y == 1.0);
+
+        mapnik::geometry::line_string<double> second;
+        record.read_points(second, 3);
+        REQUIRE(second.size() == 3);
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            CHECK(second[i].x == coords[4 + 2 * i]);
+            CHECK(second[i].y == coords[5 + 2 * i]);
+        }
+        CHECK(record.remains() == 0);
+    }
+
+    SECTION("read multipoint record")
+    {
+        record_writer w;
+        w.integer(8);
+        for (double v : { 10.0, -20.0, 30.0, 40.0 }) w.real(v);
+        w.integer(3);
+        double const coords[] = { 10.0, 40.0, 30.0, -20.0, 12.125, 0.1 };
+        for (double v : coords) w.real(v);
+
+        shape_record record(w.bytes.size());
+        record.set_data(w.bytes.data());
+        record.skip(4 + 32);
+        int num_points = record.read_ndr_integer();
+        CHECK(num_points == 3);
+        mapnik::geometry::multi_point<double> points;
+        record.read_points(points, num_points);
+        REQUIRE(points.size() == 3);
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            CHECK(points[i].x == coords[2 * i]);
+            CHECK(points[i].y == coords[2 * i + 1]);
+        }
+
+        // counts past the end of the record are truncated
+        record.set_pos(4 + 32 + 4 + 16);
+        record.read_points(points, 10);
+        REQUIRE(points.size() == 2);
+        CHECK(points[1].x == 12.125);
+        CHECK(record.remains() == 0);
+        record.read_points(points, -1);
+        CHECK(points.empty());
+    }
+}
+
+TEST_CASE("shape datasource") {
+
+    std::string shape_plugin("./plugins/input/shape.input");
+    if (mapnik::util::exists(shape_plugin))
+    {
+        SECTION("in-memory index is rebuilt when the shapefile changes")
+        {
+            testing::temp_directory dir;
+            std::string const base = dir.file("points");
+            mapnik::box2d<double> const all(-10, -10, 10, 10);
+            write_point_shapefile(base, { {0, 0}, {1, 1} }, 0, 0, 1, 1);
+            // the first query indexes the file in memory, the second uses it
+            CHECK(count_points(base + ".shp", all) == 2);
+            CHECK(count_points(base + ".shp", all) == 2);
+            CHECK(count_points(base + ".shp", mapnik::box2d<double>(0.5, 0.5, 2, 2)) == 1);
+
+            write_point_shapefile(base, { {0, 0}, {1, 1}, {2, 2} }, 0, 0, 2, 2);
+            CHECK(count_points(base + ".shp", all) == 3);
+            CHECK(count_points(base + ".shp", mapnik::box2d<double>(0.5, 0.5, 2, 2)) == 2);
+
+            write_point_shapefile(base, { {5, 5} }, 5, 5, 5, 5);
+            CHECK(count_points(base + ".shp", all) == 1);
+            CHECK(count_points(base + ".shp", mapnik::box2d<double>(0.5, 0.5, 2, 2)) == 0);
+        }
+
+        SECTION("populated files read the same")
+        {
+            testing::temp_directory dir;
+            std::string const base = dir.file("points");
+            write_point_shapefile(base, { {0, 0}, {1, 1}, {2, 2} }, 0, 0, 2, 2);
+            CHECK(count_points(base + ".shp", mapnik::box2d<double>(-10, -10, 10, 10), true) == 3);
+            CHECK(count_points(base + ".shp", mapnik::box2d<double>(0.5, 0.5, 2, 2), true) == 2);
+        }
+    }
+}
+
+TEST_CASE("shape geometry cache") {
+
+    std::string const plugin("./plugins/input/shape.input");
+    if (!mapnik::util::exists(plugin))
+    {
+        return;
+    }
+
+    testing::temp_directory dir;
+    std::string const base = dir.file("lines");
+    mapnik::box2d<double> const all(-100, -100, 100, 100);
+
+    SECTION("repeated queries at one resolution hit")
+    {
+        write_line_shapefile(base, { make_line(16), make_line(32) });
+        mapnik::datasource_ptr ds = make_cached_ds(base);
+        cache_counters before = counters(ds);
+        CHECK(read_lines(ds, all, 1.0, 1.0).size() == 2);
+        cache_counters first = counters(ds);
+        CHECK(first.misses - before.misses == 2);
+        CHECK(read_lines(ds, all, 1.0, 1.0).size() == 2);
+        cache_counters second = counters(ds);
+        CHECK(second.hits - first.hits == 2);
+        CHECK(second.misses == first.misses);
+        // another resolution bucket is a separate entry
+        CHECK(read_lines(ds, all, 64.0, 64.0).size() == 2);
+        CHECK(counters(ds).misses - second.misses == 2);
+    }
+
+    SECTION("a rewritten file no longer matches its old entries")
+    {
+        write_line_shapefile(base, { make_line(16) });
+        mapnik::datasource_ptr ds = make_cached_ds(base);
+        REQUIRE(read_lines(ds, all, 64.0, 64.0).front().size() == 16);
+        write_line_shapefile(base, { make_line(24) });
+        ds = make_cached_ds(base);
+        cache_counters before = counters(ds);
+        auto lines = read_lines(ds, all, 64.0, 64.0);
+        REQUIRE(lines.size() == 1);
+        CHECK(lines.front().size() == 24);
+        CHECK(counters(ds).misses - before.misses == 1);
+    }
+
+    SECTION("anisotropic resolutions use the finer axis")
+    {
+        // a zigzag of 0.8 pixels on the y axis at 8 pixels per unit survives
+        std::vector<std::pair<double, double>> zigzag;
+        for (std::size_t i = 0; i < 16; ++i) zigzag.emplace_back(static_cast<double>(i), 0.1 * static_cast<double>(i % 2));
+        write_line_shapefile(base, { zigzag });
+        mapnik::datasource_ptr ds = make_cached_ds(base);
+        auto lines = read_lines(ds, all, 1.0, 8.0);
+        REQUIRE(lines.size() == 1);
+        CHECK(lines.front().size() == 16);
+        lines = read_lines(ds, all, 8.0, 1.0);
+        REQUIRE(lines.size() == 1);
+        CHECK(lines.front().size() == 16);
+        // at one pixel per unit on both axes it is simplified away
+        lines = read_lines(ds, all, 1.0, 1.0);
+        REQUIRE(lines.size() == 1);
+        CHECK(lines.front().size() < 16);
+    }
+
+    SECTION("point files bypass the cache")
+    {
+        write_point_shapefile(base, { {0, 0}, {1, 1} }, 0, 0, 1, 1);
+        mapnik::datasource_ptr ds = make_cached_ds(base);
+        CHECK(!ds->get_descriptor().get_extra_parameters().get<mapnik::value_integer>("geometry_cache_hits"));
+    }
+}
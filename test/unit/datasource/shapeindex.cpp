@@ -21,6 +21,8 @@
  *****************************************************************************/
 
 #include "catch.hpp"
+#include "ds_test_util.hpp"
+#include "temp_directory.hpp"
 
 #include <mapnik/datasource.hpp>
 #include <mapnik/datasource_cache.hpp>
@@ -28,6 +30,7 @@
 #include <mapnik/util/fs.hpp>
 #include <cstdlib>
 #include <fstream>
+#include <limits>
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
 #include <boost/algorithm/string.hpp>
@@ -66,7 +69,7 @@ std::size_t count_shapefile_features(std::string const& filename)
     return feature_count;
 }
 
-int create_shapefile_index(std::string const& filename, bool index_parts, bool silent = true)
+int create_shapefile_index(std::string const& filename, bool index_parts, bool reorder = false, bool silent = true)
 {
     std::string cmd;
     if (std::getenv("DYLD_LIBRARY_PATH") != nullptr)
@@ -76,6 +79,7 @@ int create_shapefile_index(std::string const& filename, bool index_parts, bool s
 
     cmd += "shapeindex ";
     if (index_parts) cmd+= "--index-parts ";
+    if (reorder) cmd += "--reorder ";
     cmd += filename;
     if (silent)
     {
@@ -184,5 +188,57 @@ TEST_CASE("shapeindex")
                 }
             }
         }
+
+        SECTION("Reorder")
+        {
+            testing::temp_directory dir;
+            std::string const base = dir.file("boundaries");
+            for (auto const& ext : { ".shp", ".shx", ".dbf" })
+            {
+                boost::filesystem::copy_file(std::string("test/data/shp/boundaries") + ext, base + ext);
+            }
+            std::size_t feature_count = count_shapefile_features(base + ".shp");
+            REQUIRE(feature_count > 0);
+            // index sidecars of the original record order
+            for (auto const& ext : { ".qix", ".sbn", ".sbx" })
+            {
+                std::ofstream sidecar((base + ext).c_str(), std::ios::binary);
+                sidecar << "stale";
+            }
+            REQUIRE(create_shapefile_index(base + ".shp", false, true) == EXIT_SUCCESS);
+            CHECK(!mapnik::util::exists(base + ".qix"));
+            CHECK(!mapnik::util::exists(base + ".sbn"));
+            CHECK(!mapnik::util::exists(base + ".sbx"));
+            CHECK(mapnik::util::exists(base + ".index"));
+            CHECK(count_shapefile_features(base + ".shp") == feature_count);
+        }
+
+        SECTION("Invalid extent")
+        {
+            testing::temp_directory dir;
+            std::string const base = dir.file("nan_extent");
+            double const nan = std::numeric_limits<double>::quiet_NaN();
+            write_point_shapefile(base, { {0, 0}, {1, 1} }, nan, 0, 1, 1);
+            CHECK(create_shapefile_index(base + ".shp", false) != EXIT_SUCCESS);
+            CHECK(create_shapefile_index(base + ".shp", false, true) != EXIT_SUCCESS);
+            CHECK(!mapnik::util::exists(base + ".index"));
+            // the files are left untouched by the failed --reorder
+            CHECK(count_shapefile_features(base + ".shp") == 2);
+        }
+
+        SECTION("NaN records are not indexed")
+        {
+            testing::temp_directory dir;
+            std::string const base = dir.file("nan_points");
+            double const nan = std::numeric_limits<double>::quiet_NaN();
+            write_point_shapefile(base, { {0, 0}, {nan, nan}, {1, 1}, {nan, 0.5} }, 0, 0, 1, 1);
+            for (bool reorder : { false, true })
+            {
+                CAPTURE(reorder);
+                REQUIRE(create_shapefile_index(base + ".shp", false, reorder) == EXIT_SUCCESS);
+                REQUIRE(mapnik::util::exists(base + ".index"));
+                CHECK(count_shapefile_features(base + ".shp") == 2);
+            }
+        }
     }
 }
@@ -23,6 +23,7 @@
 #include "catch.hpp"
 
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/util/packed_rtree.hpp>
 #include <mapnik/util/spatial_index.hpp>
 
 TEST_CASE("spatial_index")
@@ -84,4 +85,107 @@ TEST_CASE("spatial_index")
         REQUIRE(results[3] == 2);
         REQUIRE(results.size() == 4);
     }
+
+    SECTION("mapnik::util::packed_rtree<T>")
+    {
+        using value_type = std::int32_t;
+        using mapnik::filter_in_box;
+        mapnik::util::packed_rtree<value_type> tree(2);
+        // insert some items
+        tree.insert(1, mapnik::box2d<double>(10,10,20,20));
+        tree.insert(2, mapnik::box2d<double>(30,30,40,40));
+        tree.insert(3, mapnik::box2d<double>(30,10,40,20));
+        tree.insert(4, mapnik::box2d<double>(1,1,2,2));
+        REQUIRE(tree.extent() == mapnik::box2d<double>(1,1,40,40));
+        REQUIRE(tree.count() == 3);
+        REQUIRE(tree.count_items() == 4);
+
+        // serialise
+        std::ostringstream out(std::ios::binary);
+        tree.write(out);
+        out.flush();
+
+        std::istringstream in(out.str(), std::ios::binary);
+        REQUIRE(mapnik::util::check_spatial_index(in));
+        in.seekg(0, std::ios::beg);
+        auto box = mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::bounding_box(in);
+        REQUIRE(box == tree.extent());
+
+        // bounding box query returns values in insertion order
+        std::vector<value_type> results;
+        filter_in_box filter(box);
+        mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query(filter, in, results);
+        REQUIRE(results.size() == 4);
+        REQUIRE(results[0] == 1);
+        REQUIRE(results[1] == 2);
+        REQUIRE(results[2] == 3);
+        REQUIRE(results[3] == 4);
+
+        results.clear();
+        in.seekg(0, std::ios::beg);
+        filter_in_box filter2(mapnik::box2d<double>(25,5,45,25));
+        mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query(filter2, in, results);
+        REQUIRE(results.size() == 1);
+        REQUIRE(results[0] == 3);
+
+        // query first N elements interface
+        results.clear();
+        in.seekg(0, std::ios::beg);
+        mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>::query_first_n(filter, in, results, 2);
+        REQUIRE(results.size() == 2);
+
+        // sorted data flag (shapeindex --reorder)
+        using index_type = mapnik::util::spatial_index<value_type, filter_in_box, std::istringstream>;
+        in.seekg(0, std::ios::beg);
+        REQUIRE(!index_type::data_sorted(in));
+        tree.set_flags(mapnik::util::packed_rtree_sorted);
+        std::ostringstream sorted_out(std::ios::binary);
+        tree.write(sorted_out);
+        std::istringstream sorted_in(sorted_out.str(), std::ios::binary);
+        REQUIRE(index_type::data_sorted(sorted_in));
+        REQUIRE(sorted_in.tellg() == 0);
+    }
+
+    SECTION("mapnik-index records")
+    {
+        using mapnik::util::index_record;
+        using mapnik::util::feature_index_record;
+        using filter_type = mapnik::bounding_box_filter<float>;
+        mapnik::box2d<float> box0(10,10,20,20);
+        mapnik::box2d<float> box1(30,30,40,40);
+
+        // packed R-tree with member ranges
+        mapnik::util::packed_rtree<feature_index_record, mapnik::box2d<float>> tree(2);
+        tree.insert({0, 100, box0, {10, 40, 60, 30}}, box0);
+        tree.insert({100, 50, box1, {5, 20, 0, 0}}, box1);
+        std::ostringstream out(std::ios::binary);
+        tree.write(out);
+        std::istringstream in(out.str(), std::ios::binary);
+        REQUIRE(mapnik::util::spatial_index_value_size(in) == sizeof(feature_index_record));
+        REQUIRE(in.tellg() == 0);
+        REQUIRE(mapnik::util::feature_index_bounding_box(in) == mapnik::box2d<float>(10,10,40,40));
+        std::vector<feature_index_record> results;
+        mapnik::util::query_feature_index(filter_type(box0), in, results);
+        REQUIRE(results.size() == 1);
+        CHECK(results[0].size == 100);
+        CHECK(results[0].ranges.geometry_off == 10);
+        CHECK(results[0].ranges.geometry_size == 40);
+        CHECK(results[0].ranges.attributes_off == 60);
+        CHECK(results[0].ranges.attributes_size == 30);
+
+        // quad-tree of index_record values is read with empty ranges
+        mapnik::quad_tree<index_record, mapnik::box2d<float>> qtree(mapnik::box2d<float>(0,0,50,50));
+        qtree.insert({0, 100, box0}, box0);
+        qtree.insert({100, 50, box1}, box1);
+        std::ostringstream qout(std::ios::binary);
+        qtree.write(qout);
+        std::istringstream qin(qout.str(), std::ios::binary);
+        REQUIRE(mapnik::util::spatial_index_value_size(qin) == 0);
+        results.clear();
+        mapnik::util::query_feature_index(filter_type(box1), qin, results);
+        REQUIRE(results.size() == 1);
+        CHECK(results[0].off == 100);
+        CHECK(results[0].size == 50);
+        CHECK(results[0].ranges.geometry_size == 0);
+    }
 }
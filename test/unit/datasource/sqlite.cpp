@@ -0,0 +1,241 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#include "catch.hpp"
+#include "ds_test_util.hpp"
+#include "temp_directory.hpp"
+
+#include <mapnik/datasource.hpp>
+#include <mapnik/datasource_cache.hpp>
+#include <mapnik/util/fs.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// hex digits of a little endian double
+std::string hex_ndr(double val)
+{
+    static char const* digits = "0123456789ABCDEF";
+    std::uint64_t bits;
+    std::memcpy(&bits, &val, 8);
+    std::string hex;
+    for (int i = 0; i < 8; ++i)
+    {
+        unsigned byte = (bits >> (8 * i)) & 0xff;
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0xf];
+    }
+    return hex;
+}
+
+// SQL blob literal of a little endian WKB point
+std::string wkb_point(double x, double y)
+{
+    return "X'0101000000" + hex_ndr(x) + hex_ndr(y) + "'";
+}
+
+// SQL blob literal of a GeoPackageBinary point in EPSG:4326, optionally
+// with its [minx, maxx, miny, maxy] envelope in the header
+std::string gpkg_point(double x, double y, bool envelope)
+{
+    std::string sql = envelope ? "X'47500003E6100000" + hex_ndr(x) + hex_ndr(x) + hex_ndr(y) + hex_ndr(y)
+                               : std::string("X'47500001E6100000");
+    return sql + "0101000000" + hex_ndr(x) + hex_ndr(y) + "'";
+}
+
+// an empty file is an empty SQLite database
+void create_empty_database(std::string const& filename)
+{
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    REQUIRE(file.good());
+}
+
+// ten points (i, i) with ids i + 1; safe to replay on every connection
+std::string create_points_sql()
+{
+    std::string sql = "CREATE TABLE IF NOT EXISTS pts (id INTEGER PRIMARY KEY, name TEXT, geom BLOB);"
+                      "INSERT OR IGNORE INTO pts VALUES ";
+    for (int i = 0; i < 10; ++i)
+    {
+        if (i > 0) sql += ",";
+        sql += "(" + std::to_string(i + 1) + ",'p" + std::to_string(i) + "'," + wkb_point(i, i) + ")";
+    }
+    return sql + ";";
+}
+
+// a GeoPackage layer of three points in "shape"; gpkg_contents records
+// an extent wider than the points so its use can be told apart
+std::string create_geopackage_sql()
+{
+    return "CREATE TABLE IF NOT EXISTS gpkg_contents (table_name TEXT NOT NULL PRIMARY KEY, data_type TEXT NOT NULL,"
+           " identifier TEXT, description TEXT DEFAULT '', last_change DATETIME,"
+           " min_x DOUBLE, min_y DOUBLE, max_x DOUBLE, max_y DOUBLE, srs_id INTEGER);"
+           "CREATE TABLE IF NOT EXISTS gpkg_geometry_columns (table_name TEXT NOT NULL, column_name TEXT NOT NULL,"
+           " geometry_type_name TEXT NOT NULL, srs_id INTEGER NOT NULL, z TINYINT NOT NULL, m TINYINT NOT NULL,"
+           " CONSTRAINT pk_geom_cols PRIMARY KEY (table_name, column_name));"
+           "CREATE TABLE IF NOT EXISTS places (fid INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, shape POINT);"
+           "CREATE VIRTUAL TABLE IF NOT EXISTS rtree_places_shape USING rtree(id, minx, maxx, miny, maxy);"
+           "INSERT OR IGNORE INTO gpkg_contents VALUES ('places', 'features', 'places', '', NULL, -1, -2, 21, 22, 4326);"
+           "INSERT OR IGNORE INTO gpkg_geometry_columns VALUES ('places', 'shape', 'POINT', 4326, 0, 0);"
+           "INSERT OR IGNORE INTO places VALUES (1, 'a', " + gpkg_point(0, 0, false) + "),"
+           " (2, 'b', " + gpkg_point(10, 10, true) + "), (3, 'c', " + gpkg_point(20, 20, false) + ");"
+           "INSERT OR IGNORE INTO rtree_places_shape VALUES (1, 0, 0, 0, 0), (2, 10, 10, 10, 10), (3, 20, 20, 20, 20);";
+}
+
+mapnik::parameters sqlite_params(std::string const& filename, std::string const& table = "pts")
+{
+    mapnik::parameters params;
+    params["type"] = "sqlite";
+    params["file"] = filename;
+    params["table"] = table;
+    return params;
+}
+
+std::vector<mapnik::value_integer> ids(mapnik::featureset_ptr features)
+{
+    REQUIRE(bool(features));
+    std::vector<mapnik::value_integer> result;
+    while (mapnik::feature_ptr feature = features->next())
+    {
+        result.push_back(feature->id());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+mapnik::featureset_ptr query(mapnik::datasource_ptr ds, mapnik::box2d<double> const& box)
+{
+    mapnik::query q(box);
+    q.add_property_name("name");
+    return ds->features(q);
+}
+
+}
+
+TEST_CASE("sqlite") {
+
+    std::string sqlite_plugin("./plugins/input/sqlite.input");
+    if (mapnik::util::exists(sqlite_plugin))
+    {
+        testing::temp_directory dir;
+        std::string const filename = dir.file("points.sqlite");
+        create_empty_database(filename);
+        {
+            // creates the table and its spatial index
+            mapnik::parameters params = sqlite_params(filename);
+            params["initdb"] = create_points_sql();
+            REQUIRE(bool(mapnik::datasource_cache::instance().create(params)));
+        }
+        REQUIRE(mapnik::util::exists(filename + ".index"));
+
+        SECTION("pooled connections bind the spatial filter per query")
+        {
+            mapnik::parameters params = sqlite_params(filename);
+            params["initial_size"] = mapnik::value_integer(1);
+            params["max_size"] = mapnik::value_integer(2);
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(bool(ds));
+            CHECK(ds->envelope() == mapnik::box2d<double>(0, 0, 9, 9));
+
+            // the same sql with different boxes reuses the prepared statement
+            using id_list = std::vector<mapnik::value_integer>;
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                CHECK(ids(query(ds, mapnik::box2d<double>(2.5, 2.5, 5.5, 5.5))) == id_list({4, 5, 6}));
+                CHECK(ids(query(ds, mapnik::box2d<double>(-1, -1, 0.5, 0.5))) == id_list({1}));
+                CHECK(ids(query(ds, mapnik::box2d<double>(20, 20, 30, 30))).empty());
+                CHECK(ids(query(ds, ds->envelope())).size() == 10);
+            }
+
+            // open featuresets keep their connections busy; past max_size
+            // queries get connections of their own
+            std::vector<mapnik::featureset_ptr> open;
+            for (int i = 0; i < 5; ++i)
+            {
+                open.push_back(query(ds, mapnik::box2d<double>(i - 0.5, i - 0.5, i + 1.5, i + 1.5)));
+            }
+            for (int i = 0; i < 5; ++i)
+            {
+                CHECK(ids(open[i]) == id_list({i + 1, i + 2}));
+            }
+        }
+
+        SECTION("attachdb and initdb may write on pooled connections")
+        {
+            std::string const extra = dir.file("extra.sqlite");
+            create_empty_database(extra);
+            mapnik::parameters params = sqlite_params(filename);
+            params["attachdb"] = "extra@" + extra;
+            params["initdb"] = "CREATE TABLE IF NOT EXISTS extra.log (n INTEGER PRIMARY KEY);"
+                               "INSERT OR REPLACE INTO extra.log VALUES (1);";
+            params["initial_size"] = mapnik::value_integer(1);
+            params["max_size"] = mapnik::value_integer(2);
+            auto ds = mapnik::datasource_cache::instance().create(params);
+            REQUIRE(bool(ds));
+            CHECK(ids(query(ds, mapnik::box2d<double>(2.5, 2.5, 5.5, 5.5))).size() == 3);
+            CHECK(ids(query(ds, ds->envelope())).size() == 10);
+        }
+
+        SECTION("GeoPackage")
+        {
+            std::string const gpkg = dir.file("places.gpkg");
+            create_empty_database(gpkg);
+            {
+                mapnik::parameters params = sqlite_params(gpkg, "places");
+                params["initdb"] = create_geopackage_sql();
+                REQUIRE(bool(mapnik::datasource_cache::instance().create(params)));
+            }
+            // the GeoPackage rtree is used, no index database is created
+            CHECK(!mapnik::util::exists(gpkg + ".index"));
+
+            auto ds = mapnik::datasource_cache::instance().create(sqlite_params(gpkg, "places"));
+            REQUIRE(bool(ds));
+            // the geometry column comes from gpkg_geometry_columns and isn't an attribute
+            auto fields = ds->get_descriptor().get_descriptors();
+            require_field_names(fields, {"fid", "name"});
+            // the extent comes from gpkg_contents
+            CHECK(ds->envelope() == mapnik::box2d<double>(-1, -2, 21, 22));
+
+            using id_list = std::vector<mapnik::value_integer>;
+            CHECK(ids(query(ds, mapnik::box2d<double>(5, 5, 25, 25))) == id_list({2, 3}));
+            CHECK(ids(query(ds, mapnik::box2d<double>(-1, -1, 1, 1))) == id_list({1}));
+            CHECK(ids(query(ds, mapnik::box2d<double>(30, 30, 40, 40))).empty());
+
+            auto features = query(ds, mapnik::box2d<double>(9, 9, 11, 11));
+            REQUIRE(bool(features));
+            auto feature = features->next();
+            REQUIRE(bool(feature));
+            CHECK(feature->get("name") == mapnik::value_unicode_string("b"));
+            REQUIRE(feature->get_geometry().is<mapnik::geometry::point<double>>());
+            auto const& pt = feature->get_geometry().get<mapnik::geometry::point<double>>();
+            CHECK(pt.x == 10);
+            CHECK(pt.y == 10);
+            CHECK(!features->next());
+        }
+    }
+}
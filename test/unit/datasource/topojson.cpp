@@ -56,6 +56,20 @@ bool parse_topology(std::string const& filename, mapnik::topojson::topology & to
     return (itr == end);
 }
 
+// enough geometries for several load_threads chunks of 1024
+std::string many_points_topojson(std::size_t count)
+{
+    std::string json = "{\"type\":\"Topology\",\"objects\":{\"points\":{\"type\":\"GeometryCollection\",\"geometries\":[";
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i > 0) json += ",";
+        json += "{\"type\":\"Point\",\"coordinates\":[" + std::to_string(static_cast<double>(i % 360) - 180) + "," +
+                std::to_string(static_cast<double>(i % 180) - 90) + "],\"properties\":{\"id\":" + std::to_string(i) +
+                ",\"name\":\"point " + std::to_string(i) + "\"}}";
+    }
+    return json + "]}},\"arcs\":[]}";
+}
+
 }
 
 TEST_CASE("topojson")
@@ -119,3 +133,15 @@ TEST_CASE("topojson")
     }
 
 }
+
+TEST_CASE("topojson datasource")
+{
+    std::string topojson_plugin("./plugins/input/topojson.input");
+    if (mapnik::util::exists(topojson_plugin))
+    {
+        SECTION("TopoJSON load_threads")
+        {
+            require_same_features_for_load_threads("topojson", many_points_topojson(5000));
+        }
+    }
+}
@@ -4,6 +4,8 @@
 #if !defined(_MSC_VER) && defined(HAVE_TIFF)
 
 #include "catch.hpp"
+#include "temp_directory.hpp"
+#include "unit/imaging/tiff_overviews.hpp"
 
 #include <mapnik/color.hpp>
 #include <mapnik/image_util.hpp>
@@ -404,6 +406,45 @@ TEST_CASE("tiff io")
         TIFF_READ_ONE_PIXEL
     }
 
+    SECTION("gray16 tiled with overviews") {
+        testing::temp_directory dir;
+        std::string const filename = dir.file("tiff_overviews.tif");
+        auto value = testing::tiff_overview_value;
+        REQUIRE( testing::write_tiff_overviews(filename) );
+
+        std::unique_ptr<mapnik::image_reader> reader(mapnik::get_image_reader(filename,"tiff"));
+        mapnik::util::file file(filename);
+        auto buffer = file.data();
+        mapnik::tiff_reader<mapnik::util::char_array_buffer> tiff_reader2(buffer.get(),file.size());
+        for (mapnik::image_reader * r : {reader.get(), static_cast<mapnik::image_reader*>(&tiff_reader2)})
+        {
+            REQUIRE( r->width() == 1000 );
+            REQUIRE( r->overviews() == 2 );
+            REQUIRE( r->overview_width(1) == 500 );
+            REQUIRE( r->overview_height(1) == 350 );
+            REQUIRE( r->overview_width(2) == 250 );
+            REQUIRE( r->overview_height(2) == 175 );
+            for (unsigned l = 0; l <= 2; ++l)
+            {
+                // the same pixels whether tiles are decoded serially or in parallel
+                for (std::size_t threads : {1, 4})
+                {
+                    r->set_decode_threads(threads);
+                    // a window across many tiles and one inside a single tile
+                    mapnik::image_any data = r->read_overview(l, 100 >> l, 60 >> l, 600 >> l, 500 >> l);
+                    REQUIRE( data.is<mapnik::image_gray16>() == true );
+                    auto const& image = mapnik::util::get<mapnik::image_gray16>(data);
+                    REQUIRE( image.width() == (600u >> l) );
+                    CHECK( image(0, 0) == value(l, 100 >> l, 60 >> l) );
+                    CHECK( image(image.width() - 1, image.height() - 1) == value(l, (700 >> l) - 1, (560 >> l) - 1) );
+                    mapnik::image_any pixel = r->read_overview(l, 130, 5, 1, 1);
+                    CHECK( mapnik::util::get<mapnik::image_gray16>(pixel)(0, 0) == value(l, 130, 5) );
+                }
+            }
+            CHECK_THROWS( r->read_overview(3, 0, 0, 1, 1) );
+        }
+    }
+
 }
 
 #endif
@@ -0,0 +1,67 @@
+#ifndef MAPNIK_UNIT_TIFF_OVERVIEWS
+#define MAPNIK_UNIT_TIFF_OVERVIEWS
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <tiffio.h>
+}
+
+namespace testing {
+
+// pixel (x, y) of level `level` in the file written by write_tiff_overviews
+inline std::uint16_t tiff_overview_value(unsigned level, unsigned x, unsigned y)
+{
+    return static_cast<std::uint16_t>(level * 10000 + y * 31 + x);
+}
+
+// A tiled gray16 1000x700 image, a transparency mask and two overviews
+// (500x350 and 250x175), laid out as in a cloud optimized GeoTIFF.
+inline bool write_tiff_overviews(std::string const& filename)
+{
+    TIFF * tif = TIFFOpen(filename.c_str(), "w");
+    if (tif == nullptr) return false;
+    std::uint32_t const sizes[][3] = {{1000, 700, 0}, {500, 350, FILETYPE_REDUCEDIMAGE | FILETYPE_MASK},
+                                      {500, 350, FILETYPE_REDUCEDIMAGE}, {250, 175, FILETYPE_REDUCEDIMAGE}};
+    unsigned level = 0;
+    for (auto const& size : sizes)
+    {
+        bool mask = (size[2] & FILETYPE_MASK) != 0;
+        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, size[2]);
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, size[0]);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, size[1]);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, 128);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, 128);
+        std::vector<std::uint16_t> tile(128 * 128);
+        for (std::uint32_t y0 = 0; y0 < size[1]; y0 += 128)
+        {
+            for (std::uint32_t x0 = 0; x0 < size[0]; x0 += 128)
+            {
+                for (std::uint32_t y = 0; y < 128; ++y)
+                {
+                    for (std::uint32_t x = 0; x < 128; ++x)
+                    {
+                        tile[y * 128 + x] = mask ? 0 : tiff_overview_value(level, x0 + x, y0 + y);
+                    }
+                }
+                TIFFWriteEncodedTile(tif, TIFFComputeTile(tif, x0, y0, 0, 0), tile.data(), tile.size() * 2);
+            }
+        }
+        TIFFWriteDirectory(tif);
+        if (!mask) ++level;
+    }
+    TIFFClose(tif);
+    return true;
+}
+
+}
+
+#endif
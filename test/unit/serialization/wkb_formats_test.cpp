@@ -53,6 +53,18 @@ SECTION("wkb") {
     unsigned char sq_invalid_blob[] = {
         0x23, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34, 0x40, 0x23 };
 
+    // GeoPackageBinary POINT(10 20), srs_id 4326, with an xy envelope
+    unsigned char gp_valid_blob[] = {
+        0x47, 0x50, 0x00, 0x03, 0xE6, 0x10, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x40,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34, 0x40,
+        0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34, 0x40 };
+
+    // same geometry flagged as empty
+    unsigned char gp_empty_blob[] = {
+        0x47, 0x50, 0x00, 0x11, 0xE6, 0x10, 0x00, 0x00,
+        0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34, 0x40 };
+
     // test of parsing wkb geometries
     try {
 
@@ -105,6 +117,29 @@ SECTION("wkb") {
                                                 mapnik::wkbGeneric);
         REQUIRE(geom.is<mapnik::geometry::geometry_empty>()); // returns geometry_empty
 
+        // geopackage blob
+
+        geom = mapnik::geometry_utils::from_wkb((const char*)gp_valid_blob,
+                                                sizeof(gp_valid_blob) / sizeof(gp_valid_blob[0]),
+                                                mapnik::wkbGeoPackage);
+        REQUIRE(geom.is<mapnik::geometry::point<double>>());
+        REQUIRE(geom.get<mapnik::geometry::point<double>>().x == 10);
+        REQUIRE(geom.get<mapnik::geometry::point<double>>().y == 20);
+
+        geom = mapnik::geometry_utils::from_wkb((const char*)gp_valid_blob,
+                                                sizeof(gp_valid_blob) / sizeof(gp_valid_blob[0]),
+                                                mapnik::wkbAuto);
+        REQUIRE(geom.is<mapnik::geometry::point<double>>());
+
+        geom = mapnik::geometry_utils::from_wkb((const char*)gp_empty_blob,
+                                                sizeof(gp_empty_blob) / sizeof(gp_empty_blob[0]),
+                                                mapnik::wkbAuto);
+        REQUIRE(geom.is<mapnik::geometry::geometry_empty>()); // returns geometry_empty
+
+        // truncated header
+        geom = mapnik::geometry_utils::from_wkb((const char*)gp_valid_blob, 24, mapnik::wkbGeoPackage);
+        REQUIRE(geom.is<mapnik::geometry::geometry_empty>());
+
     }
     catch (std::exception const& ex)
     {
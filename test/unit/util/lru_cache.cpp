@@ -0,0 +1,158 @@
+#include "catch.hpp"
+
+#include <mapnik/util/lru_cache.hpp>
+#include <mapnik/util/fs.hpp>
+#include "temp_directory.hpp"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using cache_type = mapnik::util::lru_cache<std::string, int>;
+
+// entries whose value is negative stay put, erased keys are recorded
+struct pinning_policy : mapnik::util::lru_cache_policy
+{
+    std::vector<std::string> * erased_keys = nullptr;
+
+    bool evictable(std::string const&, int value) const
+    {
+        return value >= 0;
+    }
+
+    void erased(std::string const& key, int)
+    {
+        if (erased_keys) erased_keys->push_back(key);
+    }
+};
+
+void write_file(std::string const& filename, std::string const& content)
+{
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file << content;
+}
+
+}
+
+TEST_CASE("lru_cache") {
+
+SECTION("hits and misses") {
+
+    cache_type cache(100);
+    CHECK(cache.find("a") == nullptr);
+    CHECK(cache.insert("a", 1, 10));
+    // present keys keep their value
+    CHECK(!cache.insert("a", 2, 10));
+    REQUIRE(cache.find("a") != nullptr);
+    CHECK(*cache.find("a") == 1);
+    mapnik::util::lru_cache_stats stats = cache.stats();
+    CHECK(stats.entries == 1);
+    CHECK(stats.bytes == 10);
+    CHECK(stats.hits == 2);
+    CHECK(stats.misses == 1);
+    CHECK(stats.evictions == 0);
+}
+
+SECTION("least recently used entries are evicted first") {
+
+    cache_type cache(30);
+    cache.insert("a", 1, 10);
+    cache.insert("b", 2, 10);
+    cache.insert("c", 3, 10);
+    // "b" becomes the least recently used entry
+    CHECK(cache.find("a"));
+    cache.insert("d", 4, 10);
+    CHECK(cache.stats().evictions == 1);
+    CHECK(cache.stats().bytes == 30);
+    CHECK(cache.find("b") == nullptr);
+    CHECK(cache.find("a"));
+    CHECK(cache.find("c"));
+    CHECK(cache.find("d"));
+}
+
+SECTION("limits") {
+
+    cache_type cache(100, 2);
+    cache.insert("a", 1, 10);
+    cache.insert("b", 2, 10);
+    cache.insert("c", 3, 10);
+    CHECK(cache.stats().entries == 2);
+    CHECK(cache.find("a") == nullptr);
+
+    // values larger than the whole cache are not kept
+    CHECK(!cache.insert("d", 4, 101));
+    CHECK(cache.find("d") == nullptr);
+
+    cache.set_max_entries(1);
+    CHECK(cache.stats().entries == 1);
+    CHECK(cache.find("c"));
+    cache.set_max_bytes(5);
+    CHECK(cache.stats().entries == 0);
+    CHECK(cache.stats().bytes == 0);
+    CHECK(cache.max_bytes() == 5);
+    CHECK(cache.max_entries() == 1);
+}
+
+SECTION("remove") {
+
+    cache_type cache(100);
+    cache.insert("a", 1, 10);
+    cache.insert("b", -2, 20);
+    cache.insert("c", 3, 30);
+    CHECK(cache.remove("a"));
+    CHECK(!cache.remove("a"));
+    cache.remove_if([](std::string const&, int value) { return value < 0; });
+    CHECK(cache.stats().entries == 1);
+    CHECK(cache.stats().bytes == 30);
+    cache.clear();
+    CHECK(cache.stats().entries == 0);
+    CHECK(cache.stats().bytes == 0);
+    CHECK(cache.find("c") == nullptr);
+}
+
+SECTION("policy") {
+
+    std::vector<std::string> erased;
+    pinning_policy policy;
+    policy.erased_keys = &erased;
+    mapnik::util::lru_cache<std::string, int, std::hash<std::string>, pinning_policy> cache(20, 100, policy);
+    cache.insert("pinned", -1, 10);
+    cache.insert("a", 1, 10);
+    // "pinned" is the oldest entry but can't go, "a" is evicted instead
+    cache.insert("b", 2, 10);
+    CHECK(cache.find("pinned"));
+    CHECK(cache.find("a") == nullptr);
+    CHECK(cache.find("b"));
+    // over the limit while nothing else may be evicted
+    cache.set_max_bytes(5);
+    CHECK(cache.stats().entries == 1);
+    CHECK(cache.stats().bytes == 10);
+    cache.clear();
+    CHECK(erased == std::vector<std::string>({"a", "b", "pinned"}));
+}
+
+SECTION("file stamps") {
+
+    testing::temp_directory dir;
+    std::string const filename = dir.file("stamped.txt");
+    write_file(filename, "one");
+    mapnik::util::file_stamp const written = mapnik::util::file_stamp::of(filename);
+    CHECK(written.name == filename);
+    CHECK(written.size == 3);
+    CHECK(written.time == mapnik::util::last_write_time(filename));
+    CHECK(written == mapnik::util::file_stamp::of(filename));
+    CHECK(written.hash() == mapnik::util::file_stamp::of(filename).hash());
+
+    // a rewritten file has another stamp
+    write_file(filename, "three");
+    CHECK(written != mapnik::util::file_stamp::of(filename));
+
+    mapnik::util::file_stamp const missing = mapnik::util::file_stamp::of(dir.file("missing.txt"));
+    CHECK(missing.size == 0);
+    CHECK(missing.time == 0);
+}
+
+}
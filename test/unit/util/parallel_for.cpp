@@ -0,0 +1,143 @@
+#include "catch.hpp"
+
+#include <mapnik/util/parallel_for.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using chunk_list = std::vector<std::pair<std::size_t, std::size_t>>;
+
+chunk_list run_chunks(std::size_t count, std::size_t threads, std::size_t min_chunk_size)
+{
+    chunk_list chunks;
+    std::mutex mutex;
+    mapnik::util::parallel_for_chunks(count, threads, min_chunk_size, [&](std::size_t first, std::size_t last)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks.emplace_back(first, last);
+    });
+    std::sort(chunks.begin(), chunks.end());
+    return chunks;
+}
+
+}
+
+TEST_CASE("parallel_for_chunks") {
+
+SECTION("chunks cover the range once and in order") {
+
+    for (std::size_t count : {1, 2, 7, 1000, 1023, 1025})
+    {
+        for (std::size_t threads : {1, 2, 3, 4, 8})
+        {
+            // Catch assertions aren't thread-safe, so workers only count
+            std::vector<std::atomic<int>> visits(count);
+            for (auto & visit : visits) visit = 0;
+            std::atomic<int> empty_chunks(0);
+            mapnik::util::parallel_for_chunks(count, threads, 1, [&](std::size_t first, std::size_t last)
+            {
+                if (first >= last) ++empty_chunks;
+                for (std::size_t i = first; i < last; ++i) ++visits[i];
+            });
+            CHECK(empty_chunks == 0);
+            CHECK(std::all_of(visits.begin(), visits.end(), [](std::atomic<int> const& visit) { return visit == 1; }));
+
+            chunk_list chunks = run_chunks(count, threads, 1);
+            REQUIRE(!chunks.empty());
+            CHECK(chunks.size() <= threads);
+            CHECK(chunks.front().first == 0);
+            CHECK(chunks.back().second == count);
+            for (std::size_t i = 1; i < chunks.size(); ++i)
+            {
+                CHECK(chunks[i].first == chunks[i - 1].second);
+            }
+        }
+    }
+}
+
+SECTION("nothing to do") {
+
+    bool called = false;
+    mapnik::util::parallel_for_chunks(0, 4, 1, [&](std::size_t, std::size_t) { called = true; });
+    CHECK(!called);
+}
+
+#ifdef MAPNIK_THREADSAFE
+SECTION("min_chunk_size limits the number of chunks") {
+
+    chunk_list chunks = run_chunks(100, 8, 30);
+    REQUIRE(chunks.size() == 3);
+    CHECK(chunks[0] == std::make_pair(std::size_t(0), std::size_t(34)));
+    CHECK(chunks[1] == std::make_pair(std::size_t(34), std::size_t(68)));
+    CHECK(chunks[2] == std::make_pair(std::size_t(68), std::size_t(100)));
+    CHECK(run_chunks(4096, 8, 1024).size() == 4);
+}
+#endif
+
+SECTION("a single chunk runs on the calling thread") {
+
+    std::thread::id const caller = std::this_thread::get_id();
+    // one thread requested, no thread allowed and too few items for two chunks
+    for (auto const& args : { std::make_pair(std::size_t(1), std::size_t(1)),
+                              std::make_pair(std::size_t(0), std::size_t(1)),
+                              std::make_pair(std::size_t(8), std::size_t(100)) })
+    {
+        std::size_t calls = 0;
+        mapnik::util::parallel_for_chunks(100, args.first, args.second, [&](std::size_t first, std::size_t last)
+        {
+            CHECK(std::this_thread::get_id() == caller);
+            CHECK(first == 0);
+            CHECK(last == 100);
+            ++calls;
+        });
+        CHECK(calls == 1);
+    }
+}
+
+SECTION("the first exception in chunk order is rethrown") {
+
+    // every chunk but the first throws; all chunks still run
+    std::atomic<std::size_t> calls(0);
+    try
+    {
+        mapnik::util::parallel_for_chunks(400, 4, 1, [&](std::size_t first, std::size_t)
+        {
+            ++calls;
+            if (first > 0) throw std::runtime_error(std::to_string(first));
+        });
+#ifdef MAPNIK_THREADSAFE
+        FAIL("expected an exception");
+#endif
+    }
+    catch (std::runtime_error const& ex)
+    {
+        CHECK(std::string(ex.what()) == "100");
+    }
+#ifdef MAPNIK_THREADSAFE
+    CHECK(calls == 4);
+#endif
+
+    // the calling thread's chunk comes first
+    try
+    {
+        mapnik::util::parallel_for_chunks(400, 4, 1, [&](std::size_t first, std::size_t)
+        {
+            throw std::runtime_error(std::to_string(first));
+        });
+        FAIL("expected an exception");
+    }
+    catch (std::runtime_error const& ex)
+    {
+        CHECK(std::string(ex.what()) == "0");
+    }
+}
+
+}
@@ -27,10 +27,12 @@
 #include <mapnik/version.hpp>
 #include <mapnik/util/fs.hpp>
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/util/packed_rtree.hpp>
 #include <mapnik/util/spatial_index.hpp>
 
 #include "process_csv_file.hpp"
 #include "process_geojson_file_x3.hpp"
+#include "process_geobuf_file.hpp"
 
 #pragma GCC diagnostic push
 #include <mapnik/warning_ignore.hpp>
@@ -40,6 +42,7 @@
 
 const int DEFAULT_DEPTH = 8;
 const double DEFAULT_RATIO = 0.55;
+const unsigned DEFAULT_NODE_SIZE = 16;
 
 namespace mapnik { namespace detail {
 
@@ -55,6 +58,11 @@ bool is_geojson(std::string const& filename)
         || boost::iends_with(filename,".json");
 }
 
+bool is_geobuf(std::string const& filename)
+{
+    return boost::iends_with(filename,".geobuf");
+}
+
 }}
 
 int main (int argc, char** argv)
@@ -65,6 +73,8 @@ int main (int argc, char** argv)
     bool validate_features = false;
     unsigned int depth = DEFAULT_DEPTH;
     double ratio = DEFAULT_RATIO;
+    bool quadtree = false;
+    unsigned int node_size = DEFAULT_NODE_SIZE;
     std::vector<std::string> files;
     char separator = 0;
     char quote = 0;
@@ -74,13 +84,15 @@ int main (int argc, char** argv)
     po::variables_map vm;
     try
     {
-        po::options_description desc("Mapnik CSV/GeoJSON index utility");
+        po::options_description desc("Mapnik CSV/GeoJSON/Geobuf index utility");
         desc.add_options()
             ("help,h", "Produce usage message")
             ("version,V","Print version string")
             ("verbose,v","Verbose output")
-            ("depth,d", po::value<unsigned int>(), "Max tree depth\n(default 8)")
-            ("ratio,r",po::value<double>(),"Split ratio (default 0.55)")
+            ("quadtree","Write the legacy quad-tree index instead of a packed Hilbert R-tree")
+            ("node-size,n", po::value<unsigned int>(), "Packed R-tree node size\n(default 16)")
+            ("depth,d", po::value<unsigned int>(), "Max quad-tree depth\n(default 8)")
+            ("ratio,r",po::value<double>(),"Quad-tree split ratio (default 0.55)")
             ("separator,s", po::value<char>(), "CSV columns separator")
             ("quote,q", po::value<char>(), "CSV columns quote")
             ("manual-headers,H", po::value<std::string>(), "CSV manual headers string")
@@ -116,6 +128,14 @@ int main (int argc, char** argv)
         {
             validate_features = true;
         }
+        if (vm.count("quadtree"))
+        {
+            quadtree = true;
+        }
+        if (vm.count("node-size"))
+        {
+            node_size = vm["node-size"].as<unsigned int>();
+        }
         if (vm.count("depth"))
         {
             depth = vm["depth"].as<unsigned int>();
@@ -160,7 +180,7 @@ int main (int argc, char** argv)
             continue;
         }
 
-        if (mapnik::detail::is_csv(filename) || mapnik::detail::is_geojson(filename))
+        if (mapnik::detail::is_csv(filename) || mapnik::detail::is_geojson(filename) || mapnik::detail::is_geobuf(filename))
         {
             files_to_process.push_back(filename);
         }
@@ -187,11 +207,12 @@ int main (int argc, char** argv)
         }
 
         std::vector<item_type> boxes;
+        std::vector<mapnik::util::feature_member_ranges> ranges;
         box_type extent;
         if (mapnik::detail::is_csv(filename))
         {
             std::clog << "processing '" << filename << "' as CSV\n";
-            auto result = mapnik::detail::process_csv_file(boxes, filename, manual_headers, separator, quote);
+            auto result = mapnik::detail::process_csv_file(boxes, ranges, filename, manual_headers, separator, quote);
             if (!result.first)
             {
                 std::clog << "Error: failed to process " << filename << std::endl;
@@ -203,7 +224,18 @@ int main (int argc, char** argv)
         {
             std::clog << "processing '" << filename << "' as GeoJSON\n";
             std::pair<bool,mapnik::box2d<float>> result;
-            result = mapnik::detail::process_geojson_file_x3(boxes, filename, validate_features, verbose);
+            result = mapnik::detail::process_geojson_file_x3(boxes, ranges, filename, validate_features, verbose);
+            if (!result.first)
+            {
+                std::clog << "Error: failed to process " << filename << std::endl;
+                return EXIT_FAILURE;
+            }
+            extent = result.second;
+        }
+        else if (mapnik::detail::is_geobuf(filename))
+        {
+            std::clog << "processing '" << filename << "' as Geobuf\n";
+            auto result = mapnik::detail::process_geobuf_file(boxes, ranges, filename, verbose);
             if (!result.first)
             {
                 std::clog << "Error: failed to process " << filename << std::endl;
@@ -217,13 +249,24 @@ int main (int argc, char** argv)
             auto tree_extent = use_bbox ? bbox : extent;
             std::clog << tree_extent << std::endl;
             mapnik::quad_tree<mapnik::util::index_record, mapnik::box2d<float>> tree(tree_extent, depth, ratio);
-            for (auto const& item : boxes)
+            mapnik::util::packed_rtree<mapnik::util::feature_index_record, mapnik::box2d<float>> packed_tree(node_size);
+            for (std::size_t i = 0; i < boxes.size(); ++i)
             {
+                auto const& item = boxes[i];
                 auto ext_f = std::get<0>(item);
                 if (use_bbox && !bbox.intersects(ext_f)) continue;
-                mapnik::util::index_record rec =
-                    {std::get<1>(item).first, std::get<1>(item).second, ext_f};
-                tree.insert(rec, ext_f);
+                if (quadtree)
+                {
+                    mapnik::util::index_record rec =
+                        {std::get<1>(item).first, std::get<1>(item).second, ext_f};
+                    tree.insert(rec, ext_f);
+                }
+                else
+                {
+                    mapnik::util::feature_index_record rec =
+                        {std::get<1>(item).first, std::get<1>(item).second, ext_f, ranges[i]};
+                    packed_tree.insert(rec, ext_f);
+                }
             }
 
             std::fstream file((filename + ".index").c_str(),
@@ -235,11 +278,20 @@ int main (int argc, char** argv)
             }
             else
             {
-                tree.trim();
-                std::clog << "number nodes=" << tree.count() << std::endl;
-                std::clog << "number element=" << tree.count_items() << std::endl;
                 file.exceptions(std::ios::failbit | std::ios::badbit);
-                tree.write(file);
+                if (quadtree)
+                {
+                    tree.trim();
+                    std::clog << "number nodes=" << tree.count() << std::endl;
+                    std::clog << "number element=" << tree.count_items() << std::endl;
+                    tree.write(file);
+                }
+                else
+                {
+                    std::clog << "number nodes=" << packed_tree.count() << std::endl;
+                    std::clog << "number element=" << packed_tree.count_items() << std::endl;
+                    packed_tree.write(file);
+                }
                 file.flush();
                 file.close();
             }
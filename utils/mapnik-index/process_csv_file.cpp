@@ -26,6 +26,8 @@
 #include <mapnik/datasource.hpp>
 #include <mapnik/geometry/envelope.hpp>
 #include <mapnik/util/utf_conv_win.hpp>
+#include <mapnik/util/spatial_index.hpp>
+#include <mapnik/util/parallel_for.hpp>
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
 #pragma GCC diagnostic push
@@ -39,25 +41,27 @@
 
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
 
 namespace mapnik { namespace detail {
 
-template <typename T>
-std::pair<bool,typename T::value_type::first_type> process_csv_file(T & boxes, std::string const& filename, std::string const& manual_headers, char separator, char quote)
+template <typename T, typename R>
+std::pair<bool,typename T::value_type::first_type> process_csv_file(T & boxes, R & ranges, std::string const& filename, std::string const& manual_headers, char separator, char quote)
 {
     using box_type = typename T::value_type::first_type;
     csv_utils::csv_file_parser p;
     p.manual_headers_ = manual_headers;
     p.separator_ = separator;
     p.quote_ = quote;
+    p.threads_ = mapnik::util::hardware_threads();
 
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
     using file_source_type = boost::interprocess::ibufferstream;
     file_source_type csv_file;
     mapnik::mapped_region_ptr mapped_region;
     boost::optional<mapnik::mapped_region_ptr> memory =
-        mapnik::mapped_memory_cache::instance().find(filename, true);
+        mapnik::mapped_memory_cache::instance().find(filename, true, mapnik::mapped_access::sequential);
     if (memory)
     {
         mapped_region = *memory;
@@ -83,6 +87,26 @@ std::pair<bool,typename T::value_type::first_type> process_csv_file(T & boxes, s
     try
     {
         p.parse_csv_and_boxes(csv_file, boxes);
+        ranges.assign(boxes.size(), {0, 0, 0, 0});
+        // record where the WKT/GeoJSON column is so the featureset can parse it alone
+        if (p.locator_.type == csv_utils::geometry_column_locator::WKT ||
+            p.locator_.type == csv_utils::geometry_column_locator::GEOJSON)
+        {
+            csv_file.clear();
+            std::string record;
+            for (std::size_t i = 0; i < boxes.size(); ++i)
+            {
+                auto const& pos = std::get<1>(boxes[i]);
+                if (pos.second > std::numeric_limits<std::uint32_t>::max()) continue;
+                record.resize(pos.second);
+                csv_file.seekg(pos.first, std::ios::beg);
+                if (!csv_file.read(&record[0], pos.second)) break;
+                auto column = csv_utils::column_range(record.data(), record.data() + record.size(),
+                                                      p.separator_, p.quote_, p.locator_.index);
+                ranges[i].geometry_off = static_cast<std::uint32_t>(column.first);
+                ranges[i].geometry_size = static_cast<std::uint32_t>(column.second - column.first);
+            }
+        }
         return std::make_pair(true, box_type(p.extent_));
     }
     catch (std::exception const& ex)
@@ -95,6 +119,7 @@ std::pair<bool,typename T::value_type::first_type> process_csv_file(T & boxes, s
 using box_type = mapnik::box2d<float>;
 using item_type = std::pair<box_type, std::pair<std::uint64_t, std::uint64_t>>;
 using boxes_type = std::vector<item_type>;
-template std::pair<bool,box_type> process_csv_file(boxes_type&, std::string const&, std::string const&, char, char);
+using ranges_type = std::vector<mapnik::util::feature_member_ranges>;
+template std::pair<bool,box_type> process_csv_file(boxes_type&, ranges_type&, std::string const&, std::string const&, char, char);
 
 }}
@@ -28,8 +28,8 @@
 
 namespace mapnik { namespace detail {
 
-template <typename T>
-std::pair<bool, typename T::value_type::first_type> process_csv_file(T & boxes, std::string const& filename, std::string const& manual_headers, char separator, char quote);
+template <typename T, typename R>
+std::pair<bool, typename T::value_type::first_type> process_csv_file(T & boxes, R & ranges, std::string const& filename, std::string const& manual_headers, char separator, char quote);
 
 }}
 
@@ -0,0 +1,122 @@
+/*****************************************************************************
+ *
+ * This file is part of Mapnik (c++ mapping toolkit)
+ *
+ * Copyright (C) 2017 Artem Pavlenko
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *****************************************************************************/
+
+#include "process_geobuf_file.hpp"
+#include "../../plugins/input/geobuf/geobuf.hpp"
+#include <mapnik/util/spatial_index.hpp>
+
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#pragma GCC diagnostic push
+#include <mapnik/warning_ignore.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+#include <mapnik/mapped_memory_cache.hpp>
+#else
+#include <mapnik/util/file_io.hpp>
+#endif
+
+#include <iostream>
+#include <vector>
+
+namespace {
+
+template <typename T>
+struct push_position
+{
+    using box_type = typename T::value_type::first_type;
+    push_position(T & boxes)
+        : boxes_(boxes) {}
+
+    void operator() (mapnik::box2d<double> const& box, std::size_t offset, std::size_t size)
+    {
+        boxes_.emplace_back(box_type(box.minx(), box.miny(), box.maxx(), box.maxy()), std::make_pair(offset, size));
+    }
+    T & boxes_;
+};
+
+}
+
+namespace mapnik { namespace detail {
+
+template <typename T, typename R>
+std::pair<bool,typename T::value_type::first_type> process_geobuf_file(T & boxes, R & ranges, std::string const& filename, bool verbose)
+{
+    using box_type = typename T::value_type::first_type;
+    box_type extent;
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+    mapnik::mapped_region_ptr mapped_region;
+    boost::optional<mapnik::mapped_region_ptr> memory =
+        mapnik::mapped_memory_cache::instance().find(filename, true, mapnik::mapped_access::sequential);
+    if (!memory)
+    {
+        std::clog << "Error : cannot memory map " << filename << std::endl;
+        return std::make_pair(false, extent);
+    }
+    else
+    {
+        mapped_region = *memory;
+    }
+    char const* start = reinterpret_cast<char const*>(mapped_region->get_address());
+    std::size_t size = mapped_region->get_size();
+#else
+    mapnik::util::file file(filename);
+    if (!file)
+    {
+        std::clog << "Error : cannot open " << filename << std::endl;
+        return std::make_pair(false, extent);
+    }
+    std::string file_buffer;
+    file_buffer.resize(file.size());
+    auto count = std::fread(&file_buffer[0], file.size(), 1, file.get());
+    char const* start = file_buffer.c_str();
+    std::size_t size = (count == 1) ? file_buffer.length() : 0;
+#endif
+    try
+    {
+        push_position<T> callback(boxes);
+        mapnik::util::geobuf<push_position<T>> buf(start, size, callback);
+        buf.read_index();
+    }
+    catch (std::exception const& ex)
+    {
+        std::clog << "mapnik-index (Geobuf) : could not extract bounding boxes from : '" <<  filename <<  "'" << std::endl;
+        if (verbose) std::clog << ex.what() << std::endl;
+        return std::make_pair(false, extent);
+    }
+    // features are decoded whole, there are no member ranges
+    ranges.assign(boxes.size(), {0, 0, 0, 0});
+    for (auto const& item : boxes)
+    {
+        if (!item.first.valid()) continue;
+        if (!extent.valid()) extent = item.first;
+        else extent.expand_to_include(item.first);
+    }
+    return std::make_pair(true, extent);
+}
+
+using box_type = mapnik::box2d<float>;
+using item_type = std::pair<box_type, std::pair<std::uint64_t, std::uint64_t>>;
+using boxes_type = std::vector<item_type>;
+using ranges_type = std::vector<mapnik::util::feature_member_ranges>;
+template std::pair<bool,box_type> process_geobuf_file(boxes_type&, ranges_type&, std::string const&, bool);
+
+}}
@@ -39,6 +39,8 @@
 #include <mapnik/json/unicode_string_grammar_x3.hpp>
 #include <mapnik/json/positions_grammar_x3.hpp>
 #include <mapnik/json/extract_bounding_boxes_x3.hpp>
+#include <mapnik/json/parse_feature.hpp>
+#include <mapnik/util/spatial_index.hpp>
 
 namespace {
 
@@ -222,6 +224,7 @@ bool validate_geojson_feature(mapnik::json::geojson_value & value, Keys const& k
 
 using box_type = mapnik::box2d<float>;
 using boxes_type = std::vector<std::pair<box_type, std::pair<std::uint64_t, std::uint64_t>>>;
+using ranges_type = std::vector<mapnik::util::feature_member_ranges>;
 using base_iterator_type = char const*;
 
 auto const& geojson_value = mapnik::json::geojson_grammar();
@@ -231,15 +234,15 @@ auto const& geojson_value = mapnik::json::geojson_grammar();
 namespace mapnik { namespace detail {
 
 
-template <typename T>
-std::pair<bool,typename T::value_type::first_type> process_geojson_file_x3(T & boxes, std::string const& filename, bool validate_features, bool verbose)
+template <typename T, typename R>
+std::pair<bool,typename T::value_type::first_type> process_geojson_file_x3(T & boxes, R & ranges, std::string const& filename, bool validate_features, bool verbose)
 {
     using box_type = typename T::value_type::first_type;
     box_type extent;
 #if defined(MAPNIK_MEMORY_MAPPED_FILE)
     mapnik::mapped_region_ptr mapped_region;
     boost::optional<mapnik::mapped_region_ptr> memory =
-        mapnik::mapped_memory_cache::instance().find(filename, true);
+        mapnik::mapped_memory_cache::instance().find(filename, true, mapnik::mapped_access::sequential);
     if (!memory)
     {
         std::clog << "Error : cannot memory map " << filename << std::endl;
@@ -287,12 +290,25 @@ std::pair<bool,typename T::value_type::first_type> process_geojson_file_x3(T & b
     auto keys = mapnik::json::get_keys();
     auto feature_grammar = x3::with<mapnik::json::grammar::keys_tag>(std::ref(keys))
         [ geojson_value ];
+    ranges.resize(boxes.size());
+    std::size_t index = 0;
     for (auto const& item : boxes)
     {
+        auto & range = ranges[index++];
+        range = {0, 0, 0, 0};
         if (item.first.valid())
         {
             if (!extent.valid()) extent = item.first;
             else extent.expand_to_include(item.first);
+            // locate geometry and properties so the featureset can parse them separately
+            std::pair<std::size_t, std::size_t> geometry, properties;
+            base_iterator_type feat_start = start + item.second.first;
+            if (item.second.second <= std::numeric_limits<std::uint32_t>::max()
+                && mapnik::json::locate_feature_members(feat_start, feat_start + item.second.second, geometry, properties))
+            {
+                range = {static_cast<std::uint32_t>(geometry.first), static_cast<std::uint32_t>(geometry.second),
+                         static_cast<std::uint32_t>(properties.first), static_cast<std::uint32_t>(properties.second)};
+            }
             if (validate_features)
             {
                 base_iterator_type feat_itr = start + item.second.first;
@@ -333,6 +349,6 @@ std::pair<bool,typename T::value_type::first_type> process_geojson_file_x3(T & b
     return std::make_pair(true, extent);
 }
 
-template std::pair<bool,box_type> process_geojson_file_x3(boxes_type&, std::string const&, bool, bool);
+template std::pair<bool,box_type> process_geojson_file_x3(boxes_type&, ranges_type&, std::string const&, bool, bool);
 
 }}
@@ -28,8 +28,8 @@
 
 namespace mapnik { namespace detail {
 
-template <typename T>
-std::pair<bool, typename T::value_type::first_type> process_geojson_file_x3(T & boxes, std::string const& filename, bool validate_features, bool verbose);
+template <typename T, typename R>
+std::pair<bool, typename T::value_type::first_type> process_geojson_file_x3(T & boxes, R & ranges, std::string const& filename, bool validate_features, bool verbose);
 
 }}
 
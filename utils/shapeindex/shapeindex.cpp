@@ -21,13 +21,24 @@
  *****************************************************************************/
 
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <mapnik/version.hpp>
 #include <mapnik/util/fs.hpp>
 #include <mapnik/quad_tree.hpp>
+#include <mapnik/util/packed_rtree.hpp>
 //#include <mapnik/util/spatial_index.hpp>
-#include <mapnik/geometry/envelope.hpp>
 #include "shapefile.hpp"
 #include "shape_io.hpp"
 #include "shape_index_featureset.hpp"
@@ -35,10 +46,400 @@
 #include <mapnik/warning_ignore.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #pragma GCC diagnostic pop
 
 const int DEFAULT_DEPTH = 8;
 const double DEFAULT_RATIO = 0.55;
+const unsigned DEFAULT_NODE_SIZE = 16;
+const std::size_t CHUNK_SIZE = 1 << 16; // records per thread and round
+
+namespace {
+
+std::mutex log_mutex;
+
+template <typename Stream>
+void open_file(Stream & stream, std::string const& filename, std::ios::openmode mode)
+{
+#ifdef _WINDOWS
+    stream.open(mapnik::utf8_to_utf16(filename).c_str(), mode | std::ios::binary);
+#else
+    stream.open(filename.c_str(), mode | std::ios::binary);
+#endif
+}
+
+void write_xdr_integer(std::ostream & out, std::int32_t val)
+{
+    char b[4];
+    b[0] = static_cast<char>((val >> 24) & 0xff);
+    b[1] = static_cast<char>((val >> 16) & 0xff);
+    b[2] = static_cast<char>((val >> 8) & 0xff);
+    b[3] = static_cast<char>(val & 0xff);
+    out.write(b, 4);
+}
+
+std::int32_t read_xdr_integer(std::istream & in)
+{
+    char b[4];
+    in.read(b, 4);
+    std::int32_t val;
+    mapnik::read_int32_xdr(b, val);
+    return val;
+}
+
+bool replace_file(std::string const& tmp_name, std::string const& filename)
+{
+#ifdef _WINDOWS
+    mapnik::util::remove(filename);
+#endif
+    return std::rename(tmp_name.c_str(), filename.c_str()) == 0;
+}
+
+// Rewrites <shapename>.shp, .shx and .dbf with records sorted along a
+// Hilbert curve of their box centres, renumbering records so that shape
+// and attribute rows stay paired. Null shapes are moved to the end.
+// Existing spatial index sidecars are removed as they refer to the old
+// record numbers.
+bool reorder_shapefile(std::string const& shapename, bool verbose)
+{
+    using mapnik::box2d;
+    std::string const shp_name = shapename + ".shp";
+    std::string const shx_name = shapename + ".shx";
+    std::string const dbf_name = shapename + ".dbf";
+
+    std::ifstream shx;
+    std::ifstream shp;
+    std::ifstream dbf;
+    open_file(shx, shx_name, std::ios::in);
+    open_file(shp, shp_name, std::ios::in);
+    open_file(dbf, dbf_name, std::ios::in);
+    if (!shx || !shp || !dbf)
+    {
+        std::clog << "Error : cannot open " << shapename << ".{shp,shx,dbf} for reordering" << std::endl;
+        return false;
+    }
+
+    char shx_header[100];
+    char shp_header[100];
+    shx.read(shx_header, 100);
+    shp.read(shp_header, 100);
+    if (!shx || !shp)
+    {
+        std::clog << "Error : cannot read shape file header" << std::endl;
+        return false;
+    }
+    std::int32_t shx_length;
+    mapnik::read_int32_xdr(shx_header + 24, shx_length);
+    box2d<double> extent;
+    double coords[4];
+    for (int i = 0; i < 4; ++i) mapnik::read_double_ndr(shx_header + 36 + i * 8, coords[i]);
+    extent.init(coords[0], coords[1], coords[2], coords[3]);
+    if (!extent.valid() || std::isnan(extent.width()) || std::isnan(extent.height()))
+    {
+        std::clog << "Invalid extent, cannot reorder" << std::endl;
+        return false;
+    }
+
+    // dBase header: record count, header size and record size (incl. deletion flag)
+    char dbf_header[32];
+    dbf.read(dbf_header, 32);
+    if (!dbf)
+    {
+        std::clog << "Error : cannot read " << dbf_name << std::endl;
+        return false;
+    }
+    std::int32_t dbf_count;
+    mapnik::read_int32_ndr(dbf_header + 4, dbf_count);
+    std::size_t dbf_header_size = (dbf_header[8] & 0xff) | ((dbf_header[9] & 0xff) << 8);
+    std::size_t dbf_record_size = (dbf_header[10] & 0xff) | ((dbf_header[11] & 0xff) << 8);
+
+    struct record
+    {
+        std::uint32_t hilbert;
+        std::int32_t offset; // 16-bit words
+        std::int32_t length; // 16-bit words, excluding record header
+        std::uint32_t row;   // zero based dbf row
+    };
+    std::vector<record> records;
+    std::size_t num_records = std::max(0, (shx_length * 2 - 100) / 8);
+    records.reserve(num_records);
+    for (std::size_t i = 0; i < num_records; ++i)
+    {
+        record rec;
+        rec.offset = read_xdr_integer(shx);
+        rec.length = read_xdr_integer(shx);
+        rec.row = static_cast<std::uint32_t>(i);
+        rec.hilbert = std::numeric_limits<std::uint32_t>::max();
+        if (!shx) break;
+        shp.seekg(std::streamoff(rec.offset) * 2 + 8, std::ios::beg);
+        char content[36];
+        shp.read(content, 36);
+        std::int32_t shape_type = 0;
+        if (shp.gcount() >= 4) mapnik::read_int32_ndr(content, shape_type);
+        shp.clear();
+        box2d<double> box;
+        if (shape_type == shape_io::shape_point
+            || shape_type == shape_io::shape_pointm
+            || shape_type == shape_io::shape_pointz)
+        {
+            mapnik::read_double_ndr(content + 4, coords[0]);
+            mapnik::read_double_ndr(content + 12, coords[1]);
+            box.init(coords[0], coords[1], coords[0], coords[1]);
+        }
+        else if (shape_type != shape_io::shape_null && rec.length * 2 >= 36)
+        {
+            for (int k = 0; k < 4; ++k) mapnik::read_double_ndr(content + 4 + k * 8, coords[k]);
+            box.init(coords[0], coords[1], coords[2], coords[3]);
+        }
+        if (box.valid()) rec.hilbert = mapnik::util::hilbert_value(box, extent);
+        records.push_back(rec);
+    }
+
+    if (records.size() != static_cast<std::size_t>(dbf_count))
+    {
+        std::clog << "Error : " << shx_name << " has " << records.size() << " records but "
+                  << dbf_name << " has " << dbf_count << ", cannot reorder" << std::endl;
+        return false;
+    }
+
+    std::stable_sort(records.begin(), records.end(),
+                     [](record const& r0, record const& r1) { return r0.hilbert < r1.hilbert; });
+
+    std::string const tmp_suffix = ".reorder";
+    std::ofstream shp_out;
+    std::ofstream shx_out;
+    std::ofstream dbf_out;
+    open_file(shp_out, shp_name + tmp_suffix, std::ios::out | std::ios::trunc);
+    open_file(shx_out, shx_name + tmp_suffix, std::ios::out | std::ios::trunc);
+    open_file(dbf_out, dbf_name + tmp_suffix, std::ios::out | std::ios::trunc);
+    if (!shp_out || !shx_out || !dbf_out)
+    {
+        std::clog << "Error : cannot open temporary files for writing " << shapename << std::endl;
+        return false;
+    }
+    try
+    {
+        shp_out.exceptions(std::ios::failbit | std::ios::badbit);
+        shx_out.exceptions(std::ios::failbit | std::ios::badbit);
+        dbf_out.exceptions(std::ios::failbit | std::ios::badbit);
+
+        shp_out.write(shp_header, 100);
+        shx_out.write(shx_header, 100);
+        std::vector<char> buffer(dbf_header_size);
+        dbf.seekg(0, std::ios::beg);
+        dbf.read(buffer.data(), dbf_header_size);
+        dbf_out.write(buffer.data(), dbf_header_size);
+
+        std::int32_t offset = 50;
+        std::int32_t record_number = 1;
+        for (auto const& rec : records)
+        {
+            buffer.resize(std::max<std::size_t>(std::size_t(rec.length) * 2, dbf_record_size));
+            shp.seekg(std::streamoff(rec.offset) * 2 + 8, std::ios::beg);
+            shp.read(buffer.data(), std::streamsize(rec.length) * 2);
+            if (!shp) throw std::runtime_error("truncated record in " + shp_name);
+            write_xdr_integer(shp_out, record_number);
+            write_xdr_integer(shp_out, rec.length);
+            shp_out.write(buffer.data(), std::streamsize(rec.length) * 2);
+            write_xdr_integer(shx_out, offset);
+            write_xdr_integer(shx_out, rec.length);
+            offset += 4 + rec.length;
+
+            dbf.seekg(std::streamoff(dbf_header_size) + std::streamoff(rec.row) * dbf_record_size, std::ios::beg);
+            dbf.read(buffer.data(), dbf_record_size);
+            if (!dbf) throw std::runtime_error("truncated record in " + dbf_name);
+            dbf_out.write(buffer.data(), dbf_record_size);
+            if (verbose)
+            {
+                std::clog << "record number " << (rec.row + 1) << " -> " << record_number << std::endl;
+            }
+            ++record_number;
+        }
+        // keep the dBase end-of-file marker
+        dbf.seekg(std::streamoff(dbf_header_size) + std::streamoff(dbf_count) * dbf_record_size, std::ios::beg);
+        char tail;
+        if (dbf.get(tail)) dbf_out.put(tail);
+        // the shape file header length only changes if the source had gaps
+        shp_out.seekp(24, std::ios::beg);
+        write_xdr_integer(shp_out, offset);
+        shp_out.close();
+        shx_out.close();
+        dbf_out.close();
+    }
+    catch (std::exception const& ex)
+    {
+        std::clog << "Error : failed to reorder " << shapename << ": " << ex.what() << std::endl;
+        mapnik::util::remove(shp_name + tmp_suffix);
+        mapnik::util::remove(shx_name + tmp_suffix);
+        mapnik::util::remove(dbf_name + tmp_suffix);
+        return false;
+    }
+    shp.close();
+    shx.close();
+    dbf.close();
+    if (!replace_file(shp_name + tmp_suffix, shp_name) ||
+        !replace_file(shx_name + tmp_suffix, shx_name) ||
+        !replace_file(dbf_name + tmp_suffix, dbf_name))
+    {
+        std::clog << "Error : cannot replace " << shapename << ".{shp,shx,dbf}" << std::endl;
+        return false;
+    }
+    for (char const* ext : { ".index", ".qix", ".sbn", ".sbx", ".QIX", ".SBN", ".SBX" })
+    {
+        std::string const sidecar = shapename + ext;
+        if (mapnik::util::exists(sidecar))
+        {
+            if (mapnik::util::remove(sidecar))
+            {
+                std::clog << "removed stale " << sidecar << std::endl;
+            }
+            else
+            {
+                std::clog << "Warning : cannot remove stale " << sidecar << std::endl;
+            }
+        }
+    }
+    std::clog << "reordered " << records.size() << " records" << std::endl;
+    return true;
+}
+
+using mapped_file_ptr = std::unique_ptr<boost::interprocess::mapped_region>;
+
+mapped_file_ptr map_file(std::string const& filename)
+{
+    try
+    {
+        boost::interprocess::file_mapping mapping(filename.c_str(), boost::interprocess::read_only);
+        mapped_file_ptr region(new boost::interprocess::mapped_region(mapping, boost::interprocess::read_only));
+        region->advise(boost::interprocess::mapped_region::advice_sequential);
+        return region;
+    }
+    catch (std::exception const& ex)
+    {
+        std::clog << "Error : cannot map " << filename << " (" << ex.what() << ")" << std::endl;
+    }
+    return mapped_file_ptr();
+}
+
+struct shape_records
+{
+    char const* shp;
+    std::size_t shp_size;
+    char const* shx;
+    std::size_t count;
+};
+
+void log_item(std::int32_t record_number, mapnik::box2d<double> const& box)
+{
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::clog << "record number " << record_number << " box=" << box << std::endl;
+}
+
+mapnik::detail::node make_item(std::uint64_t offset, std::int32_t start, std::int32_t end, mapnik::box2d<double> const& box)
+{
+    return mapnik::detail::node(offset, start, end,
+                                mapnik::box2d<float>(static_cast<float>(box.minx()),
+                                                     static_cast<float>(box.miny()),
+                                                     static_cast<float>(box.maxx()),
+                                                     static_cast<float>(box.maxy())));
+}
+
+// Appends the index items of records [first, last) in file order,
+// reading directly from the mapped .shx and .shp.
+void read_items(shape_records const& records, std::size_t first, std::size_t last,
+                bool index_parts, bool verbose, std::vector<mapnik::detail::node> & items)
+{
+    using mapnik::box2d;
+    for (std::size_t i = first; i < last; ++i)
+    {
+        std::int32_t offset;
+        std::int32_t shx_content_length;
+        mapnik::read_int32_xdr(records.shx + 100 + 8 * i, offset);
+        mapnik::read_int32_xdr(records.shx + 104 + 8 * i, shx_content_length);
+        std::size_t pos = static_cast<std::size_t>(offset) * 2;
+        if (offset < 0 || pos + 12 > records.shp_size) continue;
+        std::int32_t record_number;
+        std::int32_t shp_content_length;
+        mapnik::read_int32_xdr(records.shp + pos, record_number);
+        mapnik::read_int32_xdr(records.shp + pos + 4, shp_content_length);
+        if (shx_content_length != shp_content_length || shp_content_length < 2)
+        {
+            if (verbose)
+            {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::clog << "Content length mismatch for record number " << record_number << std::endl;
+            }
+            continue;
+        }
+        char const* record = records.shp + pos + 8;
+        std::size_t size = std::min(records.shp_size - pos - 8, static_cast<std::size_t>(shp_content_length) * 2);
+        std::int32_t shape_type;
+        mapnik::read_int32_ndr(record, shape_type);
+
+        if (shape_type == shape_io::shape_null) continue;
+
+        box2d<double> item_ext;
+        if (shape_type == shape_io::shape_point
+            || shape_type == shape_io::shape_pointm
+            || shape_type == shape_io::shape_pointz)
+        {
+            if (size < 20) continue;
+            double x, y;
+            mapnik::read_double_ndr(record + 4, x);
+            mapnik::read_double_ndr(record + 12, y);
+            item_ext = box2d<double>(x, y, x, y);
+        }
+        else if (index_parts &&
+                 (shape_type == shape_io::shape_polygon || shape_type == shape_io::shape_polygonm || shape_type == shape_io::shape_polygonz
+                  || shape_type == shape_io::shape_polyline || shape_type == shape_io::shape_polylinem || shape_type == shape_io::shape_polylinez))
+        {
+            if (size < 44) continue;
+            std::int32_t num_parts;
+            std::int32_t num_points;
+            mapnik::read_int32_ndr(record + 36, num_parts);
+            mapnik::read_int32_ndr(record + 40, num_points);
+            std::size_t points = 44 + 4 * static_cast<std::size_t>(std::max(0, num_parts));
+            if (num_parts < 0 || num_points < 0 ||
+                points + 16 * static_cast<std::size_t>(num_points) > size) continue;
+            for (std::int32_t k = 0; k < num_parts; ++k)
+            {
+                std::int32_t start;
+                std::int32_t end = num_points;
+                mapnik::read_int32_ndr(record + 44 + 4 * k, start);
+                if (k < num_parts - 1) mapnik::read_int32_ndr(record + 48 + 4 * k, end);
+                if (start < 0 || end > num_points || start >= end) continue;
+                double x, y;
+                mapnik::read_double_ndr(record + points + 16 * start, x);
+                mapnik::read_double_ndr(record + points + 16 * start + 8, y);
+                box2d<double> part_ext(x, y, x, y);
+                for (std::int32_t j = start + 1; j < end; ++j)
+                {
+                    mapnik::read_double_ndr(record + points + 16 * j, x);
+                    mapnik::read_double_ndr(record + points + 16 * j + 8, y);
+                    part_ext.expand_to_include(x, y);
+                }
+                if (!part_ext.valid()) continue;
+                if (verbose) log_item(record_number, part_ext);
+                items.push_back(make_item(pos, start, end, part_ext));
+            }
+            continue;
+        }
+        else
+        {
+            if (size < 36) continue;
+            std::memcpy(&item_ext, record + 4, sizeof(item_ext));
+        }
+
+        if (item_ext.valid())
+        {
+            if (verbose) log_item(record_number, item_ext);
+            items.push_back(make_item(pos, -1, 0, item_ext));
+        }
+    }
+}
+
+} // anonymous namespace
 
 #ifdef _WINDOWS
 #include <windows.h>
@@ -54,6 +455,10 @@ int main (int argc,char** argv)
     bool index_parts = false;
     unsigned int depth = DEFAULT_DEPTH;
     double ratio = DEFAULT_RATIO;
+    bool quadtree = false;
+    bool reorder = false;
+    unsigned int node_size = DEFAULT_NODE_SIZE;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
     std::vector<std::string> shape_files;
 
     try
@@ -64,8 +469,12 @@ int main (int argc,char** argv)
             ("version,V","print version string")
             ("index-parts","index individual shape parts (default: no)")
             ("verbose,v","verbose output")
-            ("depth,d", po::value<unsigned int>(), "max tree depth\n(default 8)")
-            ("ratio,r",po::value<double>(),"split ratio (default 0.55)")
+            ("quadtree","write the legacy quad-tree index instead of a packed Hilbert R-tree (default: no)")
+            ("node-size,n", po::value<unsigned int>(), "packed R-tree node size\n(default 16)")
+            ("reorder","rewrite .shp, .shx and .dbf in Hilbert order before indexing, removing other spatial indexes (default: no)")
+            ("threads,j", po::value<unsigned int>(), "number of threads reading records\n(default: number of cores)")
+            ("depth,d", po::value<unsigned int>(), "max quad-tree depth\n(default 8)")
+            ("ratio,r",po::value<double>(),"quad-tree split ratio (default 0.55)")
             ("shape_files",po::value<std::vector<std::string> >(),"shape files to index: file1 file2 ...fileN")
             ;
 
@@ -102,6 +511,22 @@ int main (int argc,char** argv)
         {
             index_parts = true;
         }
+        if (vm.count("quadtree"))
+        {
+            quadtree = true;
+        }
+        if (vm.count("reorder"))
+        {
+            reorder = true;
+        }
+        if (vm.count("threads"))
+        {
+            threads = std::max(1u, vm["threads"].as<unsigned int>());
+        }
+        if (vm.count("node-size"))
+        {
+            node_size = vm["node-size"].as<unsigned int>();
+        }
         if (vm.count("depth"))
         {
             depth = vm["depth"].as<unsigned int>();
@@ -122,8 +547,16 @@ int main (int argc,char** argv)
         return EXIT_FAILURE;
     }
 
-    std::clog << "max tree depth:" << depth << std::endl;
-    std::clog << "split ratio:" << ratio << std::endl;
+    if (quadtree)
+    {
+        std::clog << "max tree depth:" << depth << std::endl;
+        std::clog << "split ratio:" << ratio << std::endl;
+    }
+    else
+    {
+        std::clog << "node size:" << node_size << std::endl;
+    }
+    std::clog << "threads:" << threads << std::endl;
 
     if (shape_files.size() == 0)
     {
@@ -147,31 +580,40 @@ int main (int argc,char** argv)
             std::clog << "Error : shapefile index file (*.shx) " << shxname << " does not exist" << std::endl;
             continue;
         }
-        shape_file shp (shapename_full);
-
-        if (! shp.is_open())
+        bool sorted = false;
+        if (reorder)
+        {
+            sorted = reorder_shapefile(shapename, verbose);
+            if (!sorted)
+            {
+                std::clog << "Indexing " << shapename_full << " in original order" << std::endl;
+            }
+        }
+        mapped_file_ptr shx_file = map_file(shxname);
+        mapped_file_ptr shp_file = map_file(shapename_full);
+        if (!shx_file || !shp_file)
         {
-            std::clog << "Error : cannot open " << shapename_full << std::endl;
             continue;
         }
-
-        shape_file shx (shxname);
-        if (!shx.is_open())
+        char const* shx = static_cast<char const*>(shx_file->get_address());
+        std::size_t shx_size = shx_file->get_size();
+        if (shx_size < 100)
         {
-            std::clog << "Error : cannot open " << shxname << std::endl;
+            std::clog << "Error : invalid shapefile index file (*.shx) " << shxname << std::endl;
             continue;
         }
 
-        int code = shx.read_xdr_integer(); //file_code == 9994
-        std::clog << code << std::endl;
-        shx.skip(5*4);
-
-        int file_length=shx.read_xdr_integer();
-        int version=shx.read_ndr_integer();
-        int shape_type=shx.read_ndr_integer();
+        std::int32_t code; //file_code == 9994
+        std::int32_t file_length;
+        std::int32_t version;
+        std::int32_t shape_type;
+        mapnik::read_int32_xdr(shx, code);
+        mapnik::read_int32_xdr(shx + 24, file_length);
+        mapnik::read_int32_ndr(shx + 28, version);
+        mapnik::read_int32_ndr(shx + 32, shape_type);
         box2d<double> extent;
-        shx.read_envelope(extent);
-
+        std::memcpy(&extent, shx + 36, sizeof(extent));
+        std::clog << code << std::endl;
 
         std::clog << "length=" << file_length << std::endl;
         std::clog << "version=" << version << std::endl;
@@ -183,108 +625,58 @@ int main (int argc,char** argv)
             std::clog << "Invalid extent aborting..." << std::endl;
             return EXIT_FAILURE;
         }
-        int pos = 50;
-        shx.seek(pos * 2);
+        std::size_t num_records = file_length > 50 ? std::min<std::size_t>((file_length - 50) / 4, (shx_size - 100) / 8) : 0;
         mapnik::box2d<float> extent_f { static_cast<float>(extent.minx()),
                 static_cast<float>(extent.miny()),
                 static_cast<float>(extent.maxx()),
                 static_cast<float>(extent.maxy())};
 
         mapnik::quad_tree<mapnik::detail::node, mapnik::box2d<float> > tree(extent_f, depth, ratio);
+        mapnik::util::packed_rtree<mapnik::detail::node, mapnik::box2d<float> > packed_tree(node_size);
+        if (sorted) packed_tree.set_flags(mapnik::util::packed_rtree_sorted);
+        if (!quadtree && !index_parts) packed_tree.reserve(num_records);
+        auto insert = [&](mapnik::detail::node const& item, mapnik::box2d<float> const& ext)
+        {
+            if (quadtree) tree.insert(item, ext);
+            else packed_tree.insert(item, ext);
+        };
         int count = 0;
 
-        if (shape_type != shape_io::shape_null)
+        if (shape_type != shape_io::shape_null && num_records > 0)
         {
-            while (shx.is_good() && pos <= file_length - 4)
+            // records are read in parallel chunks and inserted in file order,
+            // a round at a time to bound the memory held by pending items
+            shape_records records { static_cast<char const*>(shp_file->get_address()), shp_file->get_size(), shx, num_records };
+            std::vector<std::vector<mapnik::detail::node>> chunks(threads);
+            auto start_time = std::chrono::steady_clock::now();
+            for (std::size_t first = 0; first < num_records; first += CHUNK_SIZE * threads)
             {
-                int offset = shx.read_xdr_integer();
-                int shx_content_length = shx.read_xdr_integer();
-                pos += 4;
-                box2d<double> item_ext;
-                shp.seek(offset * 2);
-                int record_number = shp.read_xdr_integer();
-                int shp_content_length = shp.read_xdr_integer();
-                if (shx_content_length != shp_content_length)
+                std::vector<std::thread> workers;
+                for (auto & chunk : chunks) chunk.clear();
+                for (unsigned t = 0; t < threads; ++t)
                 {
-                    if (verbose)
-                    {
-                        std::clog << "Content length mismatch for record number " << record_number << std::endl;
-                    }
-                    continue;
-                }
-                shape_type = shp.read_ndr_integer();
-
-                if (shape_type == shape_io::shape_null) continue;
-
-                if (shape_type==shape_io::shape_point
-                    || shape_type==shape_io::shape_pointm
-                    || shape_type == shape_io::shape_pointz)
-                {
-                    double x=shp.read_double();
-                    double y=shp.read_double();
-                    item_ext=box2d<double>(x,y,x,y);
-                }
-                else if (index_parts &&
-                         (shape_type == shape_io::shape_polygon || shape_type == shape_io::shape_polygonm || shape_type == shape_io::shape_polygonz
-                          || shape_type == shape_io::shape_polyline || shape_type == shape_io::shape_polylinem || shape_type == shape_io::shape_polylinez))
-                {
-                    shp.read_envelope(item_ext);
-                    int num_parts = shp.read_ndr_integer();
-                    int num_points = shp.read_ndr_integer();
-                    std::vector<int> parts;
-                    parts.resize(num_parts);
-                    std::for_each(parts.begin(), parts.end(), [&](int & part) { part = shp.read_ndr_integer();});
-                    for (int k = 0; k < num_parts; ++k)
-                    {
-                        int start = parts[k];
-                        int end;
-                        if (k == num_parts - 1) end = num_points;
-                        else end = parts[k + 1];
-
-                        mapnik::geometry::linear_ring<double> ring;
-                        ring.reserve(end - start);
-                        for (int j = start; j < end; ++j)
-                        {
-                            double x = shp.read_double();
-                            double y = shp.read_double();
-                            ring.emplace_back(x, y);
-                        }
-                        item_ext = mapnik::geometry::envelope(ring);
-                        if (item_ext.valid())
-                        {
-                            if (verbose)
-                            {
-                                std::clog << "record number " << record_number << " box=" << item_ext << std::endl;
-                            }
-                            mapnik::box2d<float> ext_f {static_cast<float>(item_ext.minx()),
-                                    static_cast<float>(item_ext.miny()),
-                                    static_cast<float>(item_ext.maxx()),
-                                    static_cast<float>(item_ext.maxy())};
-                            tree.insert(mapnik::detail::node(offset * 2, start, end, std::move(ext_f)), ext_f);
-                            ++count;
-                        }
-                    }
-                    item_ext = mapnik::box2d<double>(); //invalid
+                    std::size_t begin = std::min(num_records, first + t * CHUNK_SIZE);
+                    std::size_t end = std::min(num_records, begin + CHUNK_SIZE);
+                    if (begin == end) break;
+                    if (t == 0) continue; // read by this thread below
+                    workers.emplace_back(read_items, std::cref(records), begin, end,
+                                         index_parts, verbose, std::ref(chunks[t]));
                 }
-                else
+                read_items(records, first, std::min(num_records, first + CHUNK_SIZE), index_parts, verbose, chunks[0]);
+                for (auto & worker : workers) worker.join();
+                for (auto const& chunk : chunks)
                 {
-                    shp.read_envelope(item_ext);
-                }
-
-                if (item_ext.valid())
-                {
-                    if (verbose)
+                    for (auto const& item : chunk)
                     {
-                        std::clog << "record number " << record_number << " box=" << item_ext << std::endl;
+                        insert(item, item.box);
+                        ++count;
                     }
-                    mapnik::box2d<float> ext_f {static_cast<float>(item_ext.minx()),
-                            static_cast<float>(item_ext.miny()),
-                            static_cast<float>(item_ext.maxx()),
-                            static_cast<float>(item_ext.maxy())};
-
-                    tree.insert(mapnik::detail::node(offset * 2, -1, 0, std::move(ext_f)), ext_f);
-                    ++count;
                 }
+                std::size_t done = std::min(num_records, first + CHUNK_SIZE * threads);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                std::clog << " processed " << done << "/" << num_records << " records";
+                if (seconds > 0) std::clog << " (" << static_cast<std::size_t>(done / seconds) << " records/s)";
+                std::clog << std::endl;
             }
         }
 
@@ -303,10 +695,18 @@ int main (int argc,char** argv)
             }
             else
             {
-                tree.trim();
-                std::clog << " number nodes=" << tree.count() << std::endl;
                 file.exceptions(std::ios::failbit | std::ios::badbit);
-                tree.write(file);
+                if (quadtree)
+                {
+                    tree.trim();
+                    std::clog << " number nodes=" << tree.count() << std::endl;
+                    tree.write(file);
+                }
+                else
+                {
+                    std::clog << " number nodes=" << packed_tree.count() << std::endl;
+                    packed_tree.write(file);
+                }
                 file.flush();
                 file.close();
             }